@@ -539,6 +539,97 @@ extern int write_access_unit_as_TS(access_unit_p          access_unit,
   return write_access_unit_trailer_as_TS(context,tswriter,video_pid);
 }
 
+/*
+ * Write out an access unit as TS, as a single PES packet.
+ *
+ * The NAL units of the access unit are packed into the TS packets one after
+ * another, so that only the last TS packet needs padding.
+ *
+ * Also writes out any end of sequence or end of stream NAL unit found in the
+ * `context` (since they are assumed to have immediately followed this access
+ * unit), as part of the same PES packet.
+ *
+ * - `access_unit` is the access unit to write out. It may be NULL, in which
+ *   case just the end of sequence/stream NAL units are written.
+ * - `context` may contain additional things to write (see above), but may
+ *   legitimately be NULL if there is no context.
+ * - `tswriter` is the TS context to write with
+ * - `video_pid` is the PID to use to write the data
+ * - `num_packets` returns the number of TS packets written (it may be
+ *   NULL if this is not wanted)
+ *
+ * Returns 0 if it succeeds, 1 if some error occurs.
+ */
+extern int write_access_unit_as_TS_PES(access_unit_p          access_unit,
+                                       access_unit_context_p  context,
+                                       TS_writer_p            tswriter,
+                                       uint32_t               video_pid,
+                                       int                   *num_packets)
+{
+  int        ii, err;
+  int        num_parts = 0;
+  int        max_parts = 2;
+  byte     **part_data;
+  uint32_t  *part_len;
+
+  if (num_packets)
+    *num_packets = 0;
+
+  if (access_unit != NULL)
+    max_parts += access_unit->nal_units->length;
+  part_data = malloc(max_parts * sizeof(byte *));
+  part_len  = malloc(max_parts * sizeof(uint32_t));
+  if (part_data == NULL || part_len == NULL)
+  {
+    print_err("### Unable to allocate access unit part arrays\n");
+    free(part_data);
+    free(part_len);
+    return 1;
+  }
+
+  for (ii=0; access_unit != NULL && ii<access_unit->nal_units->length; ii++)
+  {
+    nal_unit_p  nal = access_unit->nal_units->array[ii];
+    part_data[num_parts] = nal->unit.data;
+    part_len[num_parts]  = nal->unit.data_len;
+    num_parts ++;
+  }
+  if (context != NULL && context->end_of_sequence)
+  {
+    part_data[num_parts] = context->end_of_sequence->unit.data;
+    part_len[num_parts]  = context->end_of_sequence->unit.data_len;
+    num_parts ++;
+  }
+  if (context != NULL && context->end_of_stream)
+  {
+    part_data[num_parts] = context->end_of_stream->unit.data;
+    part_len[num_parts]  = context->end_of_stream->unit.data_len;
+    num_parts ++;
+  }
+
+  if (num_parts == 0)
+    err = 0;
+  else
+    err = write_ES_parts_as_TS_PES_packet(tswriter,num_parts,part_data,part_len,
+                                          video_pid,DEFAULT_VIDEO_STREAM_ID,
+                                          num_packets);
+  free(part_data);
+  free(part_len);
+  if (err)
+  {
+    print_err("### Error writing access unit as TS PES packet\n");
+    if (access_unit != NULL)
+      report_access_unit(access_unit);
+    return err;
+  }
+
+  if (context != NULL && context->end_of_sequence)
+    free_nal_unit(&context->end_of_sequence);
+  if (context != NULL && context->end_of_stream)
+    free_nal_unit(&context->end_of_stream);
+  return 0;
+}
+
 /*
  * Write out an access unit as TS, with PTS timing in the first PES packet
  * (and PCR timing in the first TS of the frame).
@@ -714,6 +805,7 @@ extern int build_access_unit_context(ES_p                   es,
   new->reverse_data = NULL;
   new->no_more_data = FALSE;
   new->earlier_primary_start = NULL;
+  new->low_latency = FALSE;
 
   err = build_nal_unit_context(es,&new->nac);
   if (err)
@@ -903,6 +995,7 @@ static int maybe_remember_access_unit(reverse_data_p  reverse_data,
                  access_unit->index);
       return 1;
     }
+    cache_reverse_access_unit(reverse_data,access_unit);
     if (verbose) fprint_msg("REMEMBER IDR %5d at " OFFSET_T_FORMAT_08
                             "/%04d for %5d\n",access_unit->index,
                             start_posn.infile,start_posn.inpacket,num_bytes);
@@ -910,6 +1003,43 @@ static int maybe_remember_access_unit(reverse_data_p  reverse_data,
   return 0;
 }
 
+/*
+ * Having just read a slice, can we tell from the first bytes of the next
+ * NAL unit that it must start a new access unit (H.264 7.4.1.2.3)?
+ *
+ * That is so if it is an access unit delimiter, SEI, sequence or picture
+ * parameter set, or one of types 14..18, or if it is a slice with
+ * first_mb_in_slice equal to 0. The last assumes that slices are in order,
+ * and that there are no redundant pictures (only allowed in the baseline
+ * profile, which we do not support).
+ *
+ * Returns TRUE if it must, FALSE if it need not (or we cannot tell).
+ */
+static int next_NAL_starts_access_unit(access_unit_context_p  context)
+{
+  byte  next[2];
+  int   nal_unit_type;
+  int   err = peek_next_ES_unit_start(context->nac->es,2,next);
+  if (err) return FALSE;
+
+  nal_unit_type = next[0] & 0x1F;
+  switch (nal_unit_type)
+  {
+  case NAL_ACCESS_UNIT_DELIM:
+  case NAL_SEI:
+  case NAL_SEQ_PARAM_SET:
+  case NAL_PIC_PARAM_SET:
+  case 14: case 15: case 16: case 17: case 18:
+    return TRUE;
+  case NAL_NON_IDR:
+  case NAL_IDR:
+    // first_mb_in_slice is ue(v) coded, so is 0 iff its first bit is 1
+    return (next[1] & 0x80) != 0;
+  default:
+    return FALSE;
+  }
+}
+
 /*
  * Retrieve the next access unit from the given elementary stream.
  *
@@ -990,7 +1120,7 @@ extern int get_next_access_unit(access_unit_context_p context,
       //    unit).
       // Clearly, option (a) is the easiest to try, so let's see how that
       // works for now...
-      print_err("!!! Ignoring broken NAL unit\n");
+      print_err_limited("broken NAL unit","!!! Ignoring broken NAL unit\n");
       access_unit->ignored_broken_NAL_units ++;
       continue;
     }
@@ -1065,6 +1195,12 @@ extern int get_next_access_unit(access_unit_context_p context,
         if (err) goto give_up_free_nal;
         reset_nal_unit_list(context->pending_list,FALSE);
       }
+
+      // For live input, don't wait to read the whole of the next NAL unit
+      // if we can already tell that this access unit is finished
+      if (context->low_latency && access_unit->started_primary_picture &&
+          next_NAL_starts_access_unit(context))
+        break;
     }
     else if (nal->nal_unit_type == NAL_ACCESS_UNIT_DELIM)
     {
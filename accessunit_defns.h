@@ -104,6 +104,13 @@ struct access_unit_context
   // If we are collecting reversing information, then we keep a reference
   // to the reverse data here
   struct reverse_data * reverse_data;
+
+  // If `low_latency` is TRUE, then (when reading "bare" ES data) we look at
+  // the start of the NAL unit after each slice, and end the access unit at
+  // once if that NAL unit must start a new one, rather than waiting until
+  // we have read all of it. This is for live input, where the rest of that
+  // NAL unit may not have arrived yet.
+  int            low_latency;
   
   // -------------------------------------------------------------
   // Private information - used internally by the software, not to
@@ -154,6 +154,32 @@ extern int write_access_unit_as_TS(access_unit_p          access_unit,
                                    access_unit_context_p  context,
                                    TS_writer_p            tswriter,
                                    uint32_t               video_pid);
+/*
+ * Write out an access unit as TS, as a single PES packet.
+ *
+ * The NAL units of the access unit are packed into the TS packets one after
+ * another, so that only the last TS packet needs padding.
+ *
+ * Also writes out any end of sequence or end of stream NAL unit found in the
+ * `context` (since they are assumed to have immediately followed this access
+ * unit), as part of the same PES packet.
+ *
+ * - `access_unit` is the access unit to write out. It may be NULL, in which
+ *   case just the end of sequence/stream NAL units are written.
+ * - `context` may contain additional things to write (see above), but may
+ *   legitimately be NULL if there is no context.
+ * - `tswriter` is the TS context to write with
+ * - `video_pid` is the PID to use to write the data
+ * - `num_packets` returns the number of TS packets written (it may be
+ *   NULL if this is not wanted)
+ *
+ * Returns 0 if it succeeds, 1 if some error occurs.
+ */
+extern int write_access_unit_as_TS_PES(access_unit_p          access_unit,
+                                       access_unit_context_p  context,
+                                       TS_writer_p            tswriter,
+                                       uint32_t               video_pid,
+                                       int                   *num_packets);
 /*
  * Write out an access unit as TS, with PTS timing in the first PES packet
  * (and PCR timing in the first TS of the frame).
@@ -0,0 +1,415 @@
+/*
+ * Counting heap allocations by call site
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+// We want the real allocation functions in here
+#define ALLOC_STATS_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compat.h"
+#include "printing_fns.h"
+#include "allocstats_fns.h"
+
+static struct alloc_site  alloc_sites[ALLOC_MAX_SITES];
+static int                alloc_num_sites = 0;
+#ifdef ALLOC_STATS
+static int                alloc_report_registered = FALSE;
+#endif
+
+// The live blocks, as an open addressed hash table keyed by address
+static alloc_block_p      alloc_blocks = NULL;
+static size_t             alloc_blocks_size = 0;   // always a power of two
+static size_t             alloc_blocks_used = 0;
+
+// Totals over all sites
+static uint64_t           alloc_total_calls = 0;
+static uint64_t           alloc_total_bytes = 0;
+static int64_t            alloc_total_live = 0;
+static int64_t            alloc_total_peak = 0;
+
+#ifdef ALLOC_STATS
+// Only a build with ALLOC_STATS counts anything, and only then is it worth
+// registering a report at exit (which needs the shared library to be
+// linked against the C runtime - see the Makefile)
+static void report_alloc_stats_at_exit(void)
+{
+  report_alloc_stats(ALLOC_REPORT_SITES);
+  flush_msg();
+}
+#endif
+
+/*
+ * Find the entry for a call site, creating it if necessary.
+ *
+ * Sites are hashed on the address of their file name (which is a constant
+ * string, so the same for all calls from the same file) and line number.
+ * If the table fills up, the last entry is used for everything else.
+ */
+static int find_alloc_site(const char *file,
+                           int         line)
+{
+  unsigned int  hash = (unsigned int)(((size_t)file >> 3) * 31 + line);
+  int           ii = hash % (ALLOC_MAX_SITES - 1);
+  int           tries;
+
+  for (tries = 0; tries < ALLOC_MAX_SITES - 1; tries++)
+  {
+    alloc_site_p  site = &alloc_sites[ii];
+    if (site->file == NULL)
+    {
+      site->file = file;
+      site->line = line;
+      alloc_num_sites ++;
+#ifdef ALLOC_STATS
+      if (!alloc_report_registered)
+      {
+        (void) atexit(report_alloc_stats_at_exit);
+        alloc_report_registered = TRUE;
+      }
+#endif
+      return ii;
+    }
+    else if (site->line == line && site->file == file)
+      return ii;
+    ii = (ii + 1) % (ALLOC_MAX_SITES - 1);
+  }
+  ii = ALLOC_MAX_SITES - 1;
+  if (alloc_sites[ii].file == NULL)
+  {
+    alloc_sites[ii].file = "(other sites)";
+    alloc_num_sites ++;
+  }
+  return ii;
+}
+
+static inline size_t hash_block(void *ptr)
+{
+  size_t  value = (size_t)ptr >> 4;
+  return (value * 2654435761u) & (alloc_blocks_size - 1);
+}
+
+/*
+ * Find the slot for `ptr` in the table of live blocks - either the slot it
+ * is in, or the empty slot where it would go.
+ */
+static alloc_block_p find_block_slot(void *ptr)
+{
+  size_t  ii = hash_block(ptr);
+  while (alloc_blocks[ii].ptr != NULL && alloc_blocks[ii].ptr != ptr)
+    ii = (ii + 1) & (alloc_blocks_size - 1);
+  return &alloc_blocks[ii];
+}
+
+/*
+ * Make sure there is room to remember another live block.
+ *
+ * If we can't get the memory, we just stop counting new blocks.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int ensure_block_room(void)
+{
+  alloc_block_p  old = alloc_blocks;
+  size_t         old_size = alloc_blocks_size;
+  size_t         new_size;
+  size_t         ii;
+
+  if (alloc_blocks != NULL && alloc_blocks_used * 2 < alloc_blocks_size)
+    return 0;
+
+  new_size = (old_size == 0 ? ALLOC_INITIAL_BLOCKS : old_size * 2);
+  alloc_blocks = calloc(new_size,sizeof(struct alloc_block));
+  if (alloc_blocks == NULL)
+  {
+    alloc_blocks = old;
+    return 1;
+  }
+  alloc_blocks_size = new_size;
+  for (ii = 0; ii < old_size; ii++)
+  {
+    if (old[ii].ptr != NULL)
+      *find_block_slot(old[ii].ptr) = old[ii];
+  }
+  free(old);
+  return 0;
+}
+
+/*
+ * Remember a new live block
+ */
+static void add_block(void   *ptr,
+                      size_t  size,
+                      int     site_index)
+{
+  alloc_site_p   site = &alloc_sites[site_index];
+  alloc_block_p  slot;
+
+  if (ensure_block_room())
+    return;  // so it won't be counted as live
+
+  slot = find_block_slot(ptr);
+  slot->ptr = ptr;
+  slot->size = size;
+  slot->site = site_index;
+  alloc_blocks_used ++;
+
+  site->live += size;
+  if (site->live > site->peak)
+    site->peak = site->live;
+  alloc_total_live += size;
+  if (alloc_total_live > alloc_total_peak)
+    alloc_total_peak = alloc_total_live;
+}
+
+/*
+ * Forget a live block, which is about to be freed (or has been moved)
+ *
+ * Returns the block's details in `block`, and TRUE if we knew about it,
+ * FALSE if we did not.
+ */
+static int remove_block(void               *ptr,
+                        struct alloc_block *block)
+{
+  alloc_block_p  slot;
+  size_t         hole, ii;
+
+  if (ptr == NULL || alloc_blocks == NULL)
+    return FALSE;
+
+  slot = find_block_slot(ptr);
+  if (slot->ptr == NULL)
+    return FALSE;
+
+  *block = *slot;
+  alloc_sites[block->site].live -= block->size;
+  alloc_total_live -= block->size;
+  alloc_blocks_used --;
+
+  // Close up the gap, so that lookups of later entries in the same run
+  // still find them
+  hole = slot - alloc_blocks;
+  slot->ptr = NULL;
+  ii = hole;
+  for (;;)
+  {
+    size_t  home;
+    ii = (ii + 1) & (alloc_blocks_size - 1);
+    if (alloc_blocks[ii].ptr == NULL)
+      break;
+    home = hash_block(alloc_blocks[ii].ptr);
+    // Can the entry at `ii` move back into the hole? Only if its home
+    // slot is not (cyclically) after the hole
+    if (((ii - home) & (alloc_blocks_size - 1)) >=
+        ((ii - hole) & (alloc_blocks_size - 1)))
+    {
+      alloc_blocks[hole] = alloc_blocks[ii];
+      alloc_blocks[ii].ptr = NULL;
+      hole = ii;
+    }
+  }
+  return TRUE;
+}
+
+/*
+ * Count a call of malloc, calloc or realloc
+ */
+static inline alloc_site_p count_call(size_t  size,
+                                      int     site_index)
+{
+  alloc_site_p  site = &alloc_sites[site_index];
+  site->calls ++;
+  site->bytes += size;
+  alloc_total_calls ++;
+  alloc_total_bytes += size;
+  return site;
+}
+
+/*
+ * Allocate memory, counting it against the given call site.
+ *
+ * These behave as malloc, calloc and realloc, respectively.
+ */
+extern void *alloc_stats_malloc(size_t       size,
+                                const char  *file,
+                                int          line)
+{
+  int    site_index = find_alloc_site(file,line);
+  void  *ptr = malloc(size);
+  (void) count_call(size,site_index);
+  if (ptr != NULL)
+    add_block(ptr,size,site_index);
+  return ptr;
+}
+
+extern void *alloc_stats_calloc(size_t       nmemb,
+                                size_t       size,
+                                const char  *file,
+                                int          line)
+{
+  int    site_index = find_alloc_site(file,line);
+  void  *ptr = calloc(nmemb,size);
+  (void) count_call(nmemb*size,site_index);
+  if (ptr != NULL)
+    add_block(ptr,nmemb*size,site_index);
+  return ptr;
+}
+
+extern void *alloc_stats_realloc(void        *ptr,
+                                 size_t       size,
+                                 const char  *file,
+                                 int          line)
+{
+  int                 site_index = find_alloc_site(file,line);
+  alloc_site_p        site;
+  struct alloc_block  old;
+  int                 known;
+  void               *new_ptr;
+
+  site = count_call(size,site_index);
+  if (ptr == NULL)
+  {
+    new_ptr = realloc(ptr,size);
+    if (new_ptr != NULL)
+      add_block(new_ptr,size,site_index);
+    return new_ptr;
+  }
+  site->reallocs ++;
+
+  known = remove_block(ptr,&old);
+  new_ptr = realloc(ptr,size);
+  if (new_ptr == NULL && size != 0)
+  {
+    // The old block is still there, unchanged
+    if (known)
+      add_block(ptr,old.size,old.site);
+    return NULL;
+  }
+  if (new_ptr != ptr)
+  {
+    site->moves ++;
+    if (known)
+      site->copied += (old.size < size ? old.size : size);
+  }
+  if (new_ptr != NULL)
+    add_block(new_ptr,size,site_index);
+  return new_ptr;
+}
+
+/*
+ * Free memory, as free. Memory that was not allocated via the functions
+ * above (for instance, by strdup) is freed without being counted.
+ */
+extern void alloc_stats_free(void *ptr)
+{
+  struct alloc_block  old;
+  if (remove_block(ptr,&old))
+    alloc_sites[old.site].frees ++;
+  free(ptr);
+}
+
+static int compare_sites_by_bytes(const void *a,
+                                  const void *b)
+{
+  const alloc_site_p  site_a = *(const alloc_site_p *)a;
+  const alloc_site_p  site_b = *(const alloc_site_p *)b;
+  if (site_a->bytes > site_b->bytes)
+    return -1;
+  else if (site_a->bytes < site_b->bytes)
+    return 1;
+  else if (site_a->calls > site_b->calls)
+    return -1;
+  else if (site_a->calls < site_b->calls)
+    return 1;
+  else
+    return 0;
+}
+
+/*
+ * Report on allocations so far, busiest sites (by bytes asked for) first.
+ *
+ * - `max_sites` is how many sites to list, or 0 for all of them.
+ */
+extern void report_alloc_stats(int  max_sites)
+{
+  alloc_site_p  *sorted;
+  int            num_sorted = 0;
+  int            ii;
+
+  if (alloc_num_sites == 0)
+    return;
+
+  // Take a copy of the list of sites, since printing may itself allocate
+  sorted = malloc(alloc_num_sites * sizeof(alloc_site_p));
+  if (sorted == NULL)
+  {
+    print_err("### Unable to allocate space to sort allocation sites\n");
+    return;
+  }
+  for (ii = 0; ii < ALLOC_MAX_SITES && num_sorted < alloc_num_sites; ii++)
+  {
+    if (alloc_sites[ii].file != NULL)
+      sorted[num_sorted++] = &alloc_sites[ii];
+  }
+  qsort(sorted,num_sorted,sizeof(alloc_site_p),compare_sites_by_bytes);
+
+  fprint_msg("\nHeap allocations: " LLU_FORMAT " calls, " LLU_FORMAT
+             " bytes asked for, peak " LLD_FORMAT " bytes live, "
+             LLD_FORMAT " bytes still live, at %d sites\n",
+             alloc_total_calls,alloc_total_bytes,alloc_total_peak,
+             alloc_total_live,num_sorted);
+  if (max_sites > 0 && max_sites < num_sorted)
+    fprint_msg("Busiest %d sites, by bytes asked for:\n",max_sites);
+  else
+    max_sites = num_sorted;
+  fprint_msg("  %10s %12s %10s %10s %10s %12s  %s\n","Calls","Bytes",
+             "Peak live","Frees","Moves","Copied","Site");
+  for (ii = 0; ii < max_sites; ii++)
+  {
+    alloc_site_p  site = sorted[ii];
+    char          calls[24], bytes[24], peak[24], frees[24];
+    char          moves[24], copied[24];
+    snprintf(calls,sizeof(calls),LLU_FORMAT,site->calls);
+    snprintf(bytes,sizeof(bytes),LLU_FORMAT,site->bytes);
+    snprintf(peak,sizeof(peak),LLD_FORMAT,site->peak);
+    snprintf(frees,sizeof(frees),LLU_FORMAT,site->frees);
+    snprintf(moves,sizeof(moves),LLU_FORMAT,site->moves);
+    snprintf(copied,sizeof(copied),LLU_FORMAT,site->copied);
+    fprint_msg("  %10s %12s %10s %10s %10s %12s  %s:%d\n",calls,bytes,
+               peak,frees,moves,copied,site->file,site->line);
+  }
+  free(sorted);
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,88 @@
+/*
+ * Datastructures for counting heap allocations by call site
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef _allocstats_defns
+#define _allocstats_defns
+
+#include <stddef.h>
+#include "compat.h"
+
+// ------------------------------------------------------------
+// Allocation accounting
+//
+// When the software is built with ALLOC_STATS defined (for instance, with
+// "make ALLOC_STATS=1"), calls of malloc, calloc, realloc and free are
+// redirected (by compat.h) to versions that count, for each call site, how
+// many calls were made, how many bytes were asked for, the peak number of
+// bytes live from that site, and how often realloc had to move (and thus
+// copy) the data. A report on the busiest sites is output at exit.
+//
+// Otherwise, none of this is used, and the allocation functions are called
+// directly, as normal.
+
+// How many different call sites we can remember - any more are lumped
+// together as "other"
+#define ALLOC_MAX_SITES       1024
+// How many sites to list in the report at exit
+#define ALLOC_REPORT_SITES    20
+// Initial size of the table of live blocks (must be a power of two)
+#define ALLOC_INITIAL_BLOCKS  4096
+
+struct alloc_site
+{
+  const char *file;        // Where the allocation was made (NULL if unused)
+  int         line;
+  uint64_t    calls;       // Calls of malloc, calloc or realloc
+  uint64_t    bytes;       // Bytes asked for by those calls
+  uint64_t    frees;       // Blocks from here that were freed
+  uint64_t    reallocs;    // Calls of realloc on an existing block
+  uint64_t    moves;       // ...which moved the block
+  uint64_t    copied;      // ...and thus copied this many bytes
+  int64_t     live;        // Bytes currently allocated from here
+  int64_t     peak;        // The most bytes allocated from here at once
+};
+typedef struct alloc_site *alloc_site_p;
+
+// A live block, remembered so we know its size and origin when it is
+// reallocated or freed
+struct alloc_block
+{
+  void   *ptr;             // NULL if this slot is empty
+  size_t  size;
+  int     site;            // Index into the table of sites
+};
+typedef struct alloc_block *alloc_block_p;
+
+#endif // _allocstats_defns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
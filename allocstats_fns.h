@@ -0,0 +1,83 @@
+/*
+ * Functions for counting heap allocations by call site
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef _allocstats_fns
+#define _allocstats_fns
+
+// Make sure the system's declarations are seen before we redefine anything
+#include <stdlib.h>
+#include <string.h>
+#include "allocstats_defns.h"
+
+/*
+ * Allocate memory, counting it against the given call site.
+ *
+ * These behave as malloc, calloc and realloc, respectively.
+ */
+extern void *alloc_stats_malloc(size_t       size,
+                                const char  *file,
+                                int          line);
+extern void *alloc_stats_calloc(size_t       nmemb,
+                                size_t       size,
+                                const char  *file,
+                                int          line);
+extern void *alloc_stats_realloc(void        *ptr,
+                                 size_t       size,
+                                 const char  *file,
+                                 int          line);
+/*
+ * Free memory, as free. Memory that was not allocated via the functions
+ * above (for instance, by strdup) is freed without being counted.
+ */
+extern void alloc_stats_free(void *ptr);
+/*
+ * Report on allocations so far, busiest sites (by bytes asked for) first.
+ *
+ * - `max_sites` is how many sites to list, or 0 for all of them.
+ */
+extern void report_alloc_stats(int  max_sites);
+
+#if defined(ALLOC_STATS) && !defined(ALLOC_STATS_IMPLEMENTATION)
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+#define malloc(size)        alloc_stats_malloc((size),__FILE__,__LINE__)
+#define calloc(nmemb,size)  alloc_stats_calloc((nmemb),(size),__FILE__,__LINE__)
+#define realloc(ptr,size)   alloc_stats_realloc((ptr),(size),__FILE__,__LINE__)
+#define free(ptr)           alloc_stats_free(ptr)
+#endif
+
+#endif // _allocstats_fns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -156,6 +156,12 @@ typedef void *   void_p;
 #define DEFAULT_AUDIO_PID  0x67
 #define DEFAULT_PMT_PID    0x66
 
+// If we are counting heap allocations, then malloc and friends need
+// redirecting (see allocstats_defns.h)
+#if defined(ALLOC_STATS) && !defined(ALLOC_STATS_IMPLEMENTATION)
+#include "allocstats_fns.h"
+#endif
+
 #endif /* _compat */
 
 // Local Variables:
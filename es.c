@@ -57,7 +57,10 @@ static inline int get_more_data(ES_p  es);
  * it with.
  *
  * - `filename` is the ES files name. As a special case, if this is NULL
- *   then standard input (STDIN_FILENO) will be read from.
+ *   then standard input (STDIN_FILENO) will be read from. If it starts with
+ *   MULTIFILE_LIST_PREFIX ('@'), then the rest of it names a list of files
+ *   to be read as if they were a single file. If it names a gzip compressed
+ *   file, then the data it contains is read.
  *
  * Opens the file for read, builds the datastructure, and reads the first 3
  * bytes of the input file (this is done to prime the triple-byte search
@@ -71,6 +74,23 @@ extern int open_elementary_stream(char  *filename,
   int err;
   int input;
 
+  if (is_indirect_input(filename))
+  {
+    struct indirect_input  indirect;
+    err = open_indirect_input(filename,&indirect);
+    if (err) return 1;
+    err = build_elementary_stream_with_fns(indirect.handle,indirect.read_fn,
+                                           indirect.seek_fn,es);
+    if (err)
+    {
+      fprint_err("### Error building elementary stream for %s\n",filename);
+      (void) indirect.close_fn(indirect.handle);
+      return 1;
+    }
+    (*es)->close_fn = indirect.close_fn;
+    return 0;
+  }
+
   if (filename == NULL)
     input = STDIN_FILENO;
   else
@@ -102,6 +122,8 @@ static int setup_readahead(ES_p  es)
   es->last_packet_posn = 0;
   es->last_packet_es_data_len = 0;
 
+  es->data_arrival = es->prev_data_arrival = 0;
+
   // Try to get the first chunk of data from the file
   err = get_more_data(es);
   if (err) return err;
@@ -161,7 +183,52 @@ extern int build_elementary_stream_file(int    input,
 
   new->reading_ES = TRUE;
   new->input = input;
+  new->handle = NULL;
+  new->read_fn = NULL;
+  new->seek_fn = NULL;
+  new->close_fn = NULL;
+  new->reader = NULL;
+  new->max_unit_size = ES_UNIT_DEFAULT_MAX_SIZE;
+  new->note_arrival = FALSE;
+
+  setup_readahead(new);
+
+  *es = new;
+  return 0;
+}
+
+/*
+ * Build an elementary stream datastructure using the given functions as
+ * read() and seek(). This is intended for reading ES data files.
+ *
+ * - `handle` is passed to `read_fn` and `seek_fn`.
+ *
+ * Builds the datastructure, and reads the first 3 bytes of the input
+ * (this is done to prime the triple-byte search mechanism).
+ *
+ * Returns 0 if all goes well, 1 otherwise.
+ */
+extern int build_elementary_stream_with_fns(void  *handle,
+                                            int  (*read_fn)(void *, byte *, size_t),
+                                            int  (*seek_fn)(void *, offset_t),
+                                            ES_p  *es)
+{
+  ES_p new = malloc(SIZEOF_ES);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate elementary stream datastructure\n");
+    return 1;
+  }
+
+  new->reading_ES = TRUE;
+  new->input = -1;
+  new->handle = handle;
+  new->read_fn = read_fn;
+  new->seek_fn = seek_fn;
+  new->close_fn = NULL;
   new->reader = NULL;
+  new->max_unit_size = ES_UNIT_DEFAULT_MAX_SIZE;
+  new->note_arrival = FALSE;
 
   setup_readahead(new);
 
@@ -194,7 +261,13 @@ extern int build_elementary_stream_PES(PES_reader_p  reader,
 
   new->reading_ES = FALSE;
   new->input = -1;
+  new->handle = NULL;
+  new->read_fn = NULL;
+  new->seek_fn = NULL;
+  new->close_fn = NULL;
   new->reader = reader;
+  new->max_unit_size = ES_UNIT_DEFAULT_MAX_SIZE;
+  new->note_arrival = FALSE;
 
   setup_readahead(new);
 
@@ -239,7 +312,9 @@ extern void close_elementary_stream(ES_p  *es)
   if (*es == NULL)
     return;
   input = (*es)->input;
-  if (input != -1 && input != STDIN_FILENO)
+  if ((*es)->close_fn)
+    (void) (*es)->close_fn((*es)->handle);
+  else if (input != -1 && input != STDIN_FILENO)
     (void) close_file(input);
   free_elementary_stream(es);
 }
@@ -266,6 +341,37 @@ extern int es_command_changed(ES_p  es)
   return tswrite_command_changed(es->reader->tswriter);
 }
 
+/*
+ * Set the maximum size of an ES unit.
+ *
+ * ES units longer than this are discarded (with a warning), and reading
+ * continues with the next ES unit. This stops data without any start
+ * codes (for instance, because it is damaged) from making us use
+ * unbounded amounts of memory.
+ *
+ * - `es` is the elementary stream we're reading from.
+ * - `max_size` is the maximum size in bytes, or 0 for no limit. The
+ *   default is ES_UNIT_DEFAULT_MAX_SIZE.
+ */
+extern void set_ES_max_unit_size(ES_p      es,
+                                 uint32_t  max_size)
+{
+  es->max_unit_size = max_size;
+}
+
+/*
+ * Ask for each ES unit to be stamped with the time its last byte was read
+ * (as `unit->arrival`), so that the latency of live input can be measured.
+ *
+ * - `es` is the elementary stream we're reading from.
+ * - `note_arrival` is TRUE to stamp ES units, FALSE to stop.
+ */
+extern void set_ES_note_arrival(ES_p  es,
+                                int   note_arrival)
+{
+  es->note_arrival = note_arrival;
+}
+
 // ------------------------------------------------------------
 // Handling elementary stream data units
 // ------------------------------------------------------------
@@ -290,6 +396,7 @@ extern int setup_ES_unit(ES_unit_p  unit)
   unit->start_posn.inpacket = 0;
 
   unit->PES_had_PTS = FALSE;    // See the header file
+  unit->arrival = 0;
   return 0;
 }
 
@@ -364,6 +471,7 @@ extern int build_ES_unit_from_data(ES_unit_p  *unit,
   new->start_posn.infile = 0;
   new->start_posn.inpacket = 0;
   new->PES_had_PTS = FALSE;    // See the header file
+  new->arrival = 0;
   *unit = new;
   return 0;
 }
@@ -454,6 +562,40 @@ static inline int get_next_pes_packet(ES_p  es)
   return 0;
 }
 
+/*
+ * Read up to `max` bytes of "bare" ES data into `buf`.
+ *
+ * Returns the number of bytes read, 0 at end-of-file, or -1 if some error
+ * occurs.
+ */
+static inline int read_ES_bytes(ES_p    es,
+                                byte   *buf,
+                                int     max)
+{
+  // Call `read` directly - we don't particularly mind if we get a "short"
+  // read, since we'll just catch up later on
+  if (es->read_fn)
+    return es->read_fn(es->handle,buf,max);
+  else
+#ifdef _WIN32
+    return _read(es->input,buf,max);
+#else
+    return (int)read(es->input,buf,max);
+#endif
+}
+
+/*
+ * Remember that we have just read some more data, if anyone cares when
+ */
+static inline void note_data_arrival(ES_p  es)
+{
+  if (es->note_arrival)
+  {
+    es->prev_data_arrival = es->data_arrival;
+    es->data_arrival = time_now_microseconds();
+  }
+}
+
 /*
  * Read some more data into our read-ahead buffer. For a "bare" file,
  * reads the next buffer-full in, and for PES based data, reads the
@@ -464,15 +606,10 @@ static inline int get_next_pes_packet(ES_p  es)
  */
 static inline int get_more_data(ES_p  es)
 {
+  int err;
   if (es->reading_ES)
   {
-    // Call `read` directly - we don't particularly mind if we get a "short"
-    // read, since we'll just catch up later on
-#ifdef _WIN32
-    int len = _read(es->input,&es->read_ahead,ES_READ_AHEAD_SIZE);
-#else
-    ssize_t  len = read(es->input,&es->read_ahead,ES_READ_AHEAD_SIZE);
-#endif
+    int len = read_ES_bytes(es,es->read_ahead,ES_READ_AHEAD_SIZE);
     if (len == 0)
       return EOF;
     else if (len == -1)
@@ -485,11 +622,15 @@ static inline int get_more_data(ES_p  es)
     es->data = es->read_ahead;     // should be done in the setup function
     es->data_end = es->data + len; // one beyond the last byte
     es->data_ptr = es->data;
+    note_data_arrival(es);
     return 0;
   }
   else
   {
-    return get_next_pes_packet(es);
+    err = get_next_pes_packet(es);
+    if (!err)
+      note_data_arrival(es);
+    return err;
   }
 }
 
@@ -579,17 +720,23 @@ static int find_ES_unit_start(ES_p       es,
  * since we know that, in general, we want to detect it in find_ES_unit_start
  * as the 01 following on from a 00 and a 00.))
  *
+ * If the ES unit grows longer than `es->max_unit_size`, we stop storing
+ * its data (but carry on looking for its end), and `too_long` is returned
+ * as TRUE, in which case the caller should discard it.
+ *
  * Returns 0 if it succeeds, otherwise 1 if some error occurs.
  *
  * Note that finding end-of-file is not counted as an error - it is
  * assumed that it is just the natural end of the ES unit.
  */
 static int find_ES_unit_end(ES_p       es,
-                            ES_unit_p  unit)
+                            ES_unit_p  unit,
+                            int       *too_long)
 {
   int   err;
   byte  prev1 = es->cur_byte;
   byte  prev2 = es->prev1_byte;
+  *too_long = FALSE;
   for (;;)
   {
     byte  *ptr;
@@ -617,22 +764,38 @@ static int find_ES_unit_end(ES_p       es,
           es->posn_of_next_byte.infile = es->reader->packet->posn;
           es->posn_of_next_byte.inpacket = (ptr - es->data) - 2;
         }
+        // Our last byte is just before the 00 00 01, which may have
+        // started in the previous buffer
+        if (es->note_arrival)
+          unit->arrival = (ptr - es->data >= 3 ? es->data_arrival
+                                               : es->prev_data_arrival);
         return 0;
       }
 
       // Otherwise, it's a data byte
-      if (unit->data_len == unit->data_size)
+      if (unit->data_len == unit->data_size && !*too_long)
       {
-        int newsize = unit->data_size + ES_UNIT_DATA_INCREMENT;
-        unit->data = realloc(unit->data,newsize);
-        if (unit->data == NULL)
+        // Grow geometrically, so that long units don't take quadratic time
+        uint32_t newsize = unit->data_size * 2;
+        if (newsize < unit->data_size + ES_UNIT_DATA_INCREMENT)
+          newsize = unit->data_size + ES_UNIT_DATA_INCREMENT;
+        if (es->max_unit_size > 0 && newsize > es->max_unit_size)
+          newsize = es->max_unit_size;
+        if (newsize <= unit->data_size)
+          *too_long = TRUE;
+        else
         {
-          print_err("### Unable to extend ES unit data array\n");
-          return 1;
+          unit->data = realloc(unit->data,newsize);
+          if (unit->data == NULL)
+          {
+            print_err("### Unable to extend ES unit data array\n");
+            return 1;
+          }
+          unit->data_size = newsize;
         }
-        unit->data_size = newsize;
       }
-      unit->data[unit->data_len++] = *ptr;
+      if (!*too_long)
+        unit->data[unit->data_len++] = *ptr;
 
       prev2 = prev1;
       prev1 = *ptr;
@@ -658,6 +821,8 @@ static int find_ES_unit_end(ES_p       es,
       {
         es->posn_of_next_byte.inpacket = (ptr - es->data);
       }
+      if (es->note_arrival)
+        unit->arrival = es->data_arrival;
       return 0;
     }
     else if (err)
@@ -696,12 +861,26 @@ extern int find_next_ES_unit(ES_p       es,
                              ES_unit_p  unit)
 {
   int err;
-  
-  err = find_ES_unit_start(es,unit);
-  if (err) return err;  // 1 or EOF
+  int too_long;
 
-  err = find_ES_unit_end(es,unit);
-  if (err) return err;
+  for (;;)
+  {
+    err = find_ES_unit_start(es,unit);
+    if (err) return err;  // 1 or EOF
+
+    err = find_ES_unit_end(es,unit,&too_long);
+    if (err) return err;
+
+    if (!too_long)
+      break;
+
+    // Discard it, and carry on from the start code that ended it
+    fprint_err_limited("oversized ES unit",
+                       "!!! Discarding ES unit (start code %02x) at "
+                       OFFSET_T_FORMAT_08 "/%04d, which is longer than"
+                       " %u bytes\n",unit->data[3],unit->start_posn.infile,
+                       unit->start_posn.inpacket,es->max_unit_size);
+  }
 
   // The first byte after the 00 00 01 prefix tells us what sort of thing
   // we've found - we'll be friendly and extract it for the user
@@ -737,6 +916,73 @@ extern int find_and_build_next_ES_unit(ES_p        es,
   return 0;
 }
 
+/*
+ * Look at the first bytes of the next ES unit (after its 00 00 01 start
+ * code prefix), without reading it.
+ *
+ * This lets a caller decide whether the ES unit it has just read finishes
+ * something (a picture, say) without having to wait for the whole of the
+ * next ES unit to arrive, which matters when reading live input.
+ *
+ * It must be called just after an ES unit has been read. If the bytes
+ * wanted are not yet in hand, then for "bare" ES data this waits for them
+ * to be read, but for PES based data it gives up (rather than read the
+ * next PES packet).
+ *
+ * - `es` is the elementary stream we're reading from.
+ * - `num_bytes` is how many bytes to look at (at most ES_READ_AHEAD_SIZE-1)
+ * - `bytes` is returned containing them.
+ *
+ * Returns 0 if it succeeds, EOF if there is no next ES unit (or not
+ * enough of it), and 1 if the bytes are not available, or some error
+ * occurs.
+ */
+extern int peek_next_ES_unit_start(ES_p  es,
+                                   int   num_bytes,
+                                   byte  bytes[])
+{
+  // After reading an ES unit, we are left "on" the 01 of the next
+  // start code prefix (or off the end of the data, at end-of-file)
+  if (es->cur_byte != 0x01 || es->data_ptr == NULL ||
+      es->data_ptr >= es->data_end || *es->data_ptr != 0x01)
+    return EOF;
+
+  if (es->data_end - es->data_ptr <= num_bytes)
+  {
+    int  kept;
+    if (!es->reading_ES)
+      return 1;
+    if (num_bytes >= ES_READ_AHEAD_SIZE)
+      return 1;
+
+    // Move what we have of the next ES unit to the start of our read-ahead
+    // buffer, and read more after it
+    kept = (int)(es->data_end - es->data_ptr);
+    memmove(es->read_ahead,es->data_ptr,kept);
+    es->read_ahead_posn += es->read_ahead_len - kept;
+    es->read_ahead_len = kept;
+    es->data = es->data_ptr = es->read_ahead;
+    es->data_end = es->read_ahead + kept;
+    while (es->read_ahead_len <= num_bytes)
+    {
+      int len = read_ES_bytes(es,es->read_ahead + es->read_ahead_len,
+                              ES_READ_AHEAD_SIZE - es->read_ahead_len);
+      if (len == 0)
+        return EOF;
+      else if (len == -1)
+      {
+        fprint_err("### Error reading next bytes: %s\n",strerror(errno));
+        return 1;
+      }
+      es->read_ahead_len += len;
+      es->data_end += len;
+      note_data_arrival(es);
+    }
+  }
+  memcpy(bytes,es->data_ptr + 1,num_bytes);
+  return 0;
+}
+
 /*
  * Write (copy) the current ES unit to the output stream.
  *
@@ -866,7 +1112,10 @@ extern int seek_ES(ES_p       es,
   int err;
   if (es->reading_ES)
   {
-    err = seek_file(es->input,where.infile);
+    if (es->seek_fn)
+      err = es->seek_fn(es->handle,where.infile);
+    else
+      err = seek_file(es->input,where.infile);
     if (err)
     {
       print_err("### Error seeking within ES file\n");
@@ -933,6 +1182,33 @@ static int read_bytes_from_PES(ES_p     es,
   return 0;
 }
 
+/*
+ * Read a given number of bytes using an ES's `read_fn`, allowing for
+ * short reads (this is the equivalent of read_bytes() for files).
+ *
+ * Returns 0 if all goes well, EOF if end of file was read, or 1 if some
+ * other error occurred.
+ */
+static int read_ES_bytes_with_fn(ES_p   es,
+                                 int    num_bytes,
+                                 byte  *data)
+{
+  int  total = 0;
+  while (total < num_bytes)
+  {
+    int length = es->read_fn(es->handle,&(data[total]),num_bytes-total);
+    if (length == 0)
+      return EOF;
+    else if (length == -1)
+    {
+      fprint_err("### Error reading %d bytes\n",num_bytes);
+      return 1;
+    }
+    total += length;
+  }
+  return 0;
+}
+
 /*
  * Read in some ES data from disk.
  *
@@ -986,7 +1262,10 @@ extern int read_ES_data(ES_p       es,
   if (err) return err;
   if (es->reading_ES)
   {
-    err = read_bytes(es->input,num_bytes,*data);
+    if (es->read_fn)
+      err = read_ES_bytes_with_fn(es,num_bytes,*data);
+    else
+      err = read_bytes(es->input,num_bytes,*data);
     if (err)
     {
       if (err == EOF)
@@ -1148,7 +1427,9 @@ extern int append_to_ES_unit_list(ES_unit_list_p  list,
   ES_unit_p  ptr;
   if (list->length == list->size)
   {
-    int newsize = list->size + ES_UNIT_LIST_INCREMENT;
+    int newsize = list->size * 2;
+    if (newsize < list->size + ES_UNIT_LIST_INCREMENT)
+      newsize = list->size + ES_UNIT_LIST_INCREMENT;
     list->array = realloc(list->array,newsize*SIZEOF_ES_UNIT);
     if (list->array == NULL)
     {
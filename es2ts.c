@@ -40,11 +40,61 @@
 #include "compat.h"
 #include "es_fns.h"
 #include "ts_fns.h"
+#include "accessunit_fns.h"
 #include "tswrite_fns.h"
 #include "misc_fns.h"
 #include "printing_fns.h"
 #include "version.h"
 
+// With -lowlatency, we measure how long each PES packet takes to get from
+// our input to our output
+static uint32_t latency_count = 0;
+static uint64_t latency_total = 0;
+static uint64_t latency_max = 0;
+
+
+/*
+ * Push out the PES packet we have just written, and note how long it took
+ * to get through us, measured from `arrival`, when the last byte of its data
+ * was read (as stamped on its ES units).
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int flush_and_note_latency(TS_writer_p output,
+                                  uint64_t    arrival,
+                                  int         verbose)
+{
+  uint64_t  now;
+  uint64_t  latency;
+  int err = tswrite_flush(output);
+  if (err) return 1;
+
+  if (arrival == 0)
+    return 0;
+  now = time_now_microseconds();
+  latency = (now > arrival ? now - arrival : 0);
+  latency_count ++;
+  latency_total += latency;
+  if (latency > latency_max)
+    latency_max = latency;
+  if (verbose)
+    fprint_msg("Input to output latency " LLU_FORMAT " microseconds\n",
+               latency);
+  return 0;
+}
+
+/*
+ * Report on the latencies noted by `flush_and_note_latency`
+ */
+static void report_latency(void)
+{
+  if (latency_count == 0)
+    return;
+  fprint_msg("Input to output latency: average " LLU_FORMAT
+             " microseconds, maximum " LLU_FORMAT " microseconds"
+             " (over %u PES packet%s)\n",latency_total / latency_count,
+             latency_max,latency_count,(latency_count==1?"":"s"));
+}
 
 /*
  * Write (copy) the current ES data unit to the output stream, wrapped up in a
@@ -67,12 +117,361 @@ static int write_ES_unit_as_TS(TS_writer_p output,
     return 0;
 }
 
+/*
+ * How many TS packets it takes to write `data_len` bytes of ES data as
+ * a PES packet with a minimal (9 byte) PES header, on its own.
+ */
+static inline int TS_packets_for_ES_data(uint32_t data_len)
+{
+  uint32_t pes_len = data_len + 9;
+  return (pes_len + MAX_TS_PAYLOAD_SIZE - 1) / MAX_TS_PAYLOAD_SIZE;
+}
+
+/*
+ * Is this ES unit a slice? H.262 slices have start codes 0x01..0xAF,
+ * AVS slices 0x00..0xAF (since AVS doesn't use 0x00 for picture headers).
+ */
+static inline int is_slice_start_code(byte  start_code,
+                                      int   video_type)
+{
+  if (video_type == VIDEO_AVS)
+    return start_code < 0xB0;
+  else
+    return start_code >= 0x01 && start_code <= 0xAF;
+}
+
+static inline int is_slice_unit(ES_unit_p  unit,
+                                int        video_type)
+{
+  return is_slice_start_code(unit->start_code,video_type);
+}
+
+/*
+ * Write out a group of ES units as a single PES packet, and then free them.
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int write_ES_unit_group(TS_writer_p output,
+                               ES_unit_p   group[],
+                               int         num_units,
+                               uint32_t    video_pid,
+                               int        *num_packets)
+{
+  int       err = 0;
+  int       ii;
+  byte    **part_data = malloc(num_units * sizeof(byte *));
+  uint32_t *part_len  = malloc(num_units * sizeof(uint32_t));
+
+  if (part_data == NULL || part_len == NULL)
+  {
+    print_err("### Unable to allocate ES unit group arrays\n");
+    err = 1;
+  }
+  else
+  {
+    for (ii = 0; ii < num_units; ii++)
+    {
+      part_data[ii] = group[ii]->data;
+      part_len[ii]  = group[ii]->data_len;
+    }
+    err = write_ES_parts_as_TS_PES_packet(output,num_units,part_data,part_len,
+                                          video_pid,DEFAULT_VIDEO_STREAM_ID,
+                                          num_packets);
+    if (err)
+      print_err("### Error writing ES unit group\n");
+  }
+  free(part_data);
+  free(part_len);
+  for (ii = 0; ii < num_units; ii++)
+    free_ES_unit(&group[ii]);
+  return err;
+}
+
+/*
+ * Write out the group of ES units making up a picture (see
+ * `write_ES_unit_group`), count it, and if `low_latency`, push it out.
+ *
+ * `num_units` is returned as 0.
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int finish_picture(TS_writer_p output,
+                          ES_unit_p   group[],
+                          int        *num_units,
+                          uint32_t    video_pid,
+                          int         low_latency,
+                          int         verbose,
+                          int        *count,
+                          int64_t    *packets_written)
+{
+  int       err;
+  int       num_packets;
+  uint64_t  arrival = group[*num_units-1]->arrival;
+
+  err = write_ES_unit_group(output,group,*num_units,video_pid,&num_packets);
+  *num_units = 0;
+  if (err) return err;
+
+  *packets_written += num_packets;
+  (*count) ++;
+  if (low_latency)
+    return flush_and_note_latency(output,arrival,verbose);
+  return 0;
+}
+
+/*
+ * Transfer H.262 or AVS data as one PES packet per picture.
+ *
+ * We don't use the H.262 picture reader for this, because it discards
+ * items it is not interested in (e.g., GOP headers), and we want to
+ * keep everything. Instead, a picture is taken to end with its last
+ * slice, so everything up to (and including) that slice is grouped.
+ */
+static int transfer_grouped_ES_units(ES_p        es,
+                                     TS_writer_p output,
+                                     uint32_t    video_pid,
+                                     int         video_type,
+                                     int         max,
+                                     int         low_latency,
+                                     int         verbose,
+                                     int        *count,
+                                     int64_t    *packets_written,
+                                     int64_t    *packets_per_unit)
+{
+  int        err = 0;
+  int        num_units = 0;
+  int        size = 20;
+  int        last_was_slice = FALSE;
+  ES_unit_p *group = malloc(size * sizeof(ES_unit_p));
+
+  if (group == NULL)
+  {
+    print_err("### Unable to allocate ES unit group\n");
+    return 1;
+  }
+
+  for (;;)
+  {
+    ES_unit_p  unit;
+
+    err = find_and_build_next_ES_unit(es,&unit);
+    if (err == EOF)
+      break;
+    else if (err)
+    {
+      print_err("### Error reading ES data units\n");
+      break;
+    }
+
+    if (verbose)
+      report_ES_unit(FALSE,unit);
+
+    if (last_was_slice && !is_slice_unit(unit,video_type))
+    {
+      err = finish_picture(output,group,&num_units,video_pid,low_latency,
+                           verbose,count,packets_written);
+      if (err)
+      {
+        free_ES_unit(&unit);
+        break;
+      }
+      if (max > 0 && *count >= max)
+      {
+        free_ES_unit(&unit);
+        break;
+      }
+    }
+    last_was_slice = is_slice_unit(unit,video_type);
+
+    if (num_units == size)
+    {
+      ES_unit_p *tmp = realloc(group,2 * size * sizeof(ES_unit_p));
+      if (tmp == NULL)
+      {
+        print_err("### Unable to extend ES unit group\n");
+        free_ES_unit(&unit);
+        err = 1;
+        break;
+      }
+      group = tmp;
+      size *= 2;
+    }
+    group[num_units++] = unit;
+    *packets_per_unit += TS_packets_for_ES_data(unit->data_len);
+
+    // For live input, if the start of the next ES unit shows that this was
+    // the last slice of the picture, write the picture out now, rather than
+    // waiting for all of the next ES unit to arrive
+    if (low_latency && last_was_slice)
+    {
+      byte  next_start_code;
+      if (peek_next_ES_unit_start(es,1,&next_start_code) == 0 &&
+          !is_slice_start_code(next_start_code,video_type))
+      {
+        err = finish_picture(output,group,&num_units,video_pid,low_latency,
+                             verbose,count,packets_written);
+        if (err) break;
+        last_was_slice = FALSE;
+        if (max > 0 && *count >= max)
+          break;
+      }
+    }
+  }
+
+  // Whatever is left over (the last picture, a sequence end, etc.)
+  if ((err == 0 || err == EOF) && num_units > 0)
+    err = finish_picture(output,group,&num_units,video_pid,low_latency,
+                         verbose,count,packets_written);
+  while (num_units > 0)
+    free_ES_unit(&group[--num_units]);
+  free(group);
+  return (err == EOF ? 0 : err);
+}
+
+/*
+ * Transfer H.264 data as one PES packet per access unit.
+ */
+static int transfer_access_units(ES_p        es,
+                                 TS_writer_p output,
+                                 uint32_t    video_pid,
+                                 int         max,
+                                 int         low_latency,
+                                 int         verbose,
+                                 int         quiet,
+                                 int        *count,
+                                 int64_t    *packets_written,
+                                 int64_t    *packets_per_unit)
+{
+  int     err = 0;
+  int     ii;
+  int     num_packets;
+  access_unit_context_p  context;
+
+  err = build_access_unit_context(es,&context);
+  if (err)
+  {
+    print_err("### Error building access unit context\n");
+    return 1;
+  }
+  context->low_latency = low_latency;
+
+  for (;;)
+  {
+    access_unit_p  access_unit;
+    uint64_t       arrival;
+
+    err = get_next_access_unit(context,quiet,FALSE,&access_unit);
+    if (err == EOF)
+      break;
+    else if (err)
+    {
+      print_err("### Error reading access units\n");
+      break;
+    }
+
+    if (verbose)
+      report_access_unit(access_unit);
+
+    for (ii=0; ii<access_unit->nal_units->length; ii++)
+      *packets_per_unit += TS_packets_for_ES_data(
+                             access_unit->nal_units->array[ii]->unit.data_len);
+    if (context->end_of_sequence)
+      *packets_per_unit += TS_packets_for_ES_data(
+                             context->end_of_sequence->unit.data_len);
+    if (context->end_of_stream)
+      *packets_per_unit += TS_packets_for_ES_data(
+                             context->end_of_stream->unit.data_len);
+
+    err = write_access_unit_as_TS_PES(access_unit,context,output,video_pid,
+                                      &num_packets);
+    arrival = 0;
+    if (access_unit->nal_units->length > 0)
+      arrival = access_unit->nal_units->array[access_unit->nal_units->length-1]
+                  ->unit.arrival;
+    free_access_unit(&access_unit);
+    if (err) break;
+
+    *packets_written += num_packets;
+    (*count) ++;
+    if (low_latency)
+    {
+      err = flush_and_note_latency(output,arrival,verbose);
+      if (err) break;
+    }
+    if (max > 0 && *count >= max)
+      break;
+  }
+
+  // An end of stream with no access unit before it is left in the context
+  if (err == EOF && (context->end_of_sequence || context->end_of_stream))
+  {
+    err = write_access_unit_as_TS_PES(NULL,context,output,video_pid,
+                                      &num_packets);
+    if (!err)
+      *packets_written += num_packets;
+  }
+  free_access_unit_context(&context);
+  return (err == EOF ? 0 : err);
+}
+
+/*
+ * Transfer the data as one PES packet per access unit (H.264), picture
+ * (H.262) or frame (AVS), and report how many TS packets that saved
+ * compared to writing each ES unit as its own PES packet.
+ */
+static int transfer_pictures(ES_p        es,
+                             TS_writer_p output,
+                             uint32_t    video_pid,
+                             int         video_type,
+                             int         max,
+                             int         low_latency,
+                             int         verbose,
+                             int         quiet)
+{
+  int     err;
+  int     count = 0;
+  int64_t packets_written = 0;
+  int64_t packets_per_unit = 0;   // what we'd have needed, unit by unit
+
+  if (video_type == VIDEO_H264)
+    err = transfer_access_units(es,output,video_pid,max,low_latency,verbose,
+                                quiet,&count,&packets_written,
+                                &packets_per_unit);
+  else
+    err = transfer_grouped_ES_units(es,output,video_pid,video_type,max,
+                                    low_latency,verbose,&count,
+                                    &packets_written,&packets_per_unit);
+  if (err)
+  {
+    print_err("### Error copying pictures\n");
+    return err;
+  }
+
+  if (!quiet)
+  {
+    fprint_msg("Transferred %d picture%s as " LLD_FORMAT " TS packet%s\n",
+               count,(count==1?"":"s"),
+               packets_written,(packets_written==1?"":"s"));
+    if (packets_per_unit > 0)
+      fprint_msg("Writing each ES unit as its own PES packet would have taken "
+                 LLD_FORMAT " TS packets - saved " LLD_FORMAT " packets"
+                 " (" LLD_FORMAT " bytes, %.1f%%)\n",
+                 packets_per_unit,packets_per_unit - packets_written,
+                 (packets_per_unit - packets_written)*TS_PACKET_SIZE,
+                 100.0*(packets_per_unit - packets_written)/packets_per_unit);
+  }
+  return 0;
+}
+
 static int transfer_data(ES_p        es,
                          TS_writer_p output,
                          uint32_t    pmt_pid,
                          uint32_t    video_pid,
                          byte        stream_type,
+                         int         video_type,
+                         int         by_picture,
                          int         max,
+                         int         low_latency,
                          int         verbose,
                          int         quiet)
 {
@@ -91,6 +490,10 @@ static int transfer_data(ES_p        es,
     return 1;
   }
 
+  if (by_picture)
+    return transfer_pictures(es,output,video_pid,video_type,max,
+                             low_latency,verbose,quiet);
+
   for (;;)
   {
     ES_unit_p  unit;
@@ -116,6 +519,16 @@ static int transfer_data(ES_p        es,
       return err;
     }
 
+    if (low_latency)
+    {
+      err = flush_and_note_latency(output,unit->arrival,verbose);
+      if (err)
+      {
+        free_ES_unit(&unit);
+        return err;
+      }
+    }
+
     free_ES_unit(&unit);
     
     if (max > 0 && count >= max)
@@ -169,6 +582,20 @@ static void print_usage()
     "                    instead of to a named file. If <port> is not\n"
     "                    specified, it defaults to 88.\n"
     "  -max <n>, -m <n>  Maximum number of ES data units to read\n"
+    "                    (or of pictures, with -aupes)\n"
+    "  -aupes            Write each access unit (H.264), picture (H.262) or\n"
+    "                    frame (AVS) as a single PES packet, instead of\n"
+    "                    writing each ES unit as its own PES packet. This\n"
+    "                    packs the TS packets more densely, as only the last\n"
+    "                    TS packet of each picture needs padding. The number\n"
+    "                    of TS packets saved is reported at the end.\n"
+    "  -lowlatency       For live input (e.g., from an encoder, via a pipe).\n"
+    "                    Write out each ES unit (or picture, with -aupes)\n"
+    "                    as soon as it is complete, using just the start of\n"
+    "                    the next ES unit to tell if a picture has ended.\n"
+    "                    With -host, turn off Nagle's algorithm. Reports the\n"
+    "                    latency from input to output at the end (and for\n"
+    "                    each PES packet, with -verbose).\n"
     "\n"
     "Stream type:\n"
     "  When the TS data is being output, it is flagged to indicate whether\n"
@@ -206,6 +633,8 @@ int main(int argc, char **argv)
   int     verbose = FALSE;
   int     quiet = FALSE;
   int     max = 0;
+  int     by_picture = FALSE;
+  int     low_latency = FALSE;
   uint32_t video_pid = 0x68;
   uint32_t pmt_pid = 0x66;
   int     err = 0;
@@ -300,6 +729,14 @@ int main(int argc, char **argv)
         if (err) return 1;
         ii++;
       }
+      else if (!strcmp("-aupes",argv[ii]))
+      {
+        by_picture = TRUE;
+      }
+      else if (!strcmp("-lowlatency",argv[ii]))
+      {
+        low_latency = TRUE;
+      }
       else if (!strcmp("-pid",argv[ii]))
       {
         CHECKARG("es2ts",ii);
@@ -374,6 +811,9 @@ int main(int argc, char **argv)
   if (!quiet)
     fprint_msg("Reading from  %s\n",(use_stdin?"<stdin>":input_name));
 
+  if (low_latency)
+    set_ES_note_arrival(es,TRUE);
+
   // Decide if the input stream is H.262 or H.264
   if (force_stream_type || use_stdin)
   {
@@ -381,7 +821,6 @@ int main(int argc, char **argv)
   }
   else
   {
-    int video_type;
     err = decide_ES_file_video_type(es->input,FALSE,verbose,&video_type);
     if (err)
     {
@@ -427,13 +866,27 @@ int main(int argc, char **argv)
     return 1;
   }
 
+  if (low_latency)
+  {
+    err = tswrite_set_low_latency(output);
+    if (err)
+    {
+      close_elementary_stream(&es);
+      (void) tswrite_close(output,TRUE);
+      return 1;
+    }
+  }
+
   if (max && !quiet)
-    fprint_msg("Stopping after %d ES data units\n",max);
+    fprint_msg("Stopping after %d %s\n",max,
+               (by_picture?"pictures":"ES data units"));
   
-  err = transfer_data(es,output,pmt_pid,video_pid,stream_type,
-                      max,verbose,quiet);
+  err = transfer_data(es,output,pmt_pid,video_pid,stream_type,video_type,
+                      by_picture,max,low_latency,verbose,quiet);
   if (err)
     print_err("### es2ts: Error transferring data\n");
+  else if (!quiet)
+    report_latency();
 
   close_elementary_stream(&es);  // Closes the input file for us
   err2 = tswrite_close(output,quiet);
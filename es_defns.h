@@ -61,6 +61,13 @@ struct elementary_stream
   // If we're reading from an elementary data stream directly, then
   // we use the input directly
   int       input;
+  // ...unless `read_fn` and `seek_fn` are non-NULL, in which case we call
+  // them (with `handle`) instead of read() and seek(), and `close_fn` (if
+  // non-NULL) is called by close_elementary_stream() to close `handle`
+  void     *handle;
+  int     (*read_fn)(void *, byte *, size_t);
+  int     (*seek_fn)(void *, offset_t);
+  int     (*close_fn)(void *);
   // And maintain a buffer of "read ahead" bytes
   byte      read_ahead[ES_READ_AHEAD_SIZE];
   offset_t  read_ahead_posn;   // location of this data in the file
@@ -90,6 +97,18 @@ struct elementary_stream
   byte      cur_byte;    // The current (last read) byte
   byte      prev1_byte;  // The previous byte
   byte      prev2_byte;  // The byte before *that*
+
+  // ES units longer than this are discarded (and we resynchronise at the
+  // next start code prefix), so that data with no start codes cannot make
+  // us use unbounded memory. 0 means no limit.
+  uint32_t  max_unit_size;
+
+  // If `note_arrival` is TRUE, we remember when we read the current buffer
+  // of data (and the one before it), so that each ES unit can say when its
+  // last byte arrived - this is for measuring latency with live input
+  int       note_arrival;
+  uint64_t  data_arrival;       // microseconds since the epoch
+  uint64_t  prev_data_arrival;
 };
 typedef struct elementary_stream *ES_p;
 #define SIZEOF_ES sizeof(struct elementary_stream)
@@ -119,14 +138,24 @@ struct ES_unit
   // Something of a hack - if we were reading PES, did any of the PES packets
   // we read to make this ES unit contain a PTS?
   byte      PES_had_PTS;
+
+  // If the ES was noting arrival times, when the last byte of this unit
+  // was read (in microseconds since the epoch), otherwise 0
+  uint64_t  arrival;
 };
 typedef struct ES_unit *ES_unit_p;
 #define SIZEOF_ES_UNIT sizeof(struct ES_unit)
 
-// Start and increment sizes for the es_unit/data array.
+// Start and (minimum) increment sizes for the es_unit/data array.
+// The array is doubled in size each time it fills up, so that reading
+// a long ES unit does not take time proportional to the square of its length
 #define ES_UNIT_DATA_START_SIZE  1000  // was 500
 #define ES_UNIT_DATA_INCREMENT    500  // was 100
 
+// The default maximum size of an ES unit. A single H.264 slice or MPEG-2
+// picture should never be anywhere near this big.
+#define ES_UNIT_DEFAULT_MAX_SIZE  (16*1024*1024)
+
 // ------------------------------------------------------------
 // An expandable list of ES units
 struct ES_unit_list
@@ -139,7 +168,7 @@ typedef struct ES_unit_list *ES_unit_list_p;
 #define SIZEOF_ES_UNIT_LIST sizeof(struct ES_unit_list)
 
 #define ES_UNIT_LIST_START_SIZE  20
-#define ES_UNIT_LIST_INCREMENT   20
+#define ES_UNIT_LIST_INCREMENT   20  // at least - the list doubles in size
 
 #endif // _es_defns
 
@@ -39,7 +39,10 @@
  * Open an ES file and build an elementary stream datastructure to read
  * it with.
  *
- * - `filename` is the ES files name
+ * - `filename` is the ES files name. If it starts with MULTIFILE_LIST_PREFIX
+ *   ('@'), then the rest of it names a list of files to be read as if they
+ *   were a single file. If it names a gzip compressed file, then the data
+ *   it contains is read.
  *
  * Opens the file for read, builds the datastructure, and reads the first 3
  * bytes of the input file (this is done to prime the triple-byte search
@@ -68,6 +71,21 @@ extern int open_elementary_stream(char  *filename,
  */
 extern int build_elementary_stream_file(int    input,
                                         ES_p  *es);
+/*
+ * Build an elementary stream datastructure using the given functions as
+ * read() and seek(). This is intended for reading ES data files.
+ *
+ * - `handle` is passed to `read_fn` and `seek_fn`.
+ *
+ * Builds the datastructure, and reads the first 3 bytes of the input
+ * (this is done to prime the triple-byte search mechanism).
+ *
+ * Returns 0 if all goes well, 1 otherwise.
+ */
+extern int build_elementary_stream_with_fns(void  *handle,
+                                            int  (*read_fn)(void *, byte *, size_t),
+                                            int  (*seek_fn)(void *, offset_t),
+                                            ES_p  *es);
 
 
 /*
@@ -126,6 +144,29 @@ extern void close_elementary_stream(ES_p  *es);
  * Returns TRUE if there is a changed command.
  */
 extern int es_command_changed(ES_p  es);
+/*
+ * Set the maximum size of an ES unit.
+ *
+ * ES units longer than this are discarded (with a warning), and reading
+ * continues with the next ES unit. This stops data without any start
+ * codes (for instance, because it is damaged) from making us use
+ * unbounded amounts of memory.
+ *
+ * - `es` is the elementary stream we're reading from.
+ * - `max_size` is the maximum size in bytes, or 0 for no limit. The
+ *   default is ES_UNIT_DEFAULT_MAX_SIZE.
+ */
+extern void set_ES_max_unit_size(ES_p      es,
+                                 uint32_t  max_size);
+/*
+ * Ask for each ES unit to be stamped with the time its last byte was read
+ * (as `unit->arrival`), so that the latency of live input can be measured.
+ *
+ * - `es` is the elementary stream we're reading from.
+ * - `note_arrival` is TRUE to stamp ES units, FALSE to stop.
+ */
+extern void set_ES_note_arrival(ES_p  es,
+                                int   note_arrival);
 
 
 // ============================================================
@@ -228,6 +269,30 @@ extern int find_next_ES_unit(ES_p       es,
  */
 extern int find_and_build_next_ES_unit(ES_p        es,
                                        ES_unit_p  *unit);
+/*
+ * Look at the first bytes of the next ES unit (after its 00 00 01 start
+ * code prefix), without reading it.
+ *
+ * This lets a caller decide whether the ES unit it has just read finishes
+ * something (a picture, say) without having to wait for the whole of the
+ * next ES unit to arrive, which matters when reading live input.
+ *
+ * It must be called just after an ES unit has been read. If the bytes
+ * wanted are not yet in hand, then for "bare" ES data this waits for them
+ * to be read, but for PES based data it gives up (rather than read the
+ * next PES packet).
+ *
+ * - `es` is the elementary stream we're reading from.
+ * - `num_bytes` is how many bytes to look at (at most ES_READ_AHEAD_SIZE-1)
+ * - `bytes` is returned containing them.
+ *
+ * Returns 0 if it succeeds, EOF if there is no next ES unit (or not
+ * enough of it), and 1 if the bytes are not available, or some error
+ * occurs.
+ */
+extern int peek_next_ES_unit_start(ES_p  es,
+                                   int   num_bytes,
+                                   byte  bytes[]);
 
 /*
  * Write (copy) the current ES unit to the output stream.
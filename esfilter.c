@@ -276,6 +276,8 @@ static int strip_h262(ES_p    es,
  *   ideally - i.e., try to keep every <frequency>th picture. The effect
  *   should be similar to viewing the video stream at a speed up of
  *   `frequency` times.
+ * - if `bitrate` is non-zero, then also try to keep the output within
+ *   that many bits/second, when displayed at `picture_rate` pictures/second
  * - if `max` is non-zero, then reporting will stop after `max` MPEG items
  * - if `verbose` is true, then extra information will be output
  * - if `quiet` is true, then only errors will be reported
@@ -286,12 +288,15 @@ static int filter_h262(ES_p        es,
                        WRITER      output,
                        int         as_TS,
                        int         frequency,
+                       uint32_t    bitrate,
+                       int         picture_rate,
                        int         max,
                        int         verbose,
                        int         quiet)
 {
   int  err;
   int  count = 0;
+  int  dropped = 0;
   h262_context_p         h262 = NULL;
   h262_filter_context_p  fcontext = NULL;
 
@@ -322,6 +327,7 @@ static int filter_h262(ES_p        es,
     free_h262_context(&h262);
     return 1;
   }
+  set_h262_filter_bitrate(fcontext,bitrate,picture_rate);
   
   for (count = 1; ; count++)
   {
@@ -394,6 +400,7 @@ static int filter_h262(ES_p        es,
     }
   }
   
+  dropped = fcontext->budget.dropped;
   free_h262_filter_context(&fcontext);
   free_h262_context(&h262);
 
@@ -412,6 +419,9 @@ static int filter_h262(ES_p        es,
       fprint_msg("Target (frames)     .  %10d (%4.1f%%) at requested"
                  " frequency %d\n",pictures_seen/frequency,
                  100.0/frequency,frequency);
+    if (bitrate != 0)
+      fprint_msg("Dropped to keep within %u bits/second: %d\n",
+                 bitrate,dropped);
   }
   return 0;
 }
@@ -450,7 +460,7 @@ static int copy_nal_units(ES_p                es,
       break;
     else if (err == 2)
     {
-      print_err("!!! Ignoring broken NAL unit\n");
+      print_err_limited("broken NAL unit","!!! Ignoring broken NAL unit\n");
       continue;
     }
     else if (err)
@@ -581,7 +591,9 @@ static int strip_access_units(ES_p                   es,
 }
 
 /*
- * Filter out access units, aiming to keep one every `frequency`.
+ * Filter out access units, aiming to keep one every `frequency`, and,
+ * if `bitrate` is non-zero, to keep within that many bits/second when
+ * displayed at `picture_rate` pictures/second.
  *
  * Returns 0 if all went well, 1 if something went wrong.
  */
@@ -590,11 +602,14 @@ static int filter_access_units(ES_p               es,
                                int                as_TS,
                                int                max,
                                int                frequency,
+                               uint32_t           bitrate,
+                               int                picture_rate,
                                int                verbose,
                                int                quiet)
 {
   int err = 0;
   int count;
+  int dropped = 0;
   access_unit_context_p  acontext = NULL;
   h264_filter_context_p  fcontext = NULL;
 
@@ -619,6 +634,7 @@ static int filter_access_units(ES_p               es,
     free_access_unit_context(&acontext);
     return 1;
   }
+  set_h264_filter_bitrate(fcontext,bitrate,picture_rate);
 
   for (count = 1; ; count++)
   {
@@ -682,6 +698,7 @@ static int filter_access_units(ES_p               es,
     }
   }
 
+  dropped = fcontext->budget.dropped;
   free_h264_filter_context(&fcontext);
   free_access_unit_context(&acontext);
 
@@ -701,6 +718,9 @@ static int filter_access_units(ES_p               es,
       fprint_msg("Target (frames) . %10d (%4.1f%%) at requested"
                  " frequency %d\n",access_units_seen/frequency,
                  100.0/frequency,frequency);
+    if (bitrate != 0)
+      fprint_msg("Dropped to keep within %u bits/second: %d\n",
+                 bitrate,dropped);
   }
   return 0;
 }
@@ -716,6 +736,8 @@ static int do_action(ACTION   action,
                      WRITER   output,
                      int      max,
                      int      frequency,
+                     uint32_t bitrate,
+                     int      picture_rate,
                      int      is_h262,
                      int      as_TS,
                      int      keep_all_ref,
@@ -741,9 +763,11 @@ static int do_action(ACTION   action,
   {
   case ACTION_FILTER:
     if (is_h262)
-      err = filter_h262(es,output,as_TS,frequency,max,verbose,quiet);
+      err = filter_h262(es,output,as_TS,frequency,bitrate,picture_rate,
+                        max,verbose,quiet);
     else
-      err = filter_access_units(es,output,as_TS,max,frequency,verbose,quiet);
+      err = filter_access_units(es,output,as_TS,max,frequency,
+                                bitrate,picture_rate,verbose,quiet);
     break;
 
   case ACTION_STRIP:
@@ -815,12 +839,26 @@ static void print_usage()
     "                    and -strip), or ES units/NAL units (for -copy).\n"
     "  -freq <n>         Specify the frequency of frames to try to keep\n"
     "                    with -filter. Defaults to 8.\n"
+    "  -tprate <n>       With -filter, also try to keep the output within\n"
+    "                    <n> kbit/s, choosing frames by their size as well\n"
+    "                    as by frequency. Defaults to 0 (frequency alone).\n"
+    "  -tpfps <n>        The frame rate the output is displayed at, for\n"
+    "                    -tprate. Defaults to 25.\n"
     "  -allref           With -strip, keep all reference pictures (H.264)\n"
     "                    or all I and P pictures (H.262)\n"
     "  -tsout            Output data as Transport Stream PES packets\n"
     "                    (the default is as Elementary Stream)\n"
     "  -pes, -ts         The input file is TS or PS, to be read via the\n"
     "                    PES->ES reading mechanisms. Not allowed with -stdin.\n"
+    "  -maxunit <n>      Discard ES units longer than <n> bytes, carrying on\n"
+    "                    from the next start code. 0 means no limit. The\n"
+    "                    default is 16MB.\n"
+    "  -maxpes <n>       With -pes, discard unbounded PES packets longer than\n"
+    "                    <n> bytes. 0 means no limit. The default is 16MB.\n"
+    "  -diag-limit <n>   Only show the first <n> messages about each sort of\n"
+    "                    problem in the data (broken NAL units, PES packets,\n"
+    "                    and so on), then just count them. 0 shows all of\n"
+    "                    them. The default is 0.\n"
     "\n"
     "Stream type:\n"
     "  If input is from a file, then the program will look at the start of\n"
@@ -857,11 +895,15 @@ int main(int argc, char **argv)
   int    as_TS = FALSE;
   int    keep_all_ref = FALSE;
   int    frequency = 8; // The default as stated in the usage
+  int    kbps = 0;
+  int    picture_rate = DEFAULT_TRICK_PICTURE_RATE;
   int    quiet = FALSE;
   int    verbose = FALSE;
   int    ii = 1;
 
   int    use_pes = FALSE;
+  uint32_t max_unit_size = ES_UNIT_DEFAULT_MAX_SIZE;
+  int    max_pes_size = PES_DEFAULT_MAX_SIZE;
 
   int     want_data = VIDEO_H262;
   int     is_data;
@@ -898,6 +940,29 @@ int main(int argc, char **argv)
       }
       else if (!strcmp("-pes",argv[ii]) || !strcmp("-ts",argv[ii]))
         use_pes = TRUE;
+      else if (!strcmp("-maxunit",argv[ii]))
+      {
+        CHECKARG("esfilter",ii);
+        err = unsigned_value("esfilter",argv[ii],argv[ii+1],10,&max_unit_size);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-maxpes",argv[ii]))
+      {
+        CHECKARG("esfilter",ii);
+        err = int_value("esfilter",argv[ii],argv[ii+1],TRUE,10,&max_pes_size);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-diag-limit",argv[ii]))
+      {
+        int  limit;
+        CHECKARG("esfilter",ii);
+        err = int_value("esfilter",argv[ii],argv[ii+1],TRUE,10,&limit);
+        if (err) return 1;
+        set_diagnostic_limit(limit);
+        ii++;
+      }
       else if (!strcmp("-copy",argv[ii]))
       {
         action = ACTION_COPY;
@@ -980,6 +1045,25 @@ int main(int argc, char **argv)
         if (err) return 1;
         ii++;
       }
+      else if (!strcmp("-tprate",argv[ii]))
+      {
+        CHECKARG("esfilter",ii);
+        err = int_value("esfilter",argv[ii],argv[ii+1],TRUE,10,&kbps);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-tpfps",argv[ii]))
+      {
+        CHECKARG("esfilter",ii);
+        err = int_value("esfilter",argv[ii],argv[ii+1],TRUE,10,&picture_rate);
+        if (err) return 1;
+        if (picture_rate == 0)
+        {
+          print_err("### esfilter: -tpfps must be greater than 0\n");
+          return 1;
+        }
+        ii++;
+      }
       else
       {
         fprint_err("### esfilter: "
@@ -1040,6 +1124,10 @@ int main(int argc, char **argv)
     return 1;
   }
 
+  set_ES_max_unit_size(es,max_unit_size);
+  if (use_pes)
+    set_PES_reader_max_size(es->reader,max_pes_size);
+
   // If we're reading via PES, then we can ignore all but the video
   // - this may make things slightly faster, and will allow us to ignore
   // any errors in the non-video packets
@@ -1112,8 +1200,10 @@ int main(int argc, char **argv)
       fprint_msg("Stopping as soon after %d NAL units as possible\n",max);
   }
 
-  err = do_action(action,es,output,max,frequency,want_data==VIDEO_H262,
+  err = do_action(action,es,output,max,frequency,(uint32_t)kbps*1000,
+                  picture_rate,want_data==VIDEO_H262,
                   as_TS,keep_all_ref,stream_type,verbose,quiet);
+  report_diagnostics();
   if (err)
   {
     fprint_err("### esfilter: Error doing '%s'\n",action_switch);
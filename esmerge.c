@@ -42,6 +42,12 @@
 #include "printing_fns.h"
 #include "version.h"
 
+// With -lowlatency, we measure how long each video frame takes to get from
+// our input to our output
+static uint32_t latency_count = 0;
+static uint64_t latency_total = 0;
+static uint64_t latency_max = 0;
+
 // Default audio rates, in Hertz
 #define CD_RATE  44100
 #define DAT_RATE 48000
@@ -109,6 +115,49 @@ static int test_pts()
 }
 #endif  // TEST_PTS_DTS
 
+/*
+ * Push out the video frame we have just written, and note how long it took
+ * to get through us, measured from `arrival`, when the last byte of its data
+ * was read.
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int flush_and_note_latency(TS_writer_p output,
+                                  uint64_t    arrival,
+                                  int         verbose)
+{
+  uint64_t  now;
+  uint64_t  latency;
+  int err = tswrite_flush(output);
+  if (err) return 1;
+
+  if (arrival == 0)
+    return 0;
+  now = time_now_microseconds();
+  latency = (now > arrival ? now - arrival : 0);
+  latency_count ++;
+  latency_total += latency;
+  if (latency > latency_max)
+    latency_max = latency;
+  if (verbose)
+    fprint_msg("Video input to output latency " LLU_FORMAT " microseconds\n",
+               latency);
+  return 0;
+}
+
+/*
+ * Report on the latencies noted by `flush_and_note_latency`
+ */
+static void report_latency(void)
+{
+  if (latency_count == 0)
+    return;
+  fprint_msg("Video input to output latency: average " LLU_FORMAT
+             " microseconds, maximum " LLU_FORMAT " microseconds"
+             " (over %u frame%s)\n",latency_total / latency_count,
+             latency_max,latency_count,(latency_count==1?"":"s"));
+}
+
 static int is_avs_I_frame(avs_frame_p  frame)
 {
   return (frame->is_frame && frame->start_code == 0xB3);
@@ -125,6 +174,9 @@ static int is_I_or_IDR_frame(access_unit_p  frame)
 /*
  * Merge the given elementary streams to the given output.
  *
+ * If `low_latency`, each video frame is pushed out as soon as it has been
+ * written.
+ *
  * Returns 0 if all goes well, 1 if something goes wrong.
  */
 static int merge_with_avs(avs_context_p  video_context,
@@ -135,6 +187,7 @@ static int merge_with_avs(avs_context_p  video_context,
                           int            audio_sample_rate,
                           double         video_frame_rate,
                           int            pat_pmt_freq,
+                          int            low_latency,
                           int            quiet,
                           int            verbose,
                           int            debugging)
@@ -212,6 +265,7 @@ static int merge_with_avs(avs_context_p  video_context,
   {
     avs_frame_p    avs_frame;
     audio_frame_p  aframe;
+    uint64_t       arrival;
 
     // Start with a video frame
     if (got_video)
@@ -297,7 +351,15 @@ static int merge_with_avs(avs_context_p  video_context,
         print_err("### Error writing AVS frame\n");
         return 1;
       }
+      arrival = 0;
+      if (avs_frame->list->length > 0)
+        arrival = avs_frame->list->array[avs_frame->list->length-1].arrival;
       free_avs_frame(&avs_frame);
+      if (low_latency)
+      {
+        err = flush_and_note_latency(output,arrival,verbose);
+        if (err) return 1;
+      }
     }
 
     if (!got_audio)
@@ -361,6 +423,9 @@ static int merge_with_avs(avs_context_p  video_context,
 /*
  * Merge the given elementary streams to the given output.
  *
+ * If `low_latency`, each video frame is pushed out as soon as it has been
+ * written.
+ *
  * Returns 0 if all goes well, 1 if something goes wrong.
  */
 static int merge_with_h264(access_unit_context_p  video_context,
@@ -371,6 +436,7 @@ static int merge_with_h264(access_unit_context_p  video_context,
                            int                    audio_sample_rate,
                            int                    video_frame_rate,
                            int                    pat_pmt_freq,
+                           int                    low_latency,
                            int                    quiet,
                            int                    verbose,
                            int                    debugging)
@@ -448,6 +514,7 @@ static int merge_with_h264(access_unit_context_p  video_context,
   {
     access_unit_p  access_unit;
     audio_frame_p  aframe;
+    uint64_t       arrival;
 
     // Start with a video frame
     if (got_video)
@@ -513,7 +580,16 @@ static int merge_with_h264(access_unit_context_p  video_context,
         print_err("### Error writing access unit (frame)\n");
         return 1;
       }
+      arrival = 0;
+      if (access_unit->nal_units->length > 0)
+        arrival = access_unit->nal_units->array[access_unit->nal_units->length-1]
+                    ->unit.arrival;
       free_access_unit(&access_unit);
+      if (low_latency)
+      {
+        err = flush_and_note_latency(output,arrival,verbose);
+        if (err) return 1;
+      }
 
       // Did the logical video stream end after the last access unit?
       if (video_context->end_of_stream)
@@ -627,6 +703,13 @@ static void print_usage()
     "                     by default, f = 0 and PAT/PMT are inserted only at  \n"
     "                     the start of the output stream.\n"
     "\n"
+    "  -lowlatency       For live video input (e.g., from an encoder, via a\n"
+    "                    pipe). Write out each video frame as soon as it is\n"
+    "                    complete, using just the start of the next NAL unit\n"
+    "                    to tell if an H.264 frame has ended. Reports the\n"
+    "                    latency from input to output at the end (and for\n"
+    "                    each frame, with -verbose).\n"
+    "\n"
     "Limitations\n"
     "===========\n"
     "For the moment, the video input must be H.264 or AVS, and the audio input\n"
@@ -658,6 +741,7 @@ int main(int argc, char **argv)
   int    audio_type = AUDIO_ADTS;
   int    video_type = VIDEO_H264;
   int    pat_pmt_freq = 0;
+  int    low_latency = FALSE;
   int    ii = 1;
 
 #if TEST_PTS_DTS
@@ -710,6 +794,10 @@ int main(int argc, char **argv)
         debugging = TRUE;
         quiet = FALSE;
       }
+      else if (!strcmp("-lowlatency",argv[ii]))
+      {
+        low_latency = TRUE;
+      }
       else if (!strcmp("-rate",argv[ii]))
       {
         CHECKARG("esmerge",ii);
@@ -823,6 +911,8 @@ int main(int argc, char **argv)
               "Problem starting to read video as ES - abandoning reading\n");
     return 1;
   }
+  if (low_latency)
+    set_ES_note_arrival(video_es,TRUE);
 
   if (video_type == VIDEO_H264)
   {
@@ -834,6 +924,7 @@ int main(int argc, char **argv)
       close_elementary_stream(&video_es);
       return 1;
     }
+    h264_video_context->low_latency = low_latency;
   }
   else if (video_type == VIDEO_AVS)
   {
@@ -909,14 +1000,14 @@ int main(int argc, char **argv)
                           audio_type,
                           audio_samples_per_frame,audio_sample_rate,
                           video_frame_rate,
-                          pat_pmt_freq,
+                          pat_pmt_freq,low_latency,
                           quiet,verbose,debugging);
   else if (video_type == VIDEO_AVS)
     err = merge_with_avs(avs_video_context,audio_file,output,
                          audio_type,
                          audio_samples_per_frame,audio_sample_rate,
                          video_frame_rate,
-                         pat_pmt_freq,
+                         pat_pmt_freq,low_latency,
                          quiet,verbose,debugging);
   else
   {
@@ -933,6 +1024,8 @@ int main(int argc, char **argv)
     (void) tswrite_close(output,quiet);
     return 1;
   }
+  if (low_latency && !quiet)
+    report_latency();
 
   close_elementary_stream(&video_es);
   close_file(audio_file);
@@ -48,11 +48,22 @@
 #include "avs_fns.h"
 #include "misc_fns.h"
 #include "printing_fns.h"
+#include "hrd_fns.h"
 #include "version.h"
 
 #define FRAMES_PER_SECOND  25
 #define FRAMES_PER_MINUTE  (FRAMES_PER_SECOND * 60)
 
+// What the user asked for in the way of VBV/CPB checking. Any of the
+// values that are negative are to be taken from the stream itself.
+struct hrd_options
+{
+  int     check;          // TRUE if we are to run the buffer model
+  double  bit_rate;       // in bits/second
+  double  buffer_size;    // in bits
+  double  initial_delay;  // in seconds
+};
+
 
 /*
  * Report on the content of an AVS file
@@ -335,6 +346,69 @@ static void find_h262_fields(ES_p    es,
              num_sequence_ends,(num_sequence_ends==1?"":"s"));
 }
 
+/*
+ * Work out the duration of an H.262 picture, in seconds, given the frame
+ * rate and the sequence it belongs to.
+ */
+static double h262_picture_duration(h262_picture_p  picture,
+                                    double          frame_rate,
+                                    int             progressive_sequence)
+{
+  double  frame = 1.0 / frame_rate;
+  if (picture->picture_structure != 3 && !picture->was_two_fields)
+    return frame / 2;               // a single field on its own
+  else if (progressive_sequence)
+  {
+    if (picture->repeat_first_field)
+      return (picture->top_field_first ? 3 : 2) * frame;
+    else
+      return frame;
+  }
+  else if (picture->repeat_first_field)
+    return frame * 3 / 2;
+  else
+    return frame;
+}
+
+/*
+ * Build the VBV model for an H.262 stream, from the values in its first
+ * sequence header and picture, as overridden by the user.
+ *
+ * - `bit_rate` and `buffer_size` are from the sequence header, in bits/second
+ *   and bits respectively
+ * - `vbv_delay` is from the first picture. If it is 0xFFFF, then the
+ *   stream is variable bit rate.
+ * - `options` are the user's overrides
+ * - if `quiet` is true, then individual violations will not be reported
+ * - `model` is the new model
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int build_h262_vbv(double               bit_rate,
+                          double               buffer_size,
+                          uint16_t             vbv_delay,
+                          struct hrd_options  *options,
+                          int                  quiet,
+                          hrd_model_p         *model)
+{
+  double  initial_delay = options->initial_delay;
+  int     is_cbr = (vbv_delay != 0xFFFF);
+
+  if (options->bit_rate >= 0)
+    bit_rate = options->bit_rate;
+  if (options->buffer_size >= 0)
+    buffer_size = options->buffer_size;
+  if (initial_delay < 0)
+  {
+    if (is_cbr)
+      initial_delay = vbv_delay / 90000.0;
+    else if (bit_rate > 0)
+      initial_delay = buffer_size / bit_rate;
+  }
+  return build_hrd_model("VBV",bit_rate,buffer_size,is_cbr,initial_delay,
+                         quiet,model);
+}
+
 /*
  * Report on the content of an MPEG2 file
  *
@@ -343,12 +417,15 @@ static void find_h262_fields(ES_p    es,
  * - if `verbose` is true, then extra information will be output
  * - if `quiet` is true, then only errors will be reported
  * - if `count_sizes` is true, then a summary of frame sizes will be kept
+ * - if `hrd->check` is true, then the stream will be checked against
+ *   its VBV buffer model
  */
 static void report_h262_frames(ES_p    es,
                                int     max,
                                int     verbose,
                                int     quiet,
-                               int     count_sizes)
+                               int     count_sizes,
+                               struct hrd_options *hrd)
 {
   int  err;
   int  count = 0;
@@ -376,6 +453,15 @@ static void report_h262_frames(ES_p    es,
   
   h262_context_p  h262;
 
+  hrd_model_p     vbv = NULL;
+  uint32_t        vbv_header_bytes = 0;  // sequence headers, etc., so far
+  double          frame_rate = 0;
+  int             progressive_sequence = TRUE;
+  double          seq_bit_rate = 0;
+  double          seq_vbv_size = 0;
+  static double   frame_rates[] = {0, 24000.0/1001, 24, 25, 30000.0/1001,
+                                   30, 50, 60000.0/1001, 60};
+
   err = build_h262_context(es,&h262);
   if (err)
   {
@@ -402,6 +488,66 @@ static void report_h262_frames(ES_p    es,
     else if (verbose)
       report_h262_picture(picture,TRUE);
 
+    if (hrd->check)
+    {
+      err = get_ES_unit_list_bounds(picture->list,&start,&length);
+      if (err) break;
+      if (picture->is_sequence_header)
+      {
+        if (frame_rate == 0)
+        {
+          // Take the buffer model from the first sequence header
+          if (picture->frame_rate_code > 0 && picture->frame_rate_code < 9)
+            frame_rate = frame_rates[picture->frame_rate_code] *
+              (picture->frame_rate_extension_n + 1) /
+              (picture->frame_rate_extension_d + 1);
+          else
+          {
+            fprint_err("!!! Unrecognised frame_rate_code %d - assuming"
+                       " %d frames/second\n",picture->frame_rate_code,
+                       FRAMES_PER_SECOND);
+            frame_rate = FRAMES_PER_SECOND;
+          }
+          seq_bit_rate = picture->bit_rate * 400.0;
+          seq_vbv_size = picture->vbv_buffer_size * 16.0 * 1024;
+        }
+        progressive_sequence = picture->progressive_sequence;
+        vbv_header_bytes += length;
+      }
+      else if (picture->is_picture)
+      {
+        if (vbv == NULL && frame_rate == 0)
+        {
+          print_err("!!! H.262 picture before any sequence header - cannot"
+                    " check the VBV\n");
+          hrd->check = FALSE;
+        }
+        else
+        {
+          if (vbv == NULL)
+          {
+            err = build_h262_vbv(seq_bit_rate,seq_vbv_size,picture->vbv_delay,
+                                 hrd,quiet,&vbv);
+            if (err)
+            {
+              hrd->check = FALSE;
+              err = 0;
+            }
+          }
+          if (vbv != NULL)
+          {
+            err = hrd_add_picture(vbv,vbv_header_bytes + length,
+                                  h262_picture_duration(picture,frame_rate,
+                                                        progressive_sequence));
+            if (err) break;
+          }
+          vbv_header_bytes = 0;
+        }
+      }
+      else
+        vbv_header_bytes += length;
+    }
+
     if (picture->is_picture)
     {
       if (count_sizes)
@@ -494,6 +640,12 @@ static void report_h262_frames(ES_p    es,
                    sum_seq_hdr_size/(double)num_sequence_headers);
     }
   }
+
+  if (vbv != NULL)
+  {
+    report_hrd_model(vbv);
+    free_hrd_model(&vbv);
+  }
 }
 
 /*
@@ -771,6 +923,61 @@ static void find_h264_fields(ES_p    es,
   free_access_unit_context(&context);
 }
 
+/*
+ * Build the CPB model for an H.264 stream, from the sequence parameter set
+ * used by its first access unit, as overridden by the user.
+ *
+ * - `seq` is the sequence parameter set data
+ * - `options` are the user's overrides
+ * - if `quiet` is true, then individual violations will not be reported
+ * - `model` is the new model
+ * - `frame_duration` is the duration of a frame, in seconds
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int build_h264_cpb(nal_seq_param_data_p  seq,
+                          struct hrd_options   *options,
+                          int                   quiet,
+                          hrd_model_p          *model,
+                          double               *frame_duration)
+{
+  double  bit_rate = options->bit_rate;
+  double  buffer_size = options->buffer_size;
+  double  initial_delay = options->initial_delay;
+  int     is_cbr = FALSE;
+
+  if (seq->timing_info_present_flag && seq->num_units_in_tick > 0 &&
+      seq->time_scale > 0)
+    *frame_duration = 2.0 * seq->num_units_in_tick / seq->time_scale;
+  else
+  {
+    fprint_err("!!! No timing information in the sequence parameter set -"
+               " assuming %d frames/second\n",FRAMES_PER_SECOND);
+    *frame_duration = 1.0 / FRAMES_PER_SECOND;
+  }
+
+  if (seq->hrd_parameters_present_flag)
+  {
+    if (bit_rate < 0)
+      bit_rate = (double)seq->hrd_bit_rate;
+    if (buffer_size < 0)
+      buffer_size = (double)seq->hrd_cpb_size;
+    is_cbr = seq->hrd_cbr_flag;
+  }
+  else if (bit_rate < 0 || buffer_size < 0)
+  {
+    print_err("### No HRD parameters in the sequence parameter set - use"
+              " -hrdrate and -hrdsize to check the CPB\n");
+    return 1;
+  }
+  // Without a buffering period SEI, the best we can assume is that the
+  // buffer is allowed to fill before the first picture is removed
+  if (initial_delay < 0)
+    initial_delay = buffer_size / bit_rate;
+  return build_hrd_model("CPB",bit_rate,buffer_size,is_cbr,initial_delay,
+                         quiet,model);
+}
+
 /*
  * Report on data by access unit.
  */
@@ -780,7 +987,8 @@ static void report_h264_frames(ES_p  es,
                                int   verbose,
                                int   show_nal_details,
                                int   count_sizes,
-                               int   count_types)
+                               int   count_types,
+                               struct hrd_options *hrd)
 {
   int err = 0;
   int access_unit_count = 0;
@@ -806,6 +1014,9 @@ static void report_h264_frames(ES_p  es,
   ES_offset  start;
   uint32_t   length;
 
+  hrd_model_p  cpb = NULL;
+  double       frame_duration = 0;
+
   err = build_access_unit_context(es,&context);
   if (err) return;
 
@@ -834,6 +1045,40 @@ static void report_h264_frames(ES_p  es,
       sum_frame_size += length;
     }
 
+    if (hrd->check && access_unit->primary_start != NULL)
+    {
+      if (cpb == NULL)
+      {
+        nal_pic_param_data_p  pic = NULL;
+        nal_seq_param_data_p  seq = NULL;
+        nal_unit_context_p    nac = context->nac;
+        nal_slice_data_p      slice = &access_unit->primary_start->u.slice;
+        err = get_pic_param_data(nac->pic_param_dict,
+                                 slice->pic_parameter_set_id,&pic);
+        if (!err)
+          err = get_seq_param_data(nac->seq_param_dict,
+                                   pic->seq_parameter_set_id,&seq);
+        if (!err)
+          err = build_h264_cpb(seq,hrd,quiet,&cpb,&frame_duration);
+        if (err)
+        {
+          print_err("!!! Unable to check the CPB\n");
+          hrd->check = FALSE;
+          err = 0;
+        }
+      }
+      if (cpb != NULL)
+      {
+        err = get_access_unit_bounds(access_unit,&start,&length);
+        if (err) break;
+        // A field on its own only lasts half as long as a frame
+        err = hrd_add_picture(cpb,length,(access_unit->field_pic_flag ?
+                                          frame_duration / 2 :
+                                          frame_duration));
+        if (err) break;
+      }
+    }
+
     if (count_types && access_unit->primary_start != NULL)
     {
       if (access_unit->primary_start->nal_ref_idc == 0)
@@ -961,6 +1206,12 @@ static void report_h264_frames(ES_p  es,
 
   fprint_msg("Frames with PTS associated: %u\n",num_with_PTS);
 
+  if (cpb != NULL)
+  {
+    report_hrd_model(cpb);
+    free_hrd_model(&cpb);
+  }
+
   free_access_unit_context(&context);
 }
 
@@ -994,7 +1245,17 @@ static void print_usage()
     "  -framesize        Report on the sizes of frames (mean, etc.).\n"
     "  -frametype        Report on the numbers of different type of frame.\n"
     "\n"
-    "  (in fact, both of these imply -frame).\n"
+    "  -hrd              Check the stream against its buffer model (the VBV\n"
+    "                    for H.262, the CPB for H.264), reporting the range of\n"
+    "                    buffer fullness and any underflows or overflows.\n"
+    "  -hrdrate <n>      Use <n> bits/second for the buffer model, instead of\n"
+    "                    the value from the sequence header or parameter set.\n"
+    "  -hrdsize <n>      Use a buffer of <n> bits, similarly.\n"
+    "  -hrddelay <s>     Remove the first picture <s> seconds after its first\n"
+    "                    bit arrives. The default is to use the first H.262\n"
+    "                    vbv_delay, or else the time to fill the buffer.\n"
+    "\n"
+    "  (in fact, all of these imply -frame).\n"
     "\n"
     "Other switches:\n"
     "  -err stdout       Write error messages to standard output (the default)\n"
@@ -1013,6 +1274,15 @@ static void print_usage()
     "  -pes, -ts         The input file is TS or PS, to be read via the\n"
     "                    PES->ES reading mechanisms\n"
     "  -pesreport        Report on PES headers. Implies -pes and -q.\n"
+    "  -maxunit <n>      Discard ES units longer than <n> bytes, carrying on\n"
+    "                    from the next start code. 0 means no limit. The\n"
+    "                    default is 16MB.\n"
+    "  -maxpes <n>       With -pes, discard unbounded PES packets longer than\n"
+    "                    <n> bytes. 0 means no limit. The default is 16MB.\n"
+    "  -diag-limit <n>   Only show the first <n> messages about each sort of\n"
+    "                    problem in the data (broken NAL units, PES packets,\n"
+    "                    and so on), then just count them. 0 shows all of\n"
+    "                    them. The default is 0.\n"
     "\n"
     "Stream type:\n"
     "  If input is from a file, then the program will look at the start of\n"
@@ -1051,8 +1321,11 @@ int main(int argc, char **argv)
   int    report_pes_headers = FALSE;
   int    report_ES = FALSE;
   int    ii = 1;
+  struct hrd_options hrd = {FALSE, -1, -1, -1};
 
   int    use_pes = FALSE;
+  uint32_t max_unit_size = ES_UNIT_DEFAULT_MAX_SIZE;
+  int    max_pes_size = PES_DEFAULT_MAX_SIZE;
 
   int    want_data = VIDEO_H262;
   int    is_data;
@@ -1120,6 +1393,28 @@ int main(int argc, char **argv)
         by_frame = TRUE;
         report_frametype = TRUE;
       }
+      else if (!strcmp("-hrd",argv[ii]))
+      {
+        by_frame = TRUE;
+        hrd.check = TRUE;
+      }
+      else if (!strcmp("-hrdrate",argv[ii]) || !strcmp("-hrdsize",argv[ii]) ||
+               !strcmp("-hrddelay",argv[ii]))
+      {
+        double  value;
+        CHECKARG("esreport",ii);
+        err = double_value("esreport",argv[ii],argv[ii+1],TRUE,&value);
+        if (err) return 1;
+        if (!strcmp("-hrdrate",argv[ii]))
+          hrd.bit_rate = value;
+        else if (!strcmp("-hrdsize",argv[ii]))
+          hrd.buffer_size = value;
+        else
+          hrd.initial_delay = value;
+        by_frame = TRUE;
+        hrd.check = TRUE;
+        ii++;
+      }
       else if (!strcmp("-afd",argv[ii]) || !strcmp("-afds",argv[ii]))
         report_afds = TRUE;
       else if (!strcmp("-findfields",argv[ii]))
@@ -1150,6 +1445,29 @@ int main(int argc, char **argv)
       }
       else if (!strcmp("-pes",argv[ii]) || !strcmp("-ts",argv[ii]))
         use_pes = TRUE;
+      else if (!strcmp("-maxunit",argv[ii]))
+      {
+        CHECKARG("esreport",ii);
+        err = unsigned_value("esreport",argv[ii],argv[ii+1],10,&max_unit_size);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-maxpes",argv[ii]))
+      {
+        CHECKARG("esreport",ii);
+        err = int_value("esreport",argv[ii],argv[ii+1],TRUE,10,&max_pes_size);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-diag-limit",argv[ii]))
+      {
+        int  limit;
+        CHECKARG("esreport",ii);
+        err = int_value("esreport",argv[ii],argv[ii+1],TRUE,10,&limit);
+        if (err) return 1;
+        set_diagnostic_limit(limit);
+        ii++;
+      }
       else if (!strcmp("-pesreport",argv[ii]))
       {
         report_pes_headers = TRUE;
@@ -1198,6 +1516,10 @@ int main(int argc, char **argv)
     return 1;
   }
 
+  set_ES_max_unit_size(es,max_unit_size);
+  if (use_pes)
+    set_PES_reader_max_size(es->reader,max_pes_size);
+
   if (report_pes_headers)
   {
     es->reader->debug_read_packets = TRUE;
@@ -1217,7 +1539,7 @@ int main(int argc, char **argv)
     if (find_fields)
       find_h262_fields(es,max,verbose);
     else if (by_frame)
-      report_h262_frames(es,max,verbose,quiet,report_framesize);
+      report_h262_frames(es,max,verbose,quiet,report_framesize,&hrd);
     else if (report_afds)
       report_h262_afds(es,max,verbose,quiet);
     else
@@ -1233,7 +1555,7 @@ int main(int argc, char **argv)
       find_h264_fields(es,max,quiet,verbose,show_nal_details);
     else if (by_frame)
       report_h264_frames(es,max,quiet,verbose,show_nal_details,
-                         report_framesize,report_frametype);
+                         report_framesize,report_frametype,&hrd);
     else
       report_by_nal_unit(es,max,quiet,show_nal_details);
   }
@@ -1242,6 +1564,7 @@ int main(int argc, char **argv)
     print_err("### esreport: Unexpected type of video data\n");
     return 1;
   }
+  report_diagnostics();
 
   err = close_input_as_ES(input_name,&es);
   if (err)
@@ -82,17 +82,21 @@ extern int write_packet_data(WRITER   output,
  * - if `frequency` is non-zero, then attempt to produce the effect of
  *   keeping every <frequency>th picture (similar to reversing at a
  *   multiplication factor of `frequency`) If 0, just retain all I pictures.
+ * - if `bitrate` is non-zero, then also try to keep the output within
+ *   that many bits/second, when displayed at `picture_rate` pictures/second
  * - if `as_TS` is true, then output as TS packets, not ES
  * - if `verbose` is true, then extra information will be output
  * - if `quiet` is true, then only errors will be reported
  *
  * Returns 0 if all went well, 1 if something went wrong.
  */
-static int reverse_h262(ES_p    es,
-                        WRITER  output,
-                        int     max,
-                        int     frequency,
-                        int     as_TS,
+static int reverse_h262(ES_p      es,
+                        WRITER    output,
+                        int       max,
+                        int       frequency,
+                        uint32_t  bitrate,
+                        int       picture_rate,
+                        int       as_TS,
                         int     verbose,
                         int     quiet)
 {
@@ -109,6 +113,7 @@ static int reverse_h262(ES_p    es,
     free_h262_context(&hcontext);
     return 1;
   }
+  set_reverse_bitrate(reverse_data,bitrate,picture_rate);
 
   if (!quiet)
     print_msg("\nScanning forwards\n");
@@ -186,6 +191,9 @@ static int reverse_h262(ES_p    es,
       fprint_msg("Target (pictures)      . %10d (%4.1f%%) at requested"
                  " frequency %d\n",final_index/frequency,100.0/frequency,
                  frequency);
+    if (bitrate != 0)
+      fprint_msg("Dropped to keep within %u bits/second: %d\n",
+                 bitrate,reverse_data->budget.dropped);
   }
   
   free_reverse_data(&reverse_data);
@@ -271,13 +279,18 @@ static int output_parameter_sets(WRITER                 output,
 /*
  * Find IDR and I access units, and output them in reverse order.
  *
+ * If `bitrate` is non-zero, try to keep the output within that many
+ * bits/second, when displayed at `picture_rate` pictures/second.
+ *
  * Returns 0 if all went well, 1 if something went wrong.
  */
-static int reverse_access_units(ES_p   es,
-                                WRITER output,
-                                int    max,
-                                int    frequency,
-                                int    as_TS,
+static int reverse_access_units(ES_p      es,
+                                WRITER    output,
+                                int       max,
+                                int       frequency,
+                                uint32_t  bitrate,
+                                int       picture_rate,
+                                int       as_TS,
                                 int    verbose,
                                 int    quiet)
 {
@@ -294,6 +307,7 @@ static int reverse_access_units(ES_p   es,
     free_access_unit_context(&acontext);
     return 1;
   }
+  set_reverse_bitrate(reverse_data,bitrate,picture_rate);
 
   if (!quiet)
     print_msg("\nScanning forwards\n");
@@ -375,6 +389,9 @@ static int reverse_access_units(ES_p   es,
       fprint_msg("Target (access units)  . %10d (%4.1f%%) at requested"
                  " frequency %d\n",final_index/frequency,100.0/frequency,
                  frequency);
+    if (bitrate != 0)
+      fprint_msg("Dropped to keep within %u bits/second: %d\n",
+                 bitrate,reverse_data->budget.dropped);
   }
   free_reverse_data(&reverse_data);
   free_access_unit_context(&acontext);
@@ -416,6 +433,11 @@ static void print_usage()
     "  -max <n>, -m <n>  Maximum number of frames to read\n"
     "  -freq <n>         Specify the frequency of frames to try to keep\n"
     "                    when reversing. Defaults to 8.\n"
+    "  -tprate <n>       Also try to keep the output within <n> kbit/s,\n"
+    "                    choosing pictures by their size as well as by\n"
+    "                    frequency. Defaults to 0 (frequency alone).\n"
+    "  -tpfps <n>        The picture rate the output is displayed at, for\n"
+    "                    -tprate. Defaults to 25.\n"
     "  -tsout               Output H.222 Transport Stream\n"
     "\n"
     "  -pes, -ts         The input file is TS or PS, to be read via the\n"
@@ -453,6 +475,8 @@ int main(int argc, char **argv)
   int    max = 0;
   int    as_TS = FALSE;
   int    frequency = 8; // The default as stated in the usage
+  int    kbps = 0;
+  int    picture_rate = DEFAULT_TRICK_PICTURE_RATE;
   int    quiet = FALSE;
   int    verbose = FALSE;
   int    ii = 1;
@@ -563,6 +587,26 @@ int main(int argc, char **argv)
         if (err) return 1;
         ii++;
       }
+      else if (!strcmp("-tprate",argv[ii]))
+      {
+        CHECKARG("esreverse",ii);
+        err = int_value("esreverse",argv[ii],argv[ii+1],TRUE,10,&kbps);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-tpfps",argv[ii]))
+      {
+        CHECKARG("esreverse",ii);
+        err = int_value("esreverse",argv[ii],argv[ii+1],TRUE,10,
+                        &picture_rate);
+        if (err) return 1;
+        if (picture_rate == 0)
+        {
+          print_err("### esreverse: -tpfps must be greater than 0\n");
+          return 1;
+        }
+        ii++;
+      }
       else
       {
         fprint_err("### esreverse: "
@@ -726,9 +770,11 @@ int main(int argc, char **argv)
   }
 
   if (is_data == VIDEO_H262)
-    err = reverse_h262(es,output,max,frequency,as_TS,verbose,quiet);
+    err = reverse_h262(es,output,max,frequency,(uint32_t)kbps*1000,
+                       picture_rate,as_TS,verbose,quiet);
   else
-    err = reverse_access_units(es,output,max,frequency,as_TS,verbose,quiet);
+    err = reverse_access_units(es,output,max,frequency,(uint32_t)kbps*1000,
+                               picture_rate,as_TS,verbose,quiet);
 
   if (err)
   {
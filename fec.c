@@ -0,0 +1,435 @@
+/*
+ * Generate SMPTE 2022-1 (Pro-MPEG COP3) forward error correction for
+ * RTP output
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "compat.h"
+#include "misc_fns.h"
+#include "printing_fns.h"
+#include "fec_fns.h"
+
+#define FEC_PACKET_OFFSET (FEC_RTP_HEADER_SIZE + FEC_HEADER_SIZE)
+
+/*
+ * XOR `length` bytes of `src` into `dst`.
+ *
+ * This is where nearly all of the FEC time goes - every media packet is
+ * XORed into its column (and maybe its row) - so it is done in the widest
+ * blocks the compiler has been told it may use, and then by 64 bit words.
+ * Neither pointer need be aligned.
+ */
+static inline void xor_into(byte        *dst,
+                            const byte  *src,
+                            int          length)
+{
+#if defined(__AVX2__)
+  while (length >= 32)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i *)src);
+    __m256i b = _mm256_loadu_si256((const __m256i *)dst);
+    _mm256_storeu_si256((__m256i *)dst,_mm256_xor_si256(a,b));
+    src += 32; dst += 32; length -= 32;
+  }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+  while (length >= 16)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i *)src);
+    __m128i b = _mm_loadu_si128((const __m128i *)dst);
+    _mm_storeu_si128((__m128i *)dst,_mm_xor_si128(a,b));
+    src += 16; dst += 16; length -= 16;
+  }
+#endif
+  while (length >= 8)
+  {
+    uint64_t a, b;
+    memcpy(&a,src,8);
+    memcpy(&b,dst,8);
+    b ^= a;
+    memcpy(dst,&b,8);
+    src += 8; dst += 8; length -= 8;
+  }
+  while (length-- > 0)
+    *dst++ ^= *src++;
+}
+
+/*
+ * Set up an FEC group (column or row)
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int init_FEC_group(FEC_group_p  group,
+                          int          max_payload,
+                          uint16_t    *seq,
+                          int          is_row,
+                          int          offset,
+                          int          na)
+{
+  byte  *hdr;
+
+  group->count = 0;
+  group->max_length = 0;
+  group->dirty_length = 0;
+  group->seq = seq;
+  group->packet = calloc(1,FEC_PACKET_OFFSET + max_payload);
+  if (group->packet == NULL)
+  {
+    print_err("### Unable to allocate FEC packet buffer\n");
+    return 1;
+  }
+
+  // The parts of the headers that never change
+  group->packet[0] = 0x80;
+  group->packet[1] = FEC_PAYLOAD_TYPE;
+  // RTP timestamp and SSRC are left as zero, as SMPTE 2022-1 does not
+  // use them for FEC packets
+
+  hdr = group->packet + FEC_RTP_HEADER_SIZE;
+  hdr[12] = (is_row?0x40:0x00);   // X=0, D, type=XOR, index=0
+  hdr[13] = offset;
+  hdr[14] = na;
+  hdr[15] = 0;
+  return 0;
+}
+
+/*
+ * Add a media packet's details and payload to an FEC group
+ */
+static inline void add_to_FEC_group(FEC_group_p  group,
+                                    uint16_t     seq,
+                                    byte         pt,
+                                    uint32_t     timestamp,
+                                    byte        *payload,
+                                    int          length)
+{
+  byte  *data = group->packet + FEC_PACKET_OFFSET;
+
+  if (group->count == 0)
+  {
+    // Start afresh, clearing anything left over from the last time round
+    group->sn_base = seq;
+    group->length_recovery = length;
+    group->pt_recovery = pt;
+    group->ts_recovery = timestamp;
+    group->max_length = length;
+    memcpy(data,payload,length);
+    if (group->dirty_length > length)
+      memset(data + length,0,group->dirty_length - length);
+    group->dirty_length = length;
+  }
+  else
+  {
+    group->length_recovery ^= length;
+    group->pt_recovery ^= pt;
+    group->ts_recovery ^= timestamp;
+    if (length > group->max_length)
+    {
+      // Bytes beyond the old maximum are still zero (see above), so
+      // XOR-ing into them does the right thing
+      group->max_length = length;
+      if (length > group->dirty_length)
+        group->dirty_length = length;
+    }
+    xor_into(data,payload,length);
+  }
+  group->count ++;
+}
+
+/*
+ * Finish off an FEC group, filling in its headers.
+ *
+ * Returns the length of the FEC packet, which is `group->packet`.
+ */
+static int finish_FEC_group(FEC_group_p  group)
+{
+  byte  *rtp = group->packet;
+  byte  *hdr = group->packet + FEC_RTP_HEADER_SIZE;
+
+  set_16_be(rtp + 2,*group->seq);
+  (*group->seq) ++;
+
+  set_16_be(hdr + 0,group->sn_base);
+  set_16_be(hdr + 2,group->length_recovery);
+  hdr[4] = 0x80 | (group->pt_recovery & 0x7F);   // E=1
+  hdr[5] = hdr[6] = hdr[7] = 0;                   // Mask
+  set_32_be(hdr + 8,group->ts_recovery);
+
+  group->count = 0;
+  return FEC_PACKET_OFFSET + group->max_length;
+}
+
+/*
+ * Free an FEC generator.
+ *
+ * Sets `encoder` to NULL.
+ */
+extern void free_FEC_encoder(FEC_encoder_p  *encoder)
+{
+  int ii;
+  FEC_encoder_p  enc = *encoder;
+
+  if (enc == NULL)
+    return;
+  if (enc->columns != NULL)
+  {
+    for (ii = 0; ii < enc->L; ii++)
+      free(enc->columns[ii].packet);
+    free(enc->columns);
+  }
+  free(enc->row.packet);
+  free(enc);
+  *encoder = NULL;
+}
+
+/*
+ * Build a new SMPTE 2022-1 FEC generator.
+ *
+ * - `L` is the number of columns in the FEC matrix (1..20)
+ * - `D` is the number of rows in the FEC matrix (4..20). L*D may not
+ *   be more than 100.
+ * - if `want_rows` is TRUE, then row FEC packets will be generated as
+ *   well as column FEC packets
+ * - `max_payload` is the largest RTP payload (i.e., packet length less
+ *   RTP header) that will be given to the generator
+ * - `encoder` is the new generator
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_FEC_encoder(int             L,
+                             int             D,
+                             int             want_rows,
+                             int             max_payload,
+                             FEC_encoder_p  *encoder)
+{
+  int ii, err;
+  FEC_encoder_p  new;
+
+  if (L < FEC_MIN_L || L > FEC_MAX_L || D < FEC_MIN_D || D > FEC_MAX_D ||
+      L*D > FEC_MAX_LD)
+  {
+    fprint_err("### FEC matrix %dx%d is not allowed by SMPTE 2022-1"
+               " (L must be %d..%d, D %d..%d, and L*D at most %d)\n",
+               L,D,FEC_MIN_L,FEC_MAX_L,FEC_MIN_D,FEC_MAX_D,FEC_MAX_LD);
+    return 1;
+  }
+
+  new = calloc(1,SIZEOF_FEC_ENCODER);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate FEC generator\n");
+    return 1;
+  }
+  new->L = L;
+  new->D = D;
+  new->want_rows = want_rows;
+  new->max_payload = max_payload;
+  new->index = 0;
+  new->column_seq = 0;
+  new->row_seq = 0;
+
+  new->columns = calloc(L,SIZEOF_FEC_GROUP);
+  if (new->columns == NULL)
+  {
+    print_err("### Unable to allocate FEC columns\n");
+    free(new);
+    return 1;
+  }
+  for (ii = 0; ii < L; ii++)
+  {
+    err = init_FEC_group(&new->columns[ii],max_payload,&new->column_seq,
+                         FALSE,L,D);
+    if (err)
+    {
+      free_FEC_encoder(&new);
+      return 1;
+    }
+  }
+  if (want_rows)
+  {
+    err = init_FEC_group(&new->row,max_payload,&new->row_seq,TRUE,1,L);
+    if (err)
+    {
+      free_FEC_encoder(&new);
+      return 1;
+    }
+  }
+  *encoder = new;
+  return 0;
+}
+
+/*
+ * Add the next media RTP packet to the FEC generator.
+ *
+ * Packets must be given in the order they are sent, which is assumed to be
+ * sequence number order.
+ *
+ * - `encoder` is the FEC generator
+ * - `packet` is the RTP packet, header and all
+ * - `length` is its length
+ * - `column_fec` is returned as the column FEC packet that this packet
+ *   completed, or NULL if it did not complete one, and `column_length` as
+ *   its length
+ * - `row_fec` and `row_length` are the same for a completed row FEC packet
+ *
+ * Any FEC packets returned remain valid until the next call.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int add_packet_to_FEC(FEC_encoder_p  encoder,
+                             byte          *packet,
+                             int            length,
+                             byte         **column_fec,
+                             int           *column_length,
+                             byte         **row_fec,
+                             int           *row_length)
+{
+  int       header_length;
+  int       payload_length;
+  int       column, row;
+  uint16_t  seq;
+  uint32_t  timestamp;
+  byte      pt;
+
+  *column_fec = *row_fec = NULL;
+  *column_length = *row_length = 0;
+
+  if (length < FEC_RTP_HEADER_SIZE || (packet[0] & 0xC0) != 0x80)
+  {
+    fprint_err("### Cannot generate FEC for packet of length %d:"
+               " not an RTP packet\n",length);
+    return 1;
+  }
+  // Allow for any CSRCs and header extension
+  header_length = FEC_RTP_HEADER_SIZE + 4*(packet[0] & 0x0F);
+  if ((packet[0] & 0x10) && length >= header_length + 4)
+    header_length += 4 + 4*uint_16_be(packet + header_length + 2);
+  payload_length = length - header_length;
+  if (payload_length < 0 || payload_length > encoder->max_payload)
+  {
+    fprint_err("### Cannot generate FEC for RTP packet with payload"
+               " length %d (maximum is %d)\n",payload_length,
+               encoder->max_payload);
+    return 1;
+  }
+
+  pt = packet[1] & 0x7F;
+  seq = uint_16_be(packet + 2);
+  timestamp = uint_32_be(packet + 4);
+
+  column = encoder->index % encoder->L;
+  row = encoder->index / encoder->L;
+
+  add_to_FEC_group(&encoder->columns[column],seq,pt,timestamp,
+                   packet + header_length,payload_length);
+  if (row == encoder->D - 1)
+  {
+    // This packet completes its column. Since the columns complete one
+    // after another across the last row, the column FEC packets are
+    // naturally spread out, rather than coming in a burst
+    *column_length = finish_FEC_group(&encoder->columns[column]);
+    *column_fec = encoder->columns[column].packet;
+    encoder->num_column ++;
+  }
+
+  if (encoder->want_rows)
+  {
+    add_to_FEC_group(&encoder->row,seq,pt,timestamp,
+                     packet + header_length,payload_length);
+    if (column == encoder->L - 1)
+    {
+      *row_length = finish_FEC_group(&encoder->row);
+      *row_fec = encoder->row.packet;
+      encoder->num_row ++;
+    }
+  }
+
+  encoder->num_media ++;
+  encoder->index = (encoder->index + 1) % (encoder->L * encoder->D);
+  return 0;
+}
+
+/*
+ * Parse an FEC matrix size of the form "<L>,<D>" (or "<L>x<D>").
+ *
+ * - `arg` is the string to parse
+ * - `L` and `D` are returned as the number of columns and rows
+ *
+ * Returns 0 if all goes well, 1 if the string is not valid, or does not
+ * describe a matrix allowed by SMPTE 2022-1.
+ */
+extern int parse_FEC_size(char  *arg,
+                          int   *L,
+                          int   *D)
+{
+  char  *ptr;
+  char  *posn;
+  long   val;
+
+  val = strtol(arg,&ptr,10);
+  if (ptr == arg || (*ptr != ',' && *ptr != 'x'))
+  {
+    fprint_err("### FEC matrix size '%s' is not of the form <L>,<D>\n",arg);
+    return 1;
+  }
+  *L = (int)val;
+  posn = ptr + 1;
+  val = strtol(posn,&ptr,10);
+  if (ptr == posn || *ptr != '\0')
+  {
+    fprint_err("### FEC matrix size '%s' is not of the form <L>,<D>\n",arg);
+    return 1;
+  }
+  *D = (int)val;
+
+  if (*L < FEC_MIN_L || *L > FEC_MAX_L || *D < FEC_MIN_D || *D > FEC_MAX_D ||
+      (*L)*(*D) > FEC_MAX_LD)
+  {
+    fprint_err("### FEC matrix %dx%d is not allowed by SMPTE 2022-1"
+               " (L must be %d..%d, D %d..%d, and L*D at most %d)\n",
+               *L,*D,FEC_MIN_L,FEC_MAX_L,FEC_MIN_D,FEC_MAX_D,FEC_MAX_LD);
+    return 1;
+  }
+  return 0;
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,125 @@
+/*
+ * Datastructures for generating SMPTE 2022-1 (Pro-MPEG COP3) forward error
+ * correction for RTP output
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _fec_defns
+#define _fec_defns
+
+#include "compat.h"
+
+// SMPTE 2022-1 arranges the media (RTP) packets, in sequence number order,
+// into a matrix of L columns by D rows:
+//
+//     packet 0      packet 1      ...  packet L-1
+//     packet L      packet L+1    ...  packet 2L-1
+//     ...
+//     packet (D-1)L               ...  packet LD-1
+//
+// A column FEC packet is the XOR of the D packets in a column, and a row
+// FEC packet is the XOR of the L packets in a row. A receiver that has
+// lost a single packet in any column (or row) can thus rebuild it.
+//
+// Column FEC packets are sent to the media port + 2, and row FEC packets
+// (if they are wanted) to the media port + 4.
+//
+// Each FEC packet is an RTP packet (with no CSRCs or extension), followed
+// by the 16 byte FEC header:
+//
+//   2 bytes  SNBase low bits - the sequence number of the first packet
+//   2 bytes  Length recovery - the XOR of the packets' payload lengths
+//   1 byte   E (1 bit, always 1), PT recovery (7 bits)
+//   3 bytes  Mask (always 0)
+//   4 bytes  TS recovery - the XOR of the packets' RTP timestamps
+//   1 byte   X (1 bit, 0), D (1 bit, 0 for columns, 1 for rows),
+//            type (3 bits, 0 for XOR), index (3 bits, 0)
+//   1 byte   Offset - L for columns, 1 for rows
+//   1 byte   NA - the number of packets protected (D or L)
+//   1 byte   SNBase extension bits (always 0)
+//
+// followed by the XOR of the packets' payloads (each padded with zeroes to
+// the length of the longest).
+
+#define FEC_RTP_HEADER_SIZE  12
+#define FEC_HEADER_SIZE      16
+#define FEC_PAYLOAD_TYPE     96  // SMPTE 2022-1 uses a dynamic payload type
+
+// The limits on the matrix size imposed by SMPTE 2022-1
+#define FEC_MIN_L    1
+#define FEC_MAX_L   20
+#define FEC_MIN_D    4
+#define FEC_MAX_D   20
+#define FEC_MAX_LD 100
+
+// The FEC being built up for a single column or row
+struct FEC_group
+{
+  int       count;              // How many media packets are in it so far
+  uint16_t  sn_base;            // The sequence number of the first
+  uint16_t  length_recovery;
+  byte      pt_recovery;
+  uint32_t  ts_recovery;
+  int       max_length;         // The longest payload so far
+  int       dirty_length;       // How much of `packet` might be non-zero
+  uint16_t *seq;                // Where our output sequence number lives
+  byte     *packet;             // The FEC packet itself
+};
+typedef struct FEC_group *FEC_group_p;
+#define SIZEOF_FEC_GROUP sizeof(struct FEC_group)
+
+// An FEC generator
+struct FEC_encoder
+{
+  int       L;                  // Columns in the matrix
+  int       D;                  // Rows in the matrix
+  int       want_rows;          // Generate row FEC as well as column FEC?
+  int       max_payload;        // The largest media payload we can accept
+  int       index;              // Where the next packet goes in the matrix
+
+  uint16_t  column_seq;         // The next sequence number for each
+  uint16_t  row_seq;            // FEC stream
+
+  struct FEC_group  *columns;   // One for each column
+  struct FEC_group   row;       // The current row
+
+  // Statistics
+  uint32_t  num_media;          // Media packets processed
+  uint32_t  num_column;         // Column FEC packets produced
+  uint32_t  num_row;            // Row FEC packets produced
+};
+typedef struct FEC_encoder *FEC_encoder_p;
+#define SIZEOF_FEC_ENCODER sizeof(struct FEC_encoder)
+
+#endif // _fec_defns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
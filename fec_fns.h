@@ -0,0 +1,106 @@
+/*
+ * Functions for generating SMPTE 2022-1 (Pro-MPEG COP3) forward error
+ * correction for RTP output
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _fec_fns
+#define _fec_fns
+
+#include "fec_defns.h"
+
+/*
+ * Build a new SMPTE 2022-1 FEC generator.
+ *
+ * - `L` is the number of columns in the FEC matrix (1..20)
+ * - `D` is the number of rows in the FEC matrix (4..20). L*D may not
+ *   be more than 100.
+ * - if `want_rows` is TRUE, then row FEC packets will be generated as
+ *   well as column FEC packets
+ * - `max_payload` is the largest RTP payload (i.e., packet length less
+ *   RTP header) that will be given to the generator
+ * - `encoder` is the new generator
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_FEC_encoder(int             L,
+                             int             D,
+                             int             want_rows,
+                             int             max_payload,
+                             FEC_encoder_p  *encoder);
+/*
+ * Free an FEC generator.
+ *
+ * Sets `encoder` to NULL.
+ */
+extern void free_FEC_encoder(FEC_encoder_p  *encoder);
+/*
+ * Add the next media RTP packet to the FEC generator.
+ *
+ * Packets must be given in the order they are sent, which is assumed to be
+ * sequence number order.
+ *
+ * - `encoder` is the FEC generator
+ * - `packet` is the RTP packet, header and all
+ * - `length` is its length
+ * - `column_fec` is returned as the column FEC packet that this packet
+ *   completed, or NULL if it did not complete one, and `column_length` as
+ *   its length
+ * - `row_fec` and `row_length` are the same for a completed row FEC packet
+ *
+ * Any FEC packets returned remain valid until the next call.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int add_packet_to_FEC(FEC_encoder_p  encoder,
+                             byte          *packet,
+                             int            length,
+                             byte         **column_fec,
+                             int           *column_length,
+                             byte         **row_fec,
+                             int           *row_length);
+/*
+ * Parse an FEC matrix size of the form "<L>,<D>" (or "<L>x<D>").
+ *
+ * - `arg` is the string to parse
+ * - `L` and `D` are returned as the number of columns and rows
+ *
+ * Returns 0 if all goes well, 1 if the string is not valid, or does not
+ * describe a matrix allowed by SMPTE 2022-1.
+ */
+extern int parse_FEC_size(char  *arg,
+                          int   *L,
+                          int   *D);
+
+#endif // _fec_fns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -46,6 +46,7 @@
 #include "h262_fns.h"
 #include "misc_fns.h"
 #include "printing_fns.h"
+#include "reverse_fns.h"
 #include "filter_fns.h"
 
 #define DEBUG 0
@@ -70,6 +71,7 @@ static int new_h262_filter_context(h262_filter_context_p *fcontext)
   new->h262 = NULL;
   new->last_seq_hdr = NULL;
   new->new_seq_hdr  = FALSE;
+  set_trick_budget(&new->budget,0,0);
 
   reset_h262_filter_context(new);
   
@@ -137,6 +139,26 @@ extern void reset_h262_filter_context(h262_filter_context_p  fcontext)
   fcontext->count = 0;
   fcontext->frames_seen = 0;
   fcontext->frames_written = 0;
+
+  reset_trick_budget(&fcontext->budget);
+  fcontext->last_size = 0;
+  fcontext->skipped_ref_pic = FALSE;
+}
+
+/*
+ * Set (or clear) the target bitrate for filtering H.262 data.
+ *
+ * - `fcontext` is the filter context
+ * - `bitrate` is the target output bitrate, in bits/second, or 0 if
+ *   pictures are to be chosen only by frequency
+ * - `picture_rate` is the number of pictures per second that the output
+ *   is displayed at (0 means the default)
+ */
+extern void set_h262_filter_bitrate(h262_filter_context_p  fcontext,
+                                    uint32_t               bitrate,
+                                    int                    picture_rate)
+{
+  set_trick_budget(&fcontext->budget,bitrate,picture_rate);
 }
 
 /*
@@ -186,6 +208,7 @@ static int new_h264_filter_context(h264_filter_context_p *fcontext)
   // (or, for new->es, things that stop us doing anything until we're
   // setup properly by the user)
   new->access_unit_context = NULL;
+  set_trick_budget(&new->budget,0,0);
 
   reset_h264_filter_context(new);
   
@@ -259,6 +282,25 @@ extern void reset_h264_filter_context(h264_filter_context_p  fcontext)
   fcontext->count = 0;
   fcontext->frames_seen = 0;
   fcontext->frames_written = 0;
+
+  reset_trick_budget(&fcontext->budget);
+  fcontext->last_size = 0;
+}
+
+/*
+ * Set (or clear) the target bitrate for filtering H.264 data.
+ *
+ * - `fcontext` is the filter context
+ * - `bitrate` is the target output bitrate, in bits/second, or 0 if
+ *   access units are to be chosen only by frequency
+ * - `picture_rate` is the number of pictures per second that the output
+ *   is displayed at (0 means the default)
+ */
+extern void set_h264_filter_bitrate(h264_filter_context_p  fcontext,
+                                    uint32_t               bitrate,
+                                    int                    picture_rate)
+{
+  set_trick_budget(&fcontext->budget,bitrate,picture_rate);
 }
 
 /*
@@ -506,35 +548,85 @@ extern int get_next_filtered_h262_frame(h262_filter_context_p  fcontext,
     // Now to filtering
     if (this_picture->is_picture)
     {
+      int       coding_type = this_picture->picture_coding_type;
+      int       adaptive = (fcontext->budget.bitrate != 0);
+      uint32_t  size = 0;
+
       fcontext->count ++;
       (*frames_seen) ++;
 
       fcontext->frames_seen ++;
 
-      if (this_picture->picture_coding_type == 1 &&
-          fcontext->count < fcontext->freq)
+      if (adaptive)
+      {
+        ES_offset  start;
+        (void) get_ES_unit_list_bounds(this_picture->list,&start,&size);
+        trick_budget_advance(&fcontext->budget,1,fcontext->freq);
+      }
+
+      if (coding_type == 1 && fcontext->count < fcontext->freq)
       {
         // It is an I picture, but it is too soon
         if (verbose)
         {
           fprint_msg("+++ %d/%d DROP: Too soon\n",fcontext->count,fcontext->freq);
         }
+        fcontext->skipped_ref_pic = TRUE;
       }
-      else if (this_picture->picture_coding_type != 1)
+      else if (coding_type == 1 &&
+               !trick_budget_allows(&fcontext->budget,size))
+      {
+        // It is an I picture, but we don't have the bandwidth for it
+        // - leave the count alone, so the next I picture is a candidate
+        if (verbose)
+        {
+          fprint_msg("+++ %d/%d DROP: Over budget (%u bytes)\n",
+                     fcontext->count,fcontext->freq,size);
+        }
+        fcontext->skipped_ref_pic = TRUE;
+        fcontext->budget.dropped ++;
+      }
+      else if (adaptive && coding_type == 2 && !fcontext->skipped_ref_pic &&
+               fcontext->had_previous_picture &&
+               fcontext->count >= fcontext->freq &&
+               trick_budget_allows(&fcontext->budget,size))
+      {
+        // It is a P picture, but we've output every reference picture
+        // since the last I picture, and there's room for it, so we can
+        // make the output smoother by keeping it
+        if (verbose)
+        {
+          fprint_msg("+++ %d/%d KEEP: P picture, no skipped reference"
+                     " pictures\n",fcontext->count,fcontext->freq);
+        }
+        fcontext->count = 0;
+        fcontext->last_size = size;
+        trick_budget_spend(&fcontext->budget,size);
+        *seq_hdr = fcontext->last_seq_hdr;
+        *frame = this_picture;
+
+        fcontext->frames_written ++;
+        return 0;
+      }
+      else if (coding_type != 1)
       {
         // It is not an I picture
         if (verbose)
         {
           fprint_msg("+++ %d/%d DROP: %s picture\n",fcontext->count,fcontext->freq,
-                 H262_PICTURE_CODING_STR(this_picture->picture_coding_type));
+                 H262_PICTURE_CODING_STR(coding_type));
         }
+        if (coding_type == 2)
+          fcontext->skipped_ref_pic = TRUE;
         // But do we want to pad with (i.e., repeat) the previous I picture?
         if (fcontext->freq > 0)
         {
           int pictures_wanted = fcontext->frames_seen / fcontext->freq;
           int repeat = pictures_wanted - fcontext->frames_written;
-          if (repeat > 0 && fcontext->had_previous_picture)
+          if (repeat > 0 && fcontext->had_previous_picture &&
+              trick_budget_allows(&fcontext->budget,fcontext->last_size))
           {
+            trick_budget_spend(&fcontext->budget,fcontext->last_size);
             if (verbose) print_msg(">>> output last picture again\n");
             free_h262_picture(&this_picture);
             *seq_hdr = NULL;
@@ -553,6 +645,9 @@ extern int get_next_filtered_h262_frame(h262_filter_context_p  fcontext,
         }
         fcontext->count = 0;
         fcontext->had_previous_picture = TRUE;
+        fcontext->skipped_ref_pic = FALSE;
+        fcontext->last_size = size;
+        trick_budget_spend(&fcontext->budget,size);
         *seq_hdr = fcontext->last_seq_hdr;
         *frame = this_picture;
 
@@ -728,6 +823,7 @@ extern int get_next_filtered_h264_frame(h264_filter_context_p  fcontext,
   int err = 0;
   int keep = FALSE;  // Should we keep the current access unit?
   access_unit_p  this_access_unit = NULL;
+  uint32_t       size = 0;
 
   *frames_seen = 0;
   
@@ -750,6 +846,13 @@ extern int get_next_filtered_h264_frame(h264_filter_context_p  fcontext,
     (*frames_seen) ++;
 
     fcontext->frames_seen ++;
+
+    if (fcontext->budget.bitrate != 0)
+    {
+      ES_offset  start;
+      (void) get_access_unit_bounds(this_access_unit,&start,&size);
+      trick_budget_advance(&fcontext->budget,1,fcontext->freq);
+    }
     
     if (this_access_unit->primary_start == NULL)
     {
@@ -768,6 +871,19 @@ extern int get_next_filtered_h264_frame(h264_filter_context_p  fcontext,
         fprint_msg("++ %d/%d DROP: not a reference frame\n",
                    fcontext->count,fcontext->freq);
     }
+    else if ((this_access_unit->primary_start->nal_unit_type == NAL_IDR ||
+              fcontext->count >= fcontext->freq) &&
+             !trick_budget_allows(&fcontext->budget,size))
+    {
+      // We'd otherwise consider it, but we don't have the bandwidth for
+      // it - and since it's a reference frame, notice that we've skipped it
+      keep = FALSE;
+      fcontext->skipped_ref_pic = TRUE;
+      fcontext->budget.dropped ++;
+      if (verbose)
+        fprint_msg("++ %d/%d DROP: Over budget (%u bytes)\n",
+                   fcontext->count,fcontext->freq,size);
+    }
     else if (this_access_unit->primary_start->nal_unit_type == NAL_IDR &&
              fcontext->last_accepted_was_not_IDR)
     {
@@ -851,6 +967,8 @@ extern int get_next_filtered_h264_frame(h264_filter_context_p  fcontext,
       fcontext->had_previous_access_unit = TRUE;
       fcontext->frames_written ++;
       fcontext->count = 0;
+      fcontext->last_size = size;
+      trick_budget_spend(&fcontext->budget,size);
       return 0;
     }
     else
@@ -859,9 +977,11 @@ extern int get_next_filtered_h264_frame(h264_filter_context_p  fcontext,
       {
         int access_units_wanted = fcontext->frames_seen / fcontext->freq;
         int repeat = access_units_wanted - fcontext->frames_written;
-        if (repeat > 0 && fcontext->had_previous_access_unit)
+        if (repeat > 0 && fcontext->had_previous_access_unit &&
+            trick_budget_allows(&fcontext->budget,fcontext->last_size))
         {
           if (verbose) print_msg(">>> output last access unit again\n");
+          trick_budget_spend(&fcontext->budget,fcontext->last_size);
           free_access_unit(&this_access_unit);
           *frame = NULL;
           fcontext->frames_written ++;
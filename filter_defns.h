@@ -45,6 +45,12 @@
 //   so, for instance, a frequency of 8 would mean trying to keep every 8th
 //   frame, or a speedup of 8x. This is harder to do as it depends rather
 //   crucially on the distribution of reference frames in the data.
+//
+// When filtering, a target output bitrate may also be set (see the
+// `trick_budget` in reverse_defns.h). Pictures are then also chosen by
+// their size, so that the output stays within that bitrate (large pictures
+// being dropped, and the last picture repeated instead), and, if there is
+// bandwidth to spare, P pictures may be kept as well as I pictures.
 
 // ------------------------------------------------------------
 struct h262_filter_context
@@ -70,6 +76,11 @@ struct h262_filter_context
 
   int   frames_seen;    // number of pictures seen this filter run
   int   frames_written; // number of pictures written (or, returned)
+
+  // When filtering to a target bitrate, we also want:
+  struct trick_budget  budget;
+  uint32_t  last_size;       // size of the last picture returned
+  int       skipped_ref_pic; // skipped an I or P picture since the last I?
 };
 typedef struct h262_filter_context *h262_filter_context_p;
 #define SIZEOF_H262_FILTER_CONTEXT sizeof(struct h262_filter_context)
@@ -99,6 +110,10 @@ struct h264_filter_context
 
   int  frames_seen;    // number seen this filter run
   int  frames_written; // number written (or, returned)
+
+  // When filtering to a target bitrate, we also want:
+  struct trick_budget  budget;
+  uint32_t  last_size;  // size of the last access unit returned
 };
 typedef struct h264_filter_context *h264_filter_context_p;
 #define SIZEOF_H264_FILTER_CONTEXT sizeof(struct h264_filter_context)
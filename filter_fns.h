@@ -60,6 +60,18 @@ extern int build_h262_filter_context(h262_filter_context_p *fcontext,
  * Reset an H.262 filter context, ready to start filtering anew.
  */
 extern void reset_h262_filter_context(h262_filter_context_p  fcontext);
+/*
+ * Set (or clear) the target bitrate for filtering H.262 data.
+ *
+ * - `fcontext` is the filter context
+ * - `bitrate` is the target output bitrate, in bits/second, or 0 if
+ *   pictures are to be chosen only by frequency
+ * - `picture_rate` is the number of pictures per second that the output
+ *   is displayed at (0 means the default)
+ */
+extern void set_h262_filter_bitrate(h262_filter_context_p  fcontext,
+                                    uint32_t               bitrate,
+                                    int                    picture_rate);
 /*
  * Free a filter context
  *
@@ -100,6 +112,18 @@ extern int build_h264_filter_context(h264_filter_context_p *fcontext,
  * Reset an H.264 filter context, ready to start filtering anew.
  */
 extern void reset_h264_filter_context(h264_filter_context_p  fcontext);
+/*
+ * Set (or clear) the target bitrate for filtering H.264 data.
+ *
+ * - `fcontext` is the filter context
+ * - `bitrate` is the target output bitrate, in bits/second, or 0 if
+ *   access units are to be chosen only by frequency
+ * - `picture_rate` is the number of pictures per second that the output
+ *   is displayed at (0 means the default)
+ */
+extern void set_h264_filter_bitrate(h264_filter_context_p  fcontext,
+                                    uint32_t               bitrate,
+                                    int                    picture_rate);
 /*
  * Free an H.264 filter context
  *
@@ -0,0 +1,580 @@
+/*
+ * Support for reading compressed input files
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "compat.h"
+#include "misc_fns.h"
+#include "printing_fns.h"
+#include "gzinput_fns.h"
+
+// The number of bytes in a gzip member's trailer (CRC32 and length)
+#define GZIP_TRAILER_LEN  8
+
+/*
+ * Is the named file a gzip compressed file (i.e., does it start with
+ * the gzip magic number)?
+ *
+ * Returns TRUE if it is, FALSE if it is not, or if it cannot be read
+ * (including if `filename` is NULL).
+ */
+extern int is_gzip_file(char  *filename)
+{
+  int   file;
+  int   length;
+  byte  magic[2];
+#ifdef _WIN32
+  int   flags = O_RDONLY | O_BINARY;
+#else
+  int   flags = O_RDONLY;
+#endif
+
+  if (filename == NULL)
+    return FALSE;
+
+  // Any problems opening the file are left for the caller to report
+  file = open(filename,flags);
+  if (file == -1)
+    return FALSE;
+  length = read(file,magic,2);
+  (void) close_file(file);
+  return (length == 2 && magic[0] == GZIP_MAGIC_0 && magic[1] == GZIP_MAGIC_1);
+}
+
+#ifdef HAVE_ZLIB
+
+static void free_gzinput(gzinput_p  *gz)
+{
+  int  ii;
+  if (*gz == NULL)
+    return;
+  if ((*gz)->file != -1)
+    (void) close_file((*gz)->file);
+  if ((*gz)->stream != NULL)
+  {
+    (void) inflateEnd((*gz)->stream);
+    free((*gz)->stream);
+  }
+  if ((*gz)->points != NULL)
+  {
+    for (ii = 0; ii < (*gz)->num_points; ii++)
+      free((*gz)->points[ii]);
+    free((*gz)->points);
+  }
+  if ((*gz)->name != NULL)
+    free((*gz)->name);
+  free(*gz);
+  *gz = NULL;
+}
+
+/*
+ * Read some more compressed data, if we've used up what we had
+ *
+ * Returns the number of bytes now available, 0 at the end of the file,
+ * or -1 if something went wrong.
+ */
+static int fill_gzinput(gzinput_p  gz)
+{
+  z_streamp  strm = gz->stream;
+#ifdef _WIN32
+  int      length;
+#else
+  ssize_t  length;
+#endif
+
+  if (strm->avail_in > 0)
+    return strm->avail_in;
+
+  length = read(gz->file,gz->in,GZINPUT_CHUNK_SIZE);
+  if (length == -1)
+  {
+    fprint_err("### Error reading from compressed file %s: %s\n",
+               gz->name,strerror(errno));
+    return -1;
+  }
+  strm->next_in = gz->in;
+  strm->avail_in = (uInt)length;
+  gz->in_posn += length;
+  return (int)length;
+}
+
+/*
+ * Remember an access point at the current position
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int add_gzinput_point(gzinput_p  gz)
+{
+  z_streamp        strm = gz->stream;
+  gzinput_point_p  point;
+  int  start = (int)(gz->out_posn % GZINPUT_WINDOW_SIZE);
+
+  if (gz->num_points == gz->points_size)
+  {
+    int new_size = (gz->points_size == 0 ? 16 : gz->points_size * 2);
+    gzinput_point_p *new_points =
+      realloc(gz->points,new_size*sizeof(gzinput_point_p));
+    if (new_points == NULL)
+    {
+      print_err("### Unable to extend compressed file access point table\n");
+      return 1;
+    }
+    gz->points = new_points;
+    gz->points_size = new_size;
+  }
+
+  point = malloc(SIZEOF_GZINPUT_POINT);
+  if (point == NULL)
+  {
+    print_err("### Unable to allocate compressed file access point\n");
+    return 1;
+  }
+  point->out = gz->out_posn;
+  point->in = gz->in_posn - strm->avail_in;
+  point->bits = strm->data_type & 7;
+  // The window is circular, with its oldest byte at `start`
+  memcpy(point->window,gz->window+start,GZINPUT_WINDOW_SIZE-start);
+  memcpy(point->window+GZINPUT_WINDOW_SIZE-start,gz->window,start);
+
+  gz->points[gz->num_points++] = point;
+  return 0;
+}
+
+/*
+ * Decompress some more data into our window, starting at `out_posn`
+ *
+ * At most enough data is decompressed to reach the end of the window
+ * buffer (so at most GZINPUT_WINDOW_SIZE bytes).
+ *
+ * Returns the number of bytes decompressed, 0 if there is no more data,
+ * or -1 if something went wrong.
+ */
+static int inflate_gzinput(gzinput_p  gz)
+{
+  z_streamp  strm = gz->stream;
+  int        start = (int)(gz->out_posn % GZINPUT_WINDOW_SIZE);
+  offset_t   was = gz->out_posn;
+
+  if (gz->at_eof)
+    return 0;
+
+  strm->next_out = gz->window + start;
+  strm->avail_out = GZINPUT_WINDOW_SIZE - start;
+  while (strm->avail_out > 0)
+  {
+    int    ret;
+    uInt   before;
+    int    length = fill_gzinput(gz);
+    if (length == -1)
+      return -1;
+    else if (length == 0)
+    {
+      if (!gz->between_members)
+        fprint_err("!!! Compressed file %s is truncated\n",gz->name);
+      gz->at_eof = TRUE;
+      break;
+    }
+
+    if (gz->skip > 0)
+    {
+      // Skip (what's left of) the trailer of the last gzip member
+      uInt count = (strm->avail_in < (uInt)gz->skip ?
+                    strm->avail_in : (uInt)gz->skip);
+      strm->next_in += count;
+      strm->avail_in -= count;
+      gz->skip -= count;
+      continue;
+    }
+
+    before = strm->avail_out;
+    ret = inflate(strm,Z_BLOCK);
+    gz->out_posn += before - strm->avail_out;
+    if (before != strm->avail_out)
+      gz->between_members = FALSE;
+
+    if (ret == Z_DATA_ERROR && gz->between_members)
+    {
+      // Something other than another gzip member follows the last
+      fprint_err("!!! Ignoring trailing data after the compressed data"
+                 " in %s\n",gz->name);
+      gz->at_eof = TRUE;
+      break;
+    }
+    else if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR ||
+             ret == Z_STREAM_ERROR || ret == Z_MEM_ERROR)
+    {
+      fprint_err("### Error decompressing %s at offset " OFFSET_T_FORMAT
+                 ": %s\n",gz->name,gz->in_posn - strm->avail_in,
+                 (strm->msg?strm->msg:"unknown error"));
+      return -1;
+    }
+    else if (ret == Z_STREAM_END)
+    {
+      // The end of a gzip member - there may be another after it.
+      // If we were decompressing raw deflate data (after seeking to an
+      // access point), we also need to skip the member's trailer.
+      if (gz->raw)
+        gz->skip = GZIP_TRAILER_LEN;
+      if (inflateReset2(strm,15+16) != Z_OK)
+      {
+        print_err("### Error resetting decompression state\n");
+        return -1;
+      }
+      gz->raw = FALSE;
+      gz->between_members = TRUE;
+      continue;
+    }
+
+    // At the end of a block header (and not the last block), we can
+    // remember where we are, so we can restart here
+    if ((strm->data_type & 128) && !(strm->data_type & 64) &&
+        gz->out_posn >= GZINPUT_WINDOW_SIZE &&
+        gz->out_posn >= (gz->num_points == 0 ? GZINPUT_SPAN :
+                         gz->points[gz->num_points-1]->out + GZINPUT_SPAN))
+    {
+      if (add_gzinput_point(gz))
+        return -1;
+    }
+  }
+  return (int)(gz->out_posn - was);
+}
+
+/*
+ * Restart decompression at the given access point, or at the start of
+ * the file if `point` is NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int restart_gzinput(gzinput_p        gz,
+                           gzinput_point_p  point)
+{
+  z_streamp  strm = gz->stream;
+  int        start;
+  offset_t   in = (point == NULL ? 0 : point->in - (point->bits ? 1 : 0));
+
+  if (seek_file(gz->file,in))
+    return 1;
+  gz->in_posn = in;
+  strm->avail_in = 0;
+  gz->at_eof = FALSE;
+  gz->skip = 0;
+  gz->between_members = FALSE;
+
+  if (point == NULL)
+  {
+    if (inflateReset2(strm,15+16) != Z_OK)
+    {
+      print_err("### Error resetting decompression state\n");
+      return 1;
+    }
+    gz->raw = FALSE;
+    gz->out_posn = 0;
+    return 0;
+  }
+
+  if (inflateReset2(strm,-15) != Z_OK)
+  {
+    print_err("### Error resetting decompression state\n");
+    return 1;
+  }
+  gz->raw = TRUE;
+  if (point->bits)
+  {
+    int  length = fill_gzinput(gz);
+    if (length <= 0)
+    {
+      if (length == 0)
+        fprint_err("### Compressed file %s is shorter than expected\n",
+                   gz->name);
+      return 1;
+    }
+    (void) inflatePrime(strm,point->bits,
+                        strm->next_in[0] >> (8 - point->bits));
+    strm->next_in ++;
+    strm->avail_in --;
+  }
+  (void) inflateSetDictionary(strm,point->window,GZINPUT_WINDOW_SIZE);
+
+  // And our own copy of the window is circular
+  gz->out_posn = point->out;
+  start = (int)(gz->out_posn % GZINPUT_WINDOW_SIZE);
+  memcpy(gz->window+start,point->window,GZINPUT_WINDOW_SIZE-start);
+  memcpy(gz->window,point->window+GZINPUT_WINDOW_SIZE-start,start);
+  return 0;
+}
+
+/*
+ * Open a compressed file for reading.
+ *
+ * - `filename` is the file to read
+ * - `gz` is the new reader context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_gzinput(char       *filename,
+                        gzinput_p  *gz)
+{
+  gzinput_p  new;
+  z_streamp  strm;
+
+  new = malloc(SIZEOF_GZINPUT);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate compressed file datastructure\n");
+    return 1;
+  }
+  memset(new,0,SIZEOF_GZINPUT);
+  new->file = -1;
+
+  new->name = strdup(filename);
+  strm = new->stream = malloc(sizeof(z_stream));
+  if (new->name == NULL || strm == NULL)
+  {
+    print_err("### Unable to allocate compressed file datastructure\n");
+    free_gzinput(&new);
+    return 1;
+  }
+  memset(strm,0,sizeof(z_stream));
+  if (inflateInit2(strm,15+16) != Z_OK)   // 15+16 means gzip
+  {
+    fprint_err("### Unable to start decompressing %s: %s\n",filename,
+               (strm->msg?strm->msg:"unknown error"));
+    free(strm);
+    new->stream = NULL;
+    free_gzinput(&new);
+    return 1;
+  }
+
+  new->file = open_binary_file(filename,FALSE);
+  if (new->file == -1)
+  {
+    free_gzinput(&new);
+    return 1;
+  }
+  *gz = new;
+  return 0;
+}
+
+/*
+ * Close a compressed file, and free its context.
+ *
+ * Sets `gz` to NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (in which case
+ * the context will still have been freed).
+ */
+extern int close_gzinput(gzinput_p  *gz)
+{
+  int  err = 0;
+  if (*gz == NULL)
+    return 0;
+  if ((*gz)->file != -1)
+  {
+    err = close_file((*gz)->file);
+    (*gz)->file = -1;
+  }
+  free_gzinput(gz);
+  return err;
+}
+
+/*
+ * Read (uncompressed) bytes from a compressed file, in the manner of read().
+ *
+ * This is suitable for use as the `read_fn` of a TS, PS or ES reader,
+ * with the compressed file context as the `handle`.
+ *
+ * Returns the number of bytes read, 0 at the end of the data, or -1
+ * if something went wrong.
+ */
+extern int read_gzinput(void    *handle,
+                        byte    *data,
+                        size_t   num_bytes)
+{
+  gzinput_p  gz = handle;
+  int        start, count;
+  offset_t   available;
+
+  if (gz->posn == gz->out_posn)
+  {
+    int  length = inflate_gzinput(gz);
+    if (length <= 0)
+      return length;
+  }
+
+  available = gz->out_posn - gz->posn;
+  if ((offset_t)num_bytes > available)
+    num_bytes = (size_t)available;
+
+  // The data we want may wrap around the end of the window
+  start = (int)(gz->posn % GZINPUT_WINDOW_SIZE);
+  count = GZINPUT_WINDOW_SIZE - start;
+  if ((size_t)count > num_bytes)
+    count = (int)num_bytes;
+  memcpy(data,gz->window+start,count);
+  if ((size_t)count < num_bytes)
+    memcpy(data+count,gz->window,num_bytes-count);
+  gz->posn += num_bytes;
+  return (int)num_bytes;
+}
+
+/*
+ * Seek to a position in the (uncompressed) data of a compressed file.
+ *
+ * This is suitable for use as the `seek_fn` of a TS, PS or ES reader,
+ * with the compressed file context as the `handle`.
+ *
+ * Seeking back to data that has already been read restarts decompression
+ * at the nearest access point before it, and seeking forward decompresses
+ * (and discards) the data in between.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int seek_gzinput(void      *handle,
+                        offset_t   posn)
+{
+  gzinput_p  gz = handle;
+  gzinput_point_p  point = NULL;
+  int  lo, hi;
+
+  if (posn < 0)
+  {
+    fprint_err("### Cannot seek to position " OFFSET_T_FORMAT
+               " in compressed file %s\n",posn,gz->name);
+    return 1;
+  }
+
+  // Is it still in our window?
+  if (posn <= gz->out_posn && posn >= gz->out_posn - GZINPUT_WINDOW_SIZE)
+  {
+    gz->posn = posn;
+    return 0;
+  }
+
+  // Find the last access point at or before `posn`, if any
+  lo = 0;
+  hi = gz->num_points - 1;
+  while (lo <= hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (gz->points[mid]->out <= posn)
+    {
+      point = gz->points[mid];
+      lo = mid + 1;
+    }
+    else
+      hi = mid - 1;
+  }
+
+  // Going backwards, we have to restart. Going forwards, we only need to
+  // if there's an access point we can skip to.
+  if (posn < gz->out_posn || (point != NULL && point->out > gz->out_posn))
+  {
+    if (restart_gzinput(gz,point))
+      return 1;
+  }
+
+  while (gz->out_posn < posn)
+  {
+    int  length = inflate_gzinput(gz);
+    if (length == -1)
+      return 1;
+    else if (length == 0)
+    {
+      fprint_err("### Cannot seek to position " OFFSET_T_FORMAT
+                 " in compressed file %s, which only has " OFFSET_T_FORMAT
+                 " bytes of data\n",posn,gz->name,gz->out_posn);
+      return 1;
+    }
+  }
+  gz->posn = posn;
+  return 0;
+}
+
+#else // HAVE_ZLIB
+
+extern int open_gzinput(char       *filename,
+                        gzinput_p  *gz)
+{
+  fprint_err("### Cannot read compressed file %s - support for reading"
+             " compressed files was not built in\n",filename);
+  return 1;
+}
+
+extern int close_gzinput(gzinput_p  *gz)
+{
+  return 0;
+}
+
+extern int read_gzinput(void    *handle,
+                        byte    *data,
+                        size_t   num_bytes)
+{
+  return -1;
+}
+
+extern int seek_gzinput(void      *handle,
+                        offset_t   posn)
+{
+  return 1;
+}
+
+#endif // HAVE_ZLIB
+
+/*
+ * Close a compressed file given as a (reader's) handle.
+ *
+ * This is suitable for use as the `close_fn` of a TS, PS or ES reader.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int close_gzinput_handle(void  *handle)
+{
+  gzinput_p  gz = handle;
+  return close_gzinput(&gz);
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
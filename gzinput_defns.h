@@ -0,0 +1,106 @@
+/*
+ * Datastructures for reading compressed input files
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _gzinput_defns
+#define _gzinput_defns
+
+#include "compat.h"
+
+// A compressed input file is read as if it were the (uncompressed) data it
+// contains. At the moment, only gzip (and zlib) compression is understood.
+//
+// Since a deflate stream can only be decompressed from its start, seeking
+// uses a table of "access points", which is built as the data is read. Each
+// remembers where a deflate block starts, in both the compressed and
+// uncompressed data, together with the 32K "window" of uncompressed data
+// that precedes it, which is all that is needed to restart decompression
+// there.
+
+// The magic number at the start of a gzip file
+#define GZIP_MAGIC_0  0x1F
+#define GZIP_MAGIC_1  0x8B
+
+// The size of a deflate window, and thus of the data we keep for each
+// access point
+#define GZINPUT_WINDOW_SIZE  32768
+
+// How much compressed data we read at a time
+#define GZINPUT_CHUNK_SIZE   65536
+
+// How far apart (in uncompressed data) we try to make access points. Each
+// costs GZINPUT_WINDOW_SIZE bytes of memory, so this gives a table of about
+// 4MB per GB of uncompressed data.
+#define GZINPUT_SPAN         (8*1024*1024)
+
+struct gzinput_point
+{
+  offset_t  out;        // Offset in the uncompressed data
+  offset_t  in;         // Offset of the first whole byte in the compressed data
+  int       bits;       // Number of bits (1-7) from the byte before, or 0
+  byte      window[GZINPUT_WINDOW_SIZE];  // The uncompressed data before it
+};
+typedef struct gzinput_point *gzinput_point_p;
+#define SIZEOF_GZINPUT_POINT sizeof(struct gzinput_point)
+
+// The zlib stream state is kept opaque, so that users of this header
+// don't need zlib.h
+struct gzinput
+{
+  char     *name;
+  int       file;
+  void     *stream;           // The (zlib) decompression state
+  int       raw;              // Is it decompressing raw deflate data?
+  int       at_eof;           // Have we reached the end of the data?
+  int       between_members;  // Have we just finished a gzip member?
+  int       skip;             // Bytes of gzip member trailer still to skip
+
+  byte      in[GZINPUT_CHUNK_SIZE];  // Compressed data read from the file
+  offset_t  in_posn;          // The offset in the file of the end of `in`
+
+  // The most recent uncompressed data. Byte N of the uncompressed data
+  // is at `window[N % GZINPUT_WINDOW_SIZE]`, while it is still available
+  byte      window[GZINPUT_WINDOW_SIZE];
+  offset_t  out_posn;         // How much data we've decompressed
+  offset_t  posn;             // The position of the next byte to be read
+
+  gzinput_point_p *points;    // Our access points, in order
+  int       num_points;
+  int       points_size;
+};
+typedef struct gzinput *gzinput_p;
+#define SIZEOF_GZINPUT sizeof(struct gzinput)
+
+#endif // _gzinput_defns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
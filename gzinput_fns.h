@@ -0,0 +1,103 @@
+/*
+ * Prototypes for reading compressed input files
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef _gzinput_fns
+#define _gzinput_fns
+
+#include "gzinput_defns.h"
+
+/*
+ * Is the named file a gzip compressed file (i.e., does it start with
+ * the gzip magic number)?
+ *
+ * Returns TRUE if it is, FALSE if it is not, or if it cannot be read
+ * (including if `filename` is NULL).
+ */
+extern int is_gzip_file(char  *filename);
+/*
+ * Open a compressed file for reading.
+ *
+ * - `filename` is the file to read
+ * - `gz` is the new reader context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_gzinput(char       *filename,
+                        gzinput_p  *gz);
+/*
+ * Close a compressed file, and free its context.
+ *
+ * Sets `gz` to NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (in which case
+ * the context will still have been freed).
+ */
+extern int close_gzinput(gzinput_p  *gz);
+/*
+ * Read (uncompressed) bytes from a compressed file, in the manner of read().
+ *
+ * This is suitable for use as the `read_fn` of a TS, PS or ES reader,
+ * with the compressed file context as the `handle`.
+ *
+ * Returns the number of bytes read, 0 at the end of the data, or -1
+ * if something went wrong.
+ */
+extern int read_gzinput(void    *handle,
+                        byte    *data,
+                        size_t   num_bytes);
+/*
+ * Seek to a position in the (uncompressed) data of a compressed file.
+ *
+ * This is suitable for use as the `seek_fn` of a TS, PS or ES reader,
+ * with the compressed file context as the `handle`.
+ *
+ * Seeking back to data that has already been read restarts decompression
+ * at the nearest access point before it, and seeking forward decompresses
+ * (and discards) the data in between.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int seek_gzinput(void      *handle,
+                        offset_t   posn);
+/*
+ * Close a compressed file given as a (reader's) handle.
+ *
+ * This is suitable for use as the `close_fn` of a TS, PS or ES reader.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int close_gzinput_handle(void  *handle);
+
+#endif // _gzinput_fns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
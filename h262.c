@@ -329,10 +329,22 @@ static int append_to_h262_picture(h262_picture_p  picture,
     if (extension_start_code_id == 1)  // sequence extension
     {
       picture->progressive_sequence = data[5] & 0x08;
+      if (unit->data_len >= 10)
+      {
+        picture->bit_rate |= (((data[6] & 0x1F) << 7) | (data[7] >> 1)) << 18;
+        picture->vbv_buffer_size |= data[8] << 10;
+        picture->frame_rate_extension_n = (data[9] & 0x60) >> 5;
+        picture->frame_rate_extension_d = data[9] & 0x1F;
+      }
     }
     else if (extension_start_code_id == 8) // picture coding extension
     {
       picture->picture_structure = data[6] & 0x03;
+      if (unit->data_len >= 8)
+      {
+        picture->top_field_first = (data[7] & 0x80) >> 7;
+        picture->repeat_first_field = (data[7] & 0x02) >> 1;
+      }
     }
   }
   return append_to_ES_unit_list(picture->list,unit);
@@ -381,6 +393,12 @@ static int build_h262_picture(h262_context_p   context,
     new->afd = context->last_afd;
     new->aspect_ratio_info = context->last_aspect_ratio_info;
     new->is_real_afd = FALSE;
+    new->vbv_delay = 0xFFFF;
+    if (unit->data_len >= 8)
+      new->vbv_delay = ((data[5] & 0x07) << 13) | (data[6] << 5) |
+        ((data[7] & 0xF8) >> 3);
+    new->top_field_first = 0;
+    new->repeat_first_field = 0;
   }
   else if (is_h262_seq_header_item(item))
   {
@@ -391,6 +409,16 @@ static int build_h262_picture(h262_context_p   context,
     // Assume that we are only allowed progressive frames, until we're told
     // otherwise (MPEG-1 data will never tell us otherwise)
     new->progressive_sequence = 1;
+    new->bit_rate = 0;
+    new->vbv_buffer_size = 0;
+    new->frame_rate_code = data[7] & 0x0F;
+    new->frame_rate_extension_n = 0;
+    new->frame_rate_extension_d = 0;
+    if (unit->data_len >= 12)
+    {
+      new->bit_rate = (data[8] << 10) | (data[9] << 2) | ((data[10] & 0xC0) >> 6);
+      new->vbv_buffer_size = ((data[10] & 0x1F) << 5) | ((data[11] & 0xF8) >> 3);
+    }
   }
   else if (is_h262_seq_end_item(item))
   {
@@ -518,6 +546,45 @@ extern void free_h262_picture(h262_picture_p *picture)
   return;
 }
 
+/*
+ * Make a copy of an H.262 "picture", including (copies of) its ES units.
+ *
+ * Returns 0 if it succeeds, 1 if some error occurs.
+ */
+extern int copy_h262_picture(h262_picture_p   picture,
+                             h262_picture_p  *copy)
+{
+  int  ii;
+  int  err;
+  h262_picture_p  new = malloc(SIZEOF_H262_PICTURE);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate H.262 picture datastructure\n");
+    return 1;
+  }
+  *new = *picture;
+
+  err = build_ES_unit_list(&(new->list));
+  if (err)
+  {
+    print_err("### Unable to allocate internal list for H.262 picture\n");
+    free(new);
+    return 1;
+  }
+  for (ii = 0; ii < picture->list->length; ii++)
+  {
+    err = append_to_ES_unit_list(new->list,&picture->list->array[ii]);
+    if (err)
+    {
+      print_err("### Error copying H.262 picture\n");
+      free_h262_picture(&new);
+      return 1;
+    }
+  }
+  *copy = new;
+  return 0;
+}
+
 /*
  * Compare two H.262 pictures. The comparison does not include the start
  * position of the picture, but just the actual data - i.e., two pictures
@@ -573,6 +640,7 @@ static int maybe_remember_this_picture(h262_context_p  h262,
         print_err("### Error remembering reversing data for H.262 item\n");
         return 1;
       }
+      cache_reverse_h262_picture(h262->reverse_data,this_picture);
       if (verbose)
         fprint_msg("REMEMBER I picture %5d at " OFFSET_T_FORMAT_08
                    "/%04d for %5d\n",h262->picture_index,
@@ -597,6 +665,7 @@ static int maybe_remember_this_picture(h262_context_p  h262,
       print_err("### Error remembering reversing data for H.262 item\n");
       return 1;
     }
+    cache_reverse_h262_picture(h262->reverse_data,this_picture);
     if (verbose)
       fprint_msg("REMEMBER Sequence header at " OFFSET_T_FORMAT_08
                  "/%04d for %5d\n",
@@ -76,6 +76,9 @@ struct _h262_picture
                                   // (NB: with 0xF0 bits set at top of byte)
   byte      is_real_afd;          // was it a *real* AFD?
   int       was_two_fields;  // TRUE if it's a frame merged from two fields
+  uint16_t  vbv_delay;            // in 90KHz ticks, 0xFFFF if not given
+  byte      top_field_first;      // from the picture coding extension
+  byte      repeat_first_field;   // ditto
 
   // Data defined for a sequence header/extension
   // Note that H.262 requires that data given in one sequence extension
@@ -83,6 +86,12 @@ struct _h262_picture
   // particular, we know that if fields are allowed by one sequence
   // extension, they will be allowed by all.
   byte      progressive_sequence;  // frames or frames and fields allowed?
+  // The following include any extension bits from the sequence extension
+  uint32_t  bit_rate;              // in units of 400 bits/second
+  uint32_t  vbv_buffer_size;       // in units of 16*1024 bits
+  byte      frame_rate_code;       // index into the frame rate table
+  byte      frame_rate_extension_n;
+  byte      frame_rate_extension_d;
 
   // Data defined for both
   // (in a frame, this is the value from the previous section header)
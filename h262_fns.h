@@ -123,6 +123,13 @@ extern int rewind_h262_context(h262_context_p  context);
  * Does nothing if `picture` is already NULL.
  */
 extern void free_h262_picture(h262_picture_p *picture);
+/*
+ * Make a copy of an H.262 "picture", including (copies of) its ES units.
+ *
+ * Returns 0 if it succeeds, 1 if some error occurs.
+ */
+extern int copy_h262_picture(h262_picture_p   picture,
+                             h262_picture_p  *copy);
 /*
  * Compare two H.262 pictures. The comparison does not include the start
  * position of the picture, but just the actual data - i.e., two pictures
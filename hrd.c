@@ -0,0 +1,320 @@
+/*
+ * Check a video stream against its VBV (H.262) or CPB (H.264) buffer
+ * model, in a single pass over the picture sizes
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compat.h"
+#include "printing_fns.h"
+#include "hrd_fns.h"
+
+/*
+ * Build a new buffer model.
+ *
+ * - `name` is "VBV" or "CPB" (or similar), for use in messages
+ * - `bit_rate` is the rate at which bits enter the buffer, in bits/second
+ * - `buffer_size` is the size of the buffer, in bits
+ * - if `is_cbr` is TRUE, use the constant bit rate model, otherwise
+ *   bits stop arriving when the buffer is full
+ * - `initial_delay` is the time (in seconds) from the first bit arriving
+ *   to the first picture being removed
+ * - if `quiet` is TRUE, individual violations will not be reported
+ * - `model` is the new model
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_hrd_model(char         *name,
+                           double        bit_rate,
+                           double        buffer_size,
+                           int           is_cbr,
+                           double        initial_delay,
+                           int           quiet,
+                           hrd_model_p  *model)
+{
+  hrd_model_p  new;
+
+  if (bit_rate <= 0 || buffer_size <= 0)
+  {
+    fprint_err("### Cannot model a %s with bit rate %.0f and size %.0f\n",
+               name,bit_rate,buffer_size);
+    return 1;
+  }
+
+  new = malloc(SIZEOF_HRD_MODEL);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate buffer model datastructure\n");
+    return 1;
+  }
+  new->pending = malloc(HRD_PENDING_START_SIZE * sizeof(struct hrd_pending));
+  if (new->pending == NULL)
+  {
+    print_err("### Unable to allocate buffer model queue\n");
+    free(new);
+    return 1;
+  }
+  new->pending_size = HRD_PENDING_START_SIZE;
+  new->pending_start = 0;
+  new->pending_count = 0;
+
+  new->name = name;
+  new->bit_rate = bit_rate;
+  new->buffer_size = buffer_size;
+  new->is_cbr = is_cbr;
+  new->initial_delay = initial_delay;
+  new->quiet = quiet;
+
+  new->time = initial_delay;
+  new->total_bits = 0;
+  new->fullness = 0;
+  new->num_pictures = 0;
+
+  new->max_fullness = 0;
+  new->min_fullness = buffer_size;
+  new->num_underflows = 0;
+  new->num_overflows = 0;
+  new->first_underflow = 0;
+  new->first_overflow = 0;
+
+  *model = new;
+  return 0;
+}
+
+/*
+ * Free a buffer model.
+ *
+ * Sets `model` to NULL.
+ */
+extern void free_hrd_model(hrd_model_p  *model)
+{
+  if (*model == NULL)
+    return;
+  free((*model)->pending);
+  free(*model);
+  *model = NULL;
+}
+
+/*
+ * Record the fullness of the buffer just before picture `index` (of
+ * `size` bits) is removed.
+ */
+static void check_fullness(hrd_model_p  model,
+                           uint32_t     index,
+                           double       fullness,
+                           double       size)
+{
+  double  after = fullness - size;
+
+  if (fullness > model->max_fullness)
+    model->max_fullness = fullness;
+  if (after < model->min_fullness)
+    model->min_fullness = after;
+
+  if (after < 0)
+  {
+    model->num_underflows ++;
+    if (model->first_underflow == 0)
+      model->first_underflow = index;
+    if (!model->quiet)
+      fprint_msg("!!! %s underflow at picture %u: only %.0f of its %.0f bits"
+                 " have arrived\n",model->name,index,
+                 (fullness < 0 ? 0 : fullness),size);
+  }
+  if (fullness > model->buffer_size)
+  {
+    model->num_overflows ++;
+    if (model->first_overflow == 0)
+      model->first_overflow = index;
+    if (!model->quiet)
+      fprint_msg("!!! %s overflow at picture %u: %.0f bits in a buffer of"
+                 " %.0f\n",model->name,index,fullness,model->buffer_size);
+  }
+}
+
+/*
+ * Decide on any queued pictures whose fullness is now known, i.e., those
+ * for which all the bits that could have arrived by their removal time
+ * are now accounted for. If `at_end` is TRUE, then there are no more bits
+ * to come, and so all the queued pictures can be decided.
+ */
+static void resolve_pending(hrd_model_p  model,
+                            int          at_end)
+{
+  while (model->pending_count > 0)
+  {
+    struct hrd_pending *this = &model->pending[model->pending_start];
+    double  arrived = this->arrived;
+    if (arrived > model->total_bits)
+    {
+      if (!at_end)
+        break;
+      arrived = model->total_bits;
+    }
+    check_fullness(model,this->index,arrived - this->before,this->size);
+    model->pending_start = (model->pending_start + 1) % model->pending_size;
+    model->pending_count --;
+  }
+}
+
+/*
+ * Add a picture to the (CBR) queue, growing it if necessary.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int queue_pending(hrd_model_p  model,
+                         double       arrived,
+                         double       before,
+                         double       size)
+{
+  struct hrd_pending *this;
+
+  if (model->pending_count == model->pending_size)
+  {
+    int  ii;
+    int  new_size = model->pending_size * 2;
+    struct hrd_pending *new = malloc(new_size * sizeof(struct hrd_pending));
+    if (new == NULL)
+    {
+      print_err("### Unable to extend buffer model queue\n");
+      return 1;
+    }
+    for (ii = 0; ii < model->pending_count; ii++)
+      new[ii] = model->pending[(model->pending_start + ii) %
+                               model->pending_size];
+    free(model->pending);
+    model->pending = new;
+    model->pending_size = new_size;
+    model->pending_start = 0;
+  }
+  this = &model->pending[(model->pending_start + model->pending_count) %
+                         model->pending_size];
+  this->index = model->num_pictures;
+  this->arrived = arrived;
+  this->before = before;
+  this->size = size;
+  model->pending_count ++;
+  return 0;
+}
+
+/*
+ * Add the next picture (in decoding order) to the buffer model.
+ *
+ * - `size` is the number of bytes in the picture (including any headers
+ *   that precede it)
+ * - `duration` is how long (in seconds) until the next picture is removed
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int hrd_add_picture(hrd_model_p  model,
+                           uint32_t     size,
+                           double       duration)
+{
+  double  bits = 8.0 * size;
+
+  model->num_pictures ++;
+  if (model->is_cbr)
+  {
+    // With a constant bit rate, the fullness just before removal is the
+    // number of bits that have arrived by then, less those already removed
+    // - but we can't know how many have arrived until we've seen them
+    int err = queue_pending(model,model->bit_rate * model->time,
+                            model->total_bits,bits);
+    if (err) return 1;
+    model->total_bits += bits;
+    resolve_pending(model,FALSE);
+  }
+  else
+  {
+    double  fullness;
+    if (model->num_pictures == 1)
+      fullness = model->bit_rate * model->initial_delay;
+    else
+      fullness = model->fullness;
+    if (fullness > model->buffer_size)
+      fullness = model->buffer_size;
+    check_fullness(model,model->num_pictures,fullness,bits);
+    // If it underflowed, the decoder has to wait for the rest of the
+    // picture, which leaves the buffer empty
+    model->fullness = (fullness < bits ? 0 : fullness - bits);
+    model->fullness += model->bit_rate * duration;
+    model->total_bits += bits;
+  }
+  model->time += duration;
+  return 0;
+}
+
+/*
+ * Report on what the buffer model found.
+ *
+ * This should be called after the last picture has been added, as it
+ * also decides the fate of any pictures still waiting.
+ */
+extern void report_hrd_model(hrd_model_p  model)
+{
+  resolve_pending(model,TRUE);
+
+  fprint_msg("%s model: %s, bit rate %.0f bits/second, buffer size %.0f bits,"
+             " initial delay %.4fs\n",model->name,
+             (model->is_cbr ? "CBR" : "VBR"),model->bit_rate,
+             model->buffer_size,model->initial_delay);
+  if (model->num_pictures == 0)
+  {
+    print_msg("   No pictures were found\n");
+    return;
+  }
+  fprint_msg("   %u picture%s, %.0f bits, over %.3fs (mean %.0f bits/second)\n",
+             model->num_pictures,(model->num_pictures==1?"":"s"),
+             model->total_bits,model->time - model->initial_delay,
+             model->total_bits / (model->time - model->initial_delay));
+  fprint_msg("   Fullness ranged from %.0f bits (%.1f%%) after removal"
+             " to %.0f bits (%.1f%%) before removal\n",
+             model->min_fullness,
+             100.0 * model->min_fullness / model->buffer_size,
+             model->max_fullness,
+             100.0 * model->max_fullness / model->buffer_size);
+  if (model->num_underflows == 0 && model->num_overflows == 0)
+    fprint_msg("   No %s violations\n",model->name);
+  if (model->num_underflows > 0)
+    fprint_msg("   %u underflow%s, the first at picture %u\n",
+               model->num_underflows,(model->num_underflows==1?"":"s"),
+               model->first_underflow);
+  if (model->num_overflows > 0)
+    fprint_msg("   %u overflow%s, the first at picture %u\n",
+               model->num_overflows,(model->num_overflows==1?"":"s"),
+               model->first_overflow);
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,101 @@
+/*
+ * Datastructures for checking a video stream against its VBV (H.262) or
+ * CPB (H.264) buffer model
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _hrd_defns
+#define _hrd_defns
+
+#include "compat.h"
+
+// The model is the usual "leaky bucket". Bits arrive in the decoder buffer
+// at `bit_rate`, and each picture is removed from it instantaneously at its
+// decoding time. The first picture is removed `initial_delay` seconds after
+// its first bit arrived, and each subsequent picture one picture duration
+// after the one before.
+//
+// If the model is "CBR", then bits arrive continuously, and the buffer may
+// overflow (more than `buffer_size` bits waiting) as well as underflow (a
+// picture not completely arrived by its decoding time). Overflow can only
+// be judged once we know how many bits there are to arrive, so pictures are
+// queued until that is known (or until the end of the data).
+//
+// If the model is not "CBR" (H.262 with vbv_delay 0xFFFF, or H.264 with
+// cbr_flag 0), then bits only arrive while the buffer is not full, so the
+// buffer cannot overflow, but it can still underflow.
+
+// A picture whose fullness (before it is removed) cannot be decided yet
+struct hrd_pending
+{
+  uint32_t  index;         // the picture number, from 1
+  double    arrived;       // total bits that could have arrived by its time
+  double    before;        // total bits in the pictures before it
+  double    size;          // its own size, in bits
+};
+
+struct hrd_model
+{
+  char     *name;          // "VBV" or "CPB", for messages
+  double    bit_rate;      // in bits/second
+  double    buffer_size;   // in bits
+  int       is_cbr;        // TRUE for the constant bit rate model
+  double    initial_delay; // in seconds
+  int       quiet;         // if TRUE, don't report individual violations
+
+  double    time;          // removal time of the next picture, in seconds
+  double    total_bits;    // total bits in the pictures so far
+  double    fullness;      // (not CBR) fullness after the last removal
+  uint32_t  num_pictures;
+
+  // A circular queue of pictures waiting for their fullness to be known
+  struct hrd_pending *pending;
+  int       pending_start;
+  int       pending_count;
+  int       pending_size;
+
+  // And what we found
+  double    max_fullness;  // largest fullness before a removal
+  double    min_fullness;  // smallest fullness after a removal
+  uint32_t  num_underflows;
+  uint32_t  num_overflows;
+  uint32_t  first_underflow;  // picture number, 0 if none
+  uint32_t  first_overflow;   // picture number, 0 if none
+};
+typedef struct hrd_model *hrd_model_p;
+#define SIZEOF_HRD_MODEL sizeof(struct hrd_model)
+
+#define HRD_PENDING_START_SIZE  100
+
+#endif // _hrd_defns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
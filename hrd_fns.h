@@ -0,0 +1,91 @@
+/*
+ * Functions for checking a video stream against its VBV (H.262) or
+ * CPB (H.264) buffer model
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _hrd_fns
+#define _hrd_fns
+
+#include "hrd_defns.h"
+
+/*
+ * Build a new buffer model.
+ *
+ * - `name` is "VBV" or "CPB" (or similar), for use in messages
+ * - `bit_rate` is the rate at which bits enter the buffer, in bits/second
+ * - `buffer_size` is the size of the buffer, in bits
+ * - if `is_cbr` is TRUE, use the constant bit rate model, otherwise
+ *   bits stop arriving when the buffer is full
+ * - `initial_delay` is the time (in seconds) from the first bit arriving
+ *   to the first picture being removed
+ * - if `quiet` is TRUE, individual violations will not be reported
+ * - `model` is the new model
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_hrd_model(char         *name,
+                           double        bit_rate,
+                           double        buffer_size,
+                           int           is_cbr,
+                           double        initial_delay,
+                           int           quiet,
+                           hrd_model_p  *model);
+/*
+ * Free a buffer model.
+ *
+ * Sets `model` to NULL.
+ */
+extern void free_hrd_model(hrd_model_p  *model);
+/*
+ * Add the next picture (in decoding order) to the buffer model.
+ *
+ * - `size` is the number of bytes in the picture (including any headers
+ *   that precede it)
+ * - `duration` is how long (in seconds) until the next picture is removed
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int hrd_add_picture(hrd_model_p  model,
+                           uint32_t     size,
+                           double       duration);
+/*
+ * Report on what the buffer model found.
+ *
+ * This should be called after the last picture has been added, as it
+ * also decides the fate of any pictures still waiting.
+ */
+extern void report_hrd_model(hrd_model_p  model);
+
+#endif // _hrd_fns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
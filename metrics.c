@@ -0,0 +1,608 @@
+/*
+ * Publish live metrics from tsplay and tsserve, in Prometheus text format
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stddef.h>   // offsetof
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif // _WIN32
+
+#include "compat.h"
+#include "misc_fns.h"
+#include "printing_fns.h"
+#include "metrics_fns.h"
+
+#ifndef _WIN32
+
+// How long the server waits for something to happen before checking that
+// the process that started it is still there (milliseconds)
+#define METRICS_POLL_INTERVAL  1000
+
+// The largest HTTP request we bother to read
+#define METRICS_MAX_REQUEST    4096
+
+// The per-session metrics, and where to find them
+enum metric_kind { METRIC_U64, METRIC_I64, METRIC_I32 };
+struct metric_desc
+{
+  const char        *name;
+  const char        *type;
+  const char        *help;
+  size_t             offset;
+  enum metric_kind   kind;
+};
+
+static const struct metric_desc session_metrics[] =
+{
+  {"ts_packets_total","counter","TS packets written",
+   offsetof(struct metrics_session,ts_packets),METRIC_U64},
+  {"datagrams_sent_total","counter","Network writes made",
+   offsetof(struct metrics_session,datagrams_sent),METRIC_U64},
+  {"bytes_sent_total","counter","Bytes sent over the network",
+   offsetof(struct metrics_session,bytes_sent),METRIC_U64},
+  {"send_errors_total","counter","Network writes that failed",
+   offsetof(struct metrics_session,send_errors),METRIC_U64},
+  {"buffer_size","gauge","Circular buffer size, in items",
+   offsetof(struct metrics_session,buffer_size),METRIC_I32},
+  {"buffer_items","gauge","Items waiting in the circular buffer",
+   offsetof(struct metrics_session,buffer_items),METRIC_I32},
+  {"buffer_full_waits_total","counter",
+   "Times the writer waited because the circular buffer was full",
+   offsetof(struct metrics_session,buffer_full_waits),METRIC_U64},
+  {"buffer_empty_waits_total","counter",
+   "Times the sender waited because the circular buffer was empty",
+   offsetof(struct metrics_session,buffer_empty_waits),METRIC_U64},
+  {"timing_resets_total","counter",
+   "Times the sender restarted its timeline (output too late or too early)",
+   offsetof(struct metrics_session,timing_resets),METRIC_U64},
+  {"pacing_error_microseconds","gauge",
+   "How early (positive) or late (negative) the last item was due to be sent",
+   offsetof(struct metrics_session,pacing_error),METRIC_I64},
+  {"commands_total","counter","Commands received from the client",
+   offsetof(struct metrics_session,commands),METRIC_U64},
+};
+#define NUM_SESSION_METRICS \
+  (sizeof(session_metrics)/sizeof(session_metrics[0]))
+
+// A simple growing text buffer
+struct metrics_text
+{
+  char   *data;
+  size_t  length;
+  size_t  size;
+};
+
+static void append_text(struct metrics_text  *text,
+                        const char           *format,
+                        ...)
+{
+  va_list  args;
+  int      needed;
+
+  if (text->data == NULL)
+    return;   // we have already run out of memory
+  for (;;)
+  {
+    va_start(args,format);
+    needed = vsnprintf(text->data + text->length,text->size - text->length,
+                       format,args);
+    va_end(args);
+    if (needed < 0)
+      return;
+    if ((size_t)needed < text->size - text->length)
+      break;
+    else
+    {
+      char *newdata = realloc(text->data,text->size*2 + needed);
+      if (newdata == NULL)
+      {
+        free(text->data);
+        text->data = NULL;
+        return;
+      }
+      text->data = newdata;
+      text->size = text->size*2 + needed;
+    }
+  }
+  text->length += needed;
+}
+
+static const char *state_name(int32_t  state)
+{
+  switch (state)
+  {
+  case METRICS_SESSION_STARTING: return "starting";
+  case METRICS_SESSION_PLAYING:  return "playing";
+  default:                       return "unknown";
+  }
+}
+
+/*
+ * Forget any sessions whose process has gone away without releasing them
+ */
+static void reap_metrics_sessions(metrics_p  metrics)
+{
+  int ii;
+  for (ii = 0; ii < METRICS_MAX_SESSIONS; ii++)
+  {
+    metrics_session_p  session = &metrics->session[ii];
+    int32_t  pid = METRIC_GET(session,pid);
+    if (pid != 0 && kill(pid,0) == -1 && errno == ESRCH)
+      METRIC_SET(session,pid,0);
+  }
+}
+
+/*
+ * Produce the Prometheus text format for our metrics
+ */
+static void format_metrics(metrics_p             metrics,
+                           struct metrics_text  *text)
+{
+  int     ii;
+  size_t  mm;
+  int     num_active = 0;
+  const char *prefix = metrics->program;
+
+  for (ii = 0; ii < METRICS_MAX_SESSIONS; ii++)
+    if (METRIC_GET(&metrics->session[ii],pid) != 0)
+      num_active ++;
+
+  append_text(text,"# HELP %s_sessions Sessions currently active\n",prefix);
+  append_text(text,"# TYPE %s_sessions gauge\n",prefix);
+  append_text(text,"%s_sessions %d\n",prefix,num_active);
+  append_text(text,"# HELP %s_sessions_started_total Sessions started\n",
+              prefix);
+  append_text(text,"# TYPE %s_sessions_started_total counter\n",prefix);
+  append_text(text,"%s_sessions_started_total %u\n",prefix,
+              METRIC_GET(metrics,sessions_started));
+
+  append_text(text,"# HELP %s_session_info Session state and current"
+              " command\n",prefix);
+  append_text(text,"# TYPE %s_session_info gauge\n",prefix);
+  for (ii = 0; ii < METRICS_MAX_SESSIONS; ii++)
+  {
+    metrics_session_p  session = &metrics->session[ii];
+    int32_t  pid = METRIC_GET(session,pid);
+    int32_t  command = METRIC_GET(session,command);
+    if (pid == 0)
+      continue;
+    append_text(text,"%s_session_info{session=\"%u\",pid=\"%d\","
+                "state=\"%s\",command=\"%c\"} 1\n",prefix,
+                METRIC_GET(session,number),pid,
+                state_name(METRIC_GET(session,state)),
+                (command > 0 && command < 0x7F && isalnum(command)) ?
+                command : '_');
+  }
+
+  for (mm = 0; mm < NUM_SESSION_METRICS; mm++)
+  {
+    const struct metric_desc *desc = &session_metrics[mm];
+    append_text(text,"# HELP %s_%s %s\n",prefix,desc->name,desc->help);
+    append_text(text,"# TYPE %s_%s %s\n",prefix,desc->name,desc->type);
+    for (ii = 0; ii < METRICS_MAX_SESSIONS; ii++)
+    {
+      metrics_session_p  session = &metrics->session[ii];
+      byte    *field = (byte *)session + desc->offset;
+      int32_t  pid = METRIC_GET(session,pid);
+      if (pid == 0)
+        continue;
+      append_text(text,"%s_%s{session=\"%u\",pid=\"%d\"} ",prefix,desc->name,
+                  METRIC_GET(session,number),pid);
+      switch (desc->kind)
+      {
+      case METRIC_U64:
+        append_text(text,LLU_FORMAT "\n",
+                    __atomic_load_n((uint64_t *)field,__ATOMIC_RELAXED));
+        break;
+      case METRIC_I64:
+        append_text(text,LLD_FORMAT "\n",
+                    __atomic_load_n((int64_t *)field,__ATOMIC_RELAXED));
+        break;
+      case METRIC_I32:
+        append_text(text,"%d\n",
+                    __atomic_load_n((int32_t *)field,__ATOMIC_RELAXED));
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * Write all of `data` to `client`
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int write_all(int          client,
+                     const char  *data,
+                     size_t       length)
+{
+  while (length > 0)
+  {
+    ssize_t written = write(client,data,length);
+    if (written <= 0)
+    {
+      if (written == -1 && errno == EINTR)
+        continue;
+      return 1;
+    }
+    data += written;
+    length -= written;
+  }
+  return 0;
+}
+
+/*
+ * Answer a single request on `client`
+ */
+static void answer_metrics_request(metrics_p  metrics,
+                                   int        client)
+{
+  char    request[METRICS_MAX_REQUEST];
+  size_t  got = 0;
+  char    header[128];
+  struct metrics_text  text;
+  struct pollfd  pfd;
+
+  // Read (and ignore) the request - we give the same answer to anything
+  pfd.fd = client;
+  pfd.events = POLLIN;
+  while (got < sizeof(request) - 1)
+  {
+    ssize_t length;
+    if (poll(&pfd,1,METRICS_POLL_INTERVAL) <= 0)
+      break;
+    length = read(client,request + got,sizeof(request) - 1 - got);
+    if (length <= 0)
+      break;
+    got += length;
+    request[got] = '\0';
+    if (strstr(request,"\r\n\r\n") || strstr(request,"\n\n"))
+      break;
+  }
+
+  reap_metrics_sessions(metrics);
+
+  text.size = 8192;
+  text.length = 0;
+  text.data = malloc(text.size);
+  format_metrics(metrics,&text);
+  if (text.data == NULL)
+    return;
+
+  snprintf(header,sizeof(header),
+           "HTTP/1.0 200 OK\r\n"
+           "Content-Type: text/plain; version=0.0.4\r\n"
+           "Content-Length: %lu\r\n"
+           "\r\n",(unsigned long)text.length);
+  if (write_all(client,header,strlen(header)) == 0)
+    (void) write_all(client,text.data,text.length);
+  free(text.data);
+}
+
+/*
+ * The metrics server process itself
+ */
+static int metrics_server_process(metrics_p  metrics,
+                                  int        listener,
+                                  pid_t      parent)
+{
+  struct pollfd  pfd;
+
+  // A client that goes away before reading its answer must not kill us
+  signal(SIGPIPE,SIG_IGN);
+  pfd.fd = listener;
+  pfd.events = POLLIN;
+  for (;;)
+  {
+    int  result = poll(&pfd,1,METRICS_POLL_INTERVAL);
+    if (getppid() != parent)
+      break;    // The process we were serving has gone
+    if (result > 0)
+    {
+      int  client = accept(listener,NULL,NULL);
+      if (client == -1)
+        continue;
+      answer_metrics_request(metrics,client);
+      close(client);
+    }
+  }
+  close(listener);
+  return 0;
+}
+
+/*
+ * Open a socket to listen for metrics requests on
+ *
+ * Returns the socket, or -1 if something goes wrong.
+ */
+static int open_metrics_listener(char  *where)
+{
+  int  listener;
+  int  result;
+
+  if (strchr(where,'/') != NULL)
+  {
+    struct sockaddr_un  addr;
+    if (strlen(where) >= sizeof(addr.sun_path))
+    {
+      fprint_err("### Metrics socket path %s is too long\n",where);
+      return -1;
+    }
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path,where);
+    (void) unlink(where);   // in case it was left over from a previous run
+
+    listener = socket(AF_UNIX,SOCK_STREAM,0);
+    if (listener == -1)
+    {
+      fprint_err("### Unable to create metrics socket: %s\n",strerror(errno));
+      return -1;
+    }
+    result = bind(listener,(struct sockaddr *)&addr,sizeof(addr));
+  }
+  else
+  {
+    struct sockaddr_in  addr;
+    char   *colon = strrchr(where,':');
+    char   *port_str = (colon == NULL ? where : colon + 1);
+    char   *ptr;
+    long    port = strtol(port_str,&ptr,10);
+    int     one = 1;
+
+    if (ptr == port_str || *ptr != '\0' || port < 1 || port > 65535)
+    {
+      fprint_err("### Metrics address '%s' is not a port, <host>:<port> or"
+                 " socket path\n",where);
+      return -1;
+    }
+    memset(&addr,0,sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (colon == NULL)
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    else
+    {
+      struct hostent *hp;
+      *colon = '\0';
+      hp = gethostbyname(where);
+      *colon = ':';
+      if (hp == NULL)
+      {
+        fprint_err("### Unable to resolve metrics host in %s\n",where);
+        return -1;
+      }
+      memcpy(&addr.sin_addr.s_addr,hp->h_addr,hp->h_length);
+    }
+
+    listener = socket(AF_INET,SOCK_STREAM,0);
+    if (listener == -1)
+    {
+      fprint_err("### Unable to create metrics socket: %s\n",strerror(errno));
+      return -1;
+    }
+    (void) setsockopt(listener,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+    result = bind(listener,(struct sockaddr *)&addr,sizeof(addr));
+  }
+
+  if (result == -1)
+  {
+    fprint_err("### Unable to bind metrics socket to %s: %s\n",
+               where,strerror(errno));
+    close(listener);
+    return -1;
+  }
+  if (listen(listener,8) == -1)
+  {
+    fprint_err("### Unable to listen on metrics socket %s: %s\n",
+               where,strerror(errno));
+    close(listener);
+    return -1;
+  }
+  return listener;
+}
+#endif // _WIN32
+
+/*
+ * Set up the shared metrics datastructure, and start a server process to
+ * publish it.
+ *
+ * - `program` is the name of the program, which is used as the prefix
+ *   for the metric names (e.g., "tsplay")
+ * - `where` says where to listen for requests. If it contains a '/', it is
+ *   the path of a Unix domain socket; if it is of the form <host>:<port>,
+ *   then that TCP address; otherwise it is a TCP port on 127.0.0.1.
+ * - if `quiet` is true, then only errors are reported
+ * - `metrics` is the new metrics datastructure
+ *
+ * The server answers any HTTP request with the current metrics, in the
+ * Prometheus text format. It exits when `stop_metrics_server` is called,
+ * or when the process that started it exits.
+ *
+ * This must be called before any processes that will update the metrics
+ * are forked. It is not supported on Windows.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int start_metrics_server(char       *program,
+                                char       *where,
+                                int         quiet,
+                                metrics_p  *metrics)
+{
+#ifdef _WIN32
+  print_err("### Metrics are not supported on Windows\n");
+  return 1;
+#else
+  metrics_p  new;
+  int        listener;
+  pid_t      parent = getpid();
+  pid_t      pid;
+
+  if (strlen(program) >= METRICS_MAX_PROGRAM)
+  {
+    fprint_err("### Program name %s is too long for metrics\n",program);
+    return 1;
+  }
+
+  new = mmap(NULL,SIZEOF_METRICS,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANON,
+             -1,0);
+  if (new == MAP_FAILED)
+  {
+    fprint_err("### Unable to map metrics as shared memory: %s\n",
+               strerror(errno));
+    return 1;
+  }
+  memset(new,0,SIZEOF_METRICS);
+  strcpy(new->program,program);
+  if (strchr(where,'/') != NULL && strlen(where) < METRICS_MAX_PATH)
+    strcpy(new->socket_path,where);
+
+  listener = open_metrics_listener(where);
+  if (listener == -1)
+  {
+    (void) munmap(new,SIZEOF_METRICS);
+    return 1;
+  }
+
+  pid = fork();
+  if (pid == -1)
+  {
+    fprint_err("### Error forking metrics server: %s\n",strerror(errno));
+    close(listener);
+    (void) munmap(new,SIZEOF_METRICS);
+    return 1;
+  }
+  else if (pid == 0)
+    _exit(metrics_server_process(new,listener,parent));
+
+  close(listener);
+  new->server_pid = pid;
+  if (!quiet)
+    fprint_msg("Publishing metrics on %s\n",where);
+  *metrics = new;
+  return 0;
+#endif // _WIN32
+}
+
+/*
+ * Stop the metrics server, and release the shared metrics datastructure.
+ *
+ * Sets `metrics` to NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int stop_metrics_server(metrics_p  *metrics)
+{
+#ifndef _WIN32
+  if (*metrics == NULL)
+    return 0;
+  if ((*metrics)->server_pid > 0)
+  {
+    (void) kill((*metrics)->server_pid,SIGTERM);
+    (void) waitpid((*metrics)->server_pid,NULL,0);
+  }
+  if ((*metrics)->socket_path[0] != '\0')
+    (void) unlink((*metrics)->socket_path);
+  if (munmap(*metrics,SIZEOF_METRICS) == -1)
+  {
+    fprint_err("### Error unmapping metrics: %s\n",strerror(errno));
+    *metrics = NULL;
+    return 1;
+  }
+#endif // _WIN32
+  *metrics = NULL;
+  return 0;
+}
+
+/*
+ * Claim a session slot in the metrics for the current process.
+ *
+ * Returns the session, or NULL if `metrics` is NULL or there is no room.
+ */
+extern metrics_session_p claim_metrics_session(metrics_p  metrics)
+{
+#ifndef _WIN32
+  int      ii;
+  int32_t  pid = getpid();
+
+  if (metrics == NULL)
+    return NULL;
+
+  for (ii = 0; ii < METRICS_MAX_SESSIONS; ii++)
+  {
+    metrics_session_p  session = &metrics->session[ii];
+    int32_t  expected = 0;
+    if (__atomic_compare_exchange_n(&session->pid,&expected,pid,FALSE,
+                                    __ATOMIC_ACQ_REL,__ATOMIC_RELAXED))
+    {
+      // Clear any values left over from a previous session in this slot,
+      // taking care not to disturb the `pid` we have just set
+      memset((byte *)session + offsetof(struct metrics_session,state),0,
+             SIZEOF_METRICS_SESSION - offsetof(struct metrics_session,state));
+      session->state = METRICS_SESSION_STARTING;
+      session->number = __atomic_add_fetch(&metrics->sessions_started,1,
+                                           __ATOMIC_RELAXED);
+      return session;
+    }
+  }
+  print_err("!!! No room for any more sessions in the metrics\n");
+#endif // _WIN32
+  return NULL;
+}
+
+/*
+ * Release a session slot (which may be NULL).
+ */
+extern void release_metrics_session(metrics_session_p  session)
+{
+  METRIC_SET(session,pid,0);
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,122 @@
+/*
+ * Datastructures for publishing live metrics from tsplay and tsserve
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _metrics_defns
+#define _metrics_defns
+
+#include "compat.h"
+
+// The metrics live in a block of shared memory, which is mapped before any
+// of the processes that update it (the tswrite child, tsserve's per-client
+// servers) are forked. Each "session" (one tsplay run, or one tsserve
+// client) has its own slot, and only ever updates its own counters, so
+// the counters need no locking - just relaxed atomic updates, so that the
+// metrics server never sees a torn value.
+//
+// A separate metrics server process answers HTTP requests (on a TCP port or
+// a Unix domain socket) with the current values, in the Prometheus text
+// exposition format.
+
+#define METRICS_MAX_SESSIONS  32
+#define METRICS_MAX_PROGRAM   32
+#define METRICS_MAX_PATH      108   // As sockaddr_un.sun_path on Linux
+
+enum metrics_session_state
+{
+  METRICS_SESSION_FREE = 0,
+  METRICS_SESSION_STARTING,     // Claimed, but not yet sending data
+  METRICS_SESSION_PLAYING,      // Sending data
+};
+
+struct metrics_session
+{
+  int32_t   pid;                // Process that owns us, 0 if free
+  int32_t   state;              // A metrics_session_state
+  uint32_t  number;             // Which session this is (1 upwards)
+
+  uint64_t  ts_packets;         // TS packets given to tswrite
+  uint64_t  datagrams_sent;     // Network writes made
+  uint64_t  bytes_sent;         // and the bytes therein
+  uint64_t  send_errors;        // Network writes that failed
+
+  int32_t   buffer_size;        // Circular buffer size (if buffering)
+  int32_t   buffer_items;       // and how many items are in it
+  uint64_t  buffer_full_waits;  // Times the parent waited for space
+  uint64_t  buffer_empty_waits; // Times the child waited for data
+
+  uint64_t  timing_resets;      // Times the child restarted its timeline
+  int64_t   pacing_error;       // How early (+ve) or late (-ve) the last
+                                // item was, in microseconds
+
+  uint64_t  commands;           // Commands received from the client
+  int32_t   command;            // and the current command character
+};
+typedef struct metrics_session *metrics_session_p;
+#define SIZEOF_METRICS_SESSION sizeof(struct metrics_session)
+
+struct metrics
+{
+  char      program[METRICS_MAX_PROGRAM]; // Used as the metric name prefix
+  int32_t   server_pid;         // The metrics server process
+  char      socket_path[METRICS_MAX_PATH]; // Unix socket to remove, or ""
+  uint32_t  sessions_started;
+  struct metrics_session  session[METRICS_MAX_SESSIONS];
+};
+typedef struct metrics *metrics_p;
+#define SIZEOF_METRICS sizeof(struct metrics)
+
+// Updating a metric must cost no more than an (uncontended) add or store,
+// and must do nothing if metrics are not enabled (i.e., `session` is NULL)
+#if defined(__GNUC__) || defined(__clang__)
+#define METRIC_ADD(session,field,value) \
+  do { if ((session) != NULL) \
+      __atomic_fetch_add(&(session)->field,(value),__ATOMIC_RELAXED); \
+  } while (0)
+#define METRIC_SET(session,field,value) \
+  do { if ((session) != NULL) \
+      __atomic_store_n(&(session)->field,(value),__ATOMIC_RELAXED); \
+  } while (0)
+#define METRIC_GET(session,field) \
+  __atomic_load_n(&(session)->field,__ATOMIC_RELAXED)
+#else
+#define METRIC_ADD(session,field,value) \
+  do { if ((session) != NULL) (session)->field += (value); } while (0)
+#define METRIC_SET(session,field,value) \
+  do { if ((session) != NULL) (session)->field = (value); } while (0)
+#define METRIC_GET(session,field) ((session)->field)
+#endif
+
+#endif // _metrics_defns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,86 @@
+/*
+ * Functions for publishing live metrics from tsplay and tsserve
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _metrics_fns
+#define _metrics_fns
+
+#include "metrics_defns.h"
+
+/*
+ * Set up the shared metrics datastructure, and start a server process to
+ * publish it.
+ *
+ * - `program` is the name of the program, which is used as the prefix
+ *   for the metric names (e.g., "tsplay")
+ * - `where` says where to listen for requests. If it contains a '/', it is
+ *   the path of a Unix domain socket; if it is of the form <host>:<port>,
+ *   then that TCP address; otherwise it is a TCP port on 127.0.0.1.
+ * - if `quiet` is true, then only errors are reported
+ * - `metrics` is the new metrics datastructure
+ *
+ * The server answers any HTTP request with the current metrics, in the
+ * Prometheus text format. It exits when `stop_metrics_server` is called,
+ * or when the process that started it exits.
+ *
+ * This must be called before any processes that will update the metrics
+ * are forked. It is not supported on Windows.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int start_metrics_server(char       *program,
+                                char       *where,
+                                int         quiet,
+                                metrics_p  *metrics);
+/*
+ * Stop the metrics server, and release the shared metrics datastructure.
+ *
+ * Sets `metrics` to NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int stop_metrics_server(metrics_p  *metrics);
+/*
+ * Claim a session slot in the metrics for the current process.
+ *
+ * Returns the session, or NULL if `metrics` is NULL or there is no room.
+ */
+extern metrics_session_p claim_metrics_session(metrics_p  metrics);
+/*
+ * Release a session slot (which may be NULL).
+ */
+extern void release_metrics_session(metrics_session_p  session);
+
+#endif // _metrics_fns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -40,7 +40,9 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <io.h>
+#include <sys/timeb.h>   // _ftime
 #else  // _WIN32
+#include <sys/time.h>    // gettimeofday
 // For the socket handling
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -52,6 +54,8 @@
 
 #include "compat.h"
 #include "misc_fns.h"
+#include "multifile_fns.h"
+#include "gzinput_fns.h"
 #include "es_fns.h"
 #include "pes_fns.h"
 #include "printing_fns.h"
@@ -228,6 +232,27 @@ extern double log2(double x)
 }
 
 // ============================================================
+// Timing
+// ============================================================
+/*
+ * Return the time now, in microseconds since the epoch.
+ *
+ * (On Windows, this is only accurate to the nearest millisecond.)
+ */
+extern uint64_t time_now_microseconds(void)
+{
+#ifdef _WIN32
+  struct _timeb  now;
+  _ftime(&now);
+  return (uint64_t)now.time * 1000000 + (uint64_t)now.millitm * 1000;
+#else  // _WIN32
+  struct timeval  now;
+  gettimeofday(&now,NULL);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+#endif // _WIN32
+}
+
+// ============================================================
 // Simple file I/O utilities
 // ============================================================
 /*
@@ -399,6 +424,56 @@ extern int close_file(int  filedes)
     return 0;
 }
 
+/*
+ * Is the named input one that must be read indirectly - that is, is it
+ * a list of files (its name starts with MULTIFILE_LIST_PREFIX), or a
+ * compressed file?
+ *
+ * Returns TRUE if it is, FALSE if it is not (including if `name` is NULL).
+ */
+extern int is_indirect_input(char  *name)
+{
+  return (is_multifile_name(name) || is_gzip_file(name));
+}
+
+/*
+ * Open an input that must be read indirectly (see is_indirect_input()).
+ *
+ * - `name` is the name of the input
+ * - `input` is filled in with the handle and functions with which to
+ *   read, seek within, and close it. These are suitable for use as the
+ *   `handle`, `read_fn`, `seek_fn` and `close_fn` of a TS, PS or ES reader.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_indirect_input(char                   *name,
+                               struct indirect_input  *input)
+{
+  int  err;
+
+  if (is_multifile_name(name))
+  {
+    multifile_p  multifile;
+    err = open_multifile(name,&multifile);
+    if (err) return 1;
+    input->handle = multifile;
+    input->read_fn = read_multifile;
+    input->seek_fn = seek_multifile;
+    input->close_fn = close_multifile_handle;
+  }
+  else
+  {
+    gzinput_p  gz;
+    err = open_gzinput(name,&gz);
+    if (err) return 1;
+    input->handle = gz;
+    input->read_fn = read_gzinput;
+    input->seek_fn = seek_gzinput;
+    input->close_fn = close_gzinput_handle;
+  }
+  return 0;
+}
+
 // ============================================================
 // More complex file I/O utilities
 // ============================================================
@@ -471,20 +546,30 @@ static int open_input_as_ES_direct(char   *name,
   {
     input = STDIN_FILENO;
   }
-  else
+  else if (!is_indirect_input(name))
   {
     input = open_binary_file(name,FALSE);
     if (input == -1) return 1;
   }
 
-  err = build_elementary_stream_file(input,es);
-  if (err)
+  if (input == -1)
   {
-    fprint_err("### Error building elementary stream for %s\n",
-               use_stdin?"<stdin>":name);
-    if (!use_stdin)
-      (void) close_file(input);
-    return 1;
+    // A list of files, or a compressed file, which the ES will read
+    // via its `read_fn`
+    err = open_elementary_stream(name,es);
+    if (err) return 1;
+  }
+  else
+  {
+    err = build_elementary_stream_file(input,es);
+    if (err)
+    {
+      fprint_err("### Error building elementary stream for %s\n",
+                 use_stdin?"<stdin>":name);
+      if (!use_stdin)
+        (void) close_file(input);
+      return 1;
+    }
   }
 
   if (!quiet)
@@ -517,22 +602,52 @@ static int open_input_as_ES_direct(char   *name,
     // We want to rewind, to "unread" the bytes we read to decide our filetype.
     // The easiest way to do that and return to our initial conditions is to
     // recreate our ES context
-    free_elementary_stream(es);
-
-    err = seek_file(input,0);
-    if (err)
+    if ((*es)->read_fn)
     {
-      print_err("### Error returning to start position in file after"
-                " working out video type\n");
-      (void) close_file(input);
-      return 1;
+      // Reading via functions (e.g., from a list of files), so rebuild
+      // around the same handle
+      void  *handle = (*es)->handle;
+      int  (*read_fn)(void *, byte *, size_t) = (*es)->read_fn;
+      int  (*seek_fn)(void *, offset_t) = (*es)->seek_fn;
+      int  (*close_fn)(void *) = (*es)->close_fn;
+      free_elementary_stream(es);
+
+      err = seek_fn(handle,0);
+      if (err)
+      {
+        print_err("### Error returning to start position in file after"
+                  " working out video type\n");
+        if (close_fn) (void) close_fn(handle);
+        return 1;
+      }
+      err = build_elementary_stream_with_fns(handle,read_fn,seek_fn,es);
+      if (err)
+      {
+        fprint_err("### Error (re)building elementary stream for %s\n",name);
+        if (close_fn) (void) close_fn(handle);
+        return 1;
+      }
+      (*es)->close_fn = close_fn;
     }
-
-    err = build_elementary_stream_file(input,es);
-    if (err)
+    else
     {
-      fprint_err("### Error (re)building elementary stream for %s\n",name);
-      return 1;
+      free_elementary_stream(es);
+
+      err = seek_file(input,0);
+      if (err)
+      {
+        print_err("### Error returning to start position in file after"
+                  " working out video type\n");
+        (void) close_file(input);
+        return 1;
+      }
+
+      err = build_elementary_stream_file(input,es);
+      if (err)
+      {
+        fprint_err("### Error (re)building elementary stream for %s\n",name);
+        return 1;
+      }
     }
 
     *is_data = video_type;
@@ -52,6 +52,18 @@ typedef union _writer WRITER;
     return 1;                                                                 \
   }
 
+// Some inputs (a list of files to be read as one, or a compressed file)
+// cannot be read directly from a file descriptor. Instead, the TS, PS and
+// ES readers read them via a handle and these functions.
+struct indirect_input
+{
+  void  *handle;
+  int  (*read_fn)(void *, byte *, size_t);
+  int  (*seek_fn)(void *, offset_t);
+  int  (*close_fn)(void *);
+};
+typedef struct indirect_input *indirect_input_p;
+
 // A simple macro to return a bit from a bitfield, for use in printf()
 #define ON(byt,msk)  ((byt & msk)?1:0)
 
@@ -103,6 +103,15 @@ extern void print_end_of_data(char *name,
  */
 extern double log2(double x);
 
+// ============================================================
+// Timing
+// ============================================================
+/*
+ * Return the time now, in microseconds since the epoch.
+ *
+ * (On Windows, this is only accurate to the nearest millisecond.)
+ */
+extern uint64_t time_now_microseconds(void);
 
 // ============================================================
 // Simple file I/O utilities
@@ -179,6 +188,26 @@ extern int open_binary_file(char  *filename,
  * Returns 0 if all went well, 1 if an error occurred.
  */
 extern int close_file(int  filedes);
+/*
+ * Is the named input one that must be read indirectly - that is, is it
+ * a list of files (its name starts with MULTIFILE_LIST_PREFIX), or a
+ * compressed file?
+ *
+ * Returns TRUE if it is, FALSE if it is not (including if `name` is NULL).
+ */
+extern int is_indirect_input(char  *name);
+/*
+ * Open an input that must be read indirectly (see is_indirect_input()).
+ *
+ * - `name` is the name of the input
+ * - `input` is filled in with the handle and functions with which to
+ *   read, seek within, and close it. These are suitable for use as the
+ *   `handle`, `read_fn`, `seek_fn` and `close_fn` of a TS, PS or ES reader.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_indirect_input(char                   *name,
+                               struct indirect_input  *input);
 
 // ============================================================
 // More complex file I/O utilities
@@ -454,6 +483,20 @@ static inline uint16_t uint_16_le(const uint8_t *const p)
 	  ((int)p[1]&0xff)<<8);
 }
 
+static inline void set_32_be(uint8_t *const p, const uint32_t x)
+{
+  p[0] = x >> 24;
+  p[1] = (x >> 16) & 0xff;
+  p[2] = (x >> 8) & 0xff;
+  p[3] = x & 0xff;
+}
+
+static inline void set_16_be(uint8_t *const p, const unsigned int x)
+{
+  p[0] = (x >> 8) & 0xff;
+  p[1] = x & 0xff;
+}
+
 
 // ============================================================
 // Time diffs
@@ -0,0 +1,426 @@
+/*
+ * Support for reading a list of files as if they were a single file
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "compat.h"
+#include "misc_fns.h"
+#include "printing_fns.h"
+#include "multifile_fns.h"
+
+// The longest line we expect in a list of files
+#define MULTIFILE_MAX_LINE  4096
+
+/*
+ * Is this filename actually the name of a list of files, to be read
+ * as a single file (i.e., does it start with MULTIFILE_LIST_PREFIX)?
+ *
+ * Returns TRUE if it is, FALSE if it is not (including if `name` is NULL).
+ */
+extern int is_multifile_name(char  *name)
+{
+  return (name != NULL && name[0] == MULTIFILE_LIST_PREFIX);
+}
+
+/*
+ * Free a multifile context, closing any open file.
+ */
+static void free_multifile(multifile_p  *multifile)
+{
+  multifile_p  mf = *multifile;
+  int  ii;
+  if (mf == NULL)
+    return;
+  if (mf->file != -1)
+    (void) close_file(mf->file);
+  if (mf->names != NULL)
+  {
+    for (ii = 0; ii < mf->num_files; ii++)
+      free(mf->names[ii]);
+    free(mf->names);
+  }
+  if (mf->start != NULL)
+    free(mf->start);
+  free(mf);
+  *multifile = NULL;
+}
+
+/*
+ * Make sure that the file with the given index is the one that is open
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int open_multifile_file(multifile_p  mf,
+                               int          index)
+{
+  if (mf->current == index)
+    return 0;
+  if (mf->file != -1)
+  {
+    (void) close_file(mf->file);
+    mf->file = -1;
+    mf->current = -1;
+  }
+  mf->file = open_binary_file(mf->names[index],FALSE);
+  if (mf->file == -1)
+    return 1;
+  mf->current = index;
+  return 0;
+}
+
+/*
+ * Build a multifile context for reading the given files, in order,
+ * as if they were a single file.
+ *
+ * Each file is checked (and its size determined) when the context is
+ * built, but only one file is kept open at a time.
+ *
+ * - `num_files` is how many files there are
+ * - `names` are their names (which are copied)
+ * - `multifile` is the new context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_multifile(int            num_files,
+                           char          *names[],
+                           multifile_p   *multifile)
+{
+  int  ii;
+  multifile_p  new;
+
+  if (num_files < 1)
+  {
+    print_err("### Cannot read an empty list of files\n");
+    return 1;
+  }
+
+  new = malloc(SIZEOF_MULTIFILE);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate multifile datastructure\n");
+    return 1;
+  }
+  new->num_files = 0;
+  new->current = -1;
+  new->file = -1;
+  new->posn = 0;
+  new->length = 0;
+  new->names = malloc(num_files * sizeof(char *));
+  new->start = malloc(num_files * sizeof(offset_t));
+  if (new->names == NULL || new->start == NULL)
+  {
+    print_err("### Unable to allocate multifile datastructure\n");
+    free_multifile(&new);
+    return 1;
+  }
+
+  for (ii = 0; ii < num_files; ii++)
+  {
+    offset_t  size;
+    new->names[ii] = strdup(names[ii]);
+    if (new->names[ii] == NULL)
+    {
+      print_err("### Unable to allocate multifile filename\n");
+      free_multifile(&new);
+      return 1;
+    }
+    new->num_files ++;
+
+    if (open_multifile_file(new,ii))
+    {
+      free_multifile(&new);
+      return 1;
+    }
+    size = lseek(new->file,0,SEEK_END);
+    if (size == -1)
+    {
+      fprint_err("### Error determining length of file %s: %s\n",
+                 names[ii],strerror(errno));
+      free_multifile(&new);
+      return 1;
+    }
+    new->start[ii] = new->length;
+    new->length += size;
+  }
+
+  // And start at the start
+  if (open_multifile_file(new,0) || seek_file(new->file,0))
+  {
+    free_multifile(&new);
+    return 1;
+  }
+  *multifile = new;
+  return 0;
+}
+
+/*
+ * Open a list of files for reading as a single file.
+ *
+ * - `listname` is the name of a file listing the files to read, one per
+ *   line. It may optionally start with MULTIFILE_LIST_PREFIX, which
+ *   is ignored.
+ * - `multifile` is the new context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_multifile(char          *listname,
+                          multifile_p   *multifile)
+{
+  int    err;
+  FILE  *list;
+  char   line[MULTIFILE_MAX_LINE];
+  char **names = NULL;
+  int    num_names = 0;
+  int    dir_len = 0;
+  int    ii;
+  char  *slash;
+
+  if (is_multifile_name(listname))
+    listname ++;
+
+  // Relative names in the list are relative to the list's directory
+  slash = strrchr(listname,'/');
+  if (slash != NULL)
+    dir_len = (int)(slash - listname) + 1;
+
+  list = fopen(listname,"r");
+  if (list == NULL)
+  {
+    fprint_err("### Unable to open list of files %s: %s\n",listname,
+               strerror(errno));
+    return 1;
+  }
+
+  while (fgets(line,MULTIFILE_MAX_LINE,list) != NULL)
+  {
+    char  *name;
+    char **more;
+    int    len = (int)strlen(line);
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r' ||
+                       line[len-1] == ' '  || line[len-1] == '\t'))
+      line[--len] = '\0';
+    if (len == 0 || line[0] == '#')
+      continue;
+
+    more = realloc(names,(num_names+1)*sizeof(char *));
+    if (more == NULL)
+    {
+      print_err("### Unable to extend list of filenames\n");
+      (void) fclose(list);
+      for (ii = 0; ii < num_names; ii++)
+        free(names[ii]);
+      free(names);
+      return 1;
+    }
+    names = more;
+    if (line[0] == '/')
+      name = strdup(line);
+    else
+    {
+      name = malloc(dir_len + len + 1);
+      if (name != NULL)
+      {
+        memcpy(name,listname,dir_len);
+        strcpy(name+dir_len,line);
+      }
+    }
+    if (name == NULL)
+    {
+      print_err("### Unable to allocate filename\n");
+      (void) fclose(list);
+      for (ii = 0; ii < num_names; ii++)
+        free(names[ii]);
+      free(names);
+      return 1;
+    }
+    names[num_names++] = name;
+  }
+  (void) fclose(list);
+
+  if (num_names == 0)
+  {
+    fprint_err("### List of files %s does not name any files\n",listname);
+    return 1;
+  }
+
+  err = build_multifile(num_names,names,multifile);
+  for (ii = 0; ii < num_names; ii++)
+    free(names[ii]);
+  free(names);
+  if (err)
+  {
+    fprint_err("### Error opening the files listed in %s\n",listname);
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Close a multifile, and free its context.
+ *
+ * Sets `multifile` to NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (in which case
+ * the context will still have been freed).
+ */
+extern int close_multifile(multifile_p  *multifile)
+{
+  int  err = 0;
+  if (*multifile == NULL)
+    return 0;
+  if ((*multifile)->file != -1)
+  {
+    err = close_file((*multifile)->file);
+    (*multifile)->file = -1;
+  }
+  free_multifile(multifile);
+  return err;
+}
+
+/*
+ * Close a multifile given as a (reader's) handle.
+ *
+ * This is suitable for use as the `close_fn` of a TS, PS or ES reader.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int close_multifile_handle(void  *handle)
+{
+  multifile_p  mf = handle;
+  return close_multifile(&mf);
+}
+
+/*
+ * Read bytes from a multifile, in the manner of read().
+ *
+ * This is suitable for use as the `read_fn` of a TS, PS or ES reader,
+ * with the multifile context as the `handle`.
+ *
+ * At most `num_bytes` bytes are read into `data` - fewer may be read
+ * if the end of one of the component files is reached.
+ *
+ * Returns the number of bytes read, 0 at the end of the last file, or -1
+ * if something went wrong.
+ */
+extern int read_multifile(void    *handle,
+                          byte    *data,
+                          size_t   num_bytes)
+{
+  multifile_p  mf = handle;
+
+  for (;;)
+  {
+#ifdef _WIN32
+    int      length;
+#else
+    ssize_t  length;
+#endif
+    if (mf->current == -1)
+      return 0;   // we've run off the end of the last file
+
+    length = read(mf->file,data,num_bytes);
+    if (length == -1)
+    {
+      fprint_err("### Error reading from file %s: %s\n",
+                 mf->names[mf->current],strerror(errno));
+      return -1;
+    }
+    else if (length > 0)
+    {
+      mf->posn += length;
+      return (int)length;
+    }
+
+    // We've reached the end of this file, so move on to the next, if any
+    if (mf->current == mf->num_files - 1)
+      return 0;
+    if (open_multifile_file(mf,mf->current + 1))
+      return -1;
+  }
+}
+
+/*
+ * Seek to a position in a multifile.
+ *
+ * This is suitable for use as the `seek_fn` of a TS, PS or ES reader,
+ * with the multifile context as the `handle`.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int seek_multifile(void      *handle,
+                          offset_t   posn)
+{
+  int  err;
+  int  lo, hi;
+  multifile_p  mf = handle;
+
+  if (posn < 0 || posn > mf->length)
+  {
+    fprint_err("### Cannot seek to position " OFFSET_T_FORMAT
+               " in list of files of total length " OFFSET_T_FORMAT "\n",
+               posn,mf->length);
+    return 1;
+  }
+
+  // Find the last file that starts at or before `posn`
+  lo = 0;
+  hi = mf->num_files - 1;
+  while (lo < hi)
+  {
+    int mid = (lo + hi + 1) / 2;
+    if (mf->start[mid] <= posn)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  err = open_multifile_file(mf,lo);
+  if (err) return 1;
+  err = seek_file(mf->file,posn - mf->start[lo]);
+  if (err) return 1;
+  mf->posn = posn;
+  return 0;
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,67 @@
+/*
+ * Definitions for reading a list of files as a single file
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _multifile_defns
+#define _multifile_defns
+
+#include "compat.h"
+
+// A "multifile" presents an ordered list of files (for instance, the
+// successive chunks of a long recording) as if they were a single file,
+// which can be read and seeked within using 64-bit offsets.
+//
+// Only one of the files is open at any one time.
+struct multifile
+{
+  int        num_files;
+  char     **names;       // The name of each file
+  offset_t  *start;       // The offset of the start of each file in the whole
+  offset_t   length;      // The total length of all of the files
+
+  int        current;     // Which file is currently open (-1 if none)
+  int        file;        // and its file descriptor
+  offset_t   posn;        // Our position within the whole
+};
+typedef struct multifile *multifile_p;
+#define SIZEOF_MULTIFILE sizeof(struct multifile)
+
+// A "filename" starting with this character is taken to name a list of
+// files, one per line, to be read as a single file. Blank lines, and lines
+// starting with '#', are ignored. Relative filenames are taken as relative
+// to the directory containing the list.
+#define MULTIFILE_LIST_PREFIX  '@'
+
+#endif // _multifile_defns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
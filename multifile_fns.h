@@ -0,0 +1,120 @@
+/*
+ * Functions for reading a list of files as a single file
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _multifile_fns
+#define _multifile_fns
+
+#include "multifile_defns.h"
+
+/*
+ * Is this filename actually the name of a list of files, to be read
+ * as a single file (i.e., does it start with MULTIFILE_LIST_PREFIX)?
+ *
+ * Returns TRUE if it is, FALSE if it is not (including if `name` is NULL).
+ */
+extern int is_multifile_name(char  *name);
+/*
+ * Build a multifile context for reading the given files, in order,
+ * as if they were a single file.
+ *
+ * Each file is checked (and its size determined) when the context is
+ * built, but only one file is kept open at a time.
+ *
+ * - `num_files` is how many files there are
+ * - `names` are their names (which are copied)
+ * - `multifile` is the new context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_multifile(int            num_files,
+                           char          *names[],
+                           multifile_p   *multifile);
+/*
+ * Open a list of files for reading as a single file.
+ *
+ * - `listname` is the name of a file listing the files to read, one per
+ *   line. It may optionally start with MULTIFILE_LIST_PREFIX, which
+ *   is ignored.
+ * - `multifile` is the new context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_multifile(char          *listname,
+                          multifile_p   *multifile);
+/*
+ * Close a multifile, and free its context.
+ *
+ * Sets `multifile` to NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (in which case
+ * the context will still have been freed).
+ */
+extern int close_multifile(multifile_p  *multifile);
+/*
+ * Read bytes from a multifile, in the manner of read().
+ *
+ * This is suitable for use as the `read_fn` of a TS, PS or ES reader,
+ * with the multifile context as the `handle`.
+ *
+ * At most `num_bytes` bytes are read into `data` - fewer may be read
+ * if the end of one of the component files is reached.
+ *
+ * Returns the number of bytes read, 0 at the end of the last file, or -1
+ * if something went wrong.
+ */
+extern int read_multifile(void    *handle,
+                          byte    *data,
+                          size_t   num_bytes);
+/*
+ * Seek to a position in a multifile.
+ *
+ * This is suitable for use as the `seek_fn` of a TS, PS or ES reader,
+ * with the multifile context as the `handle`.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int seek_multifile(void      *handle,
+                          offset_t   posn);
+/*
+ * Close a multifile given as a (reader's) handle.
+ *
+ * This is suitable for use as the `close_fn` of a TS, PS or ES reader.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int close_multifile_handle(void  *handle);
+
+#endif // _multifile_fns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
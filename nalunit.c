@@ -335,7 +335,8 @@ static int read_slice_data(nal_unit_p   nal,
 #define CHECK(name) \
   if (err)                                      \
   {                                             \
-    fprint_err("### Error reading %s field from slice data\n",(name)); \
+    fprint_err_limited("slice data field",      \
+                       "### Error reading %s field from slice data\n",(name)); \
   }
 
   err = read_exp_golomb(bd,&data->first_mb_in_slice);
@@ -667,6 +668,193 @@ static int read_pic_param_set_data(nal_unit_p   nal,
   return 0;
 }
 
+/*
+ * Skip over a scaling_list() in a sequence parameter set.
+ *
+ * Returns 0 if it succeeds, 1 if some error occurs.
+ */
+static int skip_scaling_list(bitdata_p  bd,
+                             int        size)
+{
+  int ii;
+  int last_scale = 8;
+  int next_scale = 8;
+  for (ii = 0; ii < size; ii++)
+  {
+    if (next_scale != 0)
+    {
+      int32_t delta_scale;
+      int err = read_signed_exp_golomb(bd,&delta_scale);
+      if (err) return 1;
+      next_scale = (last_scale + delta_scale + 256) % 256;
+    }
+    last_scale = (next_scale == 0) ? last_scale : next_scale;
+  }
+  return 0;
+}
+
+/*
+ * Read the hrd_parameters() from the VUI of a sequence parameter set.
+ *
+ * We only remember the bit rate, CPB size and CBR flag for the first
+ * schedule (SchedSelIdx 0).
+ *
+ * Returns 0 if it succeeds, 1 if some error occurs.
+ */
+static int read_hrd_parameters(bitdata_p             bd,
+                               nal_seq_param_data_p  data,
+                               int                   show_nal_details)
+{
+  int      err;
+  uint32_t ii;
+  uint32_t cpb_cnt;
+  uint32_t bit_rate_scale;
+  uint32_t cpb_size_scale;
+  uint32_t temp;
+
+  err = read_exp_golomb(bd,&cpb_cnt); // minus 1
+  if (err) return 1;
+  cpb_cnt ++;
+  if (cpb_cnt > 32)
+  {
+    fprint_err("!!! cpb_cnt %u in HRD parameters is more than 32\n",cpb_cnt);
+    return 1;
+  }
+  err = read_bits(bd,4,&bit_rate_scale);
+  if (err) return 1;
+  err = read_bits(bd,4,&cpb_size_scale);
+  if (err) return 1;
+  for (ii = 0; ii < cpb_cnt; ii++)
+  {
+    uint32_t bit_rate_value;
+    uint32_t cpb_size_value;
+    byte     cbr_flag;
+    err = read_exp_golomb(bd,&bit_rate_value); // minus 1
+    if (err) return 1;
+    err = read_exp_golomb(bd,&cpb_size_value); // minus 1
+    if (err) return 1;
+    err = read_bit(bd,&cbr_flag);
+    if (err) return 1;
+    if (ii == 0)
+    {
+      data->hrd_bit_rate = ((uint64_t)bit_rate_value + 1) << (6 + bit_rate_scale);
+      data->hrd_cpb_size = ((uint64_t)cpb_size_value + 1) << (4 + cpb_size_scale);
+      data->hrd_cbr_flag = cbr_flag;
+    }
+  }
+  // initial_cpb_removal_delay_length_minus1, cpb_removal_delay_length_minus1,
+  // dpb_output_delay_length_minus1 and time_offset_length
+  err = read_bits(bd,20,&temp);
+  if (err) return 1;
+  data->hrd_parameters_present_flag = TRUE;
+  if (show_nal_details)
+    fprint_msg("   HRD: cpb_cnt %u, bit_rate " LLU_FORMAT ", cpb_size "
+               LLU_FORMAT ", cbr_flag %d\n",cpb_cnt,data->hrd_bit_rate,
+               data->hrd_cpb_size,data->hrd_cbr_flag);
+  return 0;
+}
+
+/*
+ * Read the VUI parameters at the end of a sequence parameter set.
+ *
+ * Returns 0 if it succeeds, 1 if some error occurs.
+ */
+static int read_vui_parameters(bitdata_p             bd,
+                               nal_seq_param_data_p  data,
+                               int                   show_nal_details)
+{
+  int      err;
+  byte     flag;
+  byte     nal_hrd_parameters_present_flag;
+  byte     vcl_hrd_parameters_present_flag;
+  uint32_t temp;
+
+  err = read_bit(bd,&flag);   // aspect_ratio_info_present_flag
+  if (err) return 1;
+  if (flag)
+  {
+    err = read_bits(bd,8,&temp); // aspect_ratio_idc
+    if (err) return 1;
+    if (temp == 255)            // Extended_SAR
+    {
+      err = read_bits(bd,32,&temp); // sar_width, sar_height
+      if (err) return 1;
+    }
+  }
+  err = read_bit(bd,&flag);   // overscan_info_present_flag
+  if (err) return 1;
+  if (flag)
+  {
+    err = read_bit(bd,&flag); // overscan_appropriate_flag
+    if (err) return 1;
+  }
+  err = read_bit(bd,&flag);   // video_signal_type_present_flag
+  if (err) return 1;
+  if (flag)
+  {
+    err = read_bits(bd,4,&temp); // video_format, video_full_range_flag
+    if (err) return 1;
+    err = read_bit(bd,&flag);    // colour_description_present_flag
+    if (err) return 1;
+    if (flag)
+    {
+      err = read_bits(bd,24,&temp);
+      if (err) return 1;
+    }
+  }
+  err = read_bit(bd,&flag);   // chroma_loc_info_present_flag
+  if (err) return 1;
+  if (flag)
+  {
+    err = read_exp_golomb(bd,&temp);
+    if (err) return 1;
+    err = read_exp_golomb(bd,&temp);
+    if (err) return 1;
+  }
+  err = read_bit(bd,&data->timing_info_present_flag);
+  if (err) return 1;
+  if (data->timing_info_present_flag)
+  {
+    err = read_bits(bd,32,&data->num_units_in_tick);
+    if (err) return 1;
+    err = read_bits(bd,32,&data->time_scale);
+    if (err) return 1;
+    err = read_bit(bd,&data->fixed_frame_rate_flag);
+    if (err) return 1;
+    if (show_nal_details)
+      fprint_msg("   VUI: num_units_in_tick %u, time_scale %u,"
+                 " fixed_frame_rate_flag %d\n",data->num_units_in_tick,
+                 data->time_scale,data->fixed_frame_rate_flag);
+  }
+  err = read_bit(bd,&nal_hrd_parameters_present_flag);
+  if (err) return 1;
+  if (nal_hrd_parameters_present_flag)
+  {
+    err = read_hrd_parameters(bd,data,show_nal_details);
+    if (err) return 1;
+  }
+  err = read_bit(bd,&vcl_hrd_parameters_present_flag);
+  if (err) return 1;
+  if (vcl_hrd_parameters_present_flag)
+  {
+    // We prefer the NAL HRD, since that describes the whole bitstream
+    struct nal_seq_param_data  vcl = *data;
+    err = read_hrd_parameters(bd,&vcl,show_nal_details);
+    if (err) return 1;
+    if (!nal_hrd_parameters_present_flag)
+      *data = vcl;
+  }
+  if (nal_hrd_parameters_present_flag || vcl_hrd_parameters_present_flag)
+  {
+    err = read_bit(bd,&data->low_delay_hrd_flag);
+    if (err) return 1;
+  }
+  err = read_bit(bd,&data->pic_struct_present_flag);
+  if (err) return 1;
+  // We don't care about the bitstream restriction information
+  return 0;
+}
+
 /*
  * Look at the start of the sequence parameter set.
  *
@@ -689,6 +877,7 @@ static int read_seq_param_set_data(nal_unit_p   nal,
   byte     gaps_in_frame_num_value_allowed_flag;
   uint32_t pic_width_in_mbs;
   uint32_t pic_height_in_map_units;
+  byte     flag;
 
 #undef CHECK
 #define CHECK(name)                                                       \
@@ -744,6 +933,51 @@ static int read_seq_param_set_data(nal_unit_p   nal,
   err = read_exp_golomb(bd,&temp);
   CHECK("seq_parameter_set_id");
   data->seq_parameter_set_id = temp;
+
+  // The "high" profiles have extra fields before log2_max_frame_num
+  switch (data->profile_idc)
+  {
+  case 100: case 110: case 122: case 244: case 44:
+  case 83:  case 86:  case 118: case 128: case 138:
+  case 139: case 134: case 135:
+    {
+      uint32_t chroma_format_idc;
+      int      ii;
+      err = read_exp_golomb(bd,&chroma_format_idc);
+      CHECK("chroma_format_idc");
+      if (chroma_format_idc == 3)
+      {
+        err = read_bit(bd,&flag); // separate_colour_plane_flag
+        CHECK("separate_colour_plane_flag");
+      }
+      err = read_exp_golomb(bd,&temp); // bit_depth_luma_minus8
+      CHECK("bit_depth_luma");
+      err = read_exp_golomb(bd,&temp); // bit_depth_chroma_minus8
+      CHECK("bit_depth_chroma");
+      err = read_bit(bd,&flag); // qpprime_y_zero_transform_bypass_flag
+      CHECK("qpprime_y_zero_transform_bypass_flag");
+      err = read_bit(bd,&flag); // seq_scaling_matrix_present_flag
+      CHECK("seq_scaling_matrix_present_flag");
+      if (flag)
+      {
+        for (ii = 0; ii < ((chroma_format_idc != 3) ? 8 : 12); ii++)
+        {
+          err = read_bit(bd,&flag); // seq_scaling_list_present_flag[ii]
+          CHECK("seq_scaling_list_present_flag");
+          if (!err && flag)
+          {
+            err = skip_scaling_list(bd,(ii < 6) ? 16 : 64);
+            CHECK("scaling_list");
+          }
+        }
+      }
+      if (show_nal_details)
+        fprint_msg("   chroma_format_idc %u\n",chroma_format_idc);
+    }
+    break;
+  default:
+    break;
+  }
   // We care about log2_max_frame_num_minus4
   err = read_exp_golomb(bd,&data->log2_max_frame_num); // minus 4
   CHECK("log2_max_frame_num");
@@ -821,6 +1055,48 @@ static int read_seq_param_set_data(nal_unit_p   nal,
   if (show_nal_details)
     fprint_msg("   frame_mbs_only_flag %d\n",data->frame_mbs_only_flag);
 
+  // And then the VUI, which is where the timing and HRD information lives
+  data->vui_parameters_present_flag = FALSE;
+  data->timing_info_present_flag = FALSE;
+  data->fixed_frame_rate_flag = FALSE;
+  data->hrd_parameters_present_flag = FALSE;
+  data->low_delay_hrd_flag = FALSE;
+  data->pic_struct_present_flag = FALSE;
+  if (!data->frame_mbs_only_flag)
+  {
+    err = read_bit(bd,&flag); // mb_adaptive_frame_field_flag
+    CHECK("mb_adaptive_frame_field_flag");
+  }
+  err = read_bit(bd,&flag);   // direct_8x8_inference_flag
+  CHECK("direct_8x8_inference_flag");
+  err = read_bit(bd,&flag);   // frame_cropping_flag
+  CHECK("frame_cropping_flag");
+  if (flag)
+  {
+    int ii;
+    for (ii = 0; ii < 4; ii++)
+    {
+      err = read_exp_golomb(bd,&temp);
+      CHECK("frame_crop_offset");
+    }
+  }
+  err = read_bit(bd,&data->vui_parameters_present_flag);
+  if (err)
+    data->vui_parameters_present_flag = FALSE;
+  if (data->vui_parameters_present_flag)
+  {
+    err = read_vui_parameters(bd,data,show_nal_details);
+    if (err)
+    {
+      fprint_err("!!! Error reading VUI parameters from sequence parameter"
+                 " set at " OFFSET_T_FORMAT "/%d - ignoring them\n",
+                 nal->unit.start_posn.infile,nal->unit.start_posn.inpacket);
+      data->vui_parameters_present_flag = FALSE;
+      data->timing_info_present_flag = FALSE;
+      data->hrd_parameters_present_flag = FALSE;
+    }
+  }
+
   nal->decoded = TRUE;
   return 0;
 }
@@ -979,13 +1255,14 @@ static int read_rbsp_data(nal_unit_p   nal,
 
   if (err)
   {
-    fprint_err("### Error reading RBSP data for %s NAL (ref idc %x,"
-               " unit type %x) at " OFFSET_T_FORMAT_08 "/%04d\n",
-               NAL_UNIT_TYPE_STR(nal->nal_unit_type),
-               nal->nal_ref_idc,
-               nal->nal_unit_type,
-               nal->unit.start_posn.infile,
-               nal->unit.start_posn.inpacket);
+    fprint_err_limited("NAL unit RBSP data",
+                       "### Error reading RBSP data for %s NAL (ref idc %x,"
+                       " unit type %x) at " OFFSET_T_FORMAT_08 "/%04d\n",
+                       NAL_UNIT_TYPE_STR(nal->nal_unit_type),
+                       nal->nal_ref_idc,
+                       nal->nal_unit_type,
+                       nal->unit.start_posn.infile,
+                       nal->unit.start_posn.inpacket);
   }
 
   // At this point, we've finished with the actual RBSP data
@@ -1676,7 +1953,9 @@ extern int remember_param_data(param_dict_p  param_dict,
 
   if (param_dict->length == param_dict->size)
   {
-    int newsize = param_dict->size + NAL_PIC_PARAM_INCREMENT;
+    int newsize = param_dict->size * 2;
+    if (newsize < param_dict->size + NAL_PIC_PARAM_INCREMENT)
+      newsize = param_dict->size + NAL_PIC_PARAM_INCREMENT;
     param_dict->ids = realloc(param_dict->ids,newsize*sizeof(uint32_t));
     if (param_dict->ids == NULL)
     {
@@ -1690,13 +1969,13 @@ extern int remember_param_data(param_dict_p  param_dict,
       print_err("### Unable to extend parameter set dictionary array\n");
       return 1;
     }
-    param_dict->posns = realloc(param_dict->params,newsize*SIZEOF_ES_OFFSET);
+    param_dict->posns = realloc(param_dict->posns,newsize*SIZEOF_ES_OFFSET);
     if (param_dict->posns == NULL)
     {
       print_err("### Unable to extend parameter set dictionary array\n");
       return 1;
     }
-    param_dict->data_lens = realloc(param_dict->params,
+    param_dict->data_lens = realloc(param_dict->data_lens,
                                     newsize*sizeof(uint32_t));
     if (param_dict->data_lens == NULL)
     {
@@ -1857,7 +2136,9 @@ extern int append_to_nal_unit_list(nal_unit_list_p  list,
 {
   if (list->length == list->size)
   {
-    int newsize = list->size + NAL_UNIT_LIST_INCREMENT;
+    int newsize = list->size * 2;
+    if (newsize < list->size + NAL_UNIT_LIST_INCREMENT)
+      newsize = list->size + NAL_UNIT_LIST_INCREMENT;
     list->array = realloc(list->array,newsize*sizeof(nal_unit_p));
     if (list->array == NULL)
     {
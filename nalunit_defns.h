@@ -128,6 +128,20 @@ struct nal_seq_param_data
   uint32_t log2_max_pic_order_cnt_lsb;
   byte     delta_pic_order_always_zero_flag;
   byte     frame_mbs_only_flag;
+  // From the VUI, if present (and only the parts we care about)
+  byte     vui_parameters_present_flag;
+  byte     timing_info_present_flag;
+  uint32_t num_units_in_tick;
+  uint32_t time_scale;
+  byte     fixed_frame_rate_flag;
+  // From the NAL HRD parameters if present, else from the VCL HRD
+  // parameters, for SchedSelIdx 0 (the first, and usually only, schedule)
+  byte     hrd_parameters_present_flag;
+  uint64_t hrd_bit_rate;           // in bits/second
+  uint64_t hrd_cpb_size;           // in bits
+  byte     hrd_cbr_flag;
+  byte     low_delay_hrd_flag;
+  byte     pic_struct_present_flag;
 };
 typedef struct nal_seq_param_data *nal_seq_param_data_p;
 #define SIZEOF_NAL_SEQ_PARAM_DATA sizeof(struct nal_seq_param_data)
@@ -194,7 +208,7 @@ typedef struct param_dict *param_dict_p;
 #define SIZEOF_PARAM_DICT sizeof(struct param_dict)
 
 #define NAL_PIC_PARAM_START_SIZE  20
-#define NAL_PIC_PARAM_INCREMENT   20
+#define NAL_PIC_PARAM_INCREMENT   20  // at least - the arrays double in size
 
 // ------------------------------------------------------------
 // A single NAL unit
@@ -243,7 +257,7 @@ typedef struct nal_unit_list *nal_unit_list_p;
 #define SIZEOF_NAL_UNIT_LIST sizeof(struct nal_unit_list)
 
 #define NAL_UNIT_LIST_START_SIZE  20
-#define NAL_UNIT_LIST_INCREMENT   20
+#define NAL_UNIT_LIST_INCREMENT   20  // at least - the list doubles in size
 
 // ------------------------------------------------------------
 // A context for reading NAL units from an Elementary Stream
@@ -33,6 +33,14 @@
 #include "pcap.h"
 #include "misc_fns.h"
 
+#ifdef _WIN32
+#define pcap_fseek _fseeki64
+#define pcap_ftell _ftelli64
+#else
+#define pcap_fseek fseeko
+#define pcap_ftell ftello
+#endif
+
 static inline uint32_t uint_32_ctx(const struct _pcap_io_ctx *const ctx, const void *v)
 {
   return ctx->is_be ? uint_32_be(v) : uint_32_le(v);
@@ -490,6 +498,7 @@ static int pcap_read_header(PCAP_reader_p ctx, pcap_hdr_t *hdr)
                                  uint_32_le(&hdr_val[16]));
     hdr->network = (ctx->is_be ? uint_32_be(&hdr_val[20]) :
                                  uint_32_le(&hdr_val[20]));
+    ctx->snaplen = hdr->snaplen;
   }
 
 
@@ -560,6 +569,9 @@ extern int pcap_open(PCAP_reader_p *ctx_p, pcap_hdr_t *out_hdr,
     return -4;
   }
 
+  // Remember where the records start, if we're able to seek
+  ctx->data_start = (ctx->is_ng ? -1 : pcap_ftell(ctx->file));
+
   (*ctx_p) = ctx;
 
   return 0;
@@ -668,6 +680,303 @@ int pcap_close(PCAP_reader_p *const pctx)
   return 0;
 }
 
+// A bound on record sizes, whatever the snaplen says
+#define PCAP_MAX_RECORD_LEN (256 * 1024)
+
+static int time_before(uint32_t a_sec, uint32_t a_usec,
+                       uint32_t b_sec, uint32_t b_usec)
+{
+  return (a_sec < b_sec || (a_sec == b_sec && a_usec < b_usec));
+}
+
+// Could this be a record header, given the file's first timestamp?
+static int plausible_pktheader(const PCAP_reader_p ctx, const uint8_t *p,
+                               uint32_t first_sec, uint32_t *incl_len,
+                               uint32_t *ts_sec, uint32_t *ts_usec)
+{
+  uint32_t orig_len;
+
+  *ts_sec = uint_32_ctx(ctx, p);
+  *ts_usec = uint_32_ctx(ctx, p + 4);
+  *incl_len = uint_32_ctx(ctx, p + 8);
+  orig_len = uint_32_ctx(ctx, p + 12);
+
+  return (*ts_usec < 1000000 && *ts_sec >= first_sec &&
+          *incl_len <= orig_len && orig_len <= PCAP_MAX_RECORD_LEN &&
+          (ctx->snaplen == 0 || *incl_len <= ctx->snaplen));
+}
+
+/* Find the first record header at or after `from`, checking that the
+ * following records' headers are plausible too.
+ *
+ * Returns 1 and the record's position and time if found, 0 if we reach
+ * EOF first, < 0 on error.
+ */
+static int find_pktheader(const PCAP_reader_p ctx, uint8_t *buf,
+                          offset_t from, uint32_t first_sec,
+                          offset_t *pos, uint32_t *ts_sec, uint32_t *ts_usec)
+{
+  for (;;)
+  {
+    size_t n, ii;
+
+    if (pcap_fseek(ctx->file, from, SEEK_SET) != 0)
+      return PCAP_ERR_FILE_READ;
+    n = fread(buf, 1, PCAP_RESYNC_BUFFER_SIZE, ctx->file);
+    if (n < PCAP_RESYNC_BUFFER_SIZE && ferror(ctx->file))
+      return PCAP_ERR_FILE_READ;
+
+    for (ii = 0; ii + SIZEOF_PCAPREC_HDR_ON_DISC <= n; ii++)
+    {
+      size_t   here = ii;
+      int      count = 0;
+      int      decided = FALSE;
+      uint32_t sec, usec, incl_len;
+
+      // Follow a chain of three records
+      while (count < 3)
+      {
+        if (here + SIZEOF_PCAPREC_HDR_ON_DISC > n)
+        {
+          // We've run off the end of what we read - if that is the end of
+          // the file, and this is exactly where the last record ended,
+          // then all is well
+          if (n < PCAP_RESYNC_BUFFER_SIZE && here == n)
+            decided = TRUE;
+          break;
+        }
+        if (!plausible_pktheader(ctx, buf + here, first_sec, &incl_len,
+                                 &sec, &usec))
+          break;
+        if (count == 0)
+        {
+          *ts_sec = sec;
+          *ts_usec = usec;
+        }
+        here += SIZEOF_PCAPREC_HDR_ON_DISC + incl_len;
+        count++;
+      }
+      if (count == 3)
+        decided = TRUE;
+      else if (count > 0 && !decided && here + SIZEOF_PCAPREC_HDR_ON_DISC > n &&
+               n == PCAP_RESYNC_BUFFER_SIZE)
+      {
+        // The chain runs past our buffer - read on from here, unless we
+        // already are, in which case we'll have to make do
+        if (ii == 0)
+          decided = TRUE;
+        else
+          break;
+      }
+      if (decided)
+      {
+        *pos = from + ii;
+        return 1;
+      }
+    }
+    if (n < PCAP_RESYNC_BUFFER_SIZE)
+      return 0;
+    from += ii;
+  }
+}
+
+extern int pcap_seek_time(PCAP_reader_p ctx, uint32_t ts_sec, uint32_t ts_usec)
+{
+  uint8_t  hdr_val[SIZEOF_PCAPREC_HDR_ON_DISC];
+  uint8_t *buf;
+  offset_t lo, hi;
+  uint32_t first_sec;
+  int rv;
+
+  if (ctx->is_ng || ctx->data_start < 0)
+    return PCAP_ERR_CANNOT_SEEK;
+
+  if (pcap_fseek(ctx->file, 0, SEEK_END) != 0)
+    return PCAP_ERR_CANNOT_SEEK;
+  hi = pcap_ftell(ctx->file);
+  lo = ctx->data_start;
+
+  if (pcap_fseek(ctx->file, lo, SEEK_SET) != 0)
+    return PCAP_ERR_CANNOT_SEEK;
+  if (fread(hdr_val, SIZEOF_PCAPREC_HDR_ON_DISC, 1, ctx->file) != 1)
+    return (ferror(ctx->file) ? PCAP_ERR_FILE_READ : 0);
+  first_sec = uint_32_ctx(ctx, hdr_val);
+
+  buf = malloc(PCAP_RESYNC_BUFFER_SIZE);
+  if (!buf)
+    return PCAP_ERR_OUT_OF_MEMORY;
+
+  // `lo` is always the start of a record, and all records before it
+  // are earlier than we want
+  while (hi - lo > PCAP_RESYNC_BUFFER_SIZE)
+  {
+    offset_t mid = lo + (hi - lo) / 2;
+    offset_t pos;
+    uint32_t sec = 0, usec = 0;
+
+    rv = find_pktheader(ctx, buf, mid, first_sec, &pos, &sec, &usec);
+    if (rv < 0)
+    {
+      free(buf);
+      return rv;
+    }
+    if (rv == 0 || !time_before(sec, usec, ts_sec, ts_usec))
+      hi = mid;
+    else
+      lo = pos;
+  }
+  free(buf);
+
+  // And read forwards from there
+  for (;;)
+  {
+    uint32_t incl_len;
+
+    if (pcap_fseek(ctx->file, lo, SEEK_SET) != 0)
+      return PCAP_ERR_FILE_READ;
+    if (fread(hdr_val, SIZEOF_PCAPREC_HDR_ON_DISC, 1, ctx->file) != 1)
+      return (ferror(ctx->file) ? PCAP_ERR_FILE_READ : 0);
+    if (!time_before(uint_32_ctx(ctx, hdr_val), uint_32_ctx(ctx, hdr_val + 4),
+                     ts_sec, ts_usec))
+      break;
+    incl_len = uint_32_ctx(ctx, hdr_val + 8);
+    lo += SIZEOF_PCAPREC_HDR_ON_DISC + incl_len;
+  }
+  if (pcap_fseek(ctx->file, lo, SEEK_SET) != 0)
+    return PCAP_ERR_FILE_READ;
+  return 1;
+}
+
+extern int pcap_first_time(PCAP_reader_p ctx, uint32_t *ts_sec, uint32_t *ts_usec)
+{
+  uint8_t  hdr_val[SIZEOF_PCAPREC_HDR_ON_DISC];
+  offset_t posn;
+  int rv = 1;
+
+  if (ctx->is_ng || ctx->data_start < 0)
+    return PCAP_ERR_CANNOT_SEEK;
+
+  posn = pcap_ftell(ctx->file);
+  if (posn < 0 || pcap_fseek(ctx->file, ctx->data_start, SEEK_SET) != 0)
+    return PCAP_ERR_CANNOT_SEEK;
+  if (fread(hdr_val, SIZEOF_PCAPREC_HDR_ON_DISC, 1, ctx->file) != 1)
+    rv = (ferror(ctx->file) ? PCAP_ERR_FILE_READ : 0);
+  else
+  {
+    *ts_sec = uint_32_ctx(ctx, hdr_val);
+    *ts_usec = uint_32_ctx(ctx, hdr_val + 4);
+  }
+  clearerr(ctx->file);
+  if (pcap_fseek(ctx->file, posn, SEEK_SET) != 0)
+    return PCAP_ERR_FILE_READ;
+  return rv;
+}
+
+static void put_32_le(uint8_t *p, uint32_t val)
+{
+  p[0] = val & 0xff;
+  p[1] = (val >> 8) & 0xff;
+  p[2] = (val >> 16) & 0xff;
+  p[3] = (val >> 24) & 0xff;
+}
+
+extern int pcap_create(PCAP_writer_p *ctx_p, const char *filename,
+                       uint32_t network)
+{
+  uint8_t hdr_val[SIZEOF_PCAP_HDR_ON_DISC];
+  PCAP_writer_p ctx;
+
+  (*ctx_p) = NULL;
+
+  ctx = (PCAP_writer_p)calloc(SIZEOF_PCAP_WRITER, 1);
+  if (!ctx)
+  {
+    return PCAP_ERR_OUT_OF_MEMORY;
+  }
+  ctx->buffer = malloc(PCAP_WRITE_BUFFER_SIZE);
+  if (!ctx->buffer)
+  {
+    free(ctx);
+    return PCAP_ERR_OUT_OF_MEMORY;
+  }
+  ctx->file = fopen(filename, "wb");
+  if (!ctx->file)
+  {
+    free(ctx->buffer);
+    free(ctx);
+    return -1;
+  }
+  setvbuf(ctx->file, (char *)ctx->buffer, _IOFBF, PCAP_WRITE_BUFFER_SIZE);
+
+  // Always little-endian, version 2.4
+  put_32_le(&hdr_val[0], 0xa1b2c3d4);
+  hdr_val[4] = 2; hdr_val[5] = 0;
+  hdr_val[6] = 4; hdr_val[7] = 0;
+  put_32_le(&hdr_val[8], 0);       // thiszone
+  put_32_le(&hdr_val[12], 0);      // sigfigs
+  put_32_le(&hdr_val[16], 65535);  // snaplen
+  put_32_le(&hdr_val[20], network);
+
+  if (fwrite(hdr_val, SIZEOF_PCAP_HDR_ON_DISC, 1, ctx->file) != 1 ||
+      fflush(ctx->file) != 0)
+  {
+    fclose(ctx->file);
+    free(ctx->buffer);
+    free(ctx);
+    return PCAP_ERR_FILE_WRITE;
+  }
+
+  (*ctx_p) = ctx;
+  return 0;
+}
+
+extern int pcap_write_next(PCAP_writer_p ctx,
+                           uint32_t ts_sec, uint32_t ts_usec,
+                           const uint8_t *hdr, uint32_t hdr_len,
+                           const uint8_t *data, uint32_t data_len)
+{
+  uint8_t rec_val[SIZEOF_PCAPREC_HDR_ON_DISC];
+  uint32_t len = hdr_len + data_len;
+
+  put_32_le(&rec_val[0], ts_sec);
+  put_32_le(&rec_val[4], ts_usec);
+  put_32_le(&rec_val[8], len);   // incl_len
+  put_32_le(&rec_val[12], len);  // orig_len
+
+  if (fwrite(rec_val, SIZEOF_PCAPREC_HDR_ON_DISC, 1, ctx->file) != 1)
+    return PCAP_ERR_FILE_WRITE;
+  if (hdr_len && fwrite(hdr, hdr_len, 1, ctx->file) != 1)
+    return PCAP_ERR_FILE_WRITE;
+  if (data_len && fwrite(data, data_len, 1, ctx->file) != 1)
+    return PCAP_ERR_FILE_WRITE;
+  return 0;
+}
+
+extern int pcap_flush(PCAP_writer_p ctx)
+{
+  if (ctx == NULL)
+    return 0;
+  return (fflush(ctx->file) == 0 ? 0 : PCAP_ERR_FILE_WRITE);
+}
+
+extern int pcap_write_close(PCAP_writer_p *const pctx)
+{
+  PCAP_writer_p ctx = *pctx;
+  int rv = 0;
+
+  if (ctx == NULL)
+    return 0;
+
+  if (fclose(ctx->file) != 0)
+  {
+    rv = PCAP_ERR_FILE_WRITE;
+  }
+  free(ctx->buffer);
+  free(ctx);
+  (*pctx) = NULL;
+
+  return rv;
+}
 
 // Local Variables:
 // tab-width: 8
@@ -130,6 +130,12 @@ typedef struct _pcap_io_ctx
   uint32_t if_size;
   pcapng_hdr_interface_t * interfaces;
 
+  /*! Snapshot length, from the (classic) file header */
+  uint32_t snaplen;
+
+  /*! Where the first record starts, for seeking */
+  offset_t data_start;
+
 } PCAP_reader_t;
 
 typedef struct _pcap_io_ctx *PCAP_reader_p;
@@ -157,6 +163,87 @@ int pcap_read_next(PCAP_reader_p ctx_p, pcaprec_hdr_t *out_hdr,
 /*! Close the pcap file */
 int pcap_close(PCAP_reader_p * const ctx_p);
 
+//! Seeking is not possible (pcapng, or not a seekable file)
+#define PCAP_ERR_CANNOT_SEEK (-14)
+
+/*! How much we read at a time when looking for a record header at an
+ *  arbitrary position in the file, and (roughly) how close a binary search
+ *  gets before we read sequentially.
+ */
+#define PCAP_RESYNC_BUFFER_SIZE (1024 * 1024)
+
+/*! Position a (classic) pcap file so that the next packet read is the
+ *  first with a timestamp at or after `ts_sec`.`ts_usec`.
+ *
+ *  Record timestamps are assumed to (broadly) increase through the file,
+ *  and the position is found by binary search, resynchronising on record
+ *  headers at each probe - so the cost is logarithmic in the size of the
+ *  file, rather than linear.
+ *
+ * \return 1 on success, 0 if there is no such packet (we are then at
+ *  EOF), < 0 on error (PCAP_ERR_CANNOT_SEEK if seeking is not possible).
+ */
+int pcap_seek_time(PCAP_reader_p ctx, uint32_t ts_sec, uint32_t ts_usec);
+
+/*! Find the timestamp of the first packet in a (classic) pcap file,
+ *  without changing our position in it.
+ *
+ * \return 1 on success, 0 if there are no packets, < 0 on error
+ *  (PCAP_ERR_CANNOT_SEEK if seeking is not possible).
+ */
+int pcap_first_time(PCAP_reader_p ctx, uint32_t *ts_sec, uint32_t *ts_usec);
+
+
+//! File write error
+#define PCAP_ERR_FILE_WRITE (-13)
+
+/*! How much output we buffer before writing it out - recording a
+ *  datagram must not cost a system call.
+ */
+#define PCAP_WRITE_BUFFER_SIZE (1024 * 1024)
+
+typedef struct _pcap_writer_ctx
+{
+  /*! The FILE* for this file */
+  FILE *file;
+
+  /*! Our (large) output buffer */
+  uint8_t *buffer;
+
+} PCAP_writer_t;
+
+typedef struct _pcap_writer_ctx *PCAP_writer_p;
+#define SIZEOF_PCAP_WRITER sizeof(struct _pcap_writer_ctx)
+
+/*! Create a (classic, microsecond resolution) pcap file, and write
+ *  its header. The header is written out at once, so the file may
+ *  safely be shared with a forked child process which then writes
+ *  the records.
+ *
+ * \param filename IN Filename to create.
+ * \param network IN Network type, e.g., PCAP_NETWORK_TYPE_ETHERNET
+ * \return 0 on success, non-zero on failure.
+ */
+int pcap_create(PCAP_writer_p *ctx_p, const char *filename,
+                uint32_t network);
+
+/*! Write a packet record. The packet data is given in two parts,
+ *  `hdr` and `data` (either of which may be empty), so that a caller
+ *  can prepend protocol headers without copying the payload.
+ *
+ * \return 0 on success, < 0 on error.
+ */
+int pcap_write_next(PCAP_writer_p ctx,
+                    uint32_t ts_sec, uint32_t ts_usec,
+                    const uint8_t *hdr, uint32_t hdr_len,
+                    const uint8_t *data, uint32_t data_len);
+
+/*! Write out anything still buffered */
+int pcap_flush(PCAP_writer_p ctx);
+
+/*! Flush and close a pcap file opened for writing */
+int pcap_write_close(PCAP_writer_p * const ctx_p);
+
 #endif
 
 // Local Variables:
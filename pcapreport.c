@@ -52,25 +52,18 @@
 #include "version.h"
 #include "misc_fns.h"
 #include "ts_fns.h"
+#include "stats_fns.h"
 #include "fmtx.h"
 
 typedef struct pcapreport_stream_struct pcapreport_stream_t;
 
+// Jitter is the spread of skews over (up to) the last 10s, or the last
+// JITTER_BUF_SIZE - 1 PCRs, whichever is fewer
 #define JITTER_BUF_SIZE 1024
+#define JITTER_RANGE    (90000 * 10)
 
-typedef struct jitter_el_struct {
-  uint32_t t;
-  int delta;
-} jitter_el_t;
-
-typedef struct jitter_env_struct {
-  int min_val;
-  int max_val;
-  int in_n;
-  int out_n;
-  int len;
-  jitter_el_t buf[JITTER_BUF_SIZE];
-} jitter_env_t;
+// Smoothing factor for the "sustained" jitter - roughly the last 16 PCRs
+#define JITTER_EWMA_ALPHA (1.0 / 16)
 
 typedef struct pcapreport_section_struct pcapreport_section_t;
 struct pcapreport_section_struct {
@@ -78,6 +71,9 @@ struct pcapreport_section_struct {
   unsigned int section_no;
   unsigned int pcr_count;
   unsigned int jitter_max;
+  struct stats_sketch jitter_sketch;  // for the median, etc.
+  struct stats_ewma jitter_ewma;      // smoothed jitter
+  double jitter_sustained_max;        // max of the smoothed jitter
   uint32_t pkt_start;
   uint32_t pkt_final;
   uint64_t time_start;  // 90kHz
@@ -127,7 +123,8 @@ typedef struct rtp_header_s
 } rtp_header_t;
 
 struct pcapreport_stream_struct {
-  pcapreport_stream_t * hash_next;
+  pcapreport_stream_t * retired_next;  // Next in the list of retired streams
+  uint64_t last_seen;  // 90kHz, time of the last packet (for ageing)
 
   const char *output_name;
   FILE *output_file;
@@ -173,7 +170,7 @@ struct pcapreport_stream_struct {
   pcapreport_vlan_info_t vlans[ETHERNET_VLANS_MAX];
   pcapreport_rtp_info_t rtp_info;
 
-  jitter_env_t jitter;
+  stats_window_p jitter;
 };
 
 
@@ -192,6 +189,18 @@ typedef struct pcapreport_reassembly_struct
 
 
 
+// An entry in the flow table. We keep a copy of the stream's hash and
+// destination, so that most mismatches don't need to look at the stream.
+typedef struct pcapreport_flow_struct
+{
+  uint32_t hash;
+  uint32_t dest_addr;
+  uint32_t dest_port;
+  pcapreport_stream_t * st;  // NULL if this slot is empty
+} pcapreport_flow_t;
+
+#define FLOW_TABLE_START_SIZE 256
+
 typedef struct pcapreport_ctx_struct
 {
   int use_stdin;
@@ -229,101 +238,76 @@ typedef struct pcapreport_ctx_struct
   uint32_t time_usec;
   time_t time_sec;
 
+  // Only look at packets in this window (microseconds from the first
+  // packet in the capture)
+  int have_window_start;
+  int have_window_end;
+  int64_t window_start;
+  int64_t window_end;
+
   uint8_t rtp_raw_wanted[256];
 
-  pcapreport_stream_t * stream_hash[256];
+  // The streams (flows) we know about, in an open addressing hash table
+  // (with linear probing) that doubles in size whenever it becomes half
+  // full. Streams that have been idle for longer than flow_idle (if that
+  // is set) are retired - their output files are closed, and they move
+  // to the retired list, where they wait to be reported on.
+  pcapreport_flow_t * flow_table;
+  unsigned int flow_table_size;  // always a power of 2
+  unsigned int flow_count;       // how many are in the table
+  pcapreport_stream_t * flow_retired;
+  uint64_t flow_idle;            // 90kHz, 0 means never retire
+  uint64_t flow_last_aged;       // 90kHz
+
+  // Counters for the flow table
+  uint64_t flow_lookups;
+  uint64_t flow_probes;
+  unsigned int flow_max_probes;
+  unsigned int flow_resizes;
+  unsigned int flow_retired_count;
+
   pcapreport_reassembly_t reassembly_env;
 } pcapreport_ctx_t;
 
 
-static unsigned int
-jitter_value(const jitter_env_t * const je)
+static uint64_t
+pkt_time(const pcaprec_hdr_t * const pcap_pkt_hdr)
 {
-  return je->max_val - je->min_val;
+  return (((int64_t)pcap_pkt_hdr->ts_usec*9)/100) +
+    ((int64_t)pcap_pkt_hdr->ts_sec * 90000);
 }
 
-static unsigned int
-jitter_add(jitter_env_t * const je, const int delta, const uint32_t time, const uint32_t range)
-{
-  jitter_el_t * const eob = je->buf + JITTER_BUF_SIZE;
-  jitter_el_t * const in_el = je->buf + je->in_n;
-  jitter_el_t * out_el = je->buf + je->out_n;
-  jitter_el_t * const next_el = (je->in_n == JITTER_BUF_SIZE - 1) ? je->buf : in_el + 1;
-  int needs_scan = FALSE;
-
-  // 1st expire anything we no longer want - in any case expire one if
-  // we are about to overflow.
-  while (in_el != out_el && (time - out_el->t > range || out_el == next_el))
-  {
-    if (out_el->delta == je->min_val || out_el->delta == je->max_val)
-      needs_scan = TRUE;
 
-    // Inc with wrap
-    if (++out_el >= eob)
-      out_el = je->buf;
-  }
+// Read a time of the form [[hh:]mm:]ss[.frac] as microseconds
+static int
+time_offset_value(const char * const prefix, const char * const cmd,
+                  const char * const arg, int64_t * const result)
+{
+  const char * p = arg;
+  double secs = 0;
+  int parts = 0;
 
-  if (needs_scan || in_el == out_el)
+  for (;;)
   {
-    // Only recalc max & min for the buffer if we have expired a previous one
-    // also if empty then must force both to delta which this code will do
-
-    const jitter_el_t * el = out_el;
-    int min_val = delta;
-    int max_val = delta;
-
-    while (el != in_el)
+    char * end;
+    double val = strtod(p, &end);
+    if (end == p || val < 0 || ++parts > 3)
+      break;
+    secs = secs * 60 + val;
+    if (*end == '\0')
     {
-      if (el->delta > max_val)
-        max_val = el->delta;
-      if (el->delta < min_val)
-        min_val = el->delta;
-
-      if (++el >= eob)
-        el = je->buf;
+      *result = (int64_t)(secs * 1000000 + 0.5);
+      return 0;
     }
-
-    je->max_val = max_val;
-    je->min_val = min_val;
-  }
-  else
-  {
-    // Otherwise check to see if this is a new max/min based on old values
-
-    if (delta > je->max_val)
-      je->max_val = delta;
-    if (delta < je->min_val)
-      je->min_val = delta;
+    if (*end != ':' || memchr(p, '.', end - p) != NULL)
+      break;  // only the last part may have a fraction
+    p = end + 1;
   }
-
-  // Now add to the end
-  in_el->t = time;
-  in_el->delta = delta;
-
-  // and update the environment
-  je->in_n = next_el - je->buf;
-  je->out_n = out_el - je->buf;
-
-  return jitter_value(je);
-}
-
-static void
-jitter_clear(jitter_env_t * const je)
-{
-  je->in_n = 0;
-  je->out_n = 0;
-  je->max_val = 0;
-  je->min_val = 0;
-}
-
-static uint64_t
-pkt_time(const pcaprec_hdr_t * const pcap_pkt_hdr)
-{
-  return (((int64_t)pcap_pkt_hdr->ts_usec*9)/100) +
-    ((int64_t)pcap_pkt_hdr->ts_sec * 90000);
+  fprint_err("### %s: Time '%s' for %s is not of the form"
+             " [[hh:]mm:]ss[.frac]\n", prefix, arg, cmd);
+  return 1;
 }
 
-
 static char *
 vlan_name(const char * prefix, const pcapreport_stream_t * const st, const size_t blen, char * const buf)
 {
@@ -465,6 +449,8 @@ section_create(const pcapreport_ctx_t * const ctx, pcapreport_stream_t * const s
   if (tsect == NULL)
     return NULL;
 
+  init_stats_ewma(&tsect->jitter_ewma, JITTER_EWMA_ALPHA);
+
   // Bind into stream
 
   if (last == NULL)
@@ -570,8 +556,9 @@ static int digest_times(pcapreport_ctx_t * const ctx,
 
     if (rtp_seq_delta != 0)
     {
-      fprint_msg("!%d! @%u: RTP seq delta (%u->%u) != 1\n", st->stream_no, ctx->pkt_counter,
-          ri->last_seq, rtp_header->sequence_number);
+      fprint_msg_limited("RTP sequence", "!%d! @%u: RTP seq delta (%u->%u) != 1\n",
+                         st->stream_no, ctx->pkt_counter,
+                         ri->last_seq, rtp_header->sequence_number);
     }
 
     ++ri->n;
@@ -634,10 +621,11 @@ static int digest_times(pcapreport_ctx_t * const ctx,
                            &payload, &payload_len);
       if (rv)
       {
-        fprint_msg(">%d> WARNING: TS packet %d [ packet %d @ %d.%d s ] cannot be split.\n",
-                   st->stream_no,
-                   st->ts_counter, ctx->pkt_counter, 
-                   pcap_pkt_hdr->ts_sec, pcap_pkt_hdr->ts_usec);
+        fprint_msg_limited("TS packet split",
+                           ">%d> WARNING: TS packet %d [ packet %d @ %d.%d s ] cannot be split.\n",
+                           st->stream_no,
+                           st->ts_counter, ctx->pkt_counter, 
+                           pcap_pkt_hdr->ts_sec, pcap_pkt_hdr->ts_usec);
       }
       else
       {
@@ -728,15 +716,17 @@ static int digest_times(pcapreport_ctx_t * const ctx,
                 tsect->time_last =
                 tsect->time_first = t_pcr;
 
-                jitter_clear(&st->jitter);
+                clear_stats_window(st->jitter);
                 skew = 0;
                 st->last_time_offset = 0;
               }
 
               // Extract jitter over up to the last 10s.  skew will be within
               // an int by now
-              cur_jitter = jitter_add(&st->jitter, (int)skew,
-                (uint32_t)(t_pcr & 0xffffffffU), 90000 * 10);
+              stats_window_add(st->jitter, t_pcr, (int)skew);
+              cur_jitter = (unsigned int)(stats_window_max(st->jitter) -
+                                          stats_window_min(st->jitter));
+              stats_sketch_add(&tsect->jitter_sketch, cur_jitter);
 
               if (tsect->skew_max < skew)
                 tsect->skew_max = skew;
@@ -745,6 +735,11 @@ static int digest_times(pcapreport_ctx_t * const ctx,
 
               if (tsect->jitter_max < cur_jitter)
                 tsect->jitter_max = cur_jitter;
+              {
+                double smoothed = stats_ewma_add(&tsect->jitter_ewma, cur_jitter);
+                if (tsect->jitter_sustained_max < smoothed)
+                  tsect->jitter_sustained_max = smoothed;
+              }
 
               if (rtp_header->is_rtp_ts)
               {
@@ -1057,14 +1052,14 @@ stream_merge_vlan_info(pcapreport_stream_t * const st, const ethernet_packet_t *
 
 // Close the stream
 // Closes any extraction file(s) & frees associated memory
-// Replaces contents of passed stream pointer with next in hash chain
+// Replaces contents of passed stream pointer with next in retired list
 void
 stream_close(pcapreport_ctx_t * const ctx, pcapreport_stream_t ** pst)
 {
   pcapreport_stream_t * const st = *pst;
 
   // Set pointer to next in chain
-  *pst = st->hash_next;
+  *pst = st->retired_next;
 
   {
     // Free off all our section data
@@ -1082,6 +1077,7 @@ stream_close(pcapreport_ctx_t * const ctx, pcapreport_stream_t ** pst)
     free((void *)st->csv_name);
   if (st->output_name != NULL)
     free((void *)st->output_name);
+  free_stats_window(&st->jitter);
   free(st);
 }
 
@@ -1104,6 +1100,13 @@ stream_create(pcapreport_ctx_t * const ctx, const pcaprec_hdr_t * const pcap_pkt
 
   st->skew_discontinuity_threshold = ctx->opt_skew_discontinuity_threshold;
   st->force = ctx->keep_bad;
+  st->last_seen = pkt_time(pcap_pkt_hdr);
+
+  if (build_stats_window(JITTER_BUF_SIZE - 1, JITTER_RANGE, 0, &st->jitter))
+  {
+    stream_close(ctx, &st);
+    return NULL;
+  }
 
   // Even if we don't need sections it won't hurt to have one
   // Also generates output names
@@ -1176,7 +1179,9 @@ stream_analysis(const pcapreport_ctx_t * const ctx, const pcapreport_stream_t *
   else
   {
     const pcapreport_section_t * tsect;
+    struct stats_sketch all_jitter;
 
+    memset(&all_jitter, 0, sizeof(all_jitter));
     fprint_msg("  Pkts: Good=%d, Dodgy=%d, Bad=%d, Overlength=%u\n",
       st->seen_good - st->seen_dodgy, st->seen_dodgy, st->seen_bad, st->pkts_overlength);
 
@@ -1227,6 +1232,11 @@ stream_analysis(const pcapreport_ctx_t * const ctx, const pcapreport_stream_t *
         fprint_msg("    Max jitter: %s; Skew min: %s, max: %s\n", fmtx_timestamp(tsect->jitter_max, ctx->tfmt),
           fmtx_timestamp(tsect->skew_min, ctx->tfmt),
           fmtx_timestamp(tsect->skew_max, ctx->tfmt));
+        fprint_msg("    Jitter median: %s, 99%%: %s; Sustained max: %s\n",
+          fmtx_timestamp(stats_sketch_quantile(&tsect->jitter_sketch, 0.5), ctx->tfmt),
+          fmtx_timestamp(stats_sketch_quantile(&tsect->jitter_sketch, 0.99), ctx->tfmt),
+          fmtx_timestamp((int64_t)(tsect->jitter_sustained_max + 0.5), ctx->tfmt));
+        stats_sketch_merge(&all_jitter, &tsect->jitter_sketch);
       }
       if (st->rtp_info.n != 0)
       {
@@ -1236,18 +1246,35 @@ stream_analysis(const pcapreport_ctx_t * const ctx, const pcapreport_stream_t *
           fmtx_timestamp(tsect->rtp_skew_max - tsect->rtp_skew_min, ctx->tfmt));
       }
     }
+    if (st->section_first != st->section_last && all_jitter.count != 0)
+    {
+      fprint_msg("  All sections: Jitter median: %s, 99%%: %s\n",
+        fmtx_timestamp(stats_sketch_quantile(&all_jitter, 0.5), ctx->tfmt),
+        fmtx_timestamp(stats_sketch_quantile(&all_jitter, 0.99), ctx->tfmt));
+    }
   }
 
   fprint_msg("\n");
 }
 
 
-unsigned int
-stream_hash(uint32_t const dest_addr, const uint32_t dest_port)
+static uint32_t
+stream_hash(uint32_t const dest_addr, const uint32_t dest_port,
+            const ethernet_packet_t * const epkt)
 {
-  uint32_t x = dest_addr ^ dest_port;
-  x ^= x >> 16;
-  return (x ^ (x >> 8)) & 0xff;
+  int i;
+  uint32_t h = (dest_addr * 0x9e3779b1U) ^ dest_port;
+
+  for (i = 0; i < epkt->vlan_count; ++i)
+    h = (h ^ epkt->vlans[i].vid) * 0x85ebca6bU;
+
+  // Finish off by mixing all the bits (the murmur3 finaliser)
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+  return h;
 }
 
 static int
@@ -1266,29 +1293,155 @@ stream_vlan_match(const pcapreport_stream_t * const st, const ethernet_packet_t
   return TRUE;
 }
 
+// Double the size of the flow table (or create it, if it's not there yet)
+// Returns 0 if OK, 1 if out of memory
+static int
+flow_table_grow(pcapreport_ctx_t * const ctx)
+{
+  const unsigned int old_size = ctx->flow_table_size;
+  const unsigned int new_size = old_size == 0 ? FLOW_TABLE_START_SIZE : old_size * 2;
+  const unsigned int mask = new_size - 1;
+  pcapreport_flow_t * const old_table = ctx->flow_table;
+  pcapreport_flow_t * const new_table = calloc(new_size, sizeof(*new_table));
+  unsigned int i;
+
+  if (new_table == NULL)
+  {
+    print_err("### pcapreport: Unable to grow flow table\n");
+    return 1;
+  }
+
+  for (i = 0; i != old_size; ++i)
+  {
+    if (old_table[i].st != NULL)
+    {
+      unsigned int j = old_table[i].hash & mask;
+      while (new_table[j].st != NULL)
+        j = (j + 1) & mask;
+      new_table[j] = old_table[i];
+    }
+  }
+
+  free(old_table);
+  ctx->flow_table = new_table;
+  ctx->flow_table_size = new_size;
+  if (old_size != 0)
+    ++ctx->flow_resizes;
+  return 0;
+}
+
+// Remove the entry in slot i of the flow table, moving back any later
+// entries in its probe sequence so that they can still be found
+static void
+flow_table_remove(pcapreport_ctx_t * const ctx, unsigned int i)
+{
+  pcapreport_flow_t * const table = ctx->flow_table;
+  const unsigned int mask = ctx->flow_table_size - 1;
+  unsigned int j = i;
+
+  for (;;)
+  {
+    unsigned int k;
+
+    j = (j + 1) & mask;
+    if (table[j].st == NULL)
+      break;
+
+    // Can the entry at j move to the hole at i? Only if its home slot, k,
+    // is not (cyclically) between the hole and it.
+    k = table[j].hash & mask;
+    if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+      continue;
+
+    table[i] = table[j];
+    i = j;
+  }
+  table[i].st = NULL;
+  --ctx->flow_count;
+}
+
+// Retire any streams that haven't been seen for flow_idle
+static void
+flow_table_age(pcapreport_ctx_t * const ctx, const uint64_t now)
+{
+  unsigned int i = 0;
+
+  while (i < ctx->flow_table_size)
+  {
+    pcapreport_stream_t * const st = ctx->flow_table[i].st;
+
+    if (st != NULL && (int64_t)(now - st->last_seen) > (int64_t)ctx->flow_idle)
+    {
+      stream_close_files(ctx, st);
+      st->retired_next = ctx->flow_retired;
+      ctx->flow_retired = st;
+      ++ctx->flow_retired_count;
+      // This may move another entry into slot i, so look at it again
+      flow_table_remove(ctx, i);
+    }
+    else
+      ++i;
+  }
+}
+
 pcapreport_stream_t *
 stream_find(pcapreport_ctx_t * const ctx,
     const pcaprec_hdr_t * const pcap_pkt_hdr, const ethernet_packet_t * const epkt,
     uint32_t const dest_addr, const uint32_t dest_port)
 {
-  const unsigned int h = stream_hash(dest_addr, dest_port);
-  pcapreport_stream_t ** pst = ctx->stream_hash + h;
+  const uint32_t h = stream_hash(dest_addr, dest_port, epkt);
+  const uint64_t now = pkt_time(pcap_pkt_hdr);
+  unsigned int probes = 1;
+  unsigned int mask;
+  unsigned int i;
   pcapreport_stream_t * st;
 
-  while ((st = *pst) != NULL)
+  // Retirement is checked four times per idle period, which is often
+  // enough to be reasonably prompt without scanning the table too often
+  if (ctx->flow_idle != 0 &&
+      (int64_t)(now - ctx->flow_last_aged) > (int64_t)(ctx->flow_idle / 4))
   {
-    if (st->output_dest_addr == dest_addr && st->output_dest_port == dest_port &&
+    flow_table_age(ctx, now);
+    ctx->flow_last_aged = now;
+  }
+
+  // Keep the table at most half full, so probe sequences stay short
+  if ((ctx->flow_count + 1) * 2 > ctx->flow_table_size)
+  {
+    if (flow_table_grow(ctx))
+      return NULL;
+  }
+
+  mask = ctx->flow_table_size - 1;
+  ++ctx->flow_lookups;
+  for (i = h & mask; (st = ctx->flow_table[i].st) != NULL; i = (i + 1) & mask, ++probes)
+  {
+    const pcapreport_flow_t * const f = ctx->flow_table + i;
+    if (f->hash == h && f->dest_addr == dest_addr && f->dest_port == dest_port &&
         stream_vlan_match(st, epkt))
     {
-      return st;
+      break;
     }
-    pst = &st->hash_next;
+  }
+
+  ctx->flow_probes += probes;
+  if (probes > ctx->flow_max_probes)
+    ctx->flow_max_probes = probes;
+
+  if (st != NULL)
+  {
+    st->last_seen = now;
+    return st;
   }
 
   if ((st = stream_create(ctx, pcap_pkt_hdr, epkt, dest_addr, dest_port)) == NULL)
     return NULL;
 
-  *pst = st;
+  ctx->flow_table[i].hash = h;
+  ctx->flow_table[i].dest_addr = dest_addr;
+  ctx->flow_table[i].dest_port = dest_port;
+  ctx->flow_table[i].st = st;
+  ++ctx->flow_count;
   return st;
 }
 
@@ -1417,6 +1570,12 @@ static void print_usage()
     "  -keep-bad          Extract all packets including bad ones.  Is implied if\n"
     "                     an ip & port filter is set.  Overriden by --good-ts-only.\n"
     "  -tfmt 32|90|ms|hms Set time format in report [default = 90kHz units]\n"
+    "  -start <time>\n"
+    "  -end <time>        Only look at packets in this window. Times are of the\n"
+    "                     form [[hh:]mm:]ss[.frac], from the first packet in the\n"
+    "                     capture. For (non-pcapng) files, we seek directly to\n"
+    "                     the start of the window, and packets are then\n"
+    "                     numbered from there.\n"
     "  -dump-data, -D     Dump any data in the input file to stdout.\n"
     "  -extra-dump, -e    Dump only data which isn't being sent to the -o file.\n"
     "  -times,  -t        Report continuously on PCR vs PCAP timing for the\n"
@@ -1425,6 +1584,15 @@ static void print_usage()
     "  -skew-discontinuity-threshold <number>\n"
     "  -skew <number>     Gives the skew discontinuity threshold in 90kHz units.\n"
     "                     A value of 0 disables this. [default = 6*90000]\n"
+    "  -flow-idle <secs>  Retire streams that have had no packets for <secs>\n"
+    "                     seconds, closing any files they are extracting to.\n"
+    "                     A retired stream that starts again is treated as a\n"
+    "                     new stream. [default = never]\n"
+    "  -diag-limit <n>    Only show the first <n> messages about each sort of\n"
+    "                     per-packet problem (RTP sequence errors, TS packets\n"
+    "                     that cannot be split, and so on), and after that\n"
+    "                     just count them, with a summary every few seconds.\n"
+    "                     0 shows all of them. [default = 0]\n"
     "\n"
     "  -err stdout        Write error messages to standard output (the default)\n"
     "  -err stderr        Write error messages to standard error (Unix traditional)\n"
@@ -1495,6 +1663,20 @@ static char manpage[] =
 "----------\n"
 "\n"
 "The maximum value of jitter (see above) found in a section\n"
+"\n"
+"Jitter median, 99%\n"
+"------------------\n"
+"\n"
+"The median and 99th percentile of the jitter values found in a section\n"
+"(to within about 1%). If a stream has more than one section, these are\n"
+"also given over all of its sections.\n"
+"\n"
+"Sustained max\n"
+"-------------\n"
+"\n"
+"The largest value reached by the jitter when smoothed with an exponentially\n"
+"weighted moving average over roughly the last 16 PCRs. Unlike Max jitter,\n"
+"this is not raised by a single late or early packet.\n"
 "";
 
 
@@ -1637,6 +1819,24 @@ int main(int argc, char **argv)
         ctx->opt_skew_discontinuity_threshold = val;
         ++ii;
       }
+      else if (!strcmp("flow-idle", arg))
+      {
+        int val;
+        CHECKARG("pcapreport",ii);
+        err = int_value("pcapreport", argv[ii], argv[ii+1], TRUE, 0, &val);
+        if (err) return 1;
+        ctx->flow_idle = (uint64_t)val * 90000;
+        ++ii;
+      }
+      else if (!strcmp("diag-limit", arg))
+      {
+        int val;
+        CHECKARG("pcapreport",ii);
+        err = int_value("pcapreport", argv[ii], argv[ii+1], TRUE, 10, &val);
+        if (err) return 1;
+        set_diagnostic_limit(val);
+        ++ii;
+      }
       else if (strcmp("name", arg) == 0)
       {
         CHECKARG("pcapreport",ii);
@@ -1662,6 +1862,24 @@ int main(int argc, char **argv)
       {
         ctx->file_split_section = TRUE;
       }
+      else if (strcmp("start", arg) == 0 || strcmp("end", arg) == 0)
+      {
+        int64_t val;
+        CHECKARG("pcapreport",ii);
+        err = time_offset_value("pcapreport", argv[ii], argv[ii + 1], &val);
+        if (err) return 1;
+        if (arg[0] == 's')
+        {
+          ctx->have_window_start = TRUE;
+          ctx->window_start = val;
+        }
+        else
+        {
+          ctx->have_window_end = TRUE;
+          ctx->window_end = val;
+        }
+        ++ii;
+      }
       else if (strcmp("tfmt", arg) == 0)
       {
         int tfmt;
@@ -1772,6 +1990,34 @@ int main(int argc, char **argv)
 
   {
     int done = 0;
+    int have_first = FALSE;
+    int64_t first_usec = 0;   // time of the first packet in the capture
+
+    if (ctx->have_window_start || ctx->have_window_end)
+    {
+      uint32_t sec, usec;
+      err = pcap_first_time(ctx->pcreader, &sec, &usec);
+      if (err == 1)
+      {
+        have_first = TRUE;
+        first_usec = (int64_t)sec * 1000000 + usec;
+      }
+      if (err == 1 && ctx->have_window_start)
+      {
+        int64_t target = first_usec + ctx->window_start;
+        err = pcap_seek_time(ctx->pcreader, (uint32_t)(target / 1000000),
+                             (uint32_t)(target % 1000000));
+        if (err < 0)
+        {
+          fprint_err("### pcapreport: Error seeking to the start of the"
+                     " window (code %d)\n", err);
+          return 1;
+        }
+      }
+      else if (err == PCAP_ERR_CANNOT_SEEK)
+        fprint_err("!!! pcapreport: Cannot seek in %s - reading through to"
+                   " the window\n", ctx->input_name);
+    }
 
     while (!done)
     {
@@ -1781,6 +2027,26 @@ int main(int argc, char **argv)
       int sent_to_output = 0;
 
       err = pcap_read_next(ctx->pcreader, &rec_hdr, &data, &len);
+      if (err == 1 && (ctx->have_window_start || ctx->have_window_end))
+      {
+        const int64_t t = (int64_t)rec_hdr.ts_sec * 1000000 + rec_hdr.ts_usec;
+        if (!have_first)
+        {
+          have_first = TRUE;
+          first_usec = t;
+        }
+        if (ctx->have_window_end && t - first_usec > ctx->window_end)
+        {
+          free(data);
+          break;
+        }
+        if (ctx->have_window_start && t - first_usec < ctx->window_start)
+        {
+          // Only if we could not seek
+          free(data);
+          continue;
+        }
+      }
       switch (err)
       {
       case 0: // EOF.
@@ -2001,6 +2267,11 @@ dump_out:
       t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
       t->tm_hour, t->tm_min, t->tm_sec, ctx->time_usec);
     fprint_msg("Pcap pkts: %u\n", ctx->pkt_counter);
+    if (ctx->flow_lookups != 0)
+      fprint_msg("Flows: %u (%u retired); table size %u, %u resize%s; %.2f probes/lookup (max %u)\n",
+        ctx->stream_count, ctx->flow_retired_count,
+        ctx->flow_table_size, ctx->flow_resizes, ctx->flow_resizes == 1 ? "" : "s",
+        (double)ctx->flow_probes / (double)ctx->flow_lookups, ctx->flow_max_probes);
     fprint_msg("\n");
 
     // Spit out the per stream info
@@ -2011,14 +2282,15 @@ dump_out:
       pcapreport_stream_t ** const streams = malloc(sizeof(pcapreport_stream_t *) * ctx->stream_count);
 
       // Add to array for sorting
-      for (i = 0; i != 256; ++i)
+      for (i = 0; i != ctx->flow_table_size; ++i)
       {
-        pcapreport_stream_t * st = ctx->stream_hash[i];
-        while (st != NULL)
-        {
+        if (ctx->flow_table[i].st != NULL)
+          streams[j++] = ctx->flow_table[i].st;
+      }
+      {
+        pcapreport_stream_t * st;
+        for (st = ctx->flow_retired; st != NULL; st = st->retired_next)
           streams[j++] = st;
-          st = st->hash_next;
-        }
       }
 
       // Sort into stream_no order
@@ -2035,13 +2307,17 @@ dump_out:
   // Kill it
   {
     unsigned int i;
-    for (i = 0; i != 256; ++i)
+    for (i = 0; i != ctx->flow_table_size; ++i)
     {
-      while (ctx->stream_hash[i] != NULL)
-        stream_close(ctx, ctx->stream_hash + i);
+      if (ctx->flow_table[i].st != NULL)
+        stream_close(ctx, &ctx->flow_table[i].st);
     }
+    free(ctx->flow_table);
+    while (ctx->flow_retired != NULL)
+      stream_close(ctx, &ctx->flow_retired);
   }
 
+  report_diagnostics();
   return 0;
 }
 
@@ -41,6 +41,7 @@
 #include "tswrite_fns.h"
 #include "printing_fns.h"
 #include "misc_fns.h"
+#include "tscompact_fns.h"
 
 
 //#define DEBUG
@@ -90,12 +91,16 @@ static int build_PES_packet_data(PES_packet_data_p *data)
 
   new->data = NULL;
   new->data_len = 0;
+  new->data_size = 0;
   new->es_data_len = 0;
   new->length = 0;
   new->posn = 0;
   new->is_video = TRUE;     // a guess
   new->data_alignment_indicator = FALSE; // another
   new->has_PTS = FALSE;     // assumed until told otherwise
+  new->pid = 0;
+  new->stream_type = 0;
+  new->program_number = 0;
 
   *data = new;
   return 0;
@@ -104,6 +109,10 @@ static int build_PES_packet_data(PES_packet_data_p *data)
 /*
  * Add some data to a PES packet datastructure
  *
+ * If the packet's length is known, room for all of it is allocated at
+ * once. Otherwise, the data array is doubled in size whenever it fills
+ * up, rather than being extended by each TS packet's worth of data.
+ *
  * - `data` is the PES packet datastructure concerned
  * - `bytes` is the data to add
  * - `bytes_len` is how much data there is
@@ -114,29 +123,29 @@ static inline int extend_PES_packet_data(PES_packet_data_p data,
                                          byte              bytes[],
                                          int               bytes_len)
 {
-  if (data->data == NULL)
+  int32_t  needed = data->data_len + bytes_len;
+  if (needed > data->data_size)
   {
-    data->data = malloc(bytes_len);
-    if (data->data == NULL)
+    int32_t  newsize;
+    if (data->length >= needed)
+      newsize = data->length;
+    else
     {
-      print_err("### Unable to extend PES packet data array\n");
-      return 1;
+      newsize = data->data_size * 2;
+      if (newsize < needed)
+        newsize = needed;
     }
-    memcpy(data->data,bytes,bytes_len);
-    data->data_len = bytes_len;
-  }
-  else
-  {
-    data->data = realloc(data->data,data->data_len + bytes_len);
+    data->data = realloc(data->data,newsize);
     if (data->data == NULL)
     {
       print_err("### Unable to extend PES packet data array\n");
       return 1;
     }
-    memcpy(&(data->data[data->data_len]),bytes,bytes_len);
-    data->data_len = data->data_len + bytes_len;
+    data->data_size = newsize;
   }
-  return 0;  
+  memcpy(&(data->data[data->data_len]),bytes,bytes_len);
+  data->data_len = needed;
+  return 0;
 }
 
 /*
@@ -224,6 +233,7 @@ extern void free_PES_packet_data(PES_packet_data_p *data)
     (*data)->data = NULL;
   }
   (*data)->data_len = 0;
+  (*data)->data_size = 0;
   (*data)->length = 0;
   free(*data);
   *data = NULL;
@@ -391,10 +401,12 @@ static int start_packet_in_peslist(PES_reader_p       reader,
       {
         PES_packet_data_p packet = list->data[ii];
         if (reader->give_warning)
-          fprint_err("!!! PID %04x (%d) already has an unfinished PES packet"
-                     " associated with it\n    %d byte%s of %d bytes were already"
-                     " read - ignoring them\n",pid,pid,packet->data_len,
-                     (packet->data_len==1?"":"s"),packet->length);
+          fprint_err_limited("unfinished PES packet",
+                             "!!! PID %04x (%d) already has an unfinished PES"
+                             " packet associated with it\n    %d byte%s of %d"
+                             " bytes were already read - ignoring them\n",
+                             pid,pid,packet->data_len,
+                             (packet->data_len==1?"":"s"),packet->length);
         free_PES_packet_data(&(list->data[ii]));
       }
       list->data[ii] = *data;
@@ -405,7 +417,9 @@ static int start_packet_in_peslist(PES_reader_p       reader,
   // Otherwise, we need to add a new entry to the list
   if (list->length == list->size)
   {
-    int newsize = list->size + PESLIST_INCREMENT;
+    int newsize = list->size * 2;
+    if (newsize < list->size + PESLIST_INCREMENT)
+      newsize = list->size + PESLIST_INCREMENT;
     list->data = realloc(list->data,newsize*SIZEOF_PES_PACKET_DATA);
     if (list->data == NULL)
     {
@@ -609,6 +623,7 @@ static int read_next_PES_packet_from_PS(PES_reader_p       reader,
       // it's easier to just transfer the array, if we're careful
       (*packet_data)->data      = packet.data;
       (*packet_data)->data_len  = packet.data_len;
+      (*packet_data)->data_size = packet.data_len;
       (*packet_data)->length    = packet.data_len;
       (*packet_data)->posn      = reader->posn;
       (*packet_data)->is_video  = is_video;
@@ -1114,6 +1129,13 @@ static int start_new_PES_packet(PES_reader_p       reader,
   // reach EOF).
   index = pid_index_in_peslist(reader->packets,pid);
   if (index != -1 &&
+      reader->packets->data[index] != NULL &&
+      reader->packets->data[index]->length < 0)
+  {
+    // This ends an oversized PES packet that we were ignoring
+    free_PES_packet_data(&reader->packets->data[index]);
+  }
+  else if (index != -1 &&
       reader->packets->data[index] != NULL &&
       reader->packets->data[index]->length == 0)
   {
@@ -1128,13 +1150,36 @@ static int start_new_PES_packet(PES_reader_p       reader,
 #if DEBUG_PES_ASSEMBLY
   print_msg("@@@ start packet in PES list\n");
 #endif
-  err = start_packet_in_peslist(reader,pid,pid==reader->video_pid,&data);
+  if (reader->all_programs)
+    err = start_packet_in_peslist(reader,pid,
+                                  IS_VIDEO_STREAM_TYPE(reader->pid_info[pid].stream_type),
+                                  &data);
+  else
+    err = start_packet_in_peslist(reader,pid,pid==reader->video_pid,&data);
   if (err)
   {
     fprint_err("### Error trying to start a new PES packet,"
                " for TS packet " OFFSET_T_FORMAT "\n",reader->posn);
     return 1;
   }
+  data->pid = pid;
+  if (reader->all_programs)
+  {
+    PES_pid_info_p  info = &reader->pid_info[pid];
+    data->stream_type = info->stream_type;
+    if (info->program_index != -1)
+      data->program_number = reader->programs[info->program_index].program_number;
+  }
+
+  // Knowing the length first lets us allocate all of the data at once
+  data->length = ((payload[4] << 8) | payload[5]);
+  if (data->length != 0)
+    data->length += 6;  // correct to the actual packet length
+#if DEBUG_PES_ASSEMBLY
+  else
+    print_msg("@@@ PES packet marked as length 0\n");
+#endif
+  data->posn = reader->posn;
 
 #if DEBUG_PES_ASSEMBLY
   fprint_msg("@@@ extend packet - data_len was %d\n",data->data_len);
@@ -1149,33 +1194,28 @@ static int start_new_PES_packet(PES_reader_p       reader,
   fprint_msg("@@@ data_len is now %d\n",data->data_len);
 #endif
 
-  data->length = ((payload[4] << 8) | payload[5]);
-  if (data->length != 0)
-    data->length += 6;  // correct to the actual packet length
-#if DEBUG_PES_ASSEMBLY
-  else
-    print_msg("@@@ PES packet marked as length 0\n");
-#endif
-  data->posn = reader->posn;
-
   // Unlikely, but have we already finished our PES packet?
   if ((data->data_len > data->length) && data->length != 0)
   {
 #if ALLOW_OVERLONG_PACKETS
-    int extra;
-    fprint_err("### Found %d bytes of PES data, but expected %d"
-               " (PES packet length + 6)\n",data->data_len,data->length);
-    extra = data->data_len - data->length;
+    int extra = data->data_len - data->length;
+    int report = want_diagnostic("overlong PES packet");
+    if (report)
+      fprint_err("### Found %d bytes of PES data, but expected %d"
+                 " (PES packet length + 6)\n",data->data_len,data->length);
     if (extra > 0)
     {
 #if 0
       int from = payload_len - extra;
       print_data(FALSE,"   End of data",payload+from,extra,extra);
 #endif
-      fprint_err("    In %s PES packet, PID %x, starting at "
-                 OFFSET_T_FORMAT "\n",(pid==reader->video_pid?"video":"audio"),
-                 pid,reader->posn);
-      print_err("!!! Accepting packet anyway\n");
+      if (report)
+      {
+        fprint_err("    In %s PES packet, PID %x, starting at "
+                   OFFSET_T_FORMAT "\n",(pid==reader->video_pid?"video":"audio"),
+                   pid,reader->posn);
+        print_err("!!! Accepting packet anyway\n");
+      }
       *finished = data;
       err = clear_packet_in_peslist(reader->packets,pid);
       if (err) return 1;
@@ -1239,15 +1279,42 @@ static int continue_PES_packet(PES_reader_p       reader,
   if (err || data == NULL)
   {
     if (reader->give_warning)
-      fprint_err("!!! TS packet with PID %04x at " OFFSET_T_FORMAT
-                 " continues an unstarted PES packet  - ignoring it\n",
-                 pid,reader->posn);
+      fprint_err_limited("unstarted PES packet",
+                         "!!! TS packet with PID %04x at " OFFSET_T_FORMAT
+                         " continues an unstarted PES packet  - ignoring it\n",
+                         pid,reader->posn);
     *finished = NULL;
     return 0;
   }
 
   //fprint_msg("%c",(pid==reader->video_pid?'v':'a'));fflush(stdout);
 
+  // Are we ignoring the rest of an oversized PES packet?
+  if (data->length < 0)
+  {
+    *finished = NULL;
+    return 0;
+  }
+
+  // An unbounded PES packet can only be ended by the next one starting -
+  // if that doesn't seem to be happening, give up on this one. We keep
+  // the (now empty) packet until the next one does start, so that the
+  // rest of its data is quietly ignored
+  if (data->length == 0 && reader->max_PES_size > 0 &&
+      data->data_len + payload_len > reader->max_PES_size)
+  {
+    fprint_err_limited("oversized PES packet",
+                       "!!! Discarding PES packet for PID %04x starting at "
+                       OFFSET_T_FORMAT ", which is longer than %d bytes\n",
+                       pid,data->posn,reader->max_PES_size);
+    free(data->data);
+    data->data = NULL;
+    data->data_len = data->data_size = 0;
+    data->length = -1;
+    *finished = NULL;
+    return 0;
+  }
+
   err = extend_PES_packet_data(data,payload,payload_len);
   if (err)
   {
@@ -1258,20 +1325,24 @@ static int continue_PES_packet(PES_reader_p       reader,
   if ((data->data_len > data->length) && data->length != 0)
   {
 #if ALLOW_OVERLONG_PACKETS
-    int extra;
-    fprint_err("### Found %d bytes of PES data, but expected %d"
-               " (PES packet length + 6)\n",data->data_len,data->length);
-    extra = data->data_len - data->length;
+    int extra = data->data_len - data->length;
+    int report = want_diagnostic("overlong PES packet");
+    if (report)
+      fprint_err("### Found %d bytes of PES data, but expected %d"
+                 " (PES packet length + 6)\n",data->data_len,data->length);
     if (extra > 0)
     {
 #if 0
       int from = payload_len - extra;
       print_data(FALSE,"   End of data",payload+from,extra,extra);
 #endif
-      fprint_err("    In %s PES packet, PID %x, starting at "
-                 OFFSET_T_FORMAT "\n",(pid==reader->video_pid?"video":"audio"),
-                 pid,reader->posn);
-      print_err("!!! Accepting packet anyway\n");
+      if (report)
+      {
+        fprint_err("    In %s PES packet, PID %x, starting at "
+                   OFFSET_T_FORMAT "\n",(pid==reader->video_pid?"video":"audio"),
+                   pid,reader->posn);
+        print_err("!!! Accepting packet anyway\n");
+      }
       *finished = data;
       err = clear_packet_in_peslist(reader->packets,pid);
       if (err) return 1;
@@ -1329,44 +1400,82 @@ static void check_for_EOF_packet(PES_reader_p       reader,
 }
 
 /*
- * Return the next PES packet from the input TS file
+ * Pass TS packets through to the server's TS writer.
+ *
+ * This is the pass-through "stage" of reading TS, which is kept apart from
+ * PES assembly. The packets passed through are those from `pass_from` up to
+ * (but not including) the next packet the TS reader will return. They are
+ * all still in the TS reader's read-ahead buffer, and so must be passed
+ * through before it is refilled.
  *
  * - `reader` is a PES reader context
- * - `packet_data` is the packet data (NULL if EOF is read)
+ * - `pass_from` is the first packet to pass through, or NULL if there are
+ *   none. It is returned as NULL, ready for the next batch.
  *
- * Returns 0 if all goes well, EOF if end of file is read, and 1 if
- * something goes wrong.
+ * Returns 0 if all goes well, 1 if something goes wrong.
  */
-static int read_next_PES_packet_from_TS(PES_reader_p       reader,
-                                        PES_packet_data_p *packet_data)
+static int pass_through_TS_packets(PES_reader_p   reader,
+                                   byte         **pass_from)
 {
-  // If we have a packet "in hand" because we read it earlier, then
-  // just return it
-  if (reader->deferred)
+  TS_reader_p  tsreader = reader->tsreader;
+  byte        *packet;
+
+  if (*pass_from == NULL)
+    return 0;
+
+  for (packet = *pass_from; packet < tsreader->read_ahead_ptr;
+       packet += TS_PACKET_SIZE)
   {
-    if (reader->video_only && !reader->deferred->is_video)
-    {
-      free_PES_packet_data(&reader->deferred);
-    }
-    else
+    uint32_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+    int      err = tswrite_write(reader->tswriter,packet,pid,FALSE,0);
+    if (err)
     {
-      *packet_data = reader->deferred;
-      reader->deferred = NULL;
-#if DEBUG_PES_ASSEMBLY
-      print_msg("@@@ returning deferred PES packet\n");
-#endif
-      return 0;
+      fprint_err("### Error writing TS packet (PID %04x) at "
+                 OFFSET_T_FORMAT "\n",pid,
+                 tsreader->posn - (tsreader->read_ahead_ptr - packet));
+      *pass_from = NULL;
+      return 1;
     }
   }
+  *pass_from = NULL;
+  return 0;
+}
 
-  // If we had read EOF earlier (but not said so because of a PES
-  // packet being finished by EOF), then admit to it now
-  if (reader->had_eof)
-  {
-    *packet_data = NULL;
-    return EOF;
-  }
+/*
+ * If the TS reader is about to refill its read-ahead buffer, pass the
+ * packets we have finished with through to the server's TS writer first.
+ *
+ * This is the only thing the PES assembly loops need do for pass-through,
+ * and does nothing if `pass_from` is NULL (i.e., pass-through is off).
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static inline int pass_through_before_refill(PES_reader_p   reader,
+                                             byte         **pass_from)
+{
+  if (pass_from != NULL && *pass_from != NULL &&
+      reader->tsreader->read_ahead_ptr == reader->tsreader->read_ahead_end)
+    return pass_through_TS_packets(reader,pass_from);
+  return 0;
+}
 
+/*
+ * Assemble the next PES packet from the input TS file
+ *
+ * - `reader` is a PES reader context
+ * - `packet_data` is the packet data (NULL if EOF is read)
+ * - `pass_from` is NULL if TS packets are not being passed through to
+ *   a TS writer. Otherwise, it is where to remember the first TS packet
+ *   not yet passed through - the caller must pass through any such
+ *   packets left when we return.
+ *
+ * Returns 0 if all goes well, EOF if end of file is read, and 1 if
+ * something goes wrong.
+ */
+static int assemble_PES_packet_from_TS(PES_reader_p        reader,
+                                       PES_packet_data_p  *packet_data,
+                                       byte              **pass_from)
+{
   for (;;)
   {
     int     err;
@@ -1379,6 +1488,9 @@ static int read_next_PES_packet_from_TS(PES_reader_p       reader,
 
     uint32_t pid;
 
+    err = pass_through_before_refill(reader,pass_from);
+    if (err) return 1;
+
     // Remember the position of the packet we're going to read
     reader->posn = reader->tsreader->posn;
 
@@ -1407,6 +1519,11 @@ static int read_next_PES_packet_from_TS(PES_reader_p       reader,
       return 1;
     }
 
+    // Packets are passed through (if at all) in order, from the first one
+    // we read
+    if (pass_from != NULL && *pass_from == NULL)
+      *pass_from = ts_packet;
+
     err = split_TS_packet(ts_packet,&pid,&payload_unit_start_indicator,
                           &adapt,&adapt_len,&payload,&payload_len);
     if (err)
@@ -1421,20 +1538,6 @@ static int read_next_PES_packet_from_TS(PES_reader_p       reader,
                reader->posn,pid);
 #endif
 
-    // If we're writing out TS packets directly to a client, then this
-    // is probably a sensible place to do it.
-    if (reader->write_TS_packets && reader->tswriter != NULL &&
-        !reader->suppress_writing)
-    {
-      err = tswrite_write(reader->tswriter,ts_packet,pid,FALSE,0);
-      if (err)
-      {
-        fprint_err("### Error writing TS packet (PID %04x) at "
-                   OFFSET_T_FORMAT "\n",pid,reader->posn);
-        return 1;
-      }
-    }
-
     if (pid == 0)  // PAT
     {
       // XXX We should probably check that the PAT for our program
@@ -1453,8 +1556,9 @@ static int read_next_PES_packet_from_TS(PES_reader_p       reader,
       {
         // This is the start of a new PMT packet, but we'd already
         // started one, so throw its data away
-        fprint_err("!!! Discarding previous (uncompleted) PMT data at "
-                   OFFSET_T_FORMAT "\n",reader->posn);
+        fprint_err_limited("incomplete PMT",
+                         "!!! Discarding previous (uncompleted) PMT data at "
+                         OFFSET_T_FORMAT "\n",reader->posn);
         free(reader->pmt_data);
         reader->pmt_data = NULL; reader->pmt_data_len = reader->pmt_data_used = 0;
       }
@@ -1462,8 +1566,9 @@ static int read_next_PES_packet_from_TS(PES_reader_p       reader,
       {
         // This is the continuation of a PMT packet, but we hadn't
         // started one yet
-        fprint_err("!!! Discarding PMT continuation, no PMT started, at "
-                   OFFSET_T_FORMAT "\n",reader->posn);
+        fprint_err_limited("PMT continuation",
+                           "!!! Discarding PMT continuation, no PMT started,"
+                           " at " OFFSET_T_FORMAT "\n",reader->posn);
         continue;
       }
 
@@ -1562,105 +1667,669 @@ static int read_next_PES_packet_from_TS(PES_reader_p       reader,
   return 0;
 }
 
-// ============================================================
-// General functionality
-// ============================================================
 /*
- * Look at the start of a file to determine if it appears to be transport
- * stream. Rewinds the file when it is finished.
- *
- * The file is assumed to be Transport Stream if it starts with 0x47 as
- * the first byte, and 0x47 recurs at 188 byte intervals (in other words,
- * it appears to start with several TS packets).
+ * Return the next PES packet from the input TS file
  *
- * - `input` is the file to check
- * - `is_TS` is TRUE if it looks like TS, as described above.
+ * - `reader` is a PES reader context
+ * - `packet_data` is the packet data (NULL if EOF is read)
  *
- * Returns 0 if all goes well, 1 if there was an error.
+ * Returns 0 if all goes well, EOF if end of file is read, and 1 if
+ * something goes wrong.
  */
-extern int determine_if_TS_file(int    input,
-                                int   *is_TS)
+static int read_next_PES_packet_from_TS(PES_reader_p       reader,
+                                        PES_packet_data_p *packet_data)
 {
-  int  err;
-  int  ii;
-  byte buf[TS_PACKET_SIZE];
-
-  *is_TS = TRUE;
-
-  for (ii = 0; ii < 100; ii++)
+  // If we have a packet "in hand" because we read it earlier, then
+  // just return it
+  if (reader->deferred)
   {
-    err = read_bytes(input,TS_PACKET_SIZE,buf);
-    if (err == EOF)
-      break;
-    else if (err)
+    if (reader->video_only && !reader->deferred->is_video)
     {
-      print_err("### Error trying to check if file is TS\n");
-      return 1;
+      free_PES_packet_data(&reader->deferred);
     }
-    if (buf[0] != 0x47)
+    else
     {
-      *is_TS = FALSE;
-      break;
+      *packet_data = reader->deferred;
+      reader->deferred = NULL;
+#if DEBUG_PES_ASSEMBLY
+      print_msg("@@@ returning deferred PES packet\n");
+#endif
+      return 0;
     }
   }
-  err = seek_file(input,0);
-  if (err)
+
+  // If we had read EOF earlier (but not said so because of a PES
+  // packet being finished by EOF), then admit to it now
+  if (reader->had_eof)
   {
-    print_err("### Error rewinding file after determining if it is TS\n");
-    return 1;
+    *packet_data = NULL;
+    return EOF;
   }
-  return 0;
+
+  if (reader->pass_through_TS)
+  {
+    byte  *pass_from = NULL;
+    int    err = assemble_PES_packet_from_TS(reader,packet_data,&pass_from);
+    // Don't return before the TS packets we've read have been written out
+    if (err != 1 && pass_through_TS_packets(reader,&pass_from))
+      return 1;
+    return err;
+  }
+  else
+    return assemble_PES_packet_from_TS(reader,packet_data,NULL);
 }
-
+
+// ============================================================
+// Reading all of the programs in a Transport Stream
+// ============================================================
 /*
- * Given a PES stream (PS or TS), attempt to determine if it holds H.262 or
- * H.264 data.  Sets the `video_type` flag on the reader appropriately.
- *
- * (In fact, this is only needed for PS data, as TS data "says" what it
- * contains in the PAT/PMT.)
- *
- * - `input` is the file to check
+ * Find the program with the given program number in our list of programs
  *
- * Returns 0 if all goes well, 1 if there was an error (including the
- * stream not appearing to be either).
+ * Returns its index, or -1 if it is not there.
  */
-static int determine_PES_video_type(PES_reader_p  reader)
+static int find_PES_program(PES_reader_p  reader,
+                            uint16_t      program_number)
 {
-  int  err;
-  ES_p es;
-  int  old_video_only = reader->video_only;
+  int  ii;
+  for (ii = 0; ii < reader->num_programs; ii++)
+    if (reader->programs[ii].program_number == program_number)
+      return ii;
+  return -1;
+}
 
-  err = build_elementary_stream_PES(reader,&es);
-  if (err)
+/*
+ * Remember a program (from the PAT), or update its PMT PID if we already
+ * know about it.
+ *
+ * Returns 0 if it succeeds, 1 if some error occurs.
+ */
+static int remember_PES_program(PES_reader_p  reader,
+                                uint16_t      program_number,
+                                uint32_t      pmt_pid)
+{
+  int  index = find_PES_program(reader,program_number);
+  if (index == -1)
   {
-    print_err("### Error starting elementary stream before"
-              " working out if PS is H.262 or H.264\n");
-    return 1;
+    PES_program_p  program;
+    if (reader->num_programs == reader->programs_size)
+    {
+      int newsize = reader->programs_size * 2;
+      if (newsize < reader->programs_size + PESLIST_START_SIZE)
+        newsize = reader->programs_size + PESLIST_START_SIZE;
+      PES_program_p  newarray = realloc(reader->programs,
+                                        newsize*SIZEOF_PES_PROGRAM);
+      if (newarray == NULL)
+      {
+        print_err("### Unable to extend PES reader program array\n");
+        return 1;
+      }
+      reader->programs = newarray;
+      reader->programs_size = newsize;
+    }
+    index = reader->num_programs++;
+    program = &reader->programs[index];
+    program->program_number = program_number;
+    program->pmt = NULL;
+    program->pmt_data = NULL;
+    program->pmt_data_len = program->pmt_data_used = 0;
+    if (reader->give_info)
+      fprint_msg("Program %d has PMT PID %04x\n",program_number,pmt_pid);
+  }
+  else if (reader->programs[index].pmt_pid != pmt_pid)
+  {
+    // Forget the old PMT PID
+    uint32_t  old_pid = reader->programs[index].pmt_pid;
+    if (reader->pid_info[old_pid].is_pmt &&
+        reader->pid_info[old_pid].program_index == index)
+    {
+      reader->pid_info[old_pid].is_pmt = FALSE;
+      reader->pid_info[old_pid].program_index = -1;
+    }
+    if (reader->give_info)
+      fprint_msg("Program %d PMT PID changed from %04x to %04x\n",
+                 program_number,old_pid,pmt_pid);
   }
+  reader->programs[index].pmt_pid = pmt_pid;
+  reader->pid_info[pmt_pid].is_pmt = TRUE;
+  reader->pid_info[pmt_pid].program_index = index;
+  reader->pid_info[pmt_pid].stream_type = 0;
+  return 0;
+}
 
-  reader->video_only = TRUE;
+/*
+ * Forget a program that is no longer named in the PAT.
+ *
+ * The last program in the array is moved into its place, so the caller
+ * should not rely on the index of any program after this.
+ */
+static void forget_PES_program(PES_reader_p  reader,
+                               int           index)
+{
+  int  last = reader->num_programs - 1;
+  int  ii;
+  uint32_t  pid;
+  PES_program_p  program = &reader->programs[index];
 
-  err = decide_ES_video_type(es,FALSE,FALSE,&reader->video_type);
-  if (err)
+  if (reader->give_info)
+    fprint_msg("Program %d is no longer in the PAT\n",program->program_number);
+
+  for (pid = 0; pid < PES_NUM_PIDS; pid++)
   {
-    print_err("### Error deciding on PS video type\n");
-    free_elementary_stream(&es);
-    return 1;
+    if (reader->pid_info[pid].program_index == index)
+    {
+      reader->pid_info[pid].program_index = -1;
+      reader->pid_info[pid].is_pmt = FALSE;
+      reader->pid_info[pid].stream_type = 0;
+    }
+    else if (reader->pid_info[pid].program_index == last)
+      reader->pid_info[pid].program_index = index;
   }
-  free_elementary_stream(&es);
 
-  reader->is_h264 = (reader->video_type == VIDEO_H264);
-  reader->video_only = old_video_only;
+  if (program->pmt != NULL)
+    free_pmt(&program->pmt);
+  if (program->pmt_data != NULL)
+    free(program->pmt_data);
+  if (index != last)
+    reader->programs[index] = reader->programs[last];
+  reader->num_programs --;
 
-  err = rewind_program_stream(reader->psreader);
-  if (err)
+  // Another program may share the PMT PID we just forgot
+  for (ii = 0; ii < reader->num_programs; ii++)
   {
-    print_err("### Error rewinding PS stream after determining its type\n");
-    return 1;
+    pid = reader->programs[ii].pmt_pid;
+    if (reader->pid_info[pid].program_index == -1)
+    {
+      reader->pid_info[pid].is_pmt = TRUE;
+      reader->pid_info[pid].program_index = ii;
+    }
   }
-  return 0;
 }
-
+
+/*
+ * Remember a (new) PMT for a program, and thus which PIDs it uses.
+ *
+ * The PMT is remembered by the program, and should not be freed by the
+ * caller.
+ */
+static void remember_PES_program_pmt(PES_reader_p  reader,
+                                     int           index,
+                                     pmt_p         pmt)
+{
+  int  ii;
+  PES_program_p  program = &reader->programs[index];
+
+  // Forget the streams from any previous PMT
+  if (program->pmt != NULL)
+  {
+    for (ii = 0; ii < program->pmt->num_streams; ii++)
+    {
+      uint32_t  pid = program->pmt->streams[ii].elementary_PID;
+      if (!reader->pid_info[pid].is_pmt &&
+          reader->pid_info[pid].program_index == index)
+      {
+        reader->pid_info[pid].program_index = -1;
+        reader->pid_info[pid].stream_type = 0;
+      }
+    }
+    free_pmt(&program->pmt);
+  }
+
+  for (ii = 0; ii < pmt->num_streams; ii++)
+  {
+    uint32_t  pid = pmt->streams[ii].elementary_PID;
+    if (reader->pid_info[pid].is_pmt)
+    {
+      if (reader->give_warning)
+        fprint_err("!!! Program %d stream PID %04x is also a PMT PID"
+                   " - ignoring it\n",pmt->program_number,pid);
+      continue;
+    }
+    reader->pid_info[pid].program_index = index;
+    reader->pid_info[pid].stream_type = pmt->streams[ii].stream_type;
+  }
+  program->pmt = pmt;
+}
+
+/*
+ * Handle a TS packet on PID 0 (the PAT), when reading all programs.
+ *
+ * Returns 0 if all went well, 1 if something went wrong
+ */
+static int handle_all_programs_PAT(PES_reader_p  reader,
+                                   int           payload_unit_start_indicator,
+                                   byte          payload[],
+                                   int           payload_len)
+{
+  int  err;
+  int  ii;
+  pidint_list_p  prog_list = NULL;
+
+  if (payload_unit_start_indicator && reader->pat_data)
+  {
+    if (reader->give_warning)
+      fprint_err_limited("incomplete PAT",
+                         "!!! Discarding previous (uncompleted) PAT data at "
+                         OFFSET_T_FORMAT "\n",reader->posn);
+    free(reader->pat_data);
+    reader->pat_data = NULL; reader->pat_data_len = reader->pat_data_used = 0;
+  }
+  else if (!payload_unit_start_indicator && !reader->pat_data)
+  {
+    if (reader->give_warning)
+      fprint_err_limited("PAT continuation",
+                         "!!! Discarding PAT continuation, no PAT started, at "
+                         OFFSET_T_FORMAT "\n",reader->posn);
+    return 0;
+  }
+
+  err = build_psi_data(FALSE,payload,payload_len,0,
+                       &reader->pat_data,
+                       &reader->pat_data_len,
+                       &reader->pat_data_used);
+  if (err)
+  {
+    fprint_err("### Error %s PAT at " OFFSET_T_FORMAT "\n",
+               (payload_unit_start_indicator?"starting new":"continuing"),
+               reader->posn);
+    return 1;
+  }
+
+  // Do we need more data to complete this PAT?
+  if (reader->pat_data_len > reader->pat_data_used)
+    return 0;
+
+  err = extract_prog_list_from_pat(FALSE,reader->pat_data,reader->pat_data_len,
+                                   &prog_list);
+  free(reader->pat_data);
+  reader->pat_data = NULL; reader->pat_data_len = reader->pat_data_used = 0;
+  if (err)
+  {
+    fprint_err("### Error extracting program list from PAT at "
+               OFFSET_T_FORMAT "\n",reader->posn);
+    return 1;
+  }
+
+  for (ii = 0; ii < prog_list->length; ii++)
+  {
+    // Program number 0 names the network PID, not a PMT
+    if (prog_list->number[ii] == 0)
+      continue;
+    err = remember_PES_program(reader,prog_list->number[ii],
+                               prog_list->pid[ii]);
+    if (err)
+    {
+      free_pidint_list(&prog_list);
+      return 1;
+    }
+  }
+
+  // And forget any programs that this PAT no longer names. Going backwards
+  // means that any program moved by forget_PES_program has been checked
+  for (ii = reader->num_programs - 1; ii >= 0; ii--)
+  {
+    int  jj;
+    for (jj = 0; jj < prog_list->length; jj++)
+      if (prog_list->number[jj] == reader->programs[ii].program_number)
+        break;
+    if (jj == prog_list->length)
+      forget_PES_program(reader,ii);
+  }
+  free_pidint_list(&prog_list);
+  return 0;
+}
+
+/*
+ * Handle a TS packet on a PMT PID, when reading all programs.
+ *
+ * Returns 0 if all went well, 1 if something went wrong
+ */
+static int handle_all_programs_PMT(PES_reader_p  reader,
+                                   uint32_t      pid,
+                                   int           payload_unit_start_indicator,
+                                   byte          payload[],
+                                   int           payload_len)
+{
+  int  err;
+  int  index = reader->pid_info[pid].program_index;
+  PES_program_p  program = &reader->programs[index];
+  pmt_p  pmt = NULL;
+
+  if (payload_unit_start_indicator && program->pmt_data)
+  {
+    if (reader->give_warning)
+      fprint_err_limited("incomplete PMT",
+                         "!!! Discarding previous (uncompleted) PMT data at "
+                         OFFSET_T_FORMAT "\n",reader->posn);
+    free(program->pmt_data);
+    program->pmt_data = NULL; program->pmt_data_len = program->pmt_data_used = 0;
+  }
+  else if (!payload_unit_start_indicator && !program->pmt_data)
+  {
+    if (reader->give_warning)
+      fprint_err_limited("PMT continuation",
+                         "!!! Discarding PMT continuation, no PMT started, at "
+                         OFFSET_T_FORMAT "\n",reader->posn);
+    return 0;
+  }
+
+  err = build_psi_data(FALSE,payload,payload_len,pid,
+                       &program->pmt_data,
+                       &program->pmt_data_len,
+                       &program->pmt_data_used);
+  if (err)
+  {
+    fprint_err("### Error %s PMT at " OFFSET_T_FORMAT "\n",
+               (payload_unit_start_indicator?"starting new":"continuing"),
+               reader->posn);
+    return 1;
+  }
+
+  // Do we need more data to complete this PMT?
+  if (program->pmt_data_len > program->pmt_data_used)
+    return 0;
+
+  err = extract_pmt(FALSE,program->pmt_data,program->pmt_data_len,pid,&pmt);
+  free(program->pmt_data);
+  program->pmt_data = NULL; program->pmt_data_len = program->pmt_data_used = 0;
+  if (err)
+  {
+    fprint_err("### Error extracting PMT at " OFFSET_T_FORMAT "\n",
+               reader->posn);
+    return 1;
+  }
+
+  // Several programs may share a PMT PID, so make sure we give this PMT
+  // to the right one
+  if (pmt->program_number != program->program_number)
+  {
+    index = find_PES_program(reader,pmt->program_number);
+    if (index == -1 || reader->programs[index].pmt_pid != pid)
+    {
+      free_pmt(&pmt);
+      return 0;
+    }
+  }
+
+  if (reader->give_info && reader->programs[index].pmt == NULL)
+    report_pmt(TRUE,"",pmt);
+
+  remember_PES_program_pmt(reader,index,pmt);
+  return 0;
+}
+
+/*
+ * Have we got a PMT for every program named in the PAT (and at least one
+ * program)?
+ */
+static int got_all_PES_programs(PES_reader_p  reader)
+{
+  int  ii;
+  if (reader->num_programs == 0)
+    return FALSE;
+  for (ii = 0; ii < reader->num_programs; ii++)
+    if (reader->programs[ii].pmt == NULL)
+      return FALSE;
+  return TRUE;
+}
+
+/*
+ * Assemble the next PES packet from the input TS file, for any program
+ *
+ * - `reader` is a PES reader context
+ * - `packet_data` is the packet data (NULL if EOF is read)
+ * - `pass_from` is as for assemble_PES_packet_from_TS()
+ *
+ * Returns 0 if all goes well, EOF if end of file is read, and 1 if
+ * something goes wrong.
+ */
+static int assemble_PES_packet_from_all_TS(PES_reader_p        reader,
+                                           PES_packet_data_p  *packet_data,
+                                           byte              **pass_from)
+{
+  for (;;)
+  {
+    int     err;
+    byte   *ts_packet;
+    int     payload_unit_start_indicator;
+    byte   *adapt;
+    int     adapt_len;
+    byte   *payload;
+    int     payload_len;
+    uint32_t pid;
+    PES_pid_info_p  info;
+
+    err = pass_through_before_refill(reader,pass_from);
+    if (err) return 1;
+
+    reader->posn = reader->tsreader->posn;
+
+    err = read_next_TS_packet(reader->tsreader,&ts_packet);
+    if (err == EOF)
+    {
+      // There may be several unbounded PES packets waiting to be ended
+      // by EOF - we return them one at a time
+      check_for_EOF_packet(reader,packet_data);
+      if (*packet_data == NULL)
+        return EOF;
+      else
+        return 0;
+    }
+    else if (err)
+    {
+      fprint_err("### Error reading TS packet at " OFFSET_T_FORMAT "\n",
+                 reader->posn);
+      return 1;
+    }
+
+    if (pass_from != NULL && *pass_from == NULL)
+      *pass_from = ts_packet;
+
+    err = split_TS_packet(ts_packet,&pid,&payload_unit_start_indicator,
+                          &adapt,&adapt_len,&payload,&payload_len);
+    if (err)
+    {
+      fprint_err("### Error interpreting TS packet at " OFFSET_T_FORMAT "\n",
+                 reader->posn);
+      return 1;
+    }
+
+    if (payload_len == 0)
+      continue;
+
+    info = &reader->pid_info[pid];
+    if (pid == 0)
+    {
+      err = handle_all_programs_PAT(reader,payload_unit_start_indicator,
+                                    payload,payload_len);
+      if (err) return 1;
+    }
+    else if (info->is_pmt)
+    {
+      err = handle_all_programs_PMT(reader,pid,payload_unit_start_indicator,
+                                    payload,payload_len);
+      if (err) return 1;
+    }
+    else if (info->program_index != -1 &&
+             (!reader->video_only || IS_VIDEO_STREAM_TYPE(info->stream_type)))
+    {
+      PES_packet_data_p  finished;
+      if (payload_unit_start_indicator)
+        err = start_new_PES_packet(reader,pid,payload,payload_len,
+                                   &finished);
+      else
+        err = continue_PES_packet(reader,pid,payload,payload_len,
+                                  &finished);
+      if (err)
+      {
+        fprint_err("### Error %s PES packet (PID %04x)"
+                   " with TS packet at " OFFSET_T_FORMAT "\n",
+                   (payload_unit_start_indicator?"starting":"continuing"),
+                   pid,reader->posn);
+        print_data(FALSE,"    Data",payload,payload_len,20);
+        return 1;
+      }
+      if (finished)
+      {
+        if (reader->video_only && !finished->is_video)
+          free_PES_packet_data(&finished);
+        else
+        {
+          *packet_data = finished;
+          break;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+ * Return the next PES packet from the input TS file, for any elementary
+ * stream in any program.
+ *
+ * This is the equivalent of read_next_PES_packet_from_TS(), but keeps track
+ * of all of the programs named in the PAT.
+ *
+ * - `reader` is a PES reader context
+ * - `packet_data` is the packet data (NULL if EOF is read)
+ *
+ * Returns 0 if all goes well, EOF if end of file is read, and 1 if
+ * something goes wrong.
+ */
+static int read_next_PES_packet_from_all_TS(PES_reader_p       reader,
+                                            PES_packet_data_p *packet_data)
+{
+  if (reader->deferred)
+  {
+    if (reader->video_only && !reader->deferred->is_video)
+    {
+      free_PES_packet_data(&reader->deferred);
+    }
+    else
+    {
+      *packet_data = reader->deferred;
+      reader->deferred = NULL;
+      return 0;
+    }
+  }
+
+  if (reader->had_eof)
+  {
+    *packet_data = NULL;
+    return EOF;
+  }
+
+  if (reader->pass_through_TS)
+  {
+    byte  *pass_from = NULL;
+    int    err = assemble_PES_packet_from_all_TS(reader,packet_data,&pass_from);
+    if (err != 1 && pass_through_TS_packets(reader,&pass_from))
+      return 1;
+    return err;
+  }
+  else
+    return assemble_PES_packet_from_all_TS(reader,packet_data,NULL);
+}
+
+// ============================================================
+// General functionality
+// ============================================================
+/*
+ * Look at the start of a file to determine if it appears to be transport
+ * stream. Rewinds the file when it is finished.
+ *
+ * The file is assumed to be Transport Stream if it starts with 0x47 as
+ * the first byte, and 0x47 recurs at 188 byte intervals (in other words,
+ * it appears to start with several TS packets).
+ *
+ * - `input` is the file to check
+ * - `is_TS` is TRUE if it looks like TS, as described above.
+ *
+ * Returns 0 if all goes well, 1 if there was an error.
+ */
+extern int determine_if_TS_file(int    input,
+                                int   *is_TS)
+{
+  int  err;
+  int  ii;
+  byte buf[TS_PACKET_SIZE];
+
+  *is_TS = TRUE;
+
+  for (ii = 0; ii < 100; ii++)
+  {
+    err = read_bytes(input,TS_PACKET_SIZE,buf);
+    if (err == EOF)
+      break;
+    else if (err)
+    {
+      print_err("### Error trying to check if file is TS\n");
+      return 1;
+    }
+    if (buf[0] != 0x47)
+    {
+      *is_TS = FALSE;
+      break;
+    }
+  }
+  err = seek_file(input,0);
+  if (err)
+  {
+    print_err("### Error rewinding file after determining if it is TS\n");
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Given a PES stream (PS or TS), attempt to determine if it holds H.262 or
+ * H.264 data.  Sets the `video_type` flag on the reader appropriately.
+ *
+ * (In fact, this is only needed for PS data, as TS data "says" what it
+ * contains in the PAT/PMT.)
+ *
+ * - `input` is the file to check
+ *
+ * Returns 0 if all goes well, 1 if there was an error (including the
+ * stream not appearing to be either).
+ */
+static int determine_PES_video_type(PES_reader_p  reader)
+{
+  int  err;
+  ES_p es;
+  int  old_video_only = reader->video_only;
+
+  err = build_elementary_stream_PES(reader,&es);
+  if (err)
+  {
+    print_err("### Error starting elementary stream before"
+              " working out if PS is H.262 or H.264\n");
+    return 1;
+  }
+
+  reader->video_only = TRUE;
+
+  err = decide_ES_video_type(es,FALSE,FALSE,&reader->video_type);
+  if (err)
+  {
+    print_err("### Error deciding on PS video type\n");
+    free_elementary_stream(&es);
+    return 1;
+  }
+  free_elementary_stream(&es);
+
+  reader->is_h264 = (reader->video_type == VIDEO_H264);
+  reader->video_only = old_video_only;
+
+  err = rewind_program_stream(reader->psreader);
+  if (err)
+  {
+    print_err("### Error rewinding PS stream after determining its type\n");
+    return 1;
+  }
+  return 0;
+}
+
 /*
  * Build a PES reader datastructure
  *
@@ -1703,6 +2372,16 @@ static int build_PES_reader_datastructure(int            give_info,
   new->pmt_data_len = 0;
   new->pmt_data_used = 0;
 
+  new->all_programs = FALSE;
+  new->programs = NULL;
+  new->num_programs = new->programs_size = 0;
+  new->pid_info = NULL;
+  new->pat_data = NULL;
+  new->pat_data_len = new->pat_data_used = 0;
+  new->callbacks = NULL;
+  new->default_callback.fn = NULL;
+  new->default_callback.arg = NULL;
+
   new->video_pid = new->audio_pid = 0;
   new->pcr_pid = new->pmt_pid = 0;
   new->got_program_data = FALSE;
@@ -1720,6 +2399,7 @@ static int build_PES_reader_datastructure(int            give_info,
   new->write_PES_packets = FALSE;
   new->write_TS_packets = FALSE;
   new->suppress_writing = TRUE;
+  new->pass_through_TS = FALSE;
   new->dont_write_current_packet = FALSE;
   new->pes_padding = 0;
 
@@ -1735,6 +2415,7 @@ static int build_PES_reader_datastructure(int            give_info,
 
   new->deferred = NULL;
   new->had_eof = FALSE;
+  new->max_PES_size = PES_DEFAULT_MAX_SIZE;
   *reader = new;
   return 0;
 }
@@ -1799,21 +2480,175 @@ extern int build_TS_PES_reader(TS_reader_p    tsreader,
   int  err;
 
   err = build_PES_reader_datastructure(give_info,give_warnings,reader);
-  if (err) return 1;
+  if (err) return 1;
+
+  (*reader)->is_TS = TRUE;
+  (*reader)->tsreader = tsreader;
+
+  (*reader)->program_number = program_number;
+  (*reader)->output_program_number = program_number;
+
+  // Work out the program information by reading the first PAT and
+  // the first (following) PMT
+  err = determine_TS_program_info(*reader);
+  if (err)
+  {
+    print_err("### Error determining/checking program number\n");
+    (void) free_PES_reader(reader);
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Find the first PAT, and the PMTs for all of the programs it names,
+ * and then rewind (unless reading from standard input).
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int determine_all_TS_program_info(PES_reader_p   reader)
+{
+  int  err;
+  int  ii;
+
+  while (!got_all_PES_programs(reader))
+  {
+    byte   *ts_packet;
+    int     payload_unit_start_indicator;
+    byte   *adapt;
+    int     adapt_len;
+    byte   *payload;
+    int     payload_len;
+    uint32_t pid;
+
+    reader->posn = reader->tsreader->posn;
+    err = read_next_TS_packet(reader->tsreader,&ts_packet);
+    if (err == EOF)
+      break;
+    else if (err)
+    {
+      fprint_err("### Error reading TS packet at " OFFSET_T_FORMAT
+                 " whilst looking for program information\n",reader->posn);
+      return 1;
+    }
+    err = split_TS_packet(ts_packet,&pid,&payload_unit_start_indicator,
+                          &adapt,&adapt_len,&payload,&payload_len);
+    if (err)
+    {
+      fprint_err("### Error interpreting TS packet at " OFFSET_T_FORMAT
+                 "\n",reader->posn);
+      return 1;
+    }
+    if (payload_len == 0)
+      continue;
+    if (pid == 0)
+      err = handle_all_programs_PAT(reader,payload_unit_start_indicator,
+                                    payload,payload_len);
+    else if (reader->pid_info[pid].is_pmt)
+      err = handle_all_programs_PMT(reader,pid,payload_unit_start_indicator,
+                                    payload,payload_len);
+    if (err) return 1;
+  }
+
+  if (reader->num_programs == 0)
+  {
+    print_err("### No programs found in TS\n");
+    return 1;
+  }
+  else if (!got_all_PES_programs(reader) && reader->give_warning)
+    print_err("!!! Not all programs named in the PAT have a PMT\n");
+
+  // Start our assembly of PSI data afresh
+  free(reader->pat_data);
+  reader->pat_data = NULL; reader->pat_data_len = reader->pat_data_used = 0;
+  for (ii = 0; ii < reader->num_programs; ii++)
+  {
+    PES_program_p  program = &reader->programs[ii];
+    free(program->pmt_data);
+    program->pmt_data = NULL;
+    program->pmt_data_len = program->pmt_data_used = 0;
+  }
+
+  if (reader->tsreader->file != STDIN_FILENO)
+  {
+    err = seek_using_TS_reader(reader->tsreader,0);
+    if (err)
+    {
+      print_err("### Error rewinding TS stream after finding initial"
+                " program information\n");
+      return 1;
+    }
+    reader->posn = 0;
+  }
+  return 0;
+}
+
+/*
+ * Build a PES reader datastructure for TS data, reading every elementary
+ * stream in every program.
+ *
+ * The first PAT, and the PMTs for all of the programs it names, are located,
+ * and then the TS is rewound (unless it is being read from standard input),
+ * in the same manner as for build_TS_PES_reader(). Thereafter, PES packets
+ * are returned for any PID named in any PMT, and changes to the PAT or PMTs
+ * are tracked as they are read. Each PES packet's `pid`, `stream_type` and
+ * `program_number` identify where it came from.
+ *
+ * Note that writing out PES packets as TS (see set_server_output()) is not
+ * supported in this mode, although writing out TS packets is.
+ *
+ * - `tsreader` is the Transport Stream to read the PES data from. If this
+ *   function fails, it is closed and freed (and returned as NULL).
+ * - `give_info` is TRUE if information about program data, etc., should be
+ *   output (to stdout).
+ * - `give_warnings` is TRUE if warnings (starting with "!!!") should be
+ *   output (to stderr), FALSE if they should be suppressed.
+ * - `reader` is the resulting PES reader
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_TS_PES_reader_for_all_programs(TS_reader_p   *tsreader,
+                                                int            give_info,
+                                                int            give_warnings,
+                                                PES_reader_p  *reader)
+{
+  int  err;
+  int  ii;
+  PES_reader_p  new;
+
+  err = build_PES_reader_datastructure(give_info,give_warnings,reader);
+  if (err)
+  {
+    (void) close_TS_reader(tsreader);
+    return 1;
+  }
 
-  (*reader)->is_TS = TRUE;
-  (*reader)->tsreader = tsreader;
+  new = *reader;
+  new->is_TS = TRUE;
+  new->tsreader = *tsreader;
+  new->all_programs = TRUE;
 
-  (*reader)->program_number = program_number;
-  (*reader)->output_program_number = program_number;
+  new->pid_info = malloc(PES_NUM_PIDS * SIZEOF_PES_PID_INFO);
+  if (new->pid_info == NULL)
+  {
+    print_err("### Unable to allocate PES reader PID table\n");
+    (void) close_PES_reader(reader);
+    *tsreader = NULL;
+    return 1;
+  }
+  for (ii = 0; ii < PES_NUM_PIDS; ii++)
+  {
+    new->pid_info[ii].program_index = -1;
+    new->pid_info[ii].is_pmt = FALSE;
+    new->pid_info[ii].stream_type = 0;
+  }
 
-  // Work out the program information by reading the first PAT and
-  // the first (following) PMT
-  err = determine_TS_program_info(*reader);
+  err = determine_all_TS_program_info(new);
   if (err)
   {
-    print_err("### Error determining/checking program number\n");
-    (void) free_PES_reader(reader);
+    print_err("### Error determining TS program information\n");
+    (void) close_PES_reader(reader);
+    *tsreader = NULL;
     return 1;
   }
   return 0;
@@ -1882,6 +2717,173 @@ extern int build_PES_reader(int            input,
   return 0;
 }
 
+/*
+ * Open an input that must be read indirectly - a list of files (named as
+ * "@<listfile>"), or a compressed file - for PES packet reading.
+ *
+ * - `filename` is the name of the input.
+ * - `is_TS` is TRUE if the data is TS, FALSE if it is PS, or -1 if we should
+ *   look at the start of the data to decide.
+ * - `all_programs` is TRUE if we should read all programs from TS data (see
+ *   build_TS_PES_reader_for_all_programs()), in which case
+ * - `program_number` is ignored, otherwise it identifies the TS program to
+ *   read (0 meaning the first program in the first PAT).
+ * - `give_info`, `give_warnings` and `reader` are as for open_PES_reader().
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int open_PES_reader_for_indirect(char          *filename,
+                                        int            is_TS,
+                                        int            all_programs,
+                                        uint16_t       program_number,
+                                        int            give_info,
+                                        int            give_warnings,
+                                        PES_reader_p  *reader)
+{
+  int  err;
+  struct indirect_input  input;
+
+  err = open_indirect_input(filename,&input);
+  if (err) return 1;
+
+  if (is_TS == -1)
+  {
+    // As determine_if_TS_file(), look for TS packet sync bytes
+    int  ii;
+    byte buf[TS_PACKET_SIZE];
+    is_TS = TRUE;
+    for (ii = 0; ii < 100 && is_TS; ii++)
+    {
+      int got = 0;
+      while (got < TS_PACKET_SIZE)
+      {
+        int length = input.read_fn(input.handle,buf+got,
+                                   TS_PACKET_SIZE-got);
+        if (length <= 0)
+          break;
+        got += length;
+      }
+      if (got < TS_PACKET_SIZE)
+        break;
+      if (buf[0] != 0x47)
+        is_TS = FALSE;
+    }
+    err = input.seek_fn(input.handle,0);
+    if (err)
+    {
+      print_err("### Error rewinding file after determining if it is TS\n");
+      (void) input.close_fn(input.handle);
+      return 1;
+    }
+  }
+
+  if (is_TS)
+  {
+    TS_reader_p  tsreader;
+    err = build_TS_reader_with_fns(input.handle,input.read_fn,input.seek_fn,
+                                   &tsreader);
+    if (err)
+    {
+      print_err("### Error building TS specific reader\n");
+      (void) input.close_fn(input.handle);
+      return 1;
+    }
+    tsreader->close_fn = input.close_fn;
+    if (all_programs)
+    {
+      err = build_TS_PES_reader_for_all_programs(&tsreader,give_info,
+                                                 give_warnings,reader);
+      if (err)
+      {
+        // which has closed `tsreader`, and thus our input, for us
+        print_err("### Error building TS specific reader\n");
+        return 1;
+      }
+    }
+    else
+    {
+      err = build_TS_PES_reader(tsreader,give_info,give_warnings,
+                                program_number,reader);
+      if (err)
+      {
+        // which leaves `tsreader` to us - closing it also closes our input
+        print_err("### Error building TS specific reader\n");
+        (void) close_TS_reader(&tsreader);
+        return 1;
+      }
+    }
+  }
+  else
+  {
+    PS_reader_p  ps;
+    err = build_PS_reader_with_fns(-1,input.handle,input.read_fn,input.seek_fn,
+                                   !give_info,&ps);
+    if (err)
+    {
+      print_err("### Error building PS specific reader\n");
+      (void) input.close_fn(input.handle);
+      return 1;
+    }
+    ps->close_fn = input.close_fn;
+    err = build_PS_PES_reader(ps,give_info,give_warnings,reader);
+    if (err)
+    {
+      // which leaves `ps` to us - closing it also closes our input
+      print_err("### Error building PS specific reader\n");
+      (void) close_PS_file(&ps);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Open a compact (null packet stripped) TS file for PES packet reading
+ *
+ * The null packets are not needed for reading PES data, so are not
+ * reconstructed.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int open_PES_reader_for_compact_TS(char          *filename,
+                                          int            all_programs,
+                                          uint16_t       program_number,
+                                          int            give_info,
+                                          int            give_warnings,
+                                          PES_reader_p  *reader)
+{
+  int  err;
+  TS_reader_p  tsreader;
+
+  err = open_compact_TS_for_TS_read(filename,FALSE,&tsreader);
+  if (err) return 1;
+
+  if (all_programs)
+  {
+    // On failure, this closes `tsreader` for us
+    err = build_TS_PES_reader_for_all_programs(&tsreader,give_info,
+                                               give_warnings,reader);
+    if (err)
+    {
+      print_err("### Error building TS specific reader\n");
+      return 1;
+    }
+  }
+  else
+  {
+    err = build_TS_PES_reader(tsreader,give_info,give_warnings,
+                              program_number,reader);
+    if (err)
+    {
+      // which leaves `tsreader` to us
+      print_err("### Error building TS specific reader\n");
+      (void) close_TS_reader(&tsreader);
+      return 1;
+    }
+  }
+  return 0;
+}
+
 /*
  * Open a Transport Stream file for PES packet reading
  *
@@ -1911,6 +2913,13 @@ extern int open_PES_reader_for_TS(char          *filename,
   int   err;
   int   input;
 
+  if (is_indirect_input(filename))
+    return open_PES_reader_for_indirect(filename,TRUE,FALSE,program_number,
+                                        give_info,give_warnings,reader);
+  else if (is_compact_TS_file(filename))
+    return open_PES_reader_for_compact_TS(filename,FALSE,program_number,
+                                          give_info,give_warnings,reader);
+
   input = open_binary_file(filename,FALSE);
   if (input == -1)
   {
@@ -1922,6 +2931,59 @@ extern int open_PES_reader_for_TS(char          *filename,
   if (err) return 1;
   return 0;
 }
+
+/*
+ * Open a Transport Stream file for PES packet reading from all of its
+ * programs (see build_TS_PES_reader_for_all_programs()).
+ *
+ * - `filename` is the name of the file to open.
+ * - `give_info` is TRUE if information about program data, etc., should be
+ *   output (to stdout).
+ * - `give_warnings` is TRUE if warnings (starting with "!!!") should be
+ *   output (to stderr), FALSE if they should be suppressed.
+ * - `reader` is the PES reader context corresponding to the newly
+ *   opened file.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_PES_reader_for_all_TS_programs(char          *filename,
+                                               int            give_info,
+                                               int            give_warnings,
+                                               PES_reader_p  *reader)
+{
+  int   err;
+  int   input;
+  TS_reader_p  tsreader;
+
+  if (is_indirect_input(filename))
+    return open_PES_reader_for_indirect(filename,TRUE,TRUE,0,
+                                        give_info,give_warnings,reader);
+  else if (is_compact_TS_file(filename))
+    return open_PES_reader_for_compact_TS(filename,TRUE,0,
+                                          give_info,give_warnings,reader);
+
+  input = open_binary_file(filename,FALSE);
+  if (input == -1)
+  {
+    fprint_err("### Unable to open input TS file %s\n",filename);
+    return 1;
+  }
+  err = build_TS_reader(input,&tsreader);
+  if (err)
+  {
+    print_err("### Error building TS specific reader\n");
+    (void) close_file(input);
+    return 1;
+  }
+  err = build_TS_PES_reader_for_all_programs(&tsreader,give_info,give_warnings,
+                                             reader);
+  if (err)
+  {
+    print_err("### Error building TS specific reader\n");
+    return 1;
+  }
+  return 0;
+}
 
 /*
  * Open a Program Stream file for PES packet reading
@@ -1941,7 +3003,13 @@ extern int open_PES_reader_for_PS(char          *filename,
                                   int            give_warnings,
                                   PES_reader_p  *reader)
 {
-  int input = open_binary_file(filename,FALSE);
+  int input;
+
+  if (is_indirect_input(filename))
+    return open_PES_reader_for_indirect(filename,FALSE,FALSE,0,
+                                        give_info,give_warnings,reader);
+
+  input = open_binary_file(filename,FALSE);
   if (input == -1)
   {
     fprint_err("### Unable to open input PS file %s\n",filename);
@@ -1998,6 +3066,13 @@ extern int open_PES_reader(char          *filename,
   int   input;
   int   is_TS;
 
+  if (is_indirect_input(filename))
+    return open_PES_reader_for_indirect(filename,-1,FALSE,0,
+                                        give_info,give_warnings,reader);
+  else if (is_compact_TS_file(filename))
+    return open_PES_reader_for_compact_TS(filename,FALSE,0,
+                                          give_info,give_warnings,reader);
+
   input = open_binary_file(filename,FALSE);
   if (input == -1)
   {
@@ -2143,6 +3218,21 @@ extern void set_PES_reader_h264(PES_reader_p  reader)
   reader->video_type = VIDEO_H264;
 }
 
+/*
+ * Set the largest unbounded PES packet that the PES reader will assemble.
+ *
+ * TS PES packets with a declared length of 0 are ended by the start of the
+ * next PES packet on the same PID. If one grows beyond `max_size` bytes,
+ * it is discarded (with a warning), and the reader waits for the next PES
+ * packet to start. `max_size` may be 0 for no limit. The default is
+ * PES_DEFAULT_MAX_SIZE.
+ */
+extern void set_PES_reader_max_size(PES_reader_p  reader,
+                                    int32_t       max_size)
+{
+  reader->max_PES_size = max_size;
+}
+
 /*
  * Tell the PES reader that the PS data it is reading is of
  * type `video_type` (which is assumed to be a legitimate value
@@ -2256,6 +3346,38 @@ extern int free_PES_reader(PES_reader_p  *reader)
     (*reader)->pmt_data_len = 0;
     (*reader)->pmt_data_used = 0;
   }
+  if ((*reader)->programs != NULL)
+  {
+    int  ii;
+    for (ii = 0; ii < (*reader)->num_programs; ii++)
+    {
+      PES_program_p  program = &(*reader)->programs[ii];
+      if (program->pmt != NULL)
+        free_pmt(&program->pmt);
+      if (program->pmt_data != NULL)
+        free(program->pmt_data);
+    }
+    free((*reader)->programs);
+    (*reader)->programs = NULL;
+    (*reader)->num_programs = (*reader)->programs_size = 0;
+  }
+  if ((*reader)->pid_info != NULL)
+  {
+    free((*reader)->pid_info);
+    (*reader)->pid_info = NULL;
+  }
+  if ((*reader)->pat_data != NULL)
+  {
+    free((*reader)->pat_data);
+    (*reader)->pat_data = NULL;
+  }
+  if ((*reader)->callbacks != NULL)
+  {
+    free((*reader)->callbacks);
+    (*reader)->callbacks = NULL;
+  }
+  if ((*reader)->deferred != NULL)
+    free_PES_packet_data(&(*reader)->deferred);
   if ((*reader)->packets != NULL)
   {
     free_peslist(&(*reader)->packets);
@@ -2326,7 +3448,8 @@ extern int read_next_PES_packet(PES_reader_p  reader)
   {
     if (reader->write_PES_packets && reader->tswriter != NULL &&
         !reader->suppress_writing &&
-        !reader->dont_write_current_packet)
+        !reader->dont_write_current_packet &&
+        !reader->all_programs)
     {
       // Aha - we need to output the previous PES packet
       uint32_t pid;
@@ -2401,7 +3524,9 @@ extern int read_next_PES_packet(PES_reader_p  reader)
   // have written it out
   reader->dont_write_current_packet = FALSE;
  
-  if (reader->is_TS)
+  if (reader->is_TS && reader->all_programs)
+    err = read_next_PES_packet_from_all_TS(reader,&reader->packet);
+  else if (reader->is_TS)
     err = read_next_PES_packet_from_TS(reader,&reader->packet);
   else
     err = read_next_PES_packet_from_PS(reader,&reader->packet);
@@ -2469,23 +3594,13 @@ extern int calc_mpeg1_pes_offset(byte  *data, int data_len)
  * For packets that do not contain any ES data (including PSM, etc.),
  * a zero length ES data array will be set.
  *
- * Note that only packets that appear to be video (i.e., have their
- * `is_video` flag set) will be considered as potential ES data packets.
- *
  * - `packet` is the PES packet datastructure
  */
-static inline void setup_PES_as_ES(PES_packet_data_p  packet)
+static inline void locate_PES_ES_data(PES_packet_data_p  packet)
 {
   byte  stream_id;
   int   offset;
 
-  if (!packet->is_video)
-  {
-    packet->es_data = packet->data + 6;  // Perhaps safer than using NULL
-    packet->es_data_len = 0;
-    return;
-  }
-  
   stream_id = packet->data[3];
 
   switch (stream_id)
@@ -2548,6 +3663,23 @@ static inline void setup_PES_as_ES(PES_packet_data_p  packet)
 
   return;
 }
+
+/*
+ * Set up the ES data fields of a PES packet, but only if it is video
+ * (see locate_PES_ES_data() for details).
+ *
+ * - `packet` is the PES packet datastructure
+ */
+static inline void setup_PES_as_ES(PES_packet_data_p  packet)
+{
+  if (!packet->is_video)
+  {
+    packet->es_data = packet->data + 6;  // Perhaps safer than using NULL
+    packet->es_data_len = 0;
+    return;
+  }
+  locate_PES_ES_data(packet);
+}
 
 /*
  * Read in the next PES packet that contains ES data we are interested in.
@@ -2588,6 +3720,117 @@ extern int read_next_PES_ES_packet(PES_reader_p       reader)
   }
   return 0;
 }
+
+/*
+ * Set the function to be called by read_all_PES_packets() for PES packets
+ * from a particular PID.
+ *
+ * - `reader` is a PES reader context
+ * - `pid` is the PID concerned, or -1 to set the default function, which is
+ *   called for any PID that does not have its own function. PS data is
+ *   treated as coming from PID 0.
+ * - `fn` is the function to call, or NULL to stop calling a function
+ *   for this PID.
+ * - `arg` is passed as the first argument to `fn`.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int set_PES_reader_callback(PES_reader_p   reader,
+                                   int            pid,
+                                   PES_packet_fn  fn,
+                                   void          *arg)
+{
+  if (pid == -1)
+  {
+    reader->default_callback.fn = fn;
+    reader->default_callback.arg = arg;
+    return 0;
+  }
+  else if (pid < 0 || pid >= PES_NUM_PIDS)
+  {
+    fprint_err("### Cannot set PES packet function for PID %d\n",pid);
+    return 1;
+  }
+
+  if (reader->callbacks == NULL)
+  {
+    reader->callbacks = calloc(PES_NUM_PIDS,SIZEOF_PES_CALLBACK);
+    if (reader->callbacks == NULL)
+    {
+      print_err("### Unable to allocate PES reader callback table\n");
+      return 1;
+    }
+  }
+  reader->callbacks[pid].fn = fn;
+  reader->callbacks[pid].arg = arg;
+  return 0;
+}
+
+/*
+ * Read PES packets, passing each to the function set for its PID (or to the
+ * default function) by set_PES_reader_callback(). Packets for which there
+ * is no such function are ignored.
+ *
+ * Each packet has its ES data located (i.e., `es_data` and `es_data_len`
+ * set) before it is passed on, regardless of whether it is video or not.
+ *
+ * This is particularly useful with a reader built by
+ * build_TS_PES_reader_for_all_programs(), as it allows all of the streams
+ * in a TS to be handled in a single pass.
+ *
+ * - `reader` is a PES reader context
+ * - `max` is the maximum number of PES packets to read, or 0 for no limit
+ * - `count` is returned as the number of PES packets read
+ *
+ * A function that returns EOF stops the reading early (but this is not an
+ * error), and one that returns 1 indicates an error.
+ *
+ * Returns 0 if all goes well (including reaching end of file), and 1 if
+ * something goes wrong.
+ */
+extern int read_all_PES_packets(PES_reader_p  reader,
+                                int           max,
+                                int          *count)
+{
+  int  err;
+  *count = 0;
+
+  while (max == 0 || *count < max)
+  {
+    PES_callback_p  callback;
+    PES_packet_data_p  packet;
+
+    err = read_next_PES_packet(reader);
+    if (err == EOF)
+      break;
+    else if (err)
+    {
+      fprint_err("### Error reading PES packet %d\n",*count+1);
+      return 1;
+    }
+    (*count) ++;
+
+    packet = reader->packet;
+    if (reader->callbacks != NULL && reader->callbacks[packet->pid].fn != NULL)
+      callback = &reader->callbacks[packet->pid];
+    else if (reader->default_callback.fn != NULL)
+      callback = &reader->default_callback;
+    else
+      continue;
+
+    locate_PES_ES_data(packet);
+    err = callback->fn(callback->arg,reader,packet);
+    if (err == EOF)
+      break;
+    else if (err)
+    {
+      fprint_err("### Error handling PES packet (PID %04x) at "
+                 OFFSET_T_FORMAT "\n",packet->pid,packet->posn);
+      return 1;
+    }
+  }
+  return 0;
+}
 
 // ============================================================
 // PES dissection
@@ -3619,7 +4862,10 @@ extern int find_ESCR_in_PES(byte      data[],
  *
  * An alternative, which will only work for TS input data, is
  * to write out TS packets as they are read. This will write all
- * TS packets to the client.
+ * TS packets to the client. They are written by a pass-through stage
+ * that is separate from PES assembly, a read-ahead buffer's worth at
+ * a time, but all of the TS packets read are always written out before
+ * the PES packet they finish is returned.
  *
  * - `reader` is our PES reader context
  * - `tswriter` is the TS writer
@@ -3640,6 +4886,7 @@ extern void set_server_output(PES_reader_p  reader,
   reader->write_PES_packets = write_PES;
   reader->write_TS_packets = !write_PES;
   reader->suppress_writing = FALSE;
+  reader->pass_through_TS = reader->write_TS_packets && tswriter != NULL;
   return;
 }
 
@@ -3656,7 +4903,11 @@ extern void set_server_output(PES_reader_p  reader,
 extern void start_server_output(PES_reader_p  reader)
 {
   if (reader != NULL)
+  {
     reader->suppress_writing = FALSE;
+    reader->pass_through_TS = reader->write_TS_packets &&
+                              reader->tswriter != NULL;
+  }
   return;
 }
 
@@ -3670,7 +4921,10 @@ extern void start_server_output(PES_reader_p  reader)
 extern void stop_server_output(PES_reader_p  reader)
 {
   if (reader != NULL)
+  {
     reader->suppress_writing = TRUE;
+    reader->pass_through_TS = FALSE;
+  }
   return;
 }
 
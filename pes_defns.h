@@ -41,7 +41,8 @@ struct PES_packet_data
 {
   byte    *data;      // The actual packet data
   int32_t  data_len;  // The length of the `data` array [1]
-  int32_t  length;    // Its length
+  int32_t  data_size; // The space allocated for it (at least `data_len`)
+  int32_t  length;    // Its length (-1 if it is being discarded)
   offset_t posn;      // The offset of its start in the file [2]
   int      is_video;  // Is this video data? (as opposed to audio)
 
@@ -58,6 +59,13 @@ struct PES_packet_data
   // Some applications want to know if a particular packet contains
   // a PTS or not
   int      has_PTS;
+
+  // For TS data, the PID the packet was read from (0 for PS data). When
+  // reading all programs (see `all_programs` in the PES reader), we also
+  // know the stream type and program number from the relevant PMT.
+  uint32_t pid;
+  byte     stream_type;
+  uint16_t program_number;
 };
 // [1] For PS data, data_len and length will always be the same.
 //     For TS data, length is set when the first TS packet of the
@@ -81,7 +89,59 @@ typedef struct peslist *peslist_p;
 #define SIZEOF_PESLIST sizeof(struct peslist)
 
 #define PESLIST_START_SIZE  2  // Guess at one audio, one video
-#define PESLIST_INCREMENT   1  // And a very conservative extension policy
+#define PESLIST_INCREMENT   1  // At least - the list doubles in size
+
+// PES packets with a declared length of 0 ("unbounded", as is allowed for
+// video in TS) can only be ended by the start of the next PES packet on the
+// same PID. So that a damaged stream cannot make us use unbounded memory,
+// a PES packet that grows beyond this size is discarded, and we wait for
+// the next one to start.
+#define PES_DEFAULT_MAX_SIZE  (16*1024*1024)
+
+// ------------------------------------------------------------
+// When reading all of the programs in a TS, we need to keep track of each
+// program named in the PAT, and build up its PMT
+struct PES_program
+{
+  uint16_t  program_number;
+  uint32_t  pmt_pid;
+  pmt_p     pmt;            // NULL until we've read a PMT for the program
+  // PMTs may be split over several TS packets, so we need a buffer
+  // to build them in (as for the single program case in the PES reader)
+  byte     *pmt_data;
+  int       pmt_data_len;
+  int       pmt_data_used;
+};
+typedef struct PES_program *PES_program_p;
+#define SIZEOF_PES_PROGRAM sizeof(struct PES_program)
+
+// And, for each PID, what it carries. This is indexed by PID, so that
+// lookup per TS packet is quick.
+struct PES_pid_info
+{
+  int16_t   program_index;  // index into the programs array, -1 if none
+  byte      is_pmt;         // TRUE if this is a PMT PID
+  byte      stream_type;    // otherwise, the stream type from the PMT
+};
+typedef struct PES_pid_info *PES_pid_info_p;
+#define SIZEOF_PES_PID_INFO sizeof(struct PES_pid_info)
+#define PES_NUM_PIDS  (0x1FFF+1)
+
+// A function to be called with each PES packet read by
+// `read_all_PES_packets`. It should return 0 if all went well, EOF if
+// reading should stop, or 1 if something went wrong. It must not free
+// the packet.
+struct PES_reader;
+typedef int (*PES_packet_fn)(void                    *arg,
+                             struct PES_reader       *reader,
+                             struct PES_packet_data  *packet);
+struct PES_callback
+{
+  PES_packet_fn  fn;
+  void          *arg;
+};
+typedef struct PES_callback *PES_callback_p;
+#define SIZEOF_PES_CALLBACK sizeof(struct PES_callback)
 
 // ------------------------------------------------------------
 // A PES "reader" datastructure is the interface through which one reads
@@ -133,6 +193,24 @@ struct PES_reader
   int    pmt_data_len;         // The buffers length = the PMT section length + 3
   int    pmt_data_used;        // How much of said data we've already got
 
+  // Alternatively, when reading TS data, we can read the PES packets for
+  // every elementary stream in every program, tracking all of the PMTs
+  // named in the PAT. In this case, the single program values above are
+  // not used.
+  int                 all_programs;
+  PES_program_p       programs;      // One entry per program in the PAT
+  int                 num_programs;
+  int                 programs_size; // How big the array is
+  PES_pid_info_p      pid_info;      // Indexed by PID
+  byte               *pat_data;      // For building up the PAT
+  int                 pat_data_len;
+  int                 pat_data_used;
+
+  // When reading via `read_all_PES_packets`, packets are passed to the
+  // callback for their PID (if any), or else to the default callback
+  PES_callback_p      callbacks;     // Indexed by PID, NULL until needed
+  struct PES_callback default_callback;
+
   // In order to write out TS data, we also need program information.
   // Obviously, the simplest case is when reading TS and writing it out
   // again, with the same settings. However, we also have to cope with
@@ -179,6 +257,9 @@ struct PES_reader
   // remember that we had found EOF, rather than try to bump into it again
   int               had_eof;
 
+  // The largest unbounded PES packet we will assemble (0 means no limit)
+  int32_t           max_PES_size;
+
   // When being used by a server, we want PES packets to be written out
   // as a "side effect" of reading them in to analyse their contents.
   // Thus we provide:
@@ -211,6 +292,15 @@ struct PES_reader
   // out for a while
   int               suppress_writing;
 
+  // TS packets are passed through to the TS writer by a separate stage,
+  // which is handed each read-ahead buffer's worth of packets once PES
+  // assembly has finished with it (and whatever is left over before a
+  // PES packet is returned), rather than one at a time from inside the
+  // assembly loop. This is TRUE if that stage is active (that is, we are
+  // writing TS packets, have a TS writer, and are not suppressing
+  // writing), so that the reader only has one thing to check.
+  int               pass_through_TS;
+
   // Debugging: if this is set, and the appropriate code is compiled into
   // pes.c (see DEBUG_READ_PACKETS), then report on each PES packet read
   // and written. Even if DEBUG_READ_PACKETS is not defined, some output
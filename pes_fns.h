@@ -90,6 +90,34 @@ extern int build_TS_PES_reader(TS_reader_p    tsreader,
                                int            give_warnings,
                                uint16_t       program_number,
                                PES_reader_p  *reader);
+/*
+ * Build a PES reader datastructure for TS data, reading every elementary
+ * stream in every program.
+ *
+ * The first PAT, and the PMTs for all of the programs it names, are located,
+ * and then the TS is rewound (unless it is being read from standard input),
+ * in the same manner as for build_TS_PES_reader(). Thereafter, PES packets
+ * are returned for any PID named in any PMT, and changes to the PAT or PMTs
+ * are tracked as they are read. Each PES packet's `pid`, `stream_type` and
+ * `program_number` identify where it came from.
+ *
+ * Note that writing out PES packets as TS (see set_server_output()) is not
+ * supported in this mode, although writing out TS packets is.
+ *
+ * - `tsreader` is the Transport Stream to read the PES data from. If this
+ *   function fails, it is closed and freed (and returned as NULL).
+ * - `give_info` is TRUE if information about program data, etc., should be
+ *   output (to stdout).
+ * - `give_warnings` is TRUE if warnings (starting with "!!!") should be
+ *   output (to stderr), FALSE if they should be suppressed.
+ * - `reader` is the resulting PES reader
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_TS_PES_reader_for_all_programs(TS_reader_p   *tsreader,
+                                                int            give_info,
+                                                int            give_warnings,
+                                                PES_reader_p  *reader);
 /*
  * Build a PES reader datastructure
  *
@@ -134,6 +162,24 @@ extern int open_PES_reader_for_TS(char          *filename,
                                   int            give_info,
                                   int            give_warnings,
                                   PES_reader_p  *reader);
+/*
+ * Open a Transport Stream file for PES packet reading from all of its
+ * programs (see build_TS_PES_reader_for_all_programs()).
+ *
+ * - `filename` is the name of the file to open.
+ * - `give_info` is TRUE if information about program data, etc., should be
+ *   output (to stdout).
+ * - `give_warnings` is TRUE if warnings (starting with "!!!") should be
+ *   output (to stderr), FALSE if they should be suppressed.
+ * - `reader` is the PES reader context corresponding to the newly
+ *   opened file.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_PES_reader_for_all_TS_programs(char          *filename,
+                                               int            give_info,
+                                               int            give_warnings,
+                                               PES_reader_p  *reader);
 /*
  * Open a Program Stream file for PES packet reading
  *
@@ -246,6 +292,17 @@ extern void set_PES_reader_program_data(PES_reader_p  reader,
  * as opposed to MPEG-1/MPEG-2.
  */
 extern void set_PES_reader_h264(PES_reader_p  reader);
+/*
+ * Set the largest unbounded PES packet that the PES reader will assemble.
+ *
+ * TS PES packets with a declared length of 0 are ended by the start of the
+ * next PES packet on the same PID. If one grows beyond `max_size` bytes,
+ * it is discarded (with a warning), and the reader waits for the next PES
+ * packet to start. `max_size` may be 0 for no limit. The default is
+ * PES_DEFAULT_MAX_SIZE.
+ */
+extern void set_PES_reader_max_size(PES_reader_p  reader,
+                                    int32_t       max_size);
 /*
  * Tell the PES reader that the PS data it is reading is of
  * type `video_type` (which is assumed to be a legitimate value
@@ -340,6 +397,49 @@ extern int calc_mpeg1_pes_offset(byte  *data, int data_len);
  * something goes wrong.
  */
 extern int read_next_PES_ES_packet(PES_reader_p       reader);
+/*
+ * Set the function to be called by read_all_PES_packets() for PES packets
+ * from a particular PID.
+ *
+ * - `reader` is a PES reader context
+ * - `pid` is the PID concerned, or -1 to set the default function, which is
+ *   called for any PID that does not have its own function. PS data is
+ *   treated as coming from PID 0.
+ * - `fn` is the function to call, or NULL to stop calling a function
+ *   for this PID.
+ * - `arg` is passed as the first argument to `fn`.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int set_PES_reader_callback(PES_reader_p   reader,
+                                   int            pid,
+                                   PES_packet_fn  fn,
+                                   void          *arg);
+/*
+ * Read PES packets, passing each to the function set for its PID (or to the
+ * default function) by set_PES_reader_callback(). Packets for which there
+ * is no such function are ignored.
+ *
+ * Each packet has its ES data located (i.e., `es_data` and `es_data_len`
+ * set) before it is passed on, regardless of whether it is video or not.
+ *
+ * This is particularly useful with a reader built by
+ * build_TS_PES_reader_for_all_programs(), as it allows all of the streams
+ * in a TS to be handled in a single pass.
+ *
+ * - `reader` is a PES reader context
+ * - `max` is the maximum number of PES packets to read, or 0 for no limit
+ * - `count` is returned as the number of PES packets read
+ *
+ * A function that returns EOF stops the reading early (but this is not an
+ * error), and one that returns 1 indicates an error.
+ *
+ * Returns 0 if all goes well (including reaching end of file), and 1 if
+ * something goes wrong.
+ */
+extern int read_all_PES_packets(PES_reader_p  reader,
+                                int           max,
+                                int          *count);
 /*
  * If the given PES packet data contains a PTS field, return it
  *
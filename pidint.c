@@ -102,7 +102,9 @@ extern int append_to_pidint_list(pidint_list_p  list,
 
   if (list->length == list->size)
   {
-    int newsize = list->size + PIDINT_LIST_INCREMENT;
+    int newsize = list->size * 2;
+    if (newsize < list->size + PIDINT_LIST_INCREMENT)
+      newsize = list->size + PIDINT_LIST_INCREMENT;
     list->number = realloc(list->number,newsize*sizeof(int));
     if (list->number == NULL)
     {
@@ -487,7 +489,9 @@ extern int add_stream_to_pmt(pmt_p      pmt,
 
   if (pmt->num_streams == pmt->streams_size)
   {
-    int newsize = pmt->streams_size + PMT_STREAMS_INCREMENT;
+    int newsize = pmt->streams_size * 2;
+    if (newsize < pmt->streams_size + PMT_STREAMS_INCREMENT)
+      newsize = pmt->streams_size + PMT_STREAMS_INCREMENT;
     pmt->streams = realloc(pmt->streams,newsize*SIZEOF_PMT_STREAM);
     if (pmt->streams == NULL)
     {
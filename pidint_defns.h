@@ -50,7 +50,7 @@ typedef struct pidint_list *pidint_list_p;
 #define SIZEOF_PIDINT_LIST sizeof(struct pidint_list)
 
 #define PIDINT_LIST_START_SIZE  5
-#define PIDINT_LIST_INCREMENT   10
+#define PIDINT_LIST_INCREMENT   10  // at least - the list doubles in size
 
 // ----------------------------------------------------------------------------
 // PMT - a representation of a Program Map Table
@@ -80,7 +80,7 @@ typedef struct _pmt *pmt_p;
 #define SIZEOF_PMT sizeof(struct _pmt)
 
 #define PMT_STREAMS_START_SIZE  5
-#define PMT_STREAMS_INCREMENT   10
+#define PMT_STREAMS_INCREMENT   10  // at least - the array doubles in size
 
 #define PMT_MAX_INFO_LENGTH     0x3FF   // i.e., 12 bits with the top two zero
 
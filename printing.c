@@ -29,6 +29,8 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <time.h>
 
 #include "compat.h"
 #include "printing_fns.h"
@@ -288,6 +290,180 @@ extern int redirect_output( void (*new_print_message_fn) (const char *message),
   return 0;
 }
 
+// ============================================================
+// Limiting diagnostics
+// ============================================================
+
+static struct diag_category diag_categories[DIAG_MAX_CATEGORIES];
+static int diag_num_categories = 0;
+static int diag_limit = DIAG_DEFAULT_LIMIT;
+
+/*
+ * Find (or add) the named category
+ *
+ * Returns NULL if there is no room for another category.
+ */
+static diag_category_p find_diag_category(const char *category,
+                                          int         is_msg)
+{
+  static diag_category_p last = NULL;
+  int ii;
+
+  // Messages tend to come in runs of the same category, so check the
+  // last one first - and mostly we'll be given the same (constant) string
+  if (last != NULL && (last->name == category || !strcmp(last->name,category)))
+    return last;
+
+  for (ii=0; ii<diag_num_categories; ii++)
+  {
+    if (diag_categories[ii].name == category ||
+        !strcmp(diag_categories[ii].name,category))
+    {
+      last = &diag_categories[ii];
+      return last;
+    }
+  }
+  if (diag_num_categories == DIAG_MAX_CATEGORIES)
+    return NULL;
+
+  last = &diag_categories[diag_num_categories++];
+  last->name = category;
+  last->is_msg = is_msg;
+  last->count = 0;
+  last->suppressed = 0;
+  last->last_summary = 0;
+  return last;
+}
+
+/*
+ * Count a diagnostic message, and decide if it should be output.
+ */
+static int diagnostic_wanted(const char *category,
+                             int         is_msg)
+{
+  diag_category_p  cat;
+
+  if (diag_limit == 0)
+    return TRUE;
+
+  cat = find_diag_category(category,is_msg);
+  if (cat == NULL)
+    return TRUE;
+
+  cat->count ++;
+  if (cat->count <= (uint64_t)diag_limit)
+    return TRUE;
+
+  if (cat->count == (uint64_t)diag_limit + 1)
+  {
+    fprint_msg_or_err(cat->is_msg,"!!! More than %d '%s' messages - only"
+                      " counting the rest\n",diag_limit,cat->name);
+    cat->last_summary = time(NULL);
+  }
+  cat->suppressed ++;
+
+  // Don't check the time *too* often, since that's part of what we're
+  // trying to save
+  if ((cat->suppressed & DIAG_TIME_CHECK_MASK) == 0)
+  {
+    time_t now = time(NULL);
+    if (now - cat->last_summary >= DIAG_SUMMARY_SECONDS)
+    {
+      fprint_msg_or_err(cat->is_msg,"!!! " LLU_FORMAT " more '%s' messages"
+                        " (" LLU_FORMAT " in all)\n",cat->suppressed,
+                        cat->name,cat->count);
+      cat->suppressed = 0;
+      cat->last_summary = now;
+    }
+  }
+  return FALSE;
+}
+
+/*
+ * Should a diagnostic message in this category be output?
+ *
+ * Counts the message. Returns TRUE for the first messages in each
+ * category, and FALSE once the limit (see set_diagnostic_limit) has been
+ * reached - in which case the caller should not output (or format) it.
+ *
+ * This is useful when a diagnostic takes more than one call to print
+ * (otherwise, see print_err_limited, etc.)
+ *
+ * - `category` says what sort of message it is. It is compared by content,
+ *   but is expected to be a constant string, since it is remembered.
+ */
+extern int want_diagnostic(const char *category)
+{
+  return diagnostic_wanted(category,FALSE);
+}
+
+/*
+ * Prints the given string, as an error message, if messages in `category`
+ * are not being suppressed.
+ */
+extern void print_err_limited(const char *category, const char *text)
+{
+  if (diagnostic_wanted(category,FALSE))
+    fns.print_error_fn(text);
+}
+
+/*
+ * Prints the given formatted text, as an error message, if messages in
+ * `category` are not being suppressed.
+ */
+extern void fprint_err_limited(const char *category, const char *format, ...)
+{
+  va_list va_arg;
+  if (!diagnostic_wanted(category,FALSE))
+    return;
+  va_start(va_arg, format); 
+  fns.fprint_error_fn(format, va_arg);
+  va_end(va_arg);
+}
+
+/*
+ * Prints the given formatted text, as a normal message, if messages in
+ * `category` are not being suppressed.
+ */
+extern void fprint_msg_limited(const char *category, const char *format, ...)
+{
+  va_list va_arg;
+  if (!diagnostic_wanted(category,TRUE))
+    return;
+  va_start(va_arg, format); 
+  fns.fprint_message_fn(format, va_arg);
+  va_end(va_arg);
+}
+
+/*
+ * Set how many messages in each category are output before the rest
+ * are suppressed. 0 means output all of them.
+ *
+ * The default is DIAG_DEFAULT_LIMIT, which is 0 (no limit).
+ */
+extern void set_diagnostic_limit(int limit)
+{
+  diag_limit = (limit < 0 ? 0 : limit);
+}
+
+/*
+ * Report on how many messages in each category have been suppressed.
+ *
+ * A program that sets a limit should call this before it exits.
+ */
+extern void report_diagnostics(void)
+{
+  int ii;
+  for (ii=0; ii<diag_num_categories; ii++)
+  {
+    diag_category_p  cat = &diag_categories[ii];
+    if (diag_limit != 0 && cat->count > (uint64_t)diag_limit)
+      fprint_msg_or_err(cat->is_msg,"!!! " LLU_FORMAT " '%s' messages in all,"
+                        " " LLU_FORMAT " not shown\n",cat->count,cat->name,
+                        cat->count - diag_limit);
+  }
+}
+
 extern void test_C_printing(void)
 {
   print_msg("C Message\n");
@@ -32,6 +32,41 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <time.h>
+#include "compat.h"
+
+// ------------------------------------------------------------
+// Limiting diagnostics
+//
+// On damaged data, some messages may be output once per bad TS packet or
+// NAL unit - potentially millions of times - and formatting and writing
+// them all can slow a program down enormously. Such messages may instead
+// be given a "category" (a short description of the sort of problem). If
+// the program sets a limit, only the first few messages in each category
+// are output. After that they are counted, but not formatted, with a summary
+// of how many were suppressed output every so often, and at the end of the
+// program.
+
+// How many messages in each category to output before suppressing the rest.
+// By default there is no limit (0), so a program must ask for one, and its
+// output is unchanged unless it does.
+#define DIAG_DEFAULT_LIMIT    0
+// How often (in seconds) to say how many have been suppressed since last time
+#define DIAG_SUMMARY_SECONDS  5
+// How many suppressed messages to count between checking the time
+#define DIAG_TIME_CHECK_MASK  0xFF
+// How many different categories we can remember - any more are not limited
+#define DIAG_MAX_CATEGORIES   64
+
+struct diag_category
+{
+  const char *name;        // The category (expected to be a constant string)
+  int         is_msg;      // Output as a normal message, not an error?
+  uint64_t    count;       // Messages in this category so far
+  uint64_t    suppressed;  // Not output since the last summary
+  time_t      last_summary;
+};
+typedef struct diag_category *diag_category_p;
 
 #endif // _printing_defns
 
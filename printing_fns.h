@@ -103,6 +103,52 @@ extern int redirect_output( void (*new_print_message_fn) (const char *message),
                             void (*new_flush_msg_fn) (void)
                           );
 
+// ============================================================
+// Limiting diagnostics
+// ============================================================
+/*
+ * Should a diagnostic message in this category be output?
+ *
+ * Counts the message. Returns TRUE for the first messages in each
+ * category, and FALSE once the limit (see set_diagnostic_limit) has been
+ * reached - in which case the caller should not output (or format) it.
+ *
+ * This is useful when a diagnostic takes more than one call to print
+ * (otherwise, see print_err_limited, etc.)
+ *
+ * - `category` says what sort of message it is. It is compared by content,
+ *   but is expected to be a constant string, since it is remembered.
+ */
+extern int want_diagnostic(const char *category);
+/*
+ * Prints the given string, as an error message, if messages in `category`
+ * are not being suppressed.
+ */
+extern void print_err_limited(const char *category, const char *text);
+/*
+ * Prints the given formatted text, as an error message, if messages in
+ * `category` are not being suppressed.
+ */
+extern void fprint_err_limited(const char *category, const char *format, ...);
+/*
+ * Prints the given formatted text, as a normal message, if messages in
+ * `category` are not being suppressed.
+ */
+extern void fprint_msg_limited(const char *category, const char *format, ...);
+/*
+ * Set how many messages in each category are output before the rest
+ * are suppressed. 0 means output all of them.
+ *
+ * The default is DIAG_DEFAULT_LIMIT, which is 0 (no limit).
+ */
+extern void set_diagnostic_limit(int limit);
+/*
+ * Report on how many messages in each category have been suppressed.
+ *
+ * A program that sets a limit should call this before it exits.
+ */
+extern void report_diagnostics(void);
+
 // Just for the moment
 extern void test_C_printing(void);
 #endif // _printing_fns
@@ -0,0 +1,682 @@
+/*
+ * Cache what was found by probing a file, so that repeated queries about
+ * the same (unchanged) file need not read it again.
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else // _WIN32
+#include <unistd.h>
+#endif // _WIN32
+
+#include "compat.h"
+#include "printing_fns.h"
+#include "pidint_fns.h"
+#include "probecache_fns.h"
+
+// The longest line we expect in a cache file. A PAT with the most
+// programs possible, or a PMT stream with the most descriptor data
+// possible (as hex), fits comfortably
+#define PROBE_CACHE_MAX_LINE  8192
+
+/*
+ * Work out the identity of the file being probed.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int identify_probed_file(char           *filename,
+                                probe_cache_p   cache)
+{
+#ifdef _WIN32
+  struct _stati64  info;
+  if (_stati64(filename,&info))
+#else
+  struct stat  info;
+  if (stat(filename,&info))
+#endif
+  {
+    fprint_err("### Unable to find out about file %s: %s\n",
+               filename,strerror(errno));
+    return 1;
+  }
+  cache->device = (uint64_t)info.st_dev;
+  cache->inode  = (uint64_t)info.st_ino;
+  cache->size   = (uint64_t)info.st_size;
+  cache->mtime  = (int64_t)info.st_mtime;
+#if defined(__linux__)
+  cache->mtime_nsec = (int64_t)info.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+  cache->mtime_nsec = (int64_t)info.st_mtimespec.tv_nsec;
+#else
+  cache->mtime_nsec = 0;
+#endif
+  return 0;
+}
+
+/*
+ * Forget the results of any scan
+ */
+static void clear_probe_cache_scan(probe_cache_p  cache)
+{
+  int  ii;
+  for (ii = 0; ii < cache->num_events; ii++)
+  {
+    free_pidint_list(&cache->events[ii].prog_list);
+    free_pmt(&cache->events[ii].pmt);
+  }
+  cache->num_events = 0;
+  cache->have_scan = FALSE;
+  cache->scan_max = cache->num_pats = cache->num_pmts = cache->eof_at = 0;
+}
+
+/*
+ * Make room for another event, and return it (cleared)
+ *
+ * Returns NULL if something goes wrong.
+ */
+static probe_cache_event_p new_probe_cache_event(probe_cache_p  cache)
+{
+  probe_cache_event_p  event;
+  if (cache->num_events == cache->events_size)
+  {
+    int  newsize = cache->events_size + (cache->events_size == 0 ?
+                                         PROBE_CACHE_EVENTS_START_SIZE :
+                                         PROBE_CACHE_EVENTS_INCREMENT);
+    probe_cache_event_p  tmp = realloc(cache->events,
+                                       newsize*SIZEOF_PROBE_CACHE_EVENT);
+    if (tmp == NULL)
+    {
+      print_err("### Unable to extend probe cache event array\n");
+      return NULL;
+    }
+    cache->events = tmp;
+    cache->events_size = newsize;
+  }
+  event = &cache->events[cache->num_events++];
+  memset(event,0,SIZEOF_PROBE_CACHE_EVENT);
+  return event;
+}
+
+/*
+ * Read an (unsigned) decimal number from `*line`, and move past it.
+ *
+ * Returns 0 if all goes well, 1 if there is no number there.
+ */
+static int next_cache_number(char     **line,
+                             uint64_t  *value)
+{
+  char  *ptr;
+  while (**line == ' ')
+    (*line)++;
+  if (**line < '0' || **line > '9')
+    return 1;
+  *value = strtoull(*line,&ptr,10);
+  *line = ptr;
+  return 0;
+}
+
+/*
+ * Read hexadecimal descriptor data (or "-" for none) from `*line`, and
+ * move past it.
+ *
+ * - `length` is returned as the length of the data
+ * - `data` is returned as a (malloc'ed) copy of it, or NULL if there is
+ *   none
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int next_cache_hex(char     **line,
+                          uint16_t  *length,
+                          byte     **data)
+{
+  char  *start;
+  int    num_chars = 0;
+  int    ii;
+
+  *length = 0;
+  *data = NULL;
+
+  while (**line == ' ')
+    (*line)++;
+  if (**line == '-')
+  {
+    (*line)++;
+    return 0;
+  }
+
+  start = *line;
+  while ((start[num_chars] >= '0' && start[num_chars] <= '9') ||
+         (start[num_chars] >= 'a' && start[num_chars] <= 'f'))
+    num_chars ++;
+  if (num_chars == 0 || num_chars % 2 != 0 ||
+      num_chars/2 > PMT_MAX_INFO_LENGTH)
+    return 1;
+
+  *data = malloc(num_chars/2);
+  if (*data == NULL)
+  {
+    print_err("### Unable to allocate probe cache descriptor data\n");
+    return 1;
+  }
+  for (ii = 0; ii < num_chars/2; ii++)
+  {
+    char  pair[3] = {start[2*ii], start[2*ii+1], 0};
+    (*data)[ii] = (byte)strtoul(pair,NULL,16);
+  }
+  *length = num_chars/2;
+  *line = start + num_chars;
+  return 0;
+}
+
+/*
+ * Interpret one line (entry) of a cache file.
+ *
+ * - `pmt` is the PMT that E entries add to, and is returned as the new
+ *   PMT after an M entry (or as NULL after anything else)
+ * - `matches` is returned TRUE after a K entry that matches the file
+ *
+ * Returns 0 if all goes well, 1 if the entry is not understood.
+ */
+static int read_probe_cache_entry(probe_cache_p   cache,
+                                  char           *line,
+                                  pmt_p          *pmt,
+                                  int            *matches)
+{
+  char      what = line[0];
+  uint64_t  values[6];
+  int       ii;
+
+  line++;
+  if (what == 'K')
+  {
+    for (ii = 0; ii < 5; ii++)
+      if (next_cache_number(&line,&values[ii])) return 1;
+    *matches = (values[0] == cache->device && values[1] == cache->inode &&
+                values[2] == cache->size &&
+                (int64_t)values[3] == cache->mtime &&
+                (int64_t)values[4] == cache->mtime_nsec);
+  }
+  else if (what == 'T')
+  {
+    for (ii = 0; ii < 2; ii++)
+      if (next_cache_number(&line,&values[ii])) return 1;
+    cache->have_type = TRUE;
+    cache->type = (int)values[0];
+    cache->decided = (int)values[1];
+  }
+  else if (what == 'S')
+  {
+    for (ii = 0; ii < 4; ii++)
+      if (next_cache_number(&line,&values[ii])) return 1;
+    clear_probe_cache_scan(cache);
+    cache->have_scan = TRUE;
+    cache->scan_max = (int)values[0];
+    cache->num_pats = (int)values[1];
+    cache->num_pmts = (int)values[2];
+    cache->eof_at   = (int)values[3];
+  }
+  else if (what == 'A' && cache->have_scan)
+  {
+    probe_cache_event_p  event;
+    if (next_cache_number(&line,&values[0])) return 1;
+    if (next_cache_number(&line,&values[1])) return 1;
+    event = new_probe_cache_event(cache);
+    if (event == NULL) return 1;
+    event->packet = (int)values[0];
+    if (build_pidint_list(&event->prog_list)) return 1;
+    for (ii = 0; ii < (int)values[1]; ii++)
+    {
+      if (next_cache_number(&line,&values[2])) return 1;
+      if (next_cache_number(&line,&values[3])) return 1;
+      if (append_to_pidint_list(event->prog_list,(uint32_t)values[3],
+                                (int)values[2]))
+        return 1;
+    }
+  }
+  else if (what == 'M' && cache->have_scan)
+  {
+    probe_cache_event_p  event;
+    uint16_t  info_length;
+    byte     *info;
+    int       err;
+    for (ii = 0; ii < 5; ii++)
+      if (next_cache_number(&line,&values[ii])) return 1;
+    if (next_cache_hex(&line,&info_length,&info)) return 1;
+    event = new_probe_cache_event(cache);
+    if (event == NULL) { free(info); return 1; }
+    event->packet = (int)values[0];
+    event->pmt_pid = (uint32_t)values[1];
+    event->pmt = build_pmt((uint16_t)values[2],(byte)values[3],
+                           (uint32_t)values[4]);
+    if (event->pmt == NULL) { free(info); return 1; }
+    err = (info_length > 0 ?
+           set_pmt_program_info(event->pmt,info_length,info) : 0);
+    free(info);
+    if (err) return 1;
+    *pmt = event->pmt;
+    return 0;
+  }
+  else if (what == 'E' && *pmt != NULL)
+  {
+    uint16_t  info_length;
+    byte     *info;
+    int       err;
+    for (ii = 0; ii < 2; ii++)
+      if (next_cache_number(&line,&values[ii])) return 1;
+    if (next_cache_hex(&line,&info_length,&info)) return 1;
+    err = add_stream_to_pmt(*pmt,(uint32_t)values[0],(byte)values[1],
+                            info_length,info);
+    free(info);
+    if (err) return 1;
+    return 0;
+  }
+  else
+    return 1;
+  *pmt = NULL;
+  return 0;
+}
+
+/*
+ * Read a cache file, if there is one, and it describes the probed file
+ * as it is now.
+ *
+ * If the cache file is absent, out of date or not understood, the cache
+ * is left empty (and marked as changed, so that it will be rewritten).
+ */
+static void read_probe_cache(probe_cache_p  cache)
+{
+  FILE  *file;
+  char  *line;
+  int    matches = FALSE;
+  int    bad = FALSE;
+  int    line_num = 0;
+  pmt_p  pmt = NULL;
+
+  cache->changed = TRUE;
+
+  file = fopen(cache->filename,"r");
+  if (file == NULL)
+    return;
+
+  line = malloc(PROBE_CACHE_MAX_LINE);
+  if (line == NULL)
+  {
+    print_err("### Unable to allocate probe cache line buffer\n");
+    fclose(file);
+    return;
+  }
+
+  while (!bad && fgets(line,PROBE_CACHE_MAX_LINE,file) != NULL)
+  {
+    int  len = (int)strlen(line);
+    line_num ++;
+    if (len == 0 || line[len-1] != '\n')
+    {
+      bad = TRUE;               // too long, or the file is truncated
+      break;
+    }
+    line[len-1] = '\0';
+    if (line_num == 1)
+    {
+      if (strcmp(line,PROBE_CACHE_HEADER))
+        bad = TRUE;
+      continue;
+    }
+    if (line[0] == '#' || line[0] == '\0')
+      continue;
+    // The identity of the file must come first
+    if (line_num == 2 && line[0] != 'K')
+      bad = TRUE;
+    else if (read_probe_cache_entry(cache,line,&pmt,&matches))
+      bad = TRUE;
+    else if (!matches)
+      break;
+  }
+  free(line);
+  fclose(file);
+
+  if (bad || !matches)
+  {
+    if (bad)
+      fprint_err("!!! Ignoring probe cache %s, which is not understood"
+                 " (line %d)\n",cache->filename,line_num);
+    cache->have_type = FALSE;
+    clear_probe_cache_scan(cache);
+  }
+  else
+    cache->changed = FALSE;
+}
+
+/*
+ * Find the probe cache for a file.
+ *
+ * If the cache file exists, and describes the file as it is now, its
+ * content is read. Otherwise, the cache starts out empty (and the cache
+ * file will be replaced when it is written).
+ *
+ * - `filename` is the file being probed
+ * - `cache_name` is the cache file to use, or NULL to use the sidecar
+ *   (`filename` with PROBE_CACHE_SUFFIX added)
+ * - `cache` is the new probe cache context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (for instance,
+ * if `filename` does not exist).
+ */
+extern int build_probe_cache(char           *filename,
+                             char           *cache_name,
+                             probe_cache_p  *cache)
+{
+  probe_cache_p  new = calloc(1,SIZEOF_PROBE_CACHE);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate probe cache datastructure\n");
+    return 1;
+  }
+
+  if (cache_name == NULL)
+  {
+    new->filename = malloc(strlen(filename) + strlen(PROBE_CACHE_SUFFIX) + 1);
+    if (new->filename != NULL)
+      sprintf(new->filename,"%s%s",filename,PROBE_CACHE_SUFFIX);
+  }
+  else
+  {
+    new->filename = malloc(strlen(cache_name) + 1);
+    if (new->filename != NULL)
+      strcpy(new->filename,cache_name);
+  }
+  if (new->filename == NULL)
+  {
+    print_err("### Unable to allocate probe cache filename\n");
+    free(new);
+    return 1;
+  }
+
+  if (identify_probed_file(filename,new))
+  {
+    free_probe_cache(&new);
+    return 1;
+  }
+
+  read_probe_cache(new);
+  *cache = new;
+  return 0;
+}
+
+/*
+ * Free a probe cache context, without writing it out.
+ *
+ * `cache` is returned as NULL. Does nothing if it is already NULL.
+ */
+extern void free_probe_cache(probe_cache_p  *cache)
+{
+  if (*cache == NULL)
+    return;
+  clear_probe_cache_scan(*cache);
+  if ((*cache)->events != NULL)
+    free((*cache)->events);
+  free((*cache)->filename);
+  free(*cache);
+  *cache = NULL;
+}
+
+/*
+ * Write descriptor data as hex (or "-" if there is none)
+ */
+static void write_cache_hex(FILE     *file,
+                            uint16_t  length,
+                            byte     *data)
+{
+  int  ii;
+  if (length == 0)
+    fprintf(file," -");
+  else
+  {
+    fprintf(file," ");
+    for (ii = 0; ii < length; ii++)
+      fprintf(file,"%02x",data[ii]);
+  }
+}
+
+/*
+ * Write the probe cache out, if anything in it has changed.
+ *
+ * The new cache is written to a temporary file, which then replaces the
+ * old one, so that a query running at the same time never sees half a
+ * cache.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int write_probe_cache(probe_cache_p  cache)
+{
+  FILE  *file;
+  char  *tempname;
+  int    ii, jj;
+
+  if (!cache->changed)
+    return 0;
+
+  tempname = malloc(strlen(cache->filename) + 5);
+  if (tempname == NULL)
+  {
+    print_err("### Unable to allocate temporary probe cache filename\n");
+    return 1;
+  }
+  sprintf(tempname,"%s.new",cache->filename);
+
+  file = fopen(tempname,"w");
+  if (file == NULL)
+  {
+    fprint_err("### Unable to open probe cache %s: %s\n",
+               tempname,strerror(errno));
+    free(tempname);
+    return 1;
+  }
+
+  fprintf(file,"%s\n",PROBE_CACHE_HEADER);
+  fprintf(file,"K " LLU_FORMAT " " LLU_FORMAT " " LLU_FORMAT " "
+          LLD_FORMAT " " LLD_FORMAT "\n",cache->device,cache->inode,
+          cache->size,cache->mtime,cache->mtime_nsec);
+  if (cache->have_type)
+    fprintf(file,"T %d %d\n",cache->type,cache->decided);
+  if (cache->have_scan)
+  {
+    fprintf(file,"S %d %d %d %d\n",cache->scan_max,cache->num_pats,
+            cache->num_pmts,cache->eof_at);
+    for (ii = 0; ii < cache->num_events; ii++)
+    {
+      probe_cache_event_p  event = &cache->events[ii];
+      if (event->prog_list != NULL)
+      {
+        fprintf(file,"A %d %d",event->packet,event->prog_list->length);
+        for (jj = 0; jj < event->prog_list->length; jj++)
+          fprintf(file," %d %u",event->prog_list->number[jj],
+                  event->prog_list->pid[jj]);
+        fprintf(file,"\n");
+      }
+      else
+      {
+        pmt_p  pmt = event->pmt;
+        fprintf(file,"M %d %u %u %u %u",event->packet,event->pmt_pid,
+                pmt->program_number,pmt->version_number,pmt->PCR_pid);
+        write_cache_hex(file,pmt->program_info_length,pmt->program_info);
+        fprintf(file,"\n");
+        for (jj = 0; jj < pmt->num_streams; jj++)
+        {
+          pmt_stream_p  stream = &pmt->streams[jj];
+          fprintf(file,"E %u %u",stream->elementary_PID,stream->stream_type);
+          write_cache_hex(file,stream->ES_info_length,stream->ES_info);
+          fprintf(file,"\n");
+        }
+      }
+    }
+  }
+
+  if (ferror(file) | fclose(file))
+  {
+    fprint_err("### Error writing probe cache %s\n",tempname);
+    remove(tempname);
+    free(tempname);
+    return 1;
+  }
+
+#ifdef _WIN32
+  // rename() will not replace an existing file on Windows
+  remove(cache->filename);
+#endif
+  if (rename(tempname,cache->filename))
+  {
+    fprint_err("### Unable to rename %s to %s: %s\n",
+               tempname,cache->filename,strerror(errno));
+    remove(tempname);
+    free(tempname);
+    return 1;
+  }
+  free(tempname);
+  cache->changed = FALSE;
+  return 0;
+}
+
+/*
+ * Remember what sort of data the file contains.
+ */
+extern void probe_cache_set_type(probe_cache_p  cache,
+                                 int            type,
+                                 int            decided)
+{
+  if (cache->have_type && cache->type == type && cache->decided == decided)
+    return;
+  cache->have_type = TRUE;
+  cache->type = type;
+  cache->decided = decided;
+  cache->changed = TRUE;
+}
+
+/*
+ * Start remembering the results of scanning the first `max` TS packets
+ * of the file, forgetting any previous scan.
+ *
+ * The scan is not kept unless probe_cache_end_scan() is called.
+ */
+extern void probe_cache_start_scan(probe_cache_p  cache,
+                                   int            max)
+{
+  clear_probe_cache_scan(cache);
+  cache->scan_max = max;
+  cache->changed = TRUE;
+}
+
+/*
+ * Remember a (new) PAT found by the current scan.
+ *
+ * - `packet` is the number of the TS packet that completed it, from 1
+ * - `prog_list` is its program list, which is copied
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int probe_cache_add_PAT(probe_cache_p  cache,
+                               int            packet,
+                               pidint_list_p  prog_list)
+{
+  int  ii;
+  probe_cache_event_p  event = new_probe_cache_event(cache);
+  if (event == NULL) return 1;
+  event->packet = packet;
+  if (build_pidint_list(&event->prog_list)) return 1;
+  for (ii = 0; ii < prog_list->length; ii++)
+    if (append_to_pidint_list(event->prog_list,prog_list->pid[ii],
+                              prog_list->number[ii]))
+      return 1;
+  return 0;
+}
+
+/*
+ * Remember a (new) PMT found by the current scan.
+ *
+ * - `packet` is the number of the TS packet that completed it, from 1
+ * - `pid` is the PID it was found on
+ * - `pmt` is the PMT, which is copied
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int probe_cache_add_PMT(probe_cache_p  cache,
+                               int            packet,
+                               uint32_t       pid,
+                               pmt_p          pmt)
+{
+  int  ii;
+  probe_cache_event_p  event = new_probe_cache_event(cache);
+  if (event == NULL) return 1;
+  event->packet = packet;
+  event->pmt_pid = pid;
+  event->pmt = build_pmt(pmt->program_number,pmt->version_number,
+                         pmt->PCR_pid);
+  if (event->pmt == NULL) return 1;
+  if (pmt->program_info_length > 0 &&
+      set_pmt_program_info(event->pmt,pmt->program_info_length,
+                           pmt->program_info))
+    return 1;
+  for (ii = 0; ii < pmt->num_streams; ii++)
+  {
+    pmt_stream_p  stream = &pmt->streams[ii];
+    if (add_stream_to_pmt(event->pmt,stream->elementary_PID,
+                          stream->stream_type,stream->ES_info_length,
+                          stream->ES_info))
+      return 1;
+  }
+  return 0;
+}
+
+/*
+ * Finish the current scan, which found `num_pats` PAT and `num_pmts` PMT
+ * packets, and read EOF at packet `eof_at` (or 0 if it did not).
+ */
+extern void probe_cache_end_scan(probe_cache_p  cache,
+                                 int            num_pats,
+                                 int            num_pmts,
+                                 int            eof_at)
+{
+  cache->have_scan = TRUE;
+  cache->num_pats = num_pats;
+  cache->num_pmts = num_pmts;
+  cache->eof_at = eof_at;
+  cache->changed = TRUE;
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,127 @@
+/*
+ * Datastructures for caching what was found by probing a file
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef _probecache_defns
+#define _probecache_defns
+
+#include "compat.h"
+#include "pidint_defns.h"
+
+// Probing a large file (to find out if it is TS, PS or ES, or to find its
+// programs and streams) means reading some way into it. If the same file
+// is going to be asked about repeatedly, the results can be cached, so
+// that later queries need not touch the media at all.
+//
+// A probe cache is a text file, by default a "sidecar" with the same name
+// as the file it describes, with PROBE_CACHE_SUFFIX added. It starts with
+// the line:
+//
+//   # TS probe cache 1
+//
+// and each subsequent line is an entry, whose first character says what
+// it is:
+//
+//   K <device> <inode> <size> <mtime seconds> <mtime nanoseconds>
+//       which file the cache describes, and which version of it. If any
+//       of these do not match the file as it is now, the cache is ignored
+//       (and will be overwritten)
+//   T <type> <decided>
+//       what sort of data the file contains (as decided by stream_type),
+//       and whether it was sure
+//   S <packets> <PATs> <PMTs> <EOF>
+//       the result of scanning the first <packets> TS packets (as tsinfo
+//       does): how many PAT and PMT packets there were, and which packet
+//       EOF was found at (or 0 if it was not). This is followed by the
+//       A, M and E entries (if any) found by the scan, in order
+//   A <packet> <count> [<program> <pid>]...
+//       a (new) PAT, and the program number and PMT PID for each program
+//   M <packet> <pid> <program> <version> <PCR pid> <program info>
+//       a (new) PMT, on the given PID, followed by its E entries
+//   E <pid> <stream type> <ES info>
+//       a stream in the preceding PMT
+//
+// Descriptor data (<program info>, <ES info>) is in hexadecimal, or is
+// "-" if there is none. Other numbers are decimal. Lines starting with #
+// are comments.
+
+#define PROBE_CACHE_HEADER  "# TS probe cache 1"
+#define PROBE_CACHE_SUFFIX  ".tsprobe"
+
+// A PAT or PMT found when scanning TS
+struct probe_cache_event
+{
+  int             packet;    // which TS packet completed it (from 1)
+  pidint_list_p   prog_list; // for a PAT, else NULL
+  uint32_t        pmt_pid;   // for a PMT,
+  pmt_p           pmt;       // else NULL
+};
+typedef struct probe_cache_event *probe_cache_event_p;
+#define SIZEOF_PROBE_CACHE_EVENT sizeof(struct probe_cache_event)
+
+#define PROBE_CACHE_EVENTS_START_SIZE  4
+#define PROBE_CACHE_EVENTS_INCREMENT   8
+
+struct probe_cache
+{
+  char     *filename;      // the cache file itself
+
+  // The identity of the file being probed
+  uint64_t  device;
+  uint64_t  inode;
+  uint64_t  size;
+  int64_t   mtime;
+  int64_t   mtime_nsec;
+
+  // What sort of data it is
+  int       have_type;     // TRUE if the following are known
+  int       type;
+  int       decided;
+
+  // What we found scanning its first `scan_max` TS packets
+  int       have_scan;     // TRUE if the following are known
+  int       scan_max;
+  int       num_pats;
+  int       num_pmts;
+  int       eof_at;        // the packet at which EOF was read, or 0
+  int       num_events;
+  int       events_size;
+  probe_cache_event_p  events;
+
+  int       changed;       // TRUE if the cache file needs rewriting
+};
+typedef struct probe_cache *probe_cache_p;
+#define SIZEOF_PROBE_CACHE sizeof(struct probe_cache)
+
+#endif // _probecache_defns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
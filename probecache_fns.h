@@ -0,0 +1,118 @@
+/*
+ * Prototypes for caching what was found by probing a file
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef _probecache_fns
+#define _probecache_fns
+
+#include "probecache_defns.h"
+
+/*
+ * Find the probe cache for a file.
+ *
+ * If the cache file exists, and describes the file as it is now, its
+ * content is read. Otherwise, the cache starts out empty (and the cache
+ * file will be replaced when it is written).
+ *
+ * - `filename` is the file being probed
+ * - `cache_name` is the cache file to use, or NULL to use the sidecar
+ *   (`filename` with PROBE_CACHE_SUFFIX added)
+ * - `cache` is the new probe cache context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (for instance,
+ * if `filename` does not exist).
+ */
+extern int build_probe_cache(char           *filename,
+                             char           *cache_name,
+                             probe_cache_p  *cache);
+/*
+ * Free a probe cache context, without writing it out.
+ *
+ * `cache` is returned as NULL. Does nothing if it is already NULL.
+ */
+extern void free_probe_cache(probe_cache_p  *cache);
+/*
+ * Write the probe cache out, if anything in it has changed.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int write_probe_cache(probe_cache_p  cache);
+/*
+ * Remember what sort of data the file contains.
+ */
+extern void probe_cache_set_type(probe_cache_p  cache,
+                                 int            type,
+                                 int            decided);
+/*
+ * Start remembering the results of scanning the first `max` TS packets
+ * of the file, forgetting any previous scan.
+ *
+ * The scan is not kept unless probe_cache_end_scan() is called.
+ */
+extern void probe_cache_start_scan(probe_cache_p  cache,
+                                   int            max);
+/*
+ * Remember a (new) PAT found by the current scan.
+ *
+ * - `packet` is the number of the TS packet that completed it, from 1
+ * - `prog_list` is its program list, which is copied
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int probe_cache_add_PAT(probe_cache_p  cache,
+                               int            packet,
+                               pidint_list_p  prog_list);
+/*
+ * Remember a (new) PMT found by the current scan.
+ *
+ * - `packet` is the number of the TS packet that completed it, from 1
+ * - `pid` is the PID it was found on
+ * - `pmt` is the PMT, which is copied
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int probe_cache_add_PMT(probe_cache_p  cache,
+                               int            packet,
+                               uint32_t       pid,
+                               pmt_p          pmt);
+/*
+ * Finish the current scan, which found `num_pats` PAT and `num_pmts` PMT
+ * packets, and read EOF at packet `eof_at` (or 0 if it did not).
+ */
+extern void probe_cache_end_scan(probe_cache_p  cache,
+                                 int            num_pats,
+                                 int            num_pmts,
+                                 int            eof_at);
+
+#endif // _probecache_fns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -57,6 +57,13 @@
 // (instead of just giving up)
 #define RECOVER_BROKEN_PS 1
 
+// When seeking by time, stop the binary search over pack headers when the
+// range left is this small, and just scan through it
+#define PS_TIME_SEARCH_SCAN  (64*1024)
+
+// SCR base values are 33 bits, and wrap around
+#define PS_SCR_MASK  0x1FFFFFFFFLL
+
 // ============================================================
 // PS to TS datastructures
 // ============================================================
@@ -103,9 +110,17 @@ static inline int get_more_data(PS_reader_p   ps)
   // Call `read` directly - we don't particularly mind if we get a "short"
   // read, since we'll just catch up later on
 #ifdef _WIN32
-  int len = _read(ps->input,&ps->data,PS_READ_AHEAD_SIZE);
+  int len;
+#else
+  ssize_t  len;
+#endif
+  if (ps->read_fn)
+    len = ps->read_fn(ps->handle,ps->data,PS_READ_AHEAD_SIZE);
+  else
+#ifdef _WIN32
+    len = _read(ps->input,&ps->data,PS_READ_AHEAD_SIZE);
 #else
-  ssize_t  len = read(ps->input,&ps->data,PS_READ_AHEAD_SIZE);
+    len = read(ps->input,&ps->data,PS_READ_AHEAD_SIZE);
 #endif
   if (len == 0)
     return EOF;
@@ -134,6 +149,26 @@ static inline int get_more_data(PS_reader_p   ps)
 extern int build_PS_reader(int           input,
                            int           quiet,
                            PS_reader_p  *ps)
+{
+  return build_PS_reader_with_fns(input,NULL,NULL,NULL,quiet,ps);
+}
+
+/*
+ * Build a program stream context using the given functions as read() and
+ * seek(). As build_PS_reader(), but:
+ *
+ * - `handle` is passed to `read_fn` and `seek_fn`.
+ * - if `read_fn` and `seek_fn` are NULL, then `input` is read from instead.
+ *   Otherwise, `input` should be -1.
+ *
+ * Returns 0 if all goes well, 1 otherwise.
+ */
+extern int build_PS_reader_with_fns(int           input,
+                                    void         *handle,
+                                    int         (*read_fn)(void *, byte *, size_t),
+                                    int         (*seek_fn)(void *, offset_t),
+                                    int           quiet,
+                                    PS_reader_p  *ps)
 {
   int  err;
   PS_reader_p new = malloc(SIZEOF_PS_READER);
@@ -144,9 +179,14 @@ extern int build_PS_reader(int           input,
   }
 
   new->input = input;
+  new->handle = handle;
+  new->read_fn = read_fn;
+  new->seek_fn = seek_fn;
+  new->close_fn = NULL;
   new->data_posn = 0;
   new->data_len  = 0;
   new->start     = 0;
+  new->end       = 0;
 
   err = get_more_data(new);
   if (err)
@@ -213,7 +253,9 @@ extern void free_PS_reader(PS_reader_p  *ps)
  * Open a PS file for reading.
  *
  * - `name` is the name of the file. If this is NULL, then standard input
- *   is used.
+ *   is used. If it starts with MULTIFILE_LIST_PREFIX ('@'), then the rest
+ *   of it names a list of files to be read as if they were a single file.
+ *   If it names a gzip compressed file, then the data it contains is read.
  * - If `quiet`, then don't report on ignored bytes at the start of the file
  * - `ps` is the new PS context
  *
@@ -225,6 +267,23 @@ extern int open_PS_file(char         *name,
 {
   int  f;
 
+  if (is_indirect_input(name))
+  {
+    int  err;
+    struct indirect_input  indirect;
+    err = open_indirect_input(name,&indirect);
+    if (err) return 1;
+    err = build_PS_reader_with_fns(-1,indirect.handle,indirect.read_fn,
+                                   indirect.seek_fn,quiet,ps);
+    if (err)
+    {
+      (void) indirect.close_fn(indirect.handle);
+      return 1;
+    }
+    (*ps)->close_fn = indirect.close_fn;
+    return 0;
+  }
+
   if (name == NULL)
     f = STDIN_FILENO;
   else
@@ -244,7 +303,13 @@ extern int open_PS_file(char         *name,
  */
 extern int close_PS_file(PS_reader_p   *ps)
 {
-  if ((*ps)->input != STDIN_FILENO)
+  if ((*ps)->close_fn)
+  {
+    int err = (*ps)->close_fn((*ps)->handle);
+    free_PS_reader(ps);
+    return err;
+  }
+  else if ((*ps)->input != STDIN_FILENO)
   {
     int err = close_file((*ps)->input);
     if (err) return 1;
@@ -362,7 +427,11 @@ extern int determine_PS_video_type(PS_reader_p  ps,
 extern int seek_using_PS_reader(PS_reader_p  ps,
                                 offset_t     posn)
 {
-  int err = seek_file(ps->input,posn);
+  int err;
+  if (ps->seek_fn)
+    err = ps->seek_fn(ps->handle,posn);
+  else
+    err = seek_file(ps->input,posn);
   if (err) return 1;
 
   ps->data_posn = posn;
@@ -878,7 +947,8 @@ extern void free_PS_packet(PS_packet_p  *packet)
  *
  * Returns:
  *   * 0 if it succeeds,
- *   * EOF if EOF is read, or an MPEG_program_end_code is read,
+ *   * EOF if EOF is read, or an MPEG_program_end_code is read, or the
+ *     end set by `set_PS_time_range` is reached,
  *   * 2 if the bytes read are not 00 00 01 `stream_id`, or
  *   * 1 if some other error occurs.
  */
@@ -941,6 +1011,8 @@ extern int read_PS_packet_start(PS_reader_p ps,
       print_err("### Error trying to find start of next pack header\n");
       return 1;
     }
+    if (ps->end != 0 && *posn >= ps->end)
+      return EOF;
     fprint_err("!!! Continuing with PS pack header at " OFFSET_T_FORMAT
                "\n",*posn);
     *stream_id = 0xBA;
@@ -952,6 +1024,10 @@ extern int read_PS_packet_start(PS_reader_p ps,
 
   *stream_id = buf[3];
 
+  // If we've been asked to stop before here, pretend this is the end
+  if (ps->end != 0 && *posn >= ps->end)
+    return EOF;
+
 #if DEBUG
   fprint_msg("Packet at " OFFSET_T_FORMAT ", stream id %02X (",*posn,*stream_id);
   print_stream_id(TRUE,*stream_id);
@@ -1160,6 +1236,216 @@ extern int identify_private1_data(struct PS_packet *packet,
   }
   return what;
 }
+
+// ============================================================
+// Time based access
+// ============================================================
+/*
+ * Find the next pack header, from the current position, and read its SCR.
+ *
+ * - `ps` is the PS read-ahead context we're reading from
+ * - `posn` is the file offset of the pack header found
+ * - `scr_base` is its SCR, in 90KHz units
+ *
+ * Returns 0 if all goes well, EOF if there is no further pack header,
+ * 1 if something goes wrong.
+ */
+static int read_next_PS_pack_time(PS_reader_p  ps,
+                                  offset_t    *posn,
+                                  uint64_t    *scr_base)
+{
+  int   err;
+  byte  stream_id = 0;
+  struct PS_pack_header  header;
+
+  while (stream_id != 0xBA)
+  {
+    err = find_PS_packet_start(ps,FALSE,0,posn,&stream_id);
+    if (err) return err;
+  }
+  err = read_PS_pack_header_body(ps,&header);
+  if (err) return err;
+  *scr_base = header.scr_base;
+  return 0;
+}
+
+/*
+ * Find the first pack header at or after the given time.
+ *
+ * Times are relative to the SCR of the pack header at the start of the
+ * data (`ps->start`), allowing for the SCR wrapping. The SCR is assumed
+ * to increase through the file (as it should, unless the data has been
+ * spliced together), so that a binary search over the pack headers can
+ * be used, rather than reading the whole file.
+ *
+ * This repositions the PS reader, which is left at an undefined position.
+ *
+ * - `ps` is the PS read-ahead context, which must be reading from a file
+ * - `time` is the wanted time, in 90KHz units
+ * - `size` is the size of the file
+ * - `posn` is the file offset of the pack header found
+ * - `found` is its time, in 90KHz units
+ *
+ * Returns 0 if all goes well, EOF if there is no pack header at or after
+ * `time`, 1 if something goes wrong.
+ */
+static int find_PS_pack_for_time(PS_reader_p  ps,
+                                 uint64_t     time,
+                                 offset_t     size,
+                                 offset_t    *posn,
+                                 uint64_t    *found)
+{
+  int       err;
+  uint64_t  first_scr, scr;
+  offset_t  lo, hi;
+
+  err = seek_using_PS_reader(ps,ps->start);
+  if (err) return 1;
+  err = read_next_PS_pack_time(ps,posn,&first_scr);
+  if (err)
+  {
+    print_err("### Error reading first PS pack header\n");
+    return 1;
+  }
+
+  // Narrow down the range with a binary search. `lo` is always a pack
+  // header before the wanted time, and there is no pack header we want
+  // before it, whilst the one we want (if any) starts before `hi`, or
+  // at `hi` if that is itself a pack header
+  lo = ps->start;
+  hi = size;
+  while (hi - lo > PS_TIME_SEARCH_SCAN)
+  {
+    offset_t  mid = lo + (hi - lo)/2;
+    err = seek_using_PS_reader(ps,mid);
+    if (err) return 1;
+    err = read_next_PS_pack_time(ps,posn,&scr);
+    if (err == EOF || (err == 0 && *posn >= hi))
+      hi = mid;         // no pack header between `mid` and `hi`
+    else if (err)
+      return 1;
+    else if (((scr - first_scr) & PS_SCR_MASK) < time)
+      lo = *posn;
+    else
+      hi = *posn;
+  }
+
+  // And then scan forwards for the actual pack header
+  err = seek_using_PS_reader(ps,lo);
+  if (err) return 1;
+  for (;;)
+  {
+    err = read_next_PS_pack_time(ps,posn,&scr);
+    if (err) return err;
+    if (((scr - first_scr) & PS_SCR_MASK) >= time)
+      break;
+  }
+  *found = (scr - first_scr) & PS_SCR_MASK;
+  return 0;
+}
+
+/*
+ * Restrict the PS reader to the data between two times.
+ *
+ * Times are in seconds, relative to the first pack header in the data.
+ * The start of the data (as used by `rewind_program_stream`) becomes the
+ * first pack header at or after `start_time`, and the data is treated as
+ * ending (`read_PS_packet_start` returns EOF) at the first pack header
+ * at or after `end_time`. The pack headers are found by a binary search
+ * on their SCR values, so the program stream need not be read from the
+ * start.
+ *
+ * Only PS data read directly from a file can be accessed by time.
+ *
+ * - `ps` is the PS read-ahead context
+ * - `start_time` is when to start, or 0 for the start of the data
+ * - `end_time` is when to stop, or 0 for the end of the data
+ * - if `quiet`, don't report on the positions found
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int set_PS_time_range(PS_reader_p  ps,
+                             double       start_time,
+                             double       end_time,
+                             int          quiet)
+{
+  int       err;
+  offset_t  size;
+  offset_t  start = ps->start;
+  offset_t  end = 0;
+  offset_t  posn;
+  uint64_t  found;
+
+  if (start_time <= 0.0 && end_time <= 0.0)
+    return 0;
+
+  if (ps->read_fn != NULL || ps->input == STDIN_FILENO)
+  {
+    print_err("### Time based access is only supported for PS read"
+              " from a file\n");
+    return 1;
+  }
+  if (end_time > 0.0 && end_time <= start_time)
+  {
+    fprint_err("### End time %.2fs is not after start time %.2fs\n",
+               end_time,start_time);
+    return 1;
+  }
+
+  size = lseek(ps->input,0,SEEK_END);
+  if (size == -1)
+  {
+    fprint_err("### Error finding size of PS file: %s\n",strerror(errno));
+    return 1;
+  }
+
+  if (start_time > 0.0)
+  {
+    err = find_PS_pack_for_time(ps,(uint64_t)(start_time * 90000),size,
+                                &posn,&found);
+    if (err == EOF)
+    {
+      fprint_err("### Start time %.2fs is after the end of the PS data\n",
+                 start_time);
+      return 1;
+    }
+    else if (err)
+    {
+      fprint_err("### Error finding start time %.2fs in PS data\n",
+                 start_time);
+      return 1;
+    }
+    if (!quiet)
+      fprint_msg("Starting at pack header at " OFFSET_T_FORMAT " (%.2fs)\n",
+                 posn,found/90000.0);
+    start = posn;
+  }
+
+  if (end_time > 0.0)
+  {
+    err = find_PS_pack_for_time(ps,(uint64_t)(end_time * 90000),size,
+                                &posn,&found);
+    if (err == 0)
+    {
+      if (!quiet)
+        fprint_msg("Stopping at pack header at " OFFSET_T_FORMAT " (%.2fs)\n",
+                   posn,found/90000.0);
+      end = posn;
+    }
+    else if (err != EOF)
+    {
+      fprint_err("### Error finding end time %.2fs in PS data\n",end_time);
+      return 1;
+    }
+    else if (!quiet)
+      print_msg("End time is after the end of the PS data\n");
+  }
+
+  ps->start = start;
+  ps->end = end;
+  return rewind_program_stream(ps);
+}
+
 
 // ============================================================
 // PS to TS functions
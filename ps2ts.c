@@ -127,6 +127,15 @@ static void print_usage()
     "                    each audio packet, as it is read\n"
     "  -quiet, -q        Only output error messages\n"
     "  -max <n>, -m <n>  Maximum number of PS packs to read\n"
+    "  -starttime <t>    Start at the first PS pack at or after <t> seconds\n"
+    "                    into the data (as given by the pack header SCRs).\n"
+    "                    The pack is found without reading the data before it.\n"
+    "  -endtime <t>      Stop at the first PS pack at or after <t> seconds.\n"
+    "                    These two switches need input from a named file.\n"
+    "  -diag-limit <n>   Only show the first <n> messages about each sort of\n"
+    "                    problem in the data (broken PES packets, NAL units,\n"
+    "                    and so on), then just count them. 0 shows all of\n"
+    "                    them. The default is 0.\n"
     "\n"
     "Stream type:\n"
     "  When the TS data is being output, it is flagged to indicate whether\n"
@@ -175,6 +184,8 @@ int main(int argc, char **argv)
   int     verbose = FALSE;
   int     quiet = FALSE;
   int     max = 0;
+  double  start_time = 0.0;
+  double  end_time = 0.0;
   uint32_t pmt_pid = 0x66;
   uint32_t video_pid = 0x68;
   uint32_t pcr_pid = video_pid;  // Use PCRs from the video stream
@@ -310,6 +321,29 @@ int main(int argc, char **argv)
         if (err) return 1;
         ii++;
       }
+      else if (!strcmp("-diag-limit",argv[ii]))
+      {
+        int  limit;
+        CHECKARG("ps2ts",ii);
+        err = int_value("ps2ts",argv[ii],argv[ii+1],TRUE,10,&limit);
+        if (err) return 1;
+        set_diagnostic_limit(limit);
+        ii++;
+      }
+      else if (!strcmp("-starttime",argv[ii]))
+      {
+        CHECKARG("ps2ts",ii);
+        err = double_value("ps2ts",argv[ii],argv[ii+1],TRUE,&start_time);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-endtime",argv[ii]))
+      {
+        CHECKARG("ps2ts",ii);
+        err = double_value("ps2ts",argv[ii],argv[ii+1],TRUE,&end_time);
+        if (err) return 1;
+        ii++;
+      }
       else if (!strcmp("-prepeat",argv[ii]))
       {
         CHECKARG("ps2ts",ii);
@@ -434,6 +468,14 @@ int main(int argc, char **argv)
   if (!quiet)
     fprint_msg("Reading from %s\n",(use_stdin?"<stdin>":input_name));
 
+  err = set_PS_time_range(ps,start_time,end_time,quiet);
+  if (err)
+  {
+    print_err("### ps2ts: Unable to select the requested times\n");
+    (void) close_PS_file(&ps);
+    return 1;
+  }
+
   // Try to decide what sort of data stream we have
   if (force_stream_type || use_stdin)
   {
@@ -499,6 +541,7 @@ int main(int argc, char **argv)
                  video_stream,audio_stream,want_ac3_audio,
                  want_dolby_as_dvb,pmt_pid,pcr_pid,video_pid,
                  keep_audio,audio_pid,max,verbose,quiet);
+  report_diagnostics();
   if (err)
   {
     print_err("### ps2ts: Error transferring data\n");
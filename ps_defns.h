@@ -43,6 +43,16 @@ struct ps_reader
 {
   int       input;             // where we're reading from
   offset_t  start;             // the offset at which our data starts
+  offset_t  end;               // if non-zero, where our data stops (see
+                               // set_PS_time_range())
+
+  // Alternatively, if `read_fn` and `seek_fn` are non-NULL, we call them
+  // (with `handle`) instead of read() and seek(), and `close_fn` (if
+  // non-NULL) is called by close_PS_file() to close `handle`
+  void     *handle;
+  int     (*read_fn)(void *, byte *, size_t);
+  int     (*seek_fn)(void *, offset_t);
+  int     (*close_fn)(void *);
 
   byte      data[PS_READ_AHEAD_SIZE];
   offset_t  data_posn;         // location of this data in the file
@@ -51,6 +51,22 @@
 extern int build_PS_reader(int           input,
                            int           quiet,
                            PS_reader_p  *ps);
+/*
+ * Build a program stream context using the given functions as read() and
+ * seek(). As build_PS_reader(), but:
+ *
+ * - `handle` is passed to `read_fn` and `seek_fn`.
+ * - if `read_fn` and `seek_fn` are NULL, then `input` is read from instead.
+ *   Otherwise, `input` should be -1.
+ *
+ * Returns 0 if all goes well, 1 otherwise.
+ */
+extern int build_PS_reader_with_fns(int           input,
+                                    void         *handle,
+                                    int         (*read_fn)(void *, byte *, size_t),
+                                    int         (*seek_fn)(void *, offset_t),
+                                    int           quiet,
+                                    PS_reader_p  *ps);
 /*
  * Tidy up the PS read-ahead context after we've finished with it.
  *
@@ -65,7 +81,10 @@ extern void free_PS_reader(PS_reader_p  *ps);
 /*
  * Open a PS file for reading.
  *
- * - `name` is the name of the file
+ * - `name` is the name of the file. If this is NULL, then standard input
+ *   is used. If it starts with MULTIFILE_LIST_PREFIX ('@'), then the rest
+ *   of it names a list of files to be read as if they were a single file.
+ *   If it names a gzip compressed file, then the data it contains is read.
  * - If `quiet`, then don't report on ignored bytes at the start of the file
  * - `ps` is the new PS context
  *
@@ -134,6 +153,30 @@ extern int seek_using_PS_reader(PS_reader_p  ps,
  * Returns 0 if all goes well, 1 if something goes wrong
  */
 extern int rewind_program_stream(PS_reader_p  ps);
+/*
+ * Restrict the PS reader to the data between two times.
+ *
+ * Times are in seconds, relative to the first pack header in the data.
+ * The start of the data (as used by `rewind_program_stream`) becomes the
+ * first pack header at or after `start_time`, and the data is treated as
+ * ending (`read_PS_packet_start` returns EOF) at the first pack header
+ * at or after `end_time`. The pack headers are found by a binary search
+ * on their SCR values, so the program stream need not be read from the
+ * start.
+ *
+ * Only PS data read directly from a file can be accessed by time.
+ *
+ * - `ps` is the PS read-ahead context
+ * - `start_time` is when to start, or 0 for the start of the data
+ * - `end_time` is when to stop, or 0 for the end of the data
+ * - if `quiet`, don't report on the positions found
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int set_PS_time_range(PS_reader_p  ps,
+                             double       start_time,
+                             double       end_time,
+                             int          quiet);
 /*
  * Print out a stream id in a manner consistent with the PS usages
  * of the stream id values.
@@ -256,7 +299,8 @@ extern void free_PS_packet(PS_packet_p  *packet);
  *
  * Returns:
  *   * 0 if it succeeds,
- *   * EOF if EOF is read, or an MPEG_program_end_code is read,
+ *   * EOF if EOF is read, or an MPEG_program_end_code is read, or the
+ *     end set by `set_PS_time_range` is reached,
  *   * 2 if the bytes read are not 00 00 01 `stream_id`, or
  *   * 1 if some other error occurs.
  */
@@ -476,6 +476,11 @@ static void print_usage()
     "  -stdin             Input from standard input, instead of a file\n"
     "  -verbose, -v       Output packet data as well.\n"
     "  -max <n>, -m <n>   Maximum number of PS packets to read\n"
+    "  -starttime <t>     Start at the first PS pack at or after <t> seconds\n"
+    "                     into the data (as given by the pack header SCRs).\n"
+    "                     The pack is found without reading the data before it.\n"
+    "  -endtime <t>       Stop at the first PS pack at or after <t> seconds.\n"
+    "                     These two switches need input from a named file.\n"
     "  -dvd               The PS data is from a DVD. This is the default.\n"
     "                     This switch has no effect on MPEG-1 PS data.\n"
     "  -notdvd, -nodvd    The PS data is not from a DVD.\n"
@@ -492,6 +497,8 @@ int main(int argc, char **argv)
 
   PS_reader_p  ps;        // The PS file we're reading
   int    max     = 0;     // The maximum number of PS packets to read (or 0)
+  double start_time = 0.0; // Where to start reading, in seconds (or 0)
+  double end_time = 0.0;   // Where to stop reading, in seconds (or 0)
   int    verbose = FALSE; // True => output diagnostic/progress messages
   int    is_dvd = TRUE;
 
@@ -549,6 +556,20 @@ int main(int argc, char **argv)
         if (err) return 1;
         ii++;
       }
+      else if (!strcmp("-starttime",argv[ii]))
+      {
+        CHECKARG("psreport",ii);
+        err = double_value("psreport",argv[ii],argv[ii+1],TRUE,&start_time);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-endtime",argv[ii]))
+      {
+        CHECKARG("psreport",ii);
+        err = double_value("psreport",argv[ii],argv[ii+1],TRUE,&end_time);
+        if (err) return 1;
+        ii++;
+      }
       else if (!strcmp("-stdin",argv[ii]))
       {
         use_stdin = TRUE;
@@ -599,6 +620,14 @@ int main(int argc, char **argv)
   if (max)
     fprint_msg("Stopping after %d PS packets\n",max);
 
+  err = set_PS_time_range(ps,start_time,end_time,FALSE);
+  if (err)
+  {
+    print_err("### psreport: Unable to select the requested times\n");
+    (void) close_PS_file(&ps);
+    return 1;
+  }
+
   err = report_ps(ps,is_dvd,max,verbose);
   if (err)
     print_err("### psreport: Error reporting on input stream\n");
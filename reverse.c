@@ -96,6 +96,7 @@
 extern int build_reverse_data(reverse_data_p *reverse_data,
                               int             is_h264)
 {
+  int ii;
   int newsize = REVERSE_ARRAY_START_SIZE;
   reverse_data_p  new = malloc(SIZEOF_REVERSE_DATA);
   if (new == NULL)
@@ -186,11 +187,127 @@ extern int build_reverse_data(reverse_data_p *reverse_data,
 
   new->pid = DEFAULT_VIDEO_PID;
   new->stream_id = DEFAULT_VIDEO_STREAM_ID;
+
+  set_trick_budget(&new->budget,0,0);
+
+  for (ii=0; ii<REVERSE_CACHE_MAX_ENTRIES; ii++)
+  {
+    new->cache[ii].which = -1;
+    new->cache[ii].data = NULL;
+    new->cache[ii].picture = NULL;
+    new->cache[ii].size = 0;
+  }
+  new->cache_max_bytes = 0;
+  new->cache_bytes = 0;
+  new->cache_clock = 0;
+  new->cache_hits = 0;
+  new->cache_misses = 0;
   
   *reverse_data = new;
   return 0;
 }
 
+// ============================================================
+// Keeping trick play within a bitrate
+// ============================================================
+/*
+ * Set (or clear) the target bitrate for trick play output.
+ *
+ * - `budget` is the trick play budget to set
+ * - `bitrate` is the target output bitrate, in bits/second, or 0 if
+ *   pictures are to be chosen only by frequency
+ * - `picture_rate` is the number of pictures per second that the output
+ *   is displayed at (if 0, DEFAULT_TRICK_PICTURE_RATE is used)
+ *
+ * The budget starts full.
+ */
+extern void set_trick_budget(trick_budget_p  budget,
+                             uint32_t        bitrate,
+                             int             picture_rate)
+{
+  budget->bitrate = bitrate;
+  budget->picture_rate = (picture_rate > 0 ? picture_rate :
+                          DEFAULT_TRICK_PICTURE_RATE);
+  // Allow a burst of a few pictures, but never less than one picture's
+  // worth, or we'd never output anything
+  budget->max_credit = (int64_t)bitrate * TRICK_BUDGET_BURST_MS / 1000;
+  if (budget->max_credit < (int64_t)bitrate / budget->picture_rate)
+    budget->max_credit = (int64_t)bitrate / budget->picture_rate;
+  reset_trick_budget(budget);
+}
+
+/*
+ * Refill a trick play budget, ready to start outputting trick play again.
+ */
+extern void reset_trick_budget(trick_budget_p  budget)
+{
+  budget->credit = budget->max_credit;
+  budget->remainder = 0;
+  budget->dropped = 0;
+}
+
+/*
+ * Add the credit for `pictures` more pictures, at a speed of `freq`
+ * pictures per output picture.
+ */
+extern void trick_budget_advance(trick_budget_p  budget,
+                                 int             pictures,
+                                 int             freq)
+{
+  int64_t  divisor;
+  if (budget->bitrate == 0 || pictures <= 0)
+    return;
+  // Each output picture slot is worth bitrate/picture_rate bits, and
+  // stands for `freq` input pictures. Keep the remainder, so that we
+  // don't lose credit to rounding one picture at a time
+  divisor = (int64_t)budget->picture_rate * (freq > 0 ? freq : 1);
+  budget->remainder += (int64_t)budget->bitrate * pictures;
+  budget->credit += budget->remainder / divisor;
+  budget->remainder %= divisor;
+  if (budget->credit > budget->max_credit)
+  {
+    budget->credit = budget->max_credit;
+    budget->remainder = 0;
+  }
+}
+
+/*
+ * Is there room in the budget for a picture of `num_bytes` bytes?
+ *
+ * This is always TRUE if no target bitrate is set. A picture bigger than
+ * the largest credit allowed is let through when the budget is full.
+ */
+extern int trick_budget_allows(trick_budget_p  budget,
+                               uint32_t        num_bytes)
+{
+  if (budget->bitrate == 0)
+    return TRUE;
+  return (budget->credit >= (int64_t)num_bytes * 8 ||
+          budget->credit >= budget->max_credit);
+}
+
+/*
+ * Take `num_bytes` bytes of output from the budget.
+ */
+extern void trick_budget_spend(trick_budget_p  budget,
+                               uint32_t        num_bytes)
+{
+  if (budget->bitrate != 0)
+    budget->credit -= (int64_t)num_bytes * 8;
+}
+
+/*
+ * Set the target bitrate for trick play output of reversed data.
+ *
+ * See set_trick_budget() for details.
+ */
+extern void set_reverse_bitrate(reverse_data_p  reverse_data,
+                                uint32_t        bitrate,
+                                int             picture_rate)
+{
+  set_trick_budget(&reverse_data->budget,bitrate,picture_rate);
+}
+
 /*
  * Set the video PID and stream id for TS output.
  *
@@ -206,6 +323,296 @@ extern void set_reverse_pid(reverse_data_p  reverse_data,
   reverse_data->stream_id = stream_id;
 }
 
+// ============================================================
+// Caching recently used entries
+// ============================================================
+/*
+ * Empty a reverse cache entry, freeing whatever it holds.
+ */
+static void clear_reverse_cache_entry(reverse_data_p               reverse_data,
+                                      struct reverse_cache_entry  *entry)
+{
+  if (entry->data != NULL)
+    free(entry->data);
+  if (entry->picture != NULL)
+    free_h262_picture(&entry->picture);
+  entry->data = NULL;
+  entry->picture = NULL;
+  entry->which = -1;
+  reverse_data->cache_bytes -= entry->size;
+  entry->size = 0;
+}
+
+/*
+ * Empty the reverse cache.
+ */
+static void clear_reverse_cache(reverse_data_p  reverse_data)
+{
+  int ii;
+  for (ii=0; ii<REVERSE_CACHE_MAX_ENTRIES; ii++)
+    if (reverse_data->cache[ii].which != -1)
+      clear_reverse_cache_entry(reverse_data,&reverse_data->cache[ii]);
+}
+
+/*
+ * Set how much data the cache of recently used reverse entries may hold.
+ *
+ * - `reverse_data` is the reverse data context
+ * - `max_bytes` is the most data the cache may hold, or 0 if the cache
+ *   is not to be used (the default).
+ *
+ * Anything already in the cache is discarded.
+ */
+extern void set_reverse_cache_size(reverse_data_p  reverse_data,
+                                   uint32_t        max_bytes)
+{
+  clear_reverse_cache(reverse_data);
+  reverse_data->cache_max_bytes = max_bytes;
+}
+
+/*
+ * Look for reverse entry `which` in the cache.
+ *
+ * Returns the cache entry, or NULL if it is not there.
+ */
+static struct reverse_cache_entry *find_in_reverse_cache(
+                                             reverse_data_p  reverse_data,
+                                             int             which)
+{
+  int ii;
+  if (reverse_data->cache_max_bytes == 0)
+    return NULL;
+  for (ii=0; ii<REVERSE_CACHE_MAX_ENTRIES; ii++)
+  {
+    struct reverse_cache_entry *entry = &reverse_data->cache[ii];
+    if (entry->which == which)
+    {
+      entry->last_used = ++reverse_data->cache_clock;
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Is `picture` one of the pictures held by the cache?
+ */
+static int picture_is_in_reverse_cache(reverse_data_p  reverse_data,
+                                       h262_picture_p  picture)
+{
+  int ii;
+  for (ii=0; ii<REVERSE_CACHE_MAX_ENTRIES; ii++)
+    if (reverse_data->cache[ii].picture == picture)
+      return TRUE;
+  return FALSE;
+}
+
+/*
+ * Free an H.262 picture, unless it belongs to the cache, in which case
+ * just forget about it.
+ *
+ * Sets `picture` to NULL.
+ */
+static void release_h262_picture(reverse_data_p   reverse_data,
+                                 h262_picture_p  *picture)
+{
+  if (picture_is_in_reverse_cache(reverse_data,*picture))
+    *picture = NULL;
+  else
+    free_h262_picture(picture);
+}
+
+/*
+ * Add the data (or H.262 picture) for reverse entry `which` to the cache,
+ * making room for it by discarding the least recently used entries.
+ *
+ * - `reverse_data` is the reverse data context
+ * - `which` is the index of the entry in the reverse arrays
+ * - `data` and `data_len` are the entry's data, or NULL and 0
+ * - `picture` is the entry's H.262 picture, or NULL
+ *
+ * Returns TRUE if the cache has taken over `data` (or `picture`), which
+ * the caller must then not free, or FALSE if it has not (because the cache
+ * is not being used, the entry is already cached, or it is too big).
+ */
+static int add_to_reverse_cache(reverse_data_p  reverse_data,
+                                int             which,
+                                byte           *data,
+                                uint32_t        data_len,
+                                h262_picture_p  picture)
+{
+  int       ii;
+  uint32_t  size = (data != NULL ? data_len : reverse_data->data_len[which]);
+  struct reverse_cache_entry *entry = NULL;
+
+  if (reverse_data->cache_max_bytes == 0 ||
+      size > reverse_data->cache_max_bytes)
+    return FALSE;
+
+  for (ii=0; ii<REVERSE_CACHE_MAX_ENTRIES; ii++)
+    if (reverse_data->cache[ii].which == which)
+      return FALSE;
+
+  for (;;)
+  {
+    struct reverse_cache_entry *oldest = NULL;
+    entry = NULL;
+    for (ii=0; ii<REVERSE_CACHE_MAX_ENTRIES; ii++)
+    {
+      struct reverse_cache_entry *this = &reverse_data->cache[ii];
+      if (this->which == -1)
+        entry = this;
+      else if (oldest == NULL || this->last_used < oldest->last_used)
+        oldest = this;
+    }
+    if (entry != NULL && reverse_data->cache_bytes + size <=
+                         reverse_data->cache_max_bytes)
+      break;
+    clear_reverse_cache_entry(reverse_data,oldest);
+  }
+
+  entry->which = which;
+  entry->data = data;
+  entry->data_len = data_len;
+  entry->picture = picture;
+  entry->size = size;
+  entry->last_used = ++reverse_data->cache_clock;
+  reverse_data->cache_bytes += size;
+  return TRUE;
+}
+
+/*
+ * Offer the access unit that has just been remembered (as entry
+ * `last_posn_added`) to the reverse cache, so that if we start reversing
+ * soon, it need not be read back in from the input.
+ *
+ * Does nothing if the cache is not being used.
+ */
+extern void cache_reverse_access_unit(reverse_data_p  reverse_data,
+                                      access_unit_p   access_unit)
+{
+  int       ii;
+  int       which = reverse_data->last_posn_added;
+  uint32_t  length = 0;
+  byte     *data;
+
+  if (reverse_data->cache_max_bytes == 0 || reverse_data->length == 0)
+    return;
+
+  // Check the NAL units we have are exactly the data that was remembered
+  for (ii=0; ii<access_unit->nal_units->length; ii++)
+  {
+    nal_unit_p  nal = access_unit->nal_units->array[ii];
+    if (nal->unit.data == NULL)
+      return;
+    length += nal->unit.data_len;
+  }
+  if (length == 0 || length != (uint32_t)reverse_data->data_len[which] ||
+      length > reverse_data->cache_max_bytes)
+    return;
+
+  if (find_in_reverse_cache(reverse_data,which) != NULL)
+    return;
+
+  data = malloc(length);
+  if (data == NULL)
+    return;     // it's only a cache, after all
+  length = 0;
+  for (ii=0; ii<access_unit->nal_units->length; ii++)
+  {
+    nal_unit_p  nal = access_unit->nal_units->array[ii];
+    memcpy(&data[length],nal->unit.data,nal->unit.data_len);
+    length += nal->unit.data_len;
+  }
+  if (!add_to_reverse_cache(reverse_data,which,data,length,NULL))
+    free(data);
+}
+
+/*
+ * Offer the H.262 picture or sequence header that has just been remembered
+ * (as entry `last_posn_added`) to the reverse cache, so that if we start
+ * reversing soon, it need not be read back in from the input.
+ *
+ * A picture is only kept if it is exactly what reversing would read back
+ * in - that is, if it has its own AFD, or AFDs are already being faked
+ * for pictures that do not.
+ *
+ * Does nothing if the cache is not being used.
+ */
+extern void cache_reverse_h262_picture(reverse_data_p  reverse_data,
+                                       h262_picture_p  picture)
+{
+  int        ii;
+  int        which = reverse_data->last_posn_added;
+  ES_unit_p  first;
+
+  if (reverse_data->cache_max_bytes == 0 || reverse_data->length == 0 ||
+      picture->list->length == 0)
+    return;
+
+  // Check this is the entry that was remembered
+  first = &picture->list->array[0];
+  if (first->start_posn.infile != reverse_data->start_file[which] ||
+      first->start_posn.inpacket != reverse_data->start_pkt[which])
+    return;
+
+  if (find_in_reverse_cache(reverse_data,which) != NULL)
+    return;
+
+  if (picture->is_sequence_header)
+  {
+    // Which is output as its bytes
+    uint32_t  length = 0;
+    byte     *data;
+    for (ii=0; ii<picture->list->length; ii++)
+      length += picture->list->array[ii].data_len;
+    if (length != (uint32_t)reverse_data->data_len[which] ||
+        length > reverse_data->cache_max_bytes)
+      return;
+    data = malloc(length);
+    if (data == NULL)
+      return;
+    length = 0;
+    for (ii=0; ii<picture->list->length; ii++)
+    {
+      ES_unit_p  unit = &picture->list->array[ii];
+      memcpy(&data[length],unit->data,unit->data_len);
+      length += unit->data_len;
+    }
+    if (!add_to_reverse_cache(reverse_data,which,data,length,NULL))
+      free(data);
+  }
+  else if (picture->is_picture)
+  {
+    // When reversing, a picture without an AFD is given a fake one (before
+    // its first slice), and a field pair is read with that for each field
+    h262_picture_p  copy = NULL;
+    if (!reverse_data->h262->add_fake_afd &&
+        (!picture->is_real_afd || picture->was_two_fields))
+      return;
+    if ((uint32_t)reverse_data->data_len[which] >
+        reverse_data->cache_max_bytes)
+      return;
+    if (copy_h262_picture(picture,&copy))
+      return;   // it's only a cache, after all
+    if (!add_to_reverse_cache(reverse_data,which,NULL,0,copy))
+      free_h262_picture(&copy);
+  }
+}
+
+/*
+ * Report on how well the reverse cache has done, if it is being used.
+ */
+extern void report_reverse_cache(reverse_data_p  reverse_data)
+{
+  if (reverse_data->cache_max_bytes == 0)
+    return;
+  fprint_msg("Reverse picture cache: %u entr%s output from memory,"
+             " %u read from file\n",reverse_data->cache_hits,
+             (reverse_data->cache_hits==1?"y":"ies"),
+             reverse_data->cache_misses);
+}
+
 /*
  * Add a reversing context to an H.262 context (and vice versa).
  *
@@ -260,11 +667,17 @@ extern void free_reverse_data(reverse_data_p  *reverse_data)
   if (this == NULL)
     return;
 
+  clear_reverse_cache(this);
   if (this->seq_offset != NULL)
   {
     free(this->seq_offset);
     this->seq_offset = NULL;
   }
+  if (this->afd_byte != NULL)
+  {
+    free(this->afd_byte);
+    this->afd_byte = NULL;
+  }
   free(this->index);
   free(this->start_file);
   free(this->start_pkt);
@@ -413,7 +826,9 @@ extern int remember_reverse_h262_data(reverse_data_p    reverse_data,
   
   if (reverse_data->size == reverse_data->length)
   {
-    int newsize = reverse_data->size + REVERSE_ARRAY_INCREMENT_SIZE;
+    int newsize = reverse_data->size * 2;
+    if (newsize < reverse_data->size + REVERSE_ARRAY_INCREMENT_SIZE)
+      newsize = reverse_data->size + REVERSE_ARRAY_INCREMENT_SIZE;
     reverse_data->index = realloc(reverse_data->index,
                                   newsize*sizeof(uint32_t));
     if (reverse_data->index == NULL)
@@ -539,7 +954,9 @@ extern int remember_reverse_h264_data(reverse_data_p    reverse_data,
   
   if (reverse_data->size == reverse_data->length)
   {
-    int newsize = reverse_data->size + REVERSE_ARRAY_INCREMENT_SIZE;
+    int newsize = reverse_data->size * 2;
+    if (newsize < reverse_data->size + REVERSE_ARRAY_INCREMENT_SIZE)
+      newsize = reverse_data->size + REVERSE_ARRAY_INCREMENT_SIZE;
     reverse_data->index = realloc(reverse_data->index,
                                   newsize*sizeof(uint32_t));
     if (reverse_data->index == NULL)
@@ -912,6 +1329,110 @@ static int read_h262_picture(h262_context_p   context,
   return 0;
 }
 
+/*
+ * Get the data for reverse entry `which` (an H.264 access unit, or an H.262
+ * sequence header) from the cache if it is there, and otherwise by reading
+ * it from the input.
+ *
+ * - `es` is the input elementary stream
+ * - `reverse_data` is the reverse data context
+ * - `which` is the index of the entry in the reverse arrays, and
+ *   `start_posn` and `num_bytes` say where it is in the input
+ * - `buffer` and `buffer_len` are a data array to read into, as for
+ *   read_ES_data(). If the data read is then added to the cache, the cache
+ *   takes over the array, and `buffer` is returned as NULL (and
+ *   `buffer_len` as 0).
+ * - `data` is returned pointing to the entry's data, which belongs either
+ *   to the cache or to `buffer`, and so must not be freed
+ * - `from_cache` is returned as TRUE if the data came from the cache
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int get_reverse_entry_data(ES_p             es,
+                                  reverse_data_p   reverse_data,
+                                  int              which,
+                                  ES_offset        start_posn,
+                                  uint32_t         num_bytes,
+                                  byte           **buffer,
+                                  uint32_t        *buffer_len,
+                                  byte           **data,
+                                  int             *from_cache)
+{
+  int  err;
+  struct reverse_cache_entry *entry = find_in_reverse_cache(reverse_data,
+                                                            which);
+  if (entry != NULL && entry->data != NULL)
+  {
+    reverse_data->cache_hits ++;
+    *data = entry->data;
+    *from_cache = TRUE;
+    return 0;
+  }
+
+  err = read_ES_data(es,start_posn,num_bytes,buffer_len,buffer);
+  if (err) return err;
+
+  if (reverse_data->cache_max_bytes != 0)
+    reverse_data->cache_misses ++;
+  *data = *buffer;
+  *from_cache = FALSE;
+  if (add_to_reverse_cache(reverse_data,which,*buffer,num_bytes,NULL))
+  {
+    *buffer = NULL;
+    if (buffer_len != NULL)
+      *buffer_len = 0;
+  }
+  return 0;
+}
+
+/*
+ * Having output reverse entry `which` from the cache, read it from the
+ * input anyway, so that the input is left just after it (and any H.262
+ * context in the same state), as forwards play expects after reversing.
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int reposition_after_reverse(ES_p            es,
+                                    reverse_data_p  reverse_data,
+                                    int             which,
+                                    int             verbose)
+{
+  int       err;
+  ES_offset start_posn;
+  uint32_t  num_bytes;
+  byte      afd;
+
+  err = get_reverse_data(reverse_data,which,NULL,&start_posn,&num_bytes,
+                         NULL,&afd);
+  if (err) return 1;
+
+  if (verbose)
+    fprint_msg("Repositioning after cached picture [%03d] at "
+               OFFSET_T_FORMAT_08 "/%04d for %5d\n",which,
+               start_posn.infile,start_posn.inpacket,num_bytes);
+
+  if (reverse_data->is_h264)
+  {
+    byte  *data = NULL;
+    err = read_ES_data(es,start_posn,num_bytes,NULL,&data);
+    if (data != NULL) free(data);
+  }
+  else
+  {
+    h262_picture_p  picture = NULL;
+    err = read_h262_picture(reverse_data->h262,start_posn,afd,verbose,
+                            &picture);
+    if (picture != NULL) free_h262_picture(&picture);
+  }
+  if (err)
+  {
+    fprint_err("### Error repositioning after reversing to picture at "
+               OFFSET_T_FORMAT "/%d\n",start_posn.infile,start_posn.inpacket);
+    return 1;
+  }
+  return 0;
+}
+
 /*
  * Output an H.262 sequence header.
  *
@@ -933,6 +1454,8 @@ static int output_sequence_header(ES_p            es,
   ES_offset seq_posn;
   uint32_t  seq_len;
   byte     *seq_data = NULL;
+  byte     *buffer = NULL;
+  int       from_cache;
   err = get_reverse_data(reverse_data,seq_index,NULL,&seq_posn,&seq_len,
                          NULL,NULL);
   if (err)
@@ -947,7 +1470,8 @@ static int output_sequence_header(ES_p            es,
                "/%04d for %5d\n",
                seq_index,seq_posn.infile,seq_posn.inpacket,seq_len);
 
-  err = read_ES_data(es,seq_posn,seq_len,NULL,&seq_data);
+  err = get_reverse_entry_data(es,reverse_data,seq_index,seq_posn,seq_len,
+                               &buffer,NULL,&seq_data,&from_cache);
   if (err)
   {
     fprint_err("### Error reading (sequence header) data"
@@ -957,7 +1481,7 @@ static int output_sequence_header(ES_p            es,
   }
   err = write_packet_data(output,as_TS,seq_data,seq_len,reverse_data->pid,
                           reverse_data->stream_id);
-  free(seq_data);
+  if (buffer != NULL) free(buffer);
   if (err)
   {
     print_err("### Error writing (sequence header) data as"
@@ -1224,7 +1748,9 @@ static int output_in_reverse(ES_p            es,
   int       with_sequence_headers = reverse_data->output_sequence_headers;
   byte     *data = NULL;   // picture data, as a "chunk"
   uint32_t  data_len = 0;  // the current size of `data`
+  byte     *last_data = NULL;  // the last picture's data (maybe cached)
   h262_picture_p  picture = NULL;  // H.262 picture data as a "picture"
+  int       need_reposition = FALSE; // was the last picture from the cache?
   uint32_t  last_seq_index = reverse_data->length; // impossible value
   int       max_pic_index = reverse_data->length-1;
   int       first_actual_picture_index = 0;  // the first *actual* picture
@@ -1235,6 +1761,9 @@ static int output_in_reverse(ES_p            es,
   uint32_t last_index;
 
   uint32_t last_num_bytes = 0;  // Number of bytes of last picture written
+
+  trick_budget_p budget = &reverse_data->budget;
+  uint32_t credit_index;        // Index of the last picture we gave credit for
   
   reverse_data->pictures_written = 0;
   reverse_data->pictures_kept = 0;
@@ -1277,6 +1806,9 @@ static int output_in_reverse(ES_p            es,
   // And the index of the last picture we output
   // - we carefully forge this so that the first (last) picture will be output
   last_index = final_index + frequency;
+  // We always start with a full budget
+  reset_trick_budget(budget);
+  credit_index = final_index;
 
   reverse_data->first_written = start_index;
 
@@ -1308,7 +1840,13 @@ static int output_in_reverse(ES_p            es,
     if (as_TS && tswrite_command_changed(output.ts_output))
     {
       if (data != NULL) free(data);
-      if (picture != NULL) free_h262_picture(&picture);
+      if (picture != NULL) release_h262_picture(reverse_data,&picture);
+      if (need_reposition)
+      {
+        err = reposition_after_reverse(es,reverse_data,
+                                       reverse_data->last_written,verbose);
+        if (err) return 1;
+      }
       return COMMAND_RETURN_CODE;
     }
    
@@ -1339,11 +1877,25 @@ static int output_in_reverse(ES_p            es,
     else if (frequency != 0)
     {
       int  gap = last_index - index;  // gap since last picture output
+
+      // Time has passed (at the output rate) for the pictures we've moved
+      // past since we last looked
+      trick_budget_advance(budget,credit_index - index,frequency);
+      credit_index = index;
+
       if (gap < frequency)
       {
         if (verbose) fprint_msg("++ %d/%d DROP: [%d] %d too soon\n",
                                 gap,frequency,ii,index);
       }
+      else if (!trick_budget_allows(budget,num_bytes))
+      {
+        // Leave `last_index` alone, so that the next picture is a
+        // candidate straight away
+        if (verbose) fprint_msg("++ %d/%d DROP: [%d] %d over budget\n",
+                                gap,frequency,ii,index);
+        budget->dropped ++;
+      }
       else
       {
         // It's not too soon - but do we need to up our output frequency
@@ -1356,7 +1908,7 @@ static int output_in_reverse(ES_p            es,
                      " -> repeat = %d\n",pictures_seen,pictures_wanted,
                      reverse_data->pictures_written,repeat);
         if (repeat > 0 && ((is_h262 && picture != NULL) ||
-                           (!is_h262 && data != NULL)))
+                           (!is_h262 && last_data != NULL)))
         {
           int jj;
           if (verbose)
@@ -1368,18 +1920,24 @@ static int output_in_reverse(ES_p            es,
           }
           for (jj=0; jj<repeat; jj++)
           {
+            if (!trick_budget_allows(budget,last_num_bytes))
+            {
+              if (verbose) print_msg(">> no budget for more repeats\n");
+              break;
+            }
             if (is_h262)
               err = write_picture_data(output,as_TS,picture,reverse_data->pid);
             else
-              err = write_packet_data(output,as_TS,data,last_num_bytes,
+              err = write_packet_data(output,as_TS,last_data,last_num_bytes,
                                       reverse_data->pid,reverse_data->stream_id);
             if (err)
             {
               print_err("### Error writing (picture) data\n");
               if (data != NULL) free(data);
-              if (picture != NULL) free_h262_picture(&picture);
+              if (picture != NULL) release_h262_picture(reverse_data,&picture);
               return 1;
             }
+            trick_budget_spend(budget,last_num_bytes);
             reverse_data->pictures_written ++;
           }
         }
@@ -1389,7 +1947,17 @@ static int output_in_reverse(ES_p            es,
       }
     }
     else
-      keep = TRUE;  // i.e., because frequency == 0
+    {
+      // We're meant to output every picture, so just keep within budget
+      trick_budget_advance(budget,credit_index - index,1);
+      credit_index = index;
+      keep = trick_budget_allows(budget,num_bytes);
+      if (!keep)
+      {
+        if (verbose) fprint_msg("++ DROP: [%d] %d over budget\n",ii,index);
+        budget->dropped ++;
+      }
+    }
 
     // *But* always output the *first* picture, since if we reach it we've
     // "run out" of pictures to present
@@ -1402,6 +1970,9 @@ static int output_in_reverse(ES_p            es,
 
     if (keep)
     {
+      // Let go of the previous picture before we (maybe) add to the cache
+      if (picture != NULL) release_h262_picture(reverse_data,&picture);
+
       if (with_sequence_headers)
       {
         // Make sure we've output its sequence header
@@ -1415,7 +1986,6 @@ static int output_in_reverse(ES_p            es,
             fprint_err("### Error retrieving sequence header"
                        " for picture %d (offset %d)\n",ii,seq_offset);
             if (data != NULL) free(data);
-            if (picture != NULL) free_h262_picture(&picture);
             return 1;
           }
           last_seq_index = seq_index;
@@ -1429,27 +1999,45 @@ static int output_in_reverse(ES_p            es,
 
       if (is_h262)
       {
-        if (picture != NULL) free_h262_picture(&picture);
-        err = read_h262_picture(reverse_data->h262,start_posn,afd,
-                                verbose,&picture);
-        if (err)
+        struct reverse_cache_entry *entry = find_in_reverse_cache(reverse_data,
+                                                                  ii);
+        if (entry != NULL && entry->picture != NULL)
         {
-          fprint_err("### Error reading H.262 picture from "
-                     OFFSET_T_FORMAT "/%d for %d\n",
-                     start_posn.infile,start_posn.inpacket,num_bytes);
-          return 1;
+          if (verbose) print_msg(".. from the cache\n");
+          reverse_data->cache_hits ++;
+          picture = entry->picture;
+          need_reposition = TRUE;
+        }
+        else
+        {
+          err = read_h262_picture(reverse_data->h262,start_posn,afd,
+                                  verbose,&picture);
+          if (err)
+          {
+            fprint_err("### Error reading H.262 picture from "
+                       OFFSET_T_FORMAT "/%d for %d\n",
+                       start_posn.infile,start_posn.inpacket,num_bytes);
+            return 1;
+          }
+          if (reverse_data->cache_max_bytes != 0)
+            reverse_data->cache_misses ++;
+          (void) add_to_reverse_cache(reverse_data,ii,NULL,0,picture);
+          need_reposition = FALSE;
         }
         err = write_picture_data(output,as_TS,picture,reverse_data->pid);
         if (err)
         {
           print_err("### Error writing picture\n");
-          free_h262_picture(&picture);
+          release_h262_picture(reverse_data,&picture);
           return 1;
         }
+        last_num_bytes = num_bytes;
       }
       else
       {
-        err = read_ES_data(es,start_posn,num_bytes,&data_len,&data);
+        err = get_reverse_entry_data(es,reverse_data,ii,start_posn,num_bytes,
+                                     &data,&data_len,&last_data,
+                                     &need_reposition);
         if (err)
         {
           fprint_err("### Error reading data from " OFFSET_T_FORMAT
@@ -1458,8 +2046,9 @@ static int output_in_reverse(ES_p            es,
           if (data != NULL) free(data);
           return 1;
         }
-        err = write_packet_data(output,as_TS,data,num_bytes,reverse_data->pid,
-                                reverse_data->stream_id);
+        if (verbose && need_reposition) print_msg(".. from the cache\n");
+        err = write_packet_data(output,as_TS,last_data,num_bytes,
+                                reverse_data->pid,reverse_data->stream_id);
         if (err)
         {
           print_err("### Error writing picture\n");
@@ -1469,6 +2058,7 @@ static int output_in_reverse(ES_p            es,
         last_num_bytes = num_bytes;
       }
 
+      trick_budget_spend(budget,num_bytes);
       reverse_data->last_written = ii;
       reverse_data->pictures_written ++;
       reverse_data->pictures_kept ++;
@@ -1499,7 +2089,14 @@ static int output_in_reverse(ES_p            es,
     }
   }
   if (data != NULL) free(data);
-  if (picture != NULL) free_h262_picture(&picture);
+  if (picture != NULL) release_h262_picture(reverse_data,&picture);
+
+  if (need_reposition)
+  {
+    int err = reposition_after_reverse(es,reverse_data,
+                                       reverse_data->last_written,verbose);
+    if (err) return 1;
+  }
 
   if (verbose)
     print_msg("END OF REVERSE\n");
@@ -38,6 +38,56 @@ typedef struct reverse_data *reverse_data_p;
 #include "h262_defns.h"
 #include "accessunit_defns.h"
 
+// ------------------------------------------------------------
+// Trick play (fast forwards and reverse) normally chooses pictures at a
+// fixed frequency, regardless of their size. If a target output bitrate
+// is given, a "budget" is also kept, and pictures are only output if
+// there is room for them in it. This stops large I pictures at high
+// speeds from being output faster than the client's link can take them.
+//
+// The budget is a "leaky bucket" of bits. It is filled by `bitrate` /
+// `picture_rate` bits for each picture "slot" of output (where each slot
+// corresponds to the pictures, at the current speed, that one output
+// picture stands for), up to TRICK_BUDGET_BURST_MS worth of bits, and
+// emptied by the size of each picture actually output.
+struct trick_budget
+{
+  uint32_t  bitrate;       // Target output bitrate in bits/second, 0 if none
+  int       picture_rate;  // Target output pictures/second
+  int64_t   credit;        // Bits we may output now (may go negative)
+  int64_t   max_credit;    // The most credit we allow to build up
+  int64_t   remainder;     // Part-bits of credit not yet added
+  int       dropped;       // Pictures not output for lack of bandwidth
+};
+typedef struct trick_budget *trick_budget_p;
+
+#define TRICK_BUDGET_BURST_MS     500
+#define DEFAULT_TRICK_PICTURE_RATE 25
+
+// ------------------------------------------------------------
+// Changing direction (or skipping back a little way) means outputting
+// pictures that we have only just output (or read) - normally by seeking
+// back in the input file and reading them all over again. To avoid that,
+// a small cache keeps the data for the reverse entries used most recently.
+//
+// An entry holds either the bytes of the entry (for H.264 access units and
+// H.262 sequence headers), or, for H.262 pictures, the picture itself (as
+// read for reversing, so including any fake AFD).
+struct reverse_cache_entry
+{
+  int             which;     // The entry's index in the reverse arrays,
+                             // or -1 if this cache entry is unused
+  byte           *data;      // Its data, or NULL
+  uint32_t        data_len;
+  h262_picture_p  picture;   // Or the H.262 picture, or NULL
+  uint32_t        size;      // Number of bytes we count this as using
+  uint32_t        last_used; // When it was last used, for choosing which
+                             // entry to replace
+};
+
+#define REVERSE_CACHE_MAX_ENTRIES   32
+#define DEFAULT_REVERSE_CACHE_KB    4096
+
 // ------------------------------------------------------------
 // As the software progresses through the data stream forwards, it remembers
 // the location, size and details for frames that it might want to output in
@@ -118,11 +168,23 @@ struct reverse_data
   // reversing, it is important to reset the picture index in the H.262
   // or access_unit context to the picture index of the last written
   // picture. This must be done by the caller.
+
+  // If trick play is to be kept within a target bitrate
+  struct trick_budget  budget;
+
+  // The cache of recently used entries. If `cache_max_bytes` is 0, then
+  // the cache is not used.
+  struct reverse_cache_entry  cache[REVERSE_CACHE_MAX_ENTRIES];
+  uint32_t   cache_max_bytes;  // The most data the cache may hold
+  uint32_t   cache_bytes;      // How much it holds at the moment
+  uint32_t   cache_clock;      // Incremented on each use of the cache
+  uint32_t   cache_hits;       // Entries output from the cache
+  uint32_t   cache_misses;     // Entries that had to be read from file
 };
 #define SIZEOF_REVERSE_DATA sizeof(struct reverse_data)
 
 #define REVERSE_ARRAY_START_SIZE  1000
-#define REVERSE_ARRAY_INCREMENT_SIZE  500
+#define REVERSE_ARRAY_INCREMENT_SIZE  500  // at least - the arrays double in size
 
 #endif // _reverse_defns
 
@@ -50,6 +50,52 @@
  */
 extern int build_reverse_data(reverse_data_p *reverse_data,
                               int             is_h264);
+/*
+ * Set (or clear) the target bitrate for trick play output.
+ *
+ * - `budget` is the trick play budget to set
+ * - `bitrate` is the target output bitrate, in bits/second, or 0 if
+ *   pictures are to be chosen only by frequency
+ * - `picture_rate` is the number of pictures per second that the output
+ *   is displayed at (if 0, DEFAULT_TRICK_PICTURE_RATE is used)
+ *
+ * The budget starts full.
+ */
+extern void set_trick_budget(trick_budget_p  budget,
+                             uint32_t        bitrate,
+                             int             picture_rate);
+/*
+ * Refill a trick play budget, ready to start outputting trick play again.
+ */
+extern void reset_trick_budget(trick_budget_p  budget);
+/*
+ * Add the credit for `pictures` more pictures, at a speed of `freq`
+ * pictures per output picture.
+ */
+extern void trick_budget_advance(trick_budget_p  budget,
+                                 int             pictures,
+                                 int             freq);
+/*
+ * Is there room in the budget for a picture of `num_bytes` bytes?
+ *
+ * This is always TRUE if no target bitrate is set. A picture bigger than
+ * the largest credit allowed is let through when the budget is full.
+ */
+extern int trick_budget_allows(trick_budget_p  budget,
+                               uint32_t        num_bytes);
+/*
+ * Take `num_bytes` bytes of output from the budget.
+ */
+extern void trick_budget_spend(trick_budget_p  budget,
+                               uint32_t        num_bytes);
+/*
+ * Set the target bitrate for trick play output of reversed data.
+ *
+ * See set_trick_budget() for details.
+ */
+extern void set_reverse_bitrate(reverse_data_p  reverse_data,
+                                uint32_t        bitrate,
+                                int             picture_rate);
 /*
  * Set the video PID and stream id for TS output.
  *
@@ -60,6 +106,47 @@ extern int build_reverse_data(reverse_data_p *reverse_data,
 extern void set_reverse_pid(reverse_data_p  reverse_data,
                             uint32_t        pid,
                             byte            stream_id);
+/*
+ * Set how much data the cache of recently used reverse entries may hold.
+ *
+ * With the cache, changing direction (or skipping back a little way) can
+ * output the pictures we have just output, or just read forwards, from
+ * memory, rather than by seeking back and reading them from the input.
+ *
+ * - `reverse_data` is the reverse data context
+ * - `max_bytes` is the most data the cache may hold, or 0 if the cache
+ *   is not to be used (the default).
+ *
+ * Anything already in the cache is discarded.
+ */
+extern void set_reverse_cache_size(reverse_data_p  reverse_data,
+                                   uint32_t        max_bytes);
+/*
+ * Offer the access unit that has just been remembered to the reverse cache,
+ * so that if we start reversing soon, it need not be read back in from the
+ * input.
+ *
+ * Does nothing if the cache is not being used.
+ */
+extern void cache_reverse_access_unit(reverse_data_p  reverse_data,
+                                      access_unit_p   access_unit);
+/*
+ * Offer the H.262 picture or sequence header that has just been remembered
+ * (as entry `last_posn_added`) to the reverse cache, so that if we start
+ * reversing soon, it need not be read back in from the input.
+ *
+ * A picture is only kept if it is exactly what reversing would read back
+ * in - that is, if it has its own AFD, or AFDs are already being faked
+ * for pictures that do not.
+ *
+ * Does nothing if the cache is not being used.
+ */
+extern void cache_reverse_h262_picture(reverse_data_p  reverse_data,
+                                       h262_picture_p  picture);
+/*
+ * Report on how well the reverse cache has done, if it is being used.
+ */
+extern void report_reverse_cache(reverse_data_p  reverse_data);
 /*
  * Add a reversing context to an H.262 context (and vice versa).
  *
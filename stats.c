@@ -0,0 +1,421 @@
+/*
+ * Streaming statistics - sliding window minimum and maximum, windowed
+ * rates, moving averages and quantile sketches
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "compat.h"
+#include "printing_fns.h"
+#include "stats_fns.h"
+
+/*
+ * How much older is time `then` than time `now`?
+ */
+static inline uint64_t stats_age(uint64_t  wrap,
+                                 uint64_t  now,
+                                 uint64_t  then)
+{
+  if (wrap == 0)
+    return now - then;
+  else
+    return now > then ? now - then : wrap - (then - now);
+}
+
+// ------------------------------------------------------------
+// Sliding window minimum/maximum
+// ------------------------------------------------------------
+/*
+ * Build a new sliding window minimum/maximum.
+ *
+ * - `capacity` is the most samples the window may hold
+ * - `range` is how much older than the newest sample the oldest may be
+ * - `wrap` is the value at which times wrap around, or 0
+ * - `window` is the new window
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_stats_window(int              capacity,
+                              uint64_t         range,
+                              uint64_t         wrap,
+                              stats_window_p  *window)
+{
+  stats_window_p  new = malloc(SIZEOF_STATS_WINDOW);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate sliding window datastructure\n");
+    return 1;
+  }
+  new->capacity = capacity;
+  new->range = range;
+  new->wrap = wrap;
+  new->times = malloc(capacity * sizeof(uint64_t));
+  new->values = malloc(capacity * sizeof(int64_t));
+  new->min_q = malloc(capacity * sizeof(int));
+  new->max_q = malloc(capacity * sizeof(int));
+  if (new->times == NULL || new->values == NULL ||
+      new->min_q == NULL || new->max_q == NULL)
+  {
+    print_err("### Unable to allocate sliding window buffers\n");
+    free_stats_window(&new);
+    return 1;
+  }
+  clear_stats_window(new);
+  *window = new;
+  return 0;
+}
+
+/*
+ * Free a sliding window.
+ *
+ * Sets `window` to NULL.
+ */
+extern void free_stats_window(stats_window_p  *window)
+{
+  if (*window == NULL)
+    return;
+  free((*window)->times);
+  free((*window)->values);
+  free((*window)->min_q);
+  free((*window)->max_q);
+  free(*window);
+  *window = NULL;
+}
+
+/*
+ * Forget all the samples in a sliding window.
+ */
+extern void clear_stats_window(stats_window_p  window)
+{
+  window->head = 0;
+  window->count = 0;
+  window->min_head = 0;
+  window->min_count = 0;
+  window->max_head = 0;
+  window->max_count = 0;
+}
+
+/*
+ * Add a sample to a sliding window, first discarding any samples that
+ * are now too old (or that there is no more room for).
+ */
+extern void stats_window_add(stats_window_p  window,
+                             uint64_t        time,
+                             int64_t         value)
+{
+  int  capacity = window->capacity;
+  int  posn;
+
+  // Expire from the front
+  while (window->count > 0 &&
+         (window->count >= capacity ||
+          stats_age(window->wrap,time,window->times[window->head]) >
+          window->range))
+  {
+    if (window->min_count > 0 && window->min_q[window->min_head] == window->head)
+    {
+      window->min_head = (window->min_head + 1) % capacity;
+      window->min_count --;
+    }
+    if (window->max_count > 0 && window->max_q[window->max_head] == window->head)
+    {
+      window->max_head = (window->max_head + 1) % capacity;
+      window->max_count --;
+    }
+    window->head = (window->head + 1) % capacity;
+    window->count --;
+  }
+
+  // Add to the back
+  posn = (window->head + window->count) % capacity;
+  window->times[posn] = time;
+  window->values[posn] = value;
+  window->count ++;
+
+  // Anything at the back of the deques that this sample beats can never
+  // be the minimum (maximum) again
+  while (window->min_count > 0 &&
+         window->values[window->min_q[(window->min_head + window->min_count - 1)
+                                      % capacity]] >= value)
+    window->min_count --;
+  window->min_q[(window->min_head + window->min_count) % capacity] = posn;
+  window->min_count ++;
+
+  while (window->max_count > 0 &&
+         window->values[window->max_q[(window->max_head + window->max_count - 1)
+                                      % capacity]] <= value)
+    window->max_count --;
+  window->max_q[(window->max_head + window->max_count) % capacity] = posn;
+  window->max_count ++;
+}
+
+/*
+ * Return the minimum value in a sliding window, or 0 if it is empty.
+ */
+extern int64_t stats_window_min(stats_window_p  window)
+{
+  if (window->min_count == 0)
+    return 0;
+  return window->values[window->min_q[window->min_head]];
+}
+
+/*
+ * Return the maximum value in a sliding window, or 0 if it is empty.
+ */
+extern int64_t stats_window_max(stats_window_p  window)
+{
+  if (window->max_count == 0)
+    return 0;
+  return window->values[window->max_q[window->max_head]];
+}
+
+// ------------------------------------------------------------
+// Windowed rate
+// ------------------------------------------------------------
+/*
+ * Build a new windowed rate.
+ *
+ * - `window` is the period over which to measure the rate
+ * - `wrap` is the value at which times wrap around, or 0
+ * - `ticks_per_second` is the number of time units in a second
+ * - `rate` is the new rate
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_stats_rate(uint64_t       window,
+                            uint64_t       wrap,
+                            uint64_t       ticks_per_second,
+                            stats_rate_p  *rate)
+{
+  stats_rate_p  new = malloc(SIZEOF_STATS_RATE);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate windowed rate datastructure\n");
+    return 1;
+  }
+  new->samples = malloc(STATS_RATE_START_SIZE *
+                        sizeof(struct stats_rate_sample));
+  if (new->samples == NULL)
+  {
+    print_err("### Unable to allocate windowed rate buffer\n");
+    free(new);
+    return 1;
+  }
+  new->size = STATS_RATE_START_SIZE;
+  new->head = 0;
+  new->count = 0;
+  new->window = window;
+  new->wrap = wrap;
+  new->ticks_per_second = ticks_per_second;
+  new->rate = 0;
+  new->max_rate = 0;
+  *rate = new;
+  return 0;
+}
+
+/*
+ * Free a windowed rate.
+ *
+ * Sets `rate` to NULL.
+ */
+extern void free_stats_rate(stats_rate_p  *rate)
+{
+  if (*rate == NULL)
+    return;
+  free((*rate)->samples);
+  free(*rate);
+  *rate = NULL;
+}
+
+/*
+ * Add a sample to a windowed rate.
+ *
+ * - `time` is the time of the sample
+ * - `total` is the running total (e.g., of bytes) at that time
+ *
+ * The rate (in eight times the units of `total` per second, so bits per
+ * second if counting bytes) is then in `rate->rate`, and the largest seen
+ * so far in `rate->max_rate`.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int stats_rate_add(stats_rate_p  rate,
+                          uint64_t      time,
+                          uint64_t      total)
+{
+  struct stats_rate_sample *oldest;
+  uint64_t  delta_t;
+
+  while (rate->count > 0 &&
+         stats_age(rate->wrap,time,rate->samples[rate->head].time) >
+         rate->window)
+  {
+    rate->head = (rate->head + 1) % rate->size;
+    rate->count --;
+  }
+
+  if (rate->count == rate->size)
+  {
+    int  ii;
+    int  new_size = rate->size * 2;
+    struct stats_rate_sample *new = malloc(new_size *
+                                           sizeof(struct stats_rate_sample));
+    if (new == NULL)
+    {
+      print_err("### Unable to extend windowed rate buffer\n");
+      return 1;
+    }
+    for (ii = 0; ii < rate->count; ii++)
+      new[ii] = rate->samples[(rate->head + ii) % rate->size];
+    free(rate->samples);
+    rate->samples = new;
+    rate->size = new_size;
+    rate->head = 0;
+  }
+  rate->samples[(rate->head + rate->count) % rate->size].time = time;
+  rate->samples[(rate->head + rate->count) % rate->size].total = total;
+  rate->count ++;
+
+  oldest = &rate->samples[rate->head];
+  delta_t = stats_age(rate->wrap,time,oldest->time);
+  if (delta_t != 0)
+  {
+    rate->rate = ((total - oldest->total) * 8 * rate->ticks_per_second) /
+      delta_t;
+    if (rate->rate > rate->max_rate)
+      rate->max_rate = rate->rate;
+  }
+  return 0;
+}
+
+// ------------------------------------------------------------
+// Exponentially weighted moving average
+// ------------------------------------------------------------
+/*
+ * Start a moving average, giving weight `alpha` (0..1) to each new sample.
+ */
+extern void init_stats_ewma(stats_ewma_p  ewma,
+                            double        alpha)
+{
+  ewma->alpha = alpha;
+  ewma->value = 0;
+  ewma->primed = FALSE;
+}
+
+/*
+ * Add a sample to a moving average, and return the new average.
+ */
+extern double stats_ewma_add(stats_ewma_p  ewma,
+                             double        value)
+{
+  if (ewma->primed)
+    ewma->value += ewma->alpha * (value - ewma->value);
+  else
+  {
+    ewma->value = value;
+    ewma->primed = TRUE;
+  }
+  return ewma->value;
+}
+
+// ------------------------------------------------------------
+// Quantile sketch
+// ------------------------------------------------------------
+/*
+ * Add a (non-negative) value to a quantile sketch.
+ */
+extern void stats_sketch_add(stats_sketch_p  sketch,
+                             uint64_t        value)
+{
+  sketch->count ++;
+  if (value == 0)
+    sketch->zeros ++;
+  else
+  {
+    // Bucket `ii` holds the values in (gamma^(ii-1), gamma^ii]
+    int  ii = (int)ceil(log((double)value) / log(STATS_SKETCH_GAMMA));
+    if (ii < 0)
+      ii = 0;
+    else if (ii >= STATS_SKETCH_BUCKETS)
+      ii = STATS_SKETCH_BUCKETS - 1;
+    sketch->buckets[ii] ++;
+  }
+}
+
+/*
+ * Merge the values from sketch `other` into `sketch`.
+ */
+extern void stats_sketch_merge(stats_sketch_p              sketch,
+                               const struct stats_sketch  *other)
+{
+  int  ii;
+  sketch->count += other->count;
+  sketch->zeros += other->zeros;
+  for (ii = 0; ii < STATS_SKETCH_BUCKETS; ii++)
+    sketch->buckets[ii] += other->buckets[ii];
+}
+
+/*
+ * Return (an estimate of) the `q` quantile (0..1) of the values in a
+ * sketch, or 0 if it is empty.
+ */
+extern uint64_t stats_sketch_quantile(const struct stats_sketch  *sketch,
+                                      double                      q)
+{
+  int       ii;
+  uint32_t  rank;
+  if (sketch->count == 0)
+    return 0;
+  if (q < 0) q = 0;
+  if (q > 1) q = 1;
+  rank = (uint32_t)(q * (sketch->count - 1));
+  if (rank < sketch->zeros)
+    return 0;
+  rank -= sketch->zeros;
+  for (ii = 0; ii < STATS_SKETCH_BUCKETS; ii++)
+  {
+    if (rank < sketch->buckets[ii])
+      break;
+    rank -= sketch->buckets[ii];
+  }
+  if (ii == STATS_SKETCH_BUCKETS)
+    ii = STATS_SKETCH_BUCKETS - 1;
+  // The middle of the bucket, which is within 1% of anything in it
+  return (uint64_t)(2 * pow(STATS_SKETCH_GAMMA,ii) /
+                    (STATS_SKETCH_GAMMA + 1) + 0.5);
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
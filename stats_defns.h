@@ -0,0 +1,139 @@
+/*
+ * Datastructures for streaming statistics - sliding window minimum and
+ * maximum, windowed rates, moving averages and quantile sketches
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _stats_defns
+#define _stats_defns
+
+#include "compat.h"
+
+// All of these are designed to be updated once per sample in (amortised)
+// constant time, however many samples they cover.
+//
+// Times are unsigned 64 bit values in whatever units the caller likes. If
+// `wrap` is non-zero, times are taken to wrap around at that value (so for
+// a 27MHz PCR, it would be PCR_UNSIGNED_WRAP), and the age of a sample is
+// calculated as for pcr_unsigned_diff() - in particular, note that two
+// samples with the same time are then taken to be `wrap` apart.
+
+// ------------------------------------------------------------
+// The minimum and maximum of the values in a sliding window. The window
+// holds the samples no more than `range` older than the newest, and at
+// most `capacity` samples.
+//
+// Alongside the samples themselves, we keep two "monotonic deques" of the
+// positions of the samples that might yet be the minimum (or maximum) -
+// each new sample removes any samples from the back of the deque that it
+// beats, so the front of each deque is always the current answer.
+struct stats_window
+{
+  int        capacity;
+  uint64_t   range;
+  uint64_t   wrap;
+
+  // The samples, in a circular buffer of `capacity` entries
+  uint64_t  *times;
+  int64_t   *values;
+  int        head;        // the oldest sample
+  int        count;       // how many samples there are
+
+  // The deques, as circular buffers of sample positions
+  int       *min_q;
+  int        min_head;
+  int        min_count;
+  int       *max_q;
+  int        max_head;
+  int        max_count;
+};
+typedef struct stats_window *stats_window_p;
+#define SIZEOF_STATS_WINDOW sizeof(struct stats_window)
+
+// ------------------------------------------------------------
+// The rate of change of a running total (for instance, bytes read) over
+// a sliding window of time, and the maximum such rate seen.
+struct stats_rate_sample
+{
+  uint64_t  time;
+  uint64_t  total;
+};
+
+struct stats_rate
+{
+  uint64_t   window;            // the period to measure over
+  uint64_t   wrap;
+  uint64_t   ticks_per_second;  // for converting to (bits) per second
+
+  struct stats_rate_sample *samples;  // circular buffer, grown as needed
+  int        size;
+  int        head;
+  int        count;
+
+  uint64_t   rate;              // the latest rate
+  uint64_t   max_rate;          // and the largest
+};
+typedef struct stats_rate *stats_rate_p;
+#define SIZEOF_STATS_RATE sizeof(struct stats_rate)
+
+#define STATS_RATE_START_SIZE  1024
+
+// ------------------------------------------------------------
+// An exponentially weighted moving average
+struct stats_ewma
+{
+  double  alpha;       // the weight given to each new sample (0..1)
+  double  value;
+  int     primed;      // have we had a sample yet?
+};
+typedef struct stats_ewma *stats_ewma_p;
+
+// ------------------------------------------------------------
+// A quantile sketch for non-negative values. Each value goes into a
+// bucket by its logarithm, so any quantile is found to within about 1% of
+// its true value, using fixed space. Two sketches can be merged by adding
+// their buckets together. A sketch that is all zero is empty, so a sketch
+// inside a calloc'ed datastructure needs no further setting up.
+#define STATS_SKETCH_GAMMA    1.02
+#define STATS_SKETCH_BUCKETS  1024
+
+struct stats_sketch
+{
+  uint32_t  count;
+  uint32_t  zeros;
+  uint32_t  buckets[STATS_SKETCH_BUCKETS];
+};
+typedef struct stats_sketch *stats_sketch_p;
+
+#endif // _stats_defns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,145 @@
+/*
+ * Functions for streaming statistics - sliding window minimum and
+ * maximum, windowed rates, moving averages and quantile sketches
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _stats_fns
+#define _stats_fns
+
+#include "stats_defns.h"
+
+/*
+ * Build a new sliding window minimum/maximum.
+ *
+ * - `capacity` is the most samples the window may hold
+ * - `range` is how much older than the newest sample the oldest may be
+ * - `wrap` is the value at which times wrap around, or 0
+ * - `window` is the new window
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_stats_window(int              capacity,
+                              uint64_t         range,
+                              uint64_t         wrap,
+                              stats_window_p  *window);
+/*
+ * Free a sliding window.
+ *
+ * Sets `window` to NULL.
+ */
+extern void free_stats_window(stats_window_p  *window);
+/*
+ * Forget all the samples in a sliding window.
+ */
+extern void clear_stats_window(stats_window_p  window);
+/*
+ * Add a sample to a sliding window, first discarding any samples that
+ * are now too old (or that there is no more room for).
+ */
+extern void stats_window_add(stats_window_p  window,
+                             uint64_t        time,
+                             int64_t         value);
+/*
+ * Return the minimum (maximum) value in a sliding window, or 0 if
+ * it is empty.
+ */
+extern int64_t stats_window_min(stats_window_p  window);
+extern int64_t stats_window_max(stats_window_p  window);
+
+/*
+ * Build a new windowed rate.
+ *
+ * - `window` is the period over which to measure the rate
+ * - `wrap` is the value at which times wrap around, or 0
+ * - `ticks_per_second` is the number of time units in a second
+ * - `rate` is the new rate
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_stats_rate(uint64_t       window,
+                            uint64_t       wrap,
+                            uint64_t       ticks_per_second,
+                            stats_rate_p  *rate);
+/*
+ * Free a windowed rate.
+ *
+ * Sets `rate` to NULL.
+ */
+extern void free_stats_rate(stats_rate_p  *rate);
+/*
+ * Add a sample to a windowed rate.
+ *
+ * - `time` is the time of the sample
+ * - `total` is the running total (e.g., of bytes) at that time
+ *
+ * The rate (in eight times the units of `total` per second, so bits per
+ * second if counting bytes) is then in `rate->rate`, and the largest seen
+ * so far in `rate->max_rate`.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int stats_rate_add(stats_rate_p  rate,
+                          uint64_t      time,
+                          uint64_t      total);
+
+/*
+ * Start a moving average, giving weight `alpha` (0..1) to each new sample.
+ */
+extern void init_stats_ewma(stats_ewma_p  ewma,
+                            double        alpha);
+/*
+ * Add a sample to a moving average, and return the new average.
+ */
+extern double stats_ewma_add(stats_ewma_p  ewma,
+                             double        value);
+
+/*
+ * Add a (non-negative) value to a quantile sketch.
+ */
+extern void stats_sketch_add(stats_sketch_p  sketch,
+                             uint64_t        value);
+/*
+ * Merge the values from sketch `other` into `sketch`.
+ */
+extern void stats_sketch_merge(stats_sketch_p              sketch,
+                               const struct stats_sketch  *other);
+/*
+ * Return (an estimate of) the `q` quantile (0..1) of the values in a
+ * sketch, or 0 if it is empty.
+ */
+extern uint64_t stats_sketch_quantile(const struct stats_sketch  *sketch,
+                                      double                      q);
+
+#endif // _stats_fns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
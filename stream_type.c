@@ -47,6 +47,7 @@
 #include "h262_fns.h"
 #include "misc_fns.h"
 #include "printing_fns.h"
+#include "probecache_fns.h"
 #include "version.h"
 
 #define STREAM_IS_TS     10
@@ -382,6 +383,12 @@ static void print_usage()
     "  -verbose, -v      Output more detailed information about how it is\n"
     "                    making its decision\n"
     "  -quiet, -q        Only output error messages\n"
+    "  -cache            Remember the decision in a cache file alongside\n"
+    "                    <infile> (named <infile>" PROBE_CACHE_SUFFIX "), and use it\n"
+    "                    instead of reading <infile> if asked again and\n"
+    "                    <infile> has not changed since. The cache is shared\n"
+    "                    with tsinfo.\n"
+    "  -cachefile <file> As -cache, but use the given cache file.\n"
     );
 }
 
@@ -396,6 +403,9 @@ int main(int argc, char **argv)
   int     ii = 1;
   int     decided = FALSE;
   int     result = STREAM_IS_ERROR;
+  int     use_cache = FALSE;
+  char   *cache_name = NULL;
+  probe_cache_p  cache = NULL;
   
   if (argc < 2)
   {
@@ -439,6 +449,17 @@ int main(int argc, char **argv)
         verbose = FALSE;
         quiet = TRUE;
       }
+      else if (!strcmp("-cache",argv[ii]))
+      {
+        use_cache = TRUE;
+      }
+      else if (!strcmp("-cachefile",argv[ii]))
+      {
+        CHECKARG("stream_type",ii);
+        use_cache = TRUE;
+        cache_name = argv[ii+1];
+        ii++;
+      }
       else
       {
         fprint_err("### stream_type: "
@@ -468,24 +489,58 @@ int main(int argc, char **argv)
     return STREAM_IS_ERROR;
   }
   
-  input = open_binary_file(input_name,FALSE);
-  if (input == -1)
+  if (use_cache)
   {
-    fprint_err("### stream_type: Unable to open input file %s\n",
-               input_name);
-    return 1;
+    err = build_probe_cache(input_name,cache_name,&cache);
+    if (err)
+    {
+      fprint_err("### stream_type: Unable to use a probe cache for %s\n",
+                 input_name);
+      return STREAM_IS_ERROR;
+    }
   }
 
-  if (!quiet)
-    fprint_msg("Reading from %s\n",input_name);
-  
-  // Try to guess
-  err = determine_packet_type(input,verbose,&decided,&result);
-  if (err)
+  if (cache != NULL && cache->have_type)
   {
-    print_err("### Unable to decide on stream type due to error\n");
-    return STREAM_IS_ERROR;
+    if (!quiet)
+    {
+      fprint_msg("Reading from %s\n",input_name);
+      fprint_msg("Using cached decision from %s\n",cache->filename);
+    }
+    result = cache->type;
+    decided = cache->decided;
+  }
+  else
+  {
+    input = open_binary_file(input_name,FALSE);
+    if (input == -1)
+    {
+      fprint_err("### stream_type: Unable to open input file %s\n",
+                 input_name);
+      free_probe_cache(&cache);
+      return 1;
+    }
+
+    if (!quiet)
+      fprint_msg("Reading from %s\n",input_name);
+  
+    // Try to guess
+    err = determine_packet_type(input,verbose,&decided,&result);
+    if (err)
+    {
+      print_err("### Unable to decide on stream type due to error\n");
+      free_probe_cache(&cache);
+      return STREAM_IS_ERROR;
+    }
+
+    if (cache != NULL)
+    {
+      probe_cache_set_type(cache,result,decided);
+      if (write_probe_cache(cache))
+        print_err("!!! stream_type: Unable to update probe cache\n");
+    }
   }
+  free_probe_cache(&cache);
 
   if (!quiet)
   {
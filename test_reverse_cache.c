@@ -0,0 +1,284 @@
+/*
+ * Tests that reversing H.262 data gives the same output whether or not
+ * recently used pictures are cached
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compat.h"
+#include "es_fns.h"
+#include "h262_fns.h"
+#include "reverse_fns.h"
+#include "printing_fns.h"
+
+#define ES_FILENAME        "test_reverse_cache.es"
+#define NOCACHE_FILENAME   "test_reverse_cache_0.es"
+#define CACHE_FILENAME     "test_reverse_cache_1.es"
+
+#define NUM_PICTURES     200    // in the test data
+#define GOP_LENGTH       6      // an I picture every this many pictures
+#define SEQ_HDR_EVERY    4      // and a sequence header every this many GOPs
+
+/*
+ * Write an H.262 ES file. Some of its I pictures have an AFD, and some
+ * do not, and the pictures are of different sizes.
+ */
+static int write_h262_data(void)
+{
+  static byte  seq_hdr[] = {0x00, 0x00, 0x01, 0xB3, 0x16, 0x00, 0xF0, 0x13,
+                            0xFF, 0xFF, 0xE0, 0x18};
+  static byte  afd[] = {0x00, 0x00, 0x01, 0xB2, 0x44, 0x54, 0x47, 0x31,
+                        0x41, 0xF9};
+  static byte  seq_end[] = {0x00, 0x00, 0x01, 0xB7};
+  int   ii, jj;
+  FILE *file = fopen(ES_FILENAME,"wb");
+  if (file == NULL)
+  {
+    printf("Test failed - unable to open %s\n",ES_FILENAME);
+    return 1;
+  }
+  for (ii = 0; ii < NUM_PICTURES; ii++)
+  {
+    int   is_I = (ii % GOP_LENGTH == 0);
+    int   tr = ii % GOP_LENGTH;
+    byte  picture[] = {0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0xFF, 0xF8};
+    byte  slice[] = {0x00, 0x00, 0x01, 0x01};
+    int   slice_len = 100 + (ii * 37) % 400;
+
+    if (ii % (GOP_LENGTH * SEQ_HDR_EVERY) == 0)
+      fwrite(seq_hdr,1,sizeof(seq_hdr),file);
+
+    picture[4] = (byte)(tr >> 2);
+    picture[5] = (byte)(((tr & 3) << 6) | ((is_I ? 1 : 2) << 3));
+    fwrite(picture,1,sizeof(picture),file);
+    if (is_I && (ii / GOP_LENGTH) % 3 != 1)
+    {
+      afd[9] = (byte)(0xF8 | (ii / GOP_LENGTH) % 8);
+      fwrite(afd,1,sizeof(afd),file);
+    }
+    for (jj = 0; jj < 2; jj++)
+    {
+      int  kk;
+      slice[3] = (byte)(jj + 1);
+      fwrite(slice,1,sizeof(slice),file);
+      // Slice data that cannot look like a start code
+      for (kk = 0; kk < slice_len; kk++)
+        fputc(0x10 + (ii + jj + kk) % 0xE0,file);
+    }
+  }
+  fwrite(seq_end,1,sizeof(seq_end),file);
+  fclose(file);
+  return 0;
+}
+
+/*
+ * Play forwards, reverse, play forwards again and reverse again, writing
+ * all the pictures output to `output_name`.
+ *
+ * - `cache_bytes` is how big the reverse cache is, 0 for none
+ * - `first_hits` is returned as how many entries came from the cache when
+ *   first reversing, which can only be those cached during forward play
+ * - `cache_hits` is returned as how many entries came from the cache
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int play_and_reverse(uint32_t   cache_bytes,
+                            char      *output_name,
+                            uint32_t  *first_hits,
+                            uint32_t  *cache_hits)
+{
+  int  err, ii;
+  ES_p            es;
+  h262_context_p  h262;
+  reverse_data_p  reverse_data;
+  FILE           *output;
+
+  err = open_elementary_stream(ES_FILENAME,&es);
+  if (err)
+  {
+    printf("Test failed - unable to open %s\n",ES_FILENAME);
+    return 1;
+  }
+  err = build_h262_context(es,&h262);
+  if (err)
+  {
+    printf("Test failed - unable to build H.262 context\n");
+    return 1;
+  }
+  err = build_reverse_data(&reverse_data,FALSE);
+  if (err)
+  {
+    printf("Test failed - unable to build reverse data\n");
+    return 1;
+  }
+  set_reverse_cache_size(reverse_data,cache_bytes);
+  err = add_h262_reverse_context(h262,reverse_data);
+  if (err)
+  {
+    printf("Test failed - unable to add reverse context\n");
+    return 1;
+  }
+  output = fopen(output_name,"wb");
+  if (output == NULL)
+  {
+    printf("Test failed - unable to open %s\n",output_name);
+    return 1;
+  }
+
+  err = collect_reverse_h262(h262,NUM_PICTURES/2,FALSE,TRUE);
+  if (err)
+  {
+    printf("Test failed - error playing forwards\n");
+    return 1;
+  }
+  err = output_in_reverse_as_ES(es,output,0,FALSE,TRUE,-1,0,reverse_data);
+  if (err)
+  {
+    printf("Test failed - error reversing\n");
+    return 1;
+  }
+  *first_hits = reverse_data->cache_hits;
+
+  // Forwards again, from where reversing stopped, writing what we read
+  for (ii = 0; ii < NUM_PICTURES/4; ii++)
+  {
+    h262_picture_p  picture;
+    err = get_next_h262_frame(h262,FALSE,TRUE,&picture);
+    if (err)
+    {
+      printf("Test failed - error reading picture %d after reversing\n",ii);
+      return 1;
+    }
+    err = write_h262_picture_as_ES(output,picture);
+    free_h262_picture(&picture);
+    if (err)
+    {
+      printf("Test failed - error writing picture\n");
+      return 1;
+    }
+  }
+  err = output_in_reverse_as_ES(es,output,0,FALSE,TRUE,-1,0,reverse_data);
+  if (err)
+  {
+    printf("Test failed - error reversing a second time\n");
+    return 1;
+  }
+
+  *cache_hits = reverse_data->cache_hits;
+  fclose(output);
+  free_reverse_data(&reverse_data);
+  free_h262_context(&h262);
+  close_elementary_stream(&es);
+  return 0;
+}
+
+/*
+ * Are the two files the same (and not empty)?
+ */
+static int same_files(char  *name1,
+                      char  *name2)
+{
+  int   result = TRUE;
+  long  length = 0;
+  FILE *file1 = fopen(name1,"rb");
+  FILE *file2 = fopen(name2,"rb");
+  if (file1 == NULL || file2 == NULL)
+    result = FALSE;
+  while (result)
+  {
+    int  ch1 = fgetc(file1);
+    int  ch2 = fgetc(file2);
+    if (ch1 != ch2)
+    {
+      printf("Test failed - %s and %s differ at byte %ld\n",name1,name2,
+             length);
+      result = FALSE;
+    }
+    else if (ch1 == EOF)
+      break;
+    length ++;
+  }
+  if (result && length == 0)
+  {
+    printf("Test failed - %s is empty\n",name1);
+    result = FALSE;
+  }
+  if (file1 != NULL) fclose(file1);
+  if (file2 != NULL) fclose(file2);
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  int       err;
+  uint32_t  first_hits = 0;
+  uint32_t  hits = 0;
+
+  printf("Testing the reverse cache\n");
+
+  err = write_h262_data();
+  if (err) return 1;
+
+  printf("Test 1 - reversing H.262 without the cache\n");
+  err = play_and_reverse(0,NOCACHE_FILENAME,&first_hits,&hits);
+  if (err) return 1;
+  if (hits != 0)
+  {
+    printf("Test failed - %u cache hits with no cache\n",hits);
+    return 1;
+  }
+  printf("Test 1 succeeded\n");
+
+  printf("Test 2 - reversing H.262 with the cache\n");
+  err = play_and_reverse(DEFAULT_REVERSE_CACHE_KB*1024,CACHE_FILENAME,
+                         &first_hits,&hits);
+  if (err) return 1;
+  if (first_hits == 0)
+  {
+    printf("Test failed - nothing cached during forward play was used\n");
+    return 1;
+  }
+  printf("    (%u entries output from the cache, %u when first reversing)\n",
+         hits,first_hits);
+  if (!same_files(NOCACHE_FILENAME,CACHE_FILENAME))
+    return 1;
+  printf("Test 2 succeeded\n");
+
+  remove(ES_FILENAME);
+  remove(NOCACHE_FILENAME);
+  remove(CACHE_FILENAME);
+  return 0;
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,323 @@
+/*
+ * Tests that pathological input (no start codes, unbounded PES packets,
+ * very long lists) is handled in bounded time and memory
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compat.h"
+#include "es_fns.h"
+#include "pes_fns.h"
+#include "printing_fns.h"
+
+// How long any one test may take, in seconds of processor time. Growing
+// buffers linearly would take much longer than this on the larger inputs.
+#define TIME_LIMIT  10
+
+#define ES_FILENAME  "test_worst_case.es"
+#define TS_FILENAME  "test_worst_case.ts"
+
+static int check_time(clock_t  start,
+                      char    *what)
+{
+  double  taken = (double)(clock() - start) / CLOCKS_PER_SEC;
+  if (taken > TIME_LIMIT)
+  {
+    printf("Test failed - %s took %.1f seconds\n",what,taken);
+    return 1;
+  }
+  printf("    (%s took %.2f seconds)\n",what,taken);
+  return 0;
+}
+
+/*
+ * Write an ES file with a single ES unit of `zeros` zero bytes,
+ * followed by a short sequence end unit.
+ */
+static int write_long_ES_unit(int  zeros)
+{
+  static byte  start[] = {0x00, 0x00, 0x01, 0xB3};
+  static byte  end[] = {0x00, 0x00, 0x01, 0xB7};
+  byte  block[4096];
+  FILE *file = fopen(ES_FILENAME,"wb");
+  if (file == NULL)
+  {
+    printf("Test failed - unable to open %s\n",ES_FILENAME);
+    return 1;
+  }
+  memset(block,0,sizeof(block));
+  fwrite(start,1,sizeof(start),file);
+  while (zeros > 0)
+  {
+    int  len = (zeros > (int)sizeof(block) ? (int)sizeof(block) : zeros);
+    fwrite(block,1,len,file);
+    zeros -= len;
+  }
+  fwrite(end,1,sizeof(end),file);
+  fclose(file);
+  return 0;
+}
+
+/*
+ * Read the ES units from our ES file.
+ *
+ * Returns the number of units read, and the length of the first, or
+ * -1 if something went wrong.
+ */
+static int read_ES_units(uint32_t  max_unit_size,
+                         byte     *first_start_code,
+                         uint32_t *first_len,
+                         uint32_t *first_size)
+{
+  int        err;
+  int        count = 0;
+  ES_p       es;
+  ES_unit_p  unit;
+
+  err = open_elementary_stream(ES_FILENAME,&es);
+  if (err)
+  {
+    printf("Test failed - unable to open %s\n",ES_FILENAME);
+    return -1;
+  }
+  set_ES_max_unit_size(es,max_unit_size);
+  for (;;)
+  {
+    err = find_and_build_next_ES_unit(es,&unit);
+    if (err == EOF)
+      break;
+    else if (err)
+    {
+      printf("Test failed - error reading ES unit %d\n",count);
+      close_elementary_stream(&es);
+      return -1;
+    }
+    if (count == 0)
+    {
+      *first_start_code = unit->start_code;
+      *first_len = unit->data_len;
+      *first_size = unit->data_size;
+    }
+    count ++;
+    free_ES_unit(&unit);
+  }
+  close_elementary_stream(&es);
+  return count;
+}
+
+/*
+ * Write a TS file with one program, whose video PES packet has a declared
+ * length of 0 and runs on for `num_packets` TS packets, after which a
+ * short PES packet starts.
+ */
+static int write_unbounded_PES(int  num_packets)
+{
+  static byte  pat[] = {0x47, 0x40, 0x00, 0x10, 0x00,
+                        0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                        0x00, 0x01, 0xE0, 0x66, 0x8C, 0xC3, 0x14, 0x84};
+  static byte  pmt[] = {0x47, 0x40, 0x66, 0x10, 0x00,
+                        0x02, 0xB0, 0x12, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                        0xE0, 0x68, 0xF0, 0x00, 0x02, 0xE0, 0x68, 0xF0,
+                        0x00, 0xC6, 0x01, 0xED, 0x45};
+  static byte  pes_start[] = {0x00, 0x00, 0x01, 0xE0, 0x00, 0x00,
+                              0x80, 0x00, 0x00};
+  byte  packet[TS_PACKET_SIZE];
+  int   ii;
+  FILE *file = fopen(TS_FILENAME,"wb");
+  if (file == NULL)
+  {
+    printf("Test failed - unable to open %s\n",TS_FILENAME);
+    return 1;
+  }
+
+  memset(packet,0xFF,TS_PACKET_SIZE);
+  memcpy(packet,pat,sizeof(pat));
+  fwrite(packet,1,TS_PACKET_SIZE,file);
+  memset(packet,0xFF,TS_PACKET_SIZE);
+  memcpy(packet,pmt,sizeof(pmt));
+  fwrite(packet,1,TS_PACKET_SIZE,file);
+
+  for (ii = 0; ii < num_packets + 1; ii++)
+  {
+    memset(packet,0,TS_PACKET_SIZE);
+    packet[0] = 0x47;
+    packet[1] = (ii == 0 || ii == num_packets ? 0x40 : 0x00);
+    packet[2] = 0x68;
+    packet[3] = 0x10 | (ii & 0x0F);
+    if (ii == 0 || ii == num_packets)
+    {
+      memcpy(packet+4,pes_start,sizeof(pes_start));
+      packet[4+sizeof(pes_start)+2] = 0x01;
+      packet[4+sizeof(pes_start)+3] = (ii == 0 ? 0xB3 : 0xB7);
+    }
+    fwrite(packet,1,TS_PACKET_SIZE,file);
+  }
+  fclose(file);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  int       err, ii;
+  int       count;
+  byte      start_code = 0;
+  uint32_t  len = 0, size = 0;
+  clock_t   start;
+  PES_reader_p    reader;
+  ES_unit_list_p  list;
+  ES_unit_p       unit;
+
+  printf("Testing worst case input\n");
+
+  printf("Test 1 - an ES unit longer than the maximum\n");
+  err = write_long_ES_unit(40*1024*1024);
+  if (err) return 1;
+  start = clock();
+  count = read_ES_units(ES_UNIT_DEFAULT_MAX_SIZE,&start_code,&len,&size);
+  if (count < 0) return 1;
+  if (count != 1 || start_code != 0xB7)
+  {
+    printf("Test failed - read %d ES units, the first being %02x,"
+           " expected 1, being b7\n",count,start_code);
+    return 1;
+  }
+  if (check_time(start,"reading")) return 1;
+  printf("Test 1 succeeded\n");
+
+  printf("Test 2 - a long ES unit, with no maximum\n");
+  err = write_long_ES_unit(12*1024*1024);
+  if (err) return 1;
+  start = clock();
+  count = read_ES_units(0,&start_code,&len,&size);
+  if (count < 0) return 1;
+  if (count != 2 || len != 12*1024*1024 + 4)
+  {
+    printf("Test failed - read %d ES units, the first %u bytes long,"
+           " expected 2, %u bytes long\n",count,len,12*1024*1024 + 4);
+    return 1;
+  }
+  if (size > 2*len + ES_UNIT_DATA_INCREMENT)
+  {
+    printf("Test failed - ES unit of %u bytes used a %u byte buffer\n",
+           len,size);
+    return 1;
+  }
+  if (check_time(start,"reading")) return 1;
+  remove(ES_FILENAME);
+  printf("Test 2 succeeded\n");
+
+  printf("Test 3 - an unbounded PES packet longer than the maximum\n");
+  err = write_unbounded_PES(2*PES_DEFAULT_MAX_SIZE/(TS_PACKET_SIZE-4));
+  if (err) return 1;
+  start = clock();
+  err = open_PES_reader(TS_FILENAME,FALSE,FALSE,&reader);
+  if (err)
+  {
+    printf("Test failed - unable to open %s\n",TS_FILENAME);
+    return 1;
+  }
+  count = 0;
+  for (;;)
+  {
+    err = read_next_PES_packet(reader);
+    if (err == EOF)
+      break;
+    else if (err)
+    {
+      printf("Test failed - error reading PES packet %d\n",count);
+      return 1;
+    }
+    if (reader->packet->data_len > PES_DEFAULT_MAX_SIZE)
+    {
+      printf("Test failed - read a PES packet of %d bytes\n",
+             reader->packet->data_len);
+      return 1;
+    }
+    // Its data should start with the 00 00 01 B7 after the PES header
+    if (count == 0 && reader->packet->data[12] != 0xB7)
+    {
+      printf("Test failed - first PES packet contains %02x,"
+             " expected b7\n",reader->packet->data[12]);
+      return 1;
+    }
+    count ++;
+  }
+  (void) close_PES_reader(&reader);
+  if (count != 1)
+  {
+    printf("Test failed - read %d PES packets, expected 1\n",count);
+    return 1;
+  }
+  if (check_time(start,"reading")) return 1;
+  remove(TS_FILENAME);
+  printf("Test 3 succeeded\n");
+
+  printf("Test 4 - a very long ES unit list\n");
+  start = clock();
+  err = build_ES_unit_list(&list);
+  if (err)
+  {
+    printf("Test failed - constructing list\n");
+    return 1;
+  }
+  err = build_ES_unit(&unit);
+  if (err)
+  {
+    printf("Test failed - constructing ES unit\n");
+    return 1;
+  }
+  for (ii = 0; ii < 2000000; ii++)
+  {
+    err = append_to_ES_unit_list(list,unit);
+    if (err)
+    {
+      printf("Test failed - appending ES unit %d\n",ii);
+      return 1;
+    }
+  }
+  if (list->size > 2*list->length)
+  {
+    printf("Test failed - list of %d ES units has size %d\n",
+           list->length,list->size);
+    return 1;
+  }
+  free_ES_unit(&unit);
+  free_ES_unit_list(&list);
+  if (check_time(start,"appending")) return 1;
+  printf("Test 4 succeeded\n");
+  return 0;
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -41,6 +41,7 @@
 #include "ts_fns.h"
 #include "tswrite_fns.h"
 #include "misc_fns.h"
+#include "tscompact_fns.h"
 #include "printing_fns.h"
 #include "pidint_fns.h"
 #include "pes_fns.h"
@@ -599,6 +600,148 @@ extern int write_ES_as_TS_PES_packet_with_pcr(TS_writer_p output,
                                   data,data_len,TRUE,TRUE,pid,stream_id,
                                   TRUE,pcr_base,pcr_extn);
 }
+
+/*
+ * Write out several pieces of ES data as a single Transport Stream PES
+ * packet.
+ *
+ * - `output` is the TS output context returned by `tswrite_open`
+ * - `num_parts` is how many pieces of ES data there are
+ * - `part_data` is an array of the pieces of ES data (e.g., the NAL units
+ *   of an access unit), in the order they should be output
+ * - `part_len` is an array of the corresponding lengths
+ * - `pid` is the PID to use for the TS packets
+ * - `stream_id` is the PES packet stream id to use (e.g.,
+ *    DEFAULT_VIDEO_STREAM_ID)
+ * - `num_packets` returns the number of TS packets written. It may be
+ *   NULL if this is not wanted.
+ *
+ * The pieces are packed into the TS payloads one after another, so that
+ * only the last TS packet of the PES packet needs padding.
+ *
+ * If the total data is more than 65535 bytes long, then PES_packet_length
+ * will be set to zero, as for `write_ES_as_TS_PES_packet`.
+ *
+ * Returns 0 if it worked, 1 if something went wrong.
+ */
+extern int write_ES_parts_as_TS_PES_packet(TS_writer_p output,
+                                           int         num_parts,
+                                           byte       *part_data[],
+                                           uint32_t    part_len[],
+                                           uint32_t    pid,
+                                           byte        stream_id,
+                                           int        *num_packets)
+{
+  byte     TS_packet[TS_PACKET_SIZE];
+  byte     pes_hdr[TS_PACKET_SIZE];  // better be more than long enough!
+  int      pes_hdr_len = 0;
+  int      pes_hdr_posn = 0;
+  uint32_t total_len = 0;
+  uint32_t left;                     // PES bytes still to be written
+  uint32_t part_posn = 0;            // how far through the current part
+  int      part = 0;
+  int      count = 0;
+  int      ii;
+
+#if DEBUG_WRITE_PACKETS
+  fprint_msg("||  ES parts (%d) as TS/PES, pid %x (%d)\n",num_parts,pid,pid);
+#endif
+
+  if (pid < 0x0010 || pid > 0x1ffe)
+  {
+    fprint_err("### PID %03x is outside legal program stream range",pid);
+    return 1;
+  }
+
+  for (ii = 0; ii < num_parts; ii++)
+    total_len += part_len[ii];
+
+  PES_header(total_len,stream_id,FALSE,0,FALSE,0,pes_hdr,&pes_hdr_len);
+  left = total_len + pes_hdr_len;
+
+  while (left > 0)
+  {
+    int      TS_hdr_len;
+    uint32_t space_left;
+    int      posn;
+
+    TS_packet[0] = 0x47;
+    if (count == 0)
+      TS_packet[1] = (byte)(0x40 | ((pid & 0x1f00) >> 8));
+    else
+      TS_packet[1] = (byte)(0x00 | ((pid & 0x1f00) >> 8));
+    TS_packet[2] = (byte)(pid & 0xff);
+
+    if (left < MAX_TS_PAYLOAD_SIZE)
+    {
+      // The last packet needs padding out with an adaptation field
+      int padlen;
+      TS_packet[3] = (byte)(0x30 | next_continuity_count(pid));
+      if (left == MAX_TS_PAYLOAD_SIZE - 1)
+      {
+        TS_packet[4] = 0;
+        TS_hdr_len = 5;
+      }
+      else
+      {
+        TS_packet[4] = 1;
+        TS_packet[5] = 0;
+        TS_hdr_len = 6;
+        padlen = MAX_TS_PAYLOAD_SIZE - 2 - left;
+        for (ii = 0; ii < padlen; ii++)
+          TS_packet[TS_hdr_len+ii] = 0xFF;
+        TS_packet[4] += padlen;
+        TS_hdr_len   += padlen;
+      }
+    }
+    else
+    {
+      TS_packet[3] = (byte)(0x10 | next_continuity_count(pid));
+      TS_hdr_len = 4;
+    }
+    space_left = TS_PACKET_SIZE - TS_hdr_len;
+    posn = TS_hdr_len;
+
+    // The PES header (which always fits in the first packet)
+    if (pes_hdr_posn < pes_hdr_len)
+    {
+      memcpy(&(TS_packet[posn]),pes_hdr,pes_hdr_len);
+      posn += pes_hdr_len;
+      space_left -= pes_hdr_len;
+      left -= pes_hdr_len;
+      pes_hdr_posn = pes_hdr_len;
+    }
+
+    // And as much of the ES data as will fit
+    while (space_left > 0 && part < num_parts)
+    {
+      uint32_t this_len = part_len[part] - part_posn;
+      if (this_len > space_left)
+        this_len = space_left;
+      if (this_len > 0)
+        memcpy(&(TS_packet[posn]),part_data[part] + part_posn,this_len);
+      posn += this_len;
+      space_left -= this_len;
+      left -= this_len;
+      part_posn += this_len;
+      if (part_posn == part_len[part])
+      {
+        part ++;
+        part_posn = 0;
+      }
+    }
+
+    if (tswrite_write(output,TS_packet,pid,FALSE,0))
+    {
+      fprint_err("### Error writing out TS packet: %s\n",strerror(errno));
+      return 1;
+    }
+    count ++;
+  }
+  if (num_packets)
+    *num_packets = count;
+  return 0;
+}
 
 /*
  * Write out a PES packet's data as a Transport Stream PES packet.
@@ -1263,6 +1406,16 @@ extern int build_TS_reader_with_fns(void *handle,
  *
  * If `filename` is NULL, then the input will be taken from standard input.
  *
+ * If `filename` starts with MULTIFILE_LIST_PREFIX ('@'), then the rest of it
+ * names a list of files, which will be read (and may be seeked within) as
+ * if they were a single file.
+ *
+ * If `filename` names a gzip compressed file, then the TS data it contains
+ * will be read (and may be seeked within).
+ *
+ * If `filename` names a compact (null packet stripped) TS file, then the
+ * TS packets it contains will be read, without any null packets.
+ *
  * Returns 0 if all goes well, 1 if something goes wrong.
  */
 extern int open_file_for_TS_read(char         *filename,
@@ -1271,6 +1424,25 @@ extern int open_file_for_TS_read(char         *filename,
   int  err;
   int  file;
 
+  if (is_indirect_input(filename))
+  {
+    struct indirect_input  indirect;
+    err = open_indirect_input(filename,&indirect);
+    if (err) return 1;
+    err = build_TS_reader_with_fns(indirect.handle,indirect.read_fn,
+                                   indirect.seek_fn,tsreader);
+    if (err)
+    {
+      (void) indirect.close_fn(indirect.handle);
+      return 1;
+    }
+    (*tsreader)->close_fn = indirect.close_fn;
+    return 0;
+  }
+
+  if (is_compact_TS_file(filename))
+    return open_compact_TS_for_TS_read(filename,FALSE,tsreader);
+
   if (filename == NULL)
     file = STDIN_FILENO;
   else
@@ -1319,7 +1491,9 @@ extern int close_TS_reader(TS_reader_p  *tsreader)
   int err = 0;
   if (*tsreader == NULL)
     return 0;
-  if ((*tsreader)->file != STDIN_FILENO && (*tsreader)->file != -1)
+  if ((*tsreader)->close_fn)
+    err = (*tsreader)->close_fn((*tsreader)->handle);
+  else if ((*tsreader)->file != STDIN_FILENO && (*tsreader)->file != -1)
     err = close_file((*tsreader)->file);
 
   free_TS_reader(tsreader);
@@ -3481,7 +3655,8 @@ extern int split_TS_packet(byte      buf[TS_PACKET_SIZE],
 
   if (buf[0] != 0x47)
   {
-    fprint_err("### TS packet starts %02x, not %02x\n",buf[0],0x47);
+    fprint_err_limited("TS sync byte",
+                       "### TS packet starts %02x, not %02x\n",buf[0],0x47);
     return 1;
   }
   *payload_unit_start_indicator = (buf[1] & 0x40) >> 6;
@@ -55,6 +55,7 @@ enum pid_extract
   EXTRACT_VIDEO,  // Output the first "named" video stream
   EXTRACT_AUDIO,  // Ditto for audio
   EXTRACT_PID,    // Output an explicit PID
+  EXTRACT_ALL,    // Output every stream in every program
 };
 typedef enum pid_extract EXTRACT;
 
@@ -141,6 +142,130 @@ static int extract_av_via_pes(char  *input_name,
   return 0;
 }
 
+// When extracting all streams, we need an output file for each PID
+struct all_outputs
+{
+  char  *prefix;
+  FILE  *output[PES_NUM_PIDS];
+  int    num_files;
+  int    quiet;
+};
+
+/*
+ * Write out the ES data for a PES packet, for extract_all_via_pes().
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int write_PES_packet_ES_data(void               *arg,
+                                    PES_reader_p        reader,
+                                    PES_packet_data_p   packet)
+{
+  struct all_outputs *outputs = arg;
+  FILE  *output = outputs->output[packet->pid];
+  size_t written;
+
+  if (packet->es_data_len == 0)
+    return 0;
+
+  if (output == NULL)
+  {
+    char  *name = malloc(strlen(outputs->prefix) + 10);
+    if (name == NULL)
+    {
+      print_err("### Unable to allocate output file name\n");
+      return 1;
+    }
+    sprintf(name,"%s_%04x.es",outputs->prefix,packet->pid);
+    output = fopen(name,"wb");
+    if (output == NULL)
+    {
+      fprint_err("### Unable to open output file %s: %s\n",name,
+                 strerror(errno));
+      free(name);
+      return 1;
+    }
+    if (!outputs->quiet)
+      fprint_msg("Writing program %d PID %04x (stream type %02x, %s) to %s\n",
+                 packet->program_number,packet->pid,packet->stream_type,
+                 h222_stream_type_str(packet->stream_type),name);
+    free(name);
+    outputs->output[packet->pid] = output;
+    outputs->num_files ++;
+  }
+
+  written = fwrite(packet->es_data,1,packet->es_data_len,output);
+  if (written != (size_t)packet->es_data_len)
+  {
+    fprint_err("### Error writing ES data for PID %04x: %s\n",packet->pid,
+               strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Extract the ES data for every stream in every program, in a single pass.
+ *
+ * Each stream is written to a file named <prefix>_<pid>.es, where <pid> is
+ * four hexadecimal digits.
+ *
+ * If the PES reader cannot be built, `tsreader` is closed (and returned
+ * as NULL).
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int extract_all_via_pes(TS_reader_p *tsreader,
+                               char        *prefix,
+                               int          max,
+                               int          verbose,
+                               int          quiet)
+{
+  int          err;
+  int          ii;
+  int          count = 0;
+  PES_reader_p reader = NULL;
+  struct all_outputs *outputs;
+
+  outputs = malloc(sizeof(struct all_outputs));
+  if (outputs == NULL)
+  {
+    print_err("### Unable to allocate output file array\n");
+    return 1;
+  }
+  outputs->prefix = prefix;
+  outputs->num_files = 0;
+  outputs->quiet = quiet;
+  for (ii = 0; ii < PES_NUM_PIDS; ii++)
+    outputs->output[ii] = NULL;
+
+  err = build_TS_PES_reader_for_all_programs(tsreader,verbose,!quiet,&reader);
+  if (err)
+  {
+    print_err("### Unable to build PES reader for all programs\n");
+    free(outputs);
+    return 1;
+  }
+
+  err = set_PES_reader_callback(reader,-1,write_PES_packet_ES_data,outputs);
+  if (!err)
+    err = read_all_PES_packets(reader,max,&count);
+
+  for (ii = 0; ii < PES_NUM_PIDS; ii++)
+  {
+    if (outputs->output[ii] != NULL)
+      (void) fclose(outputs->output[ii]);
+  }
+  if (!quiet)
+    fprint_msg("Read %d PES packet%s, wrote %d file%s\n",
+               count,(count==1?"":"s"),
+               outputs->num_files,(outputs->num_files==1?"":"s"));
+  free(outputs);
+  // The caller is responsible for the TS reader
+  reader->tsreader = NULL;
+  (void) free_PES_reader(&reader);
+  return err;
+}
+
 /*
  * Extract all the TS packets for a nominated PID to another file.
  *
@@ -295,24 +420,19 @@ static int extract_pid_packets(TS_reader_p  tsreader,
  *
  * Returns 0 if all went well, 1 if something went wrong.
  */
-static int extract_av(int   input,
-                      FILE *output,
-                      int   want_video,
-                      int   max,
-                      int   verbose,
-                      int   quiet)
+static int extract_av(TS_reader_p  tsreader,
+                      FILE        *output,
+                      int          want_video,
+                      int          max,
+                      int          verbose,
+                      int          quiet)
 {
   int      err, ii;
   int      max_to_read = max;
   int      total_num_read = 0;
   uint32_t pid = 0;
-  TS_reader_p tsreader = NULL;
   pmt_p       pmt = NULL;
 
-  // Turn our file into a TS reader
-  err = build_TS_reader(input,&tsreader);
-  if (err) return 1;
-
   // First, find out what program streams we actually have
   for (;;)
   {
@@ -327,14 +447,12 @@ static int extract_av(int   input,
     {
       if (!quiet)
         print_msg("No program stream information in the input file\n");
-      free_TS_reader(&tsreader);
       free_pmt(&pmt);
       return 0;
     }
     else if (err)
     {
       print_err("### Error finding program stream information\n");
-      free_TS_reader(&tsreader);
       free_pmt(&pmt);
       return 1;
     }
@@ -365,7 +483,6 @@ static int extract_av(int   input,
   {
     fprint_err("### No %s stream specified in first %d TS packets in input file\n",
                (want_video?"video":"audio"),max);
-    free_TS_reader(&tsreader);
     return 1;
   }
 
@@ -377,9 +494,7 @@ static int extract_av(int   input,
   max -= total_num_read;
 
   // And do the extraction.
-  err = extract_pid_packets(tsreader,output,pid,max,verbose,quiet);
-  free_TS_reader(&tsreader);
-  return err;
+  return extract_pid_packets(tsreader,output,pid,max,verbose,quiet);
 }
 
 /*
@@ -387,24 +502,14 @@ static int extract_av(int   input,
  *
  * Returns 0 if all went well, 1 if something went wrong.
  */
-static int extract_pid(int          input,
+static int extract_pid(TS_reader_p  tsreader,
                        FILE        *output,
                        uint32_t     pid_wanted,
                        int          max,
                        int          verbose,
                        int          quiet)
 {
-  int    err;
-  TS_reader_p tsreader = NULL;
-
-  // Turn our file into a TS reader
-  err = build_TS_reader(input,&tsreader);
-  if (err) return 1;
-
-  err = extract_pid_packets(tsreader,output,pid_wanted,max,verbose,quiet);
-
-  free_TS_reader(&tsreader);
-  return err;
+  return extract_pid_packets(tsreader,output,pid_wanted,max,verbose,quiet);
 }
 
 static void print_usage()
@@ -430,6 +535,11 @@ static void print_usage()
     "                     named in the (first) PMT. This is the default.\n"
     "  -audio             Output data for the (first) audio stream\n"
     "                     named in the (first) PMT\n"
+    "  -all               Output data for every stream in every program,\n"
+    "                     in a single pass. <outfile> is used as a prefix,\n"
+    "                     and each stream is written to <outfile>_<pid>.es\n"
+    "                     (with <pid> in hex). -max counts PES packets.\n"
+    "                     Does not support -pes or -stdout.\n"
     "\n"
     "General switches:\n"
     "  -err stdout        Write error messages to standard output (the default)\n"
@@ -440,6 +550,10 @@ static void print_usage()
     "  -verbose, -v       Output informational/diagnostic messages\n"
     "  -quiet, -q         Only output error messages\n"
     "  -max <n>, -m <n>   Maximum number of TS packets to read\n"
+    "  -diag-limit <n>    Only show the first <n> messages about each sort of\n"
+    "                     problem in the data (broken PES packets, lost TS\n"
+    "                     sync, and so on), then just count them. 0 shows\n"
+    "                     all of them. [default = 0]\n"
     "\n"
     "  -pes, -ps          Use the PES interface to read ES units from\n"
     "                     the input file. This allows PS data to be read\n"
@@ -459,7 +573,7 @@ int main(int argc, char **argv)
   char  *action_switch = "None";
 
   EXTRACT   extract = EXTRACT_VIDEO; // What we're meant to extract
-  int       input   = -1;    // Our input file descriptor
+  TS_reader_p tsreader = NULL; // Our input
   FILE     *output  = NULL;  // The stream we're writing to (if any)
   int       max     = 0;     // The maximum number of TS packets to read (or 0)
   uint32_t  pid     = 0;     // The PID of the (single) stream to extract
@@ -503,6 +617,15 @@ int main(int argc, char **argv)
         if (err) return 1;
         ii++;
       }
+      else if (!strcmp("-diag-limit",argv[ii]))
+      {
+        int  limit;
+        CHECKARG("ts2es",ii);
+        err = int_value("ts2es",argv[ii],argv[ii+1],TRUE,10,&limit);
+        if (err) return 1;
+        set_diagnostic_limit(limit);
+        ii++;
+      }
       else if (!strcmp("-pes",argv[ii]) || !strcmp("-ps",argv[ii]))
       {
         use_pes = TRUE;
@@ -523,6 +646,10 @@ int main(int argc, char **argv)
       {
         extract = EXTRACT_AUDIO;
       }
+      else if (!strcmp("-all",argv[ii]))
+      {
+        extract = EXTRACT_ALL;
+      }
       else if (!strcmp("-stdin",argv[ii]))
       {
         use_stdin = TRUE;
@@ -603,6 +730,16 @@ int main(int argc, char **argv)
     print_err("### ts2es: -stdout is not supported with -pes\n");
     return 1;
   }
+  if (extract == EXTRACT_ALL && use_pes)
+  {
+    print_err("### ts2es: -all is not supported with -pes\n");
+    return 1;
+  }
+  if (extract == EXTRACT_ALL && use_stdout)
+  {
+    print_err("### ts2es: -all is not supported with -stdout\n");
+    return 1;
+  }
   if (use_pes && use_stdin)
   {
     print_err("### ts2es: -stdin is not supported with -pes\n");
@@ -612,6 +749,7 @@ int main(int argc, char **argv)
   {
     err = extract_av_via_pes(input_name,output_name,(extract==EXTRACT_VIDEO),
                              quiet);
+    report_diagnostics();
     if (err)
     {
       print_err("### ts2es: Error writing via PES\n");
@@ -628,20 +766,28 @@ int main(int argc, char **argv)
     quiet = TRUE;
   }
 
-  if (use_stdin)
-    input = STDIN_FILENO;
-  else
+  err = open_file_for_TS_read((use_stdin?NULL:input_name),&tsreader);
+  if (err)
   {
-    input = open_binary_file(input_name,FALSE);
-    if (input == -1)
-    {
-      fprint_err("### ts2es: Unable to open input file %s\n",input_name);
-      return 1;
-    }
+    fprint_err("### ts2es: Unable to open input file %s\n",
+               (use_stdin?"<stdin>":input_name));
+    return 1;
   }
   if (!quiet)
     fprint_msg("Reading from %s\n",(use_stdin?"<stdin>":input_name));
 
+  if (extract == EXTRACT_ALL)
+  {
+    if (max && !quiet)
+      fprint_msg("Stopping after %d PES packets\n",max);
+    err = extract_all_via_pes(&tsreader,output_name,max,verbose,quiet);
+    report_diagnostics();
+    if (err)
+      print_err("### ts2es: Error extracting data\n");
+    (void) close_TS_reader(&tsreader);
+    return err;
+  }
+
   if (had_output_name)
   {
     if (use_stdout)
@@ -651,7 +797,7 @@ int main(int argc, char **argv)
       output = fopen(output_name,"wb");
       if (output == NULL)
       {
-        if (!use_stdin) (void) close_file(input);
+        (void) close_TS_reader(&tsreader);
         fprint_err("### ts2es: "
                    "Unable to open output file %s: %s\n",output_name,
                    strerror(errno));
@@ -674,14 +820,15 @@ int main(int argc, char **argv)
     fprint_msg("Stopping after %d TS packets\n",max);
 
   if (extract == EXTRACT_PID)
-    err = extract_pid(input,output,pid,max,verbose,quiet);
+    err = extract_pid(tsreader,output,pid,max,verbose,quiet);
   else
-    err = extract_av(input,output,(extract==EXTRACT_VIDEO),
+    err = extract_av(tsreader,output,(extract==EXTRACT_VIDEO),
                      max,verbose,quiet);
+  report_diagnostics();
   if (err)
   {
     print_err("### ts2es: Error extracting data\n");
-    if (!use_stdin)  (void) close_file(input);
+    (void) close_TS_reader(&tsreader);
     if (!use_stdout) (void) fclose(output);
     return 1;
   }
@@ -695,16 +842,13 @@ int main(int argc, char **argv)
     {
       fprint_err("### ts2es: Error closing output file %s: %s\n",
                  output_name,strerror(errno));
-      (void) close_file(input);
+      (void) close_TS_reader(&tsreader);
       return 1;
     }
   }
-  if (!use_stdin)
-  {
-    err = close_file(input);
-    if (err)
-      fprint_err("### ts2es: Error closing input file %s\n",input_name);
-  }
+  err = close_TS_reader(&tsreader);
+  if (err)
+    fprint_err("### ts2es: Error closing input file %s\n",input_name);
   return 0;
 }
 
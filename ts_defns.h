@@ -113,6 +113,8 @@ struct _ts_reader
   //  when we would call read() or seek().
   int (*read_fn)(void *, byte *, size_t);
   int (*seek_fn)(void *, offset_t);
+  // And, if non-NULL, this is called by close_TS_reader() to close `handle`
+  int (*close_fn)(void *);
 
   byte     read_ahead[TS_READ_AHEAD_COUNT*TS_PACKET_SIZE];
   byte    *read_ahead_ptr;  // location of next packet in said array
@@ -236,6 +236,36 @@ extern int write_ES_as_TS_PES_packet_with_pcr(TS_writer_p output,
                                               byte        stream_id,
                                               uint64_t    pcr_base,
                                               uint32_t    pcr_extn);
+/*
+ * Write out several pieces of ES data as a single Transport Stream PES
+ * packet.
+ *
+ * - `output` is the TS output context returned by `tswrite_open`
+ * - `num_parts` is how many pieces of ES data there are
+ * - `part_data` is an array of the pieces of ES data (e.g., the NAL units
+ *   of an access unit), in the order they should be output
+ * - `part_len` is an array of the corresponding lengths
+ * - `pid` is the PID to use for the TS packets
+ * - `stream_id` is the PES packet stream id to use (e.g.,
+ *    DEFAULT_VIDEO_STREAM_ID)
+ * - `num_packets` returns the number of TS packets written. It may be
+ *   NULL if this is not wanted.
+ *
+ * The pieces are packed into the TS payloads one after another, so that
+ * only the last TS packet of the PES packet needs padding.
+ *
+ * If the total data is more than 65535 bytes long, then PES_packet_length
+ * will be set to zero, as for `write_ES_as_TS_PES_packet`.
+ *
+ * Returns 0 if it worked, 1 if something went wrong.
+ */
+extern int write_ES_parts_as_TS_PES_packet(TS_writer_p output,
+                                           int         num_parts,
+                                           byte       *part_data[],
+                                           uint32_t    part_len[],
+                                           uint32_t    pid,
+                                           byte        stream_id,
+                                           int        *num_packets);
 /*
  * Write out a PES packet's data as a Transport Stream PES packet.
  *
@@ -305,6 +335,16 @@ extern int build_TS_reader_with_fns(void *handle,
  *
  * If `filename` is NULL, then the input will be taken from standard input.
  *
+ * If `filename` starts with MULTIFILE_LIST_PREFIX ('@'), then the rest of it
+ * names a list of files, which will be read (and may be seeked within) as
+ * if they were a single file.
+ *
+ * If `filename` names a gzip compressed file, then the TS data it contains
+ * will be read (and may be seeked within).
+ *
+ * If `filename` names a compact (null packet stripped) TS file, then the
+ * TS packets it contains will be read, without any null packets.
+ *
  * Returns 0 if all goes well, 1 if something goes wrong.
  */
 extern int open_file_for_TS_read(char         *filename,
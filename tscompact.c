@@ -0,0 +1,739 @@
+/*
+ * Support for reading and writing "compact" (null packet stripped)
+ * Transport Stream archives
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "compat.h"
+#include "misc_fns.h"
+#include "printing_fns.h"
+#include "ts_fns.h"
+#include "tscompact_fns.h"
+
+static void encode_uint32(byte     *data,
+                          uint32_t  value)
+{
+  data[0] = (byte)((value >> 24) & 0xFF);
+  data[1] = (byte)((value >> 16) & 0xFF);
+  data[2] = (byte)((value >>  8) & 0xFF);
+  data[3] = (byte)( value        & 0xFF);
+}
+
+static uint32_t decode_uint32(byte  *data)
+{
+  return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+/*
+ * Read exactly `num_bytes` from `file`, unless we hit the end of file
+ *
+ * Returns the number of bytes read, or -1 if something went wrong.
+ */
+static int read_all_bytes(int      file,
+                          byte    *data,
+                          size_t   num_bytes)
+{
+  size_t  got = 0;
+  while (got < num_bytes)
+  {
+#ifdef _WIN32
+    int      length = read(file,data+got,(unsigned int)(num_bytes-got));
+#else
+    ssize_t  length = read(file,data+got,num_bytes-got);
+#endif
+    if (length == -1)
+    {
+      fprint_err("### Error reading compact TS file: %s\n",strerror(errno));
+      return -1;
+    }
+    else if (length == 0)
+      break;
+    got += length;
+  }
+  return (int)got;
+}
+
+/*
+ * Write all of `num_bytes` to `file`
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int write_all_bytes(int      file,
+                           byte    *data,
+                           size_t   num_bytes)
+{
+  size_t  done = 0;
+  while (done < num_bytes)
+  {
+#ifdef _WIN32
+    int      length = write(file,data+done,(unsigned int)(num_bytes-done));
+#else
+    ssize_t  length = write(file,data+done,num_bytes-done);
+#endif
+    if (length == -1)
+    {
+      fprint_err("### Error writing compact TS file: %s\n",strerror(errno));
+      return 1;
+    }
+    done += length;
+  }
+  return 0;
+}
+
+/*
+ * Is the named file a compact TS file (i.e., does it start with the
+ * compact TS header)?
+ *
+ * Returns TRUE if it is, FALSE if it is not, or if it cannot be read
+ * (including if `filename` is NULL).
+ */
+extern int is_compact_TS_file(char  *filename)
+{
+  int   file;
+  int   length;
+  byte  header[COMPACT_TS_HEADER_LEN];
+#ifdef _WIN32
+  int   flags = O_RDONLY | O_BINARY;
+#else
+  int   flags = O_RDONLY;
+#endif
+
+  if (filename == NULL)
+    return FALSE;
+
+  // Any problems opening the file are left for the caller to report
+  file = open(filename,flags);
+  if (file == -1)
+    return FALSE;
+  length = read_all_bytes(file,header,COMPACT_TS_HEADER_LEN);
+  (void) close_file(file);
+  return (length == COMPACT_TS_HEADER_LEN &&
+          !memcmp(header,COMPACT_TS_MAGIC,COMPACT_TS_MAGIC_LEN));
+}
+
+// ============================================================
+// Writing
+// ============================================================
+
+/*
+ * Write out the buffered record, if there is anything to write
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int flush_compact_TS_record(compact_TS_writer_p  writer)
+{
+  int   err;
+  byte  record[COMPACT_TS_RECORD_LEN];
+
+  if (writer->num_nulls == 0 && writer->num_packets == 0)
+    return 0;
+
+  memset(record,0,COMPACT_TS_RECORD_LEN);
+  encode_uint32(record,writer->num_nulls);
+  encode_uint32(record+4,writer->num_packets);
+  if (writer->num_nulls > 0)
+  {
+    memcpy(record+8,writer->null_header,3);
+    record[11] = writer->null_fill;
+    record[12] = writer->null_cc_step;
+  }
+  err = write_all_bytes(writer->file,record,COMPACT_TS_RECORD_LEN);
+  if (err) return 1;
+  err = write_all_bytes(writer->file,writer->packets,
+                        writer->num_packets*TS_PACKET_SIZE);
+  if (err) return 1;
+
+  writer->num_records ++;
+  writer->num_nulls = 0;
+  writer->num_packets = 0;
+  return 0;
+}
+
+/*
+ * Open a compact TS file for writing.
+ *
+ * - `filename` is the file to write to
+ * - `writer` is the new writer context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_compact_TS_writer(char                 *filename,
+                                  compact_TS_writer_p  *writer)
+{
+  int   err;
+  byte  header[COMPACT_TS_HEADER_LEN];
+  compact_TS_writer_p  new;
+
+  new = malloc(SIZEOF_COMPACT_TS_WRITER);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate compact TS writer datastructure\n");
+    return 1;
+  }
+  memset(new,0,SIZEOF_COMPACT_TS_WRITER);
+
+  new->file = open_binary_file(filename,TRUE);
+  if (new->file == -1)
+  {
+    free(new);
+    return 1;
+  }
+
+  memset(header,0,COMPACT_TS_HEADER_LEN);
+  memcpy(header,COMPACT_TS_MAGIC,COMPACT_TS_MAGIC_LEN);
+  header[COMPACT_TS_MAGIC_LEN] = COMPACT_TS_VERSION;
+  err = write_all_bytes(new->file,header,COMPACT_TS_HEADER_LEN);
+  if (err)
+  {
+    (void) close_file(new->file);
+    free(new);
+    return 1;
+  }
+  *writer = new;
+  return 0;
+}
+
+/*
+ * Can this null packet be reconstructed from a single repeated payload byte?
+ */
+static int null_packet_is_uniform(byte  packet[TS_PACKET_SIZE])
+{
+  int  ii;
+  if (packet[0] != 0x47)
+    return FALSE;
+  for (ii = 5; ii < TS_PACKET_SIZE; ii++)
+    if (packet[ii] != packet[4])
+      return FALSE;
+  return TRUE;
+}
+
+/*
+ * Does this (uniform) null packet carry on the run of null packets in
+ * the current record?
+ */
+static int null_packet_continues_run(compact_TS_writer_p  writer,
+                                     byte                 packet[TS_PACKET_SIZE])
+{
+  byte  first_cc = writer->null_header[2] & 0x0F;
+  byte  cc = packet[3] & 0x0F;
+
+  if (packet[1] != writer->null_header[0] ||
+      packet[2] != writer->null_header[1] ||
+      (packet[3] & 0xF0) != (writer->null_header[2] & 0xF0) ||
+      packet[4] != writer->null_fill)
+    return FALSE;
+
+  // The second null packet in a run tells us how the continuity counter
+  // is going up - thereafter, it must keep doing so
+  if (writer->num_nulls == 1)
+    return TRUE;
+  return cc == ((first_cc + (writer->num_nulls & 0x0F) *
+                 writer->null_cc_step) & 0x0F);
+}
+
+/*
+ * Write a TS packet to a compact TS file.
+ *
+ * If the packet is a null packet (PID 0x1FFF), then only the fact that it
+ * occurred is remembered, along with enough of its content to rebuild it
+ * exactly. A null packet whose payload is not a single repeated byte is
+ * kept as an ordinary packet.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int write_compact_TS_packet(compact_TS_writer_p  writer,
+                                   byte                 packet[TS_PACKET_SIZE])
+{
+  uint32_t pid = ((packet[1] & 0x1F) << 8) | packet[2];
+
+  if (pid == 0x1FFF && null_packet_is_uniform(packet))
+  {
+    // Nulls always precede the packets in a record, so if we've already
+    // got packets, or these nulls don't follow on from the ones we've got,
+    // they must start a new record
+    if (writer->num_packets > 0 ||
+        (writer->num_nulls > 0 && !null_packet_continues_run(writer,packet)))
+    {
+      int err = flush_compact_TS_record(writer);
+      if (err) return 1;
+    }
+    if (writer->num_nulls == 0)
+    {
+      memcpy(writer->null_header,packet+1,3);
+      writer->null_fill = packet[4];
+      writer->null_cc_step = 0;
+    }
+    else if (writer->num_nulls == 1)
+      writer->null_cc_step = ((packet[3] & 0x0F) -
+                              (writer->null_header[2] & 0x0F)) & 0x0F;
+    writer->num_nulls ++;
+    writer->total_nulls ++;
+    return 0;
+  }
+  else if (pid == 0x1FFF)
+    writer->total_kept_nulls ++;
+
+  memcpy(writer->packets + writer->num_packets*TS_PACKET_SIZE,packet,
+         TS_PACKET_SIZE);
+  writer->num_packets ++;
+  writer->total_packets ++;
+  if (writer->num_packets == COMPACT_TS_MAX_RUN)
+    return flush_compact_TS_record(writer);
+  return 0;
+}
+
+/*
+ * Close a compact TS file that is being written, and free the writer
+ * context.
+ *
+ * Any buffered packets (and any trailing null packets) are written out
+ * first.
+ *
+ * Sets `writer` to NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (in which case
+ * the context will still have been freed).
+ */
+extern int close_compact_TS_writer(compact_TS_writer_p  *writer)
+{
+  int  err;
+  if (*writer == NULL)
+    return 0;
+  err = flush_compact_TS_record(*writer);
+  if (close_file((*writer)->file))
+    err = 1;
+  free(*writer);
+  *writer = NULL;
+  return err;
+}
+
+// ============================================================
+// Reading
+// ============================================================
+
+/*
+ * How long is a record in the view being read?
+ */
+static inline offset_t compact_TS_record_length(compact_TS_p         ct,
+                                                compact_TS_record_p  record)
+{
+  offset_t  num = record->num_packets;
+  if (ct->expand_nulls)
+    num += record->num_nulls;
+  return num * TS_PACKET_SIZE;
+}
+
+static void free_compact_TS(compact_TS_p  *ct)
+{
+  if (*ct == NULL)
+    return;
+  if ((*ct)->file != -1)
+    (void) close_file((*ct)->file);
+  if ((*ct)->records != NULL)
+    free((*ct)->records);
+  free(*ct);
+  *ct = NULL;
+}
+
+/*
+ * Read the record headers of a compact TS file, building our index
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+static int index_compact_TS(compact_TS_p  ct,
+                            char         *filename)
+{
+  int       records_size = 0;
+  offset_t  file_length;
+  offset_t  posn = COMPACT_TS_HEADER_LEN;
+
+  file_length = lseek(ct->file,0,SEEK_END);
+  if (file_length == -1)
+  {
+    fprint_err("### Error determining length of file %s: %s\n",
+               filename,strerror(errno));
+    return 1;
+  }
+
+  ct->length = 0;
+  while (posn < file_length)
+  {
+    int       length;
+    byte      data[COMPACT_TS_RECORD_LEN];
+    compact_TS_record_p  record;
+
+    if (seek_file(ct->file,posn))
+      return 1;
+    length = read_all_bytes(ct->file,data,COMPACT_TS_RECORD_LEN);
+    if (length == -1)
+      return 1;
+    else if (length < COMPACT_TS_RECORD_LEN)
+    {
+      fprint_err("!!! Compact TS file %s ends with a partial record header"
+                 " - ignoring it\n",filename);
+      break;
+    }
+
+    if (ct->num_records == records_size)
+    {
+      int new_size = (records_size == 0 ? 64 : records_size * 2);
+      compact_TS_record_p  new_records =
+        realloc(ct->records,new_size*SIZEOF_COMPACT_TS_RECORD);
+      if (new_records == NULL)
+      {
+        print_err("### Unable to extend compact TS record index\n");
+        return 1;
+      }
+      ct->records = new_records;
+      records_size = new_size;
+    }
+    record = &ct->records[ct->num_records];
+    record->data_posn = posn + COMPACT_TS_RECORD_LEN;
+    record->view_start = ct->length;
+    record->num_nulls = decode_uint32(data);
+    record->num_packets = decode_uint32(data+4);
+    memcpy(record->null_header,data+8,3);
+    record->null_fill = data[11];
+    record->null_cc_step = data[12] & 0x0F;
+
+    posn = record->data_posn + (offset_t)record->num_packets * TS_PACKET_SIZE;
+    if (posn > file_length)
+    {
+      offset_t  whole = (file_length - record->data_posn) / TS_PACKET_SIZE;
+      fprint_err("!!! Compact TS file %s is truncated - only %d of the %u"
+                 " TS packets in its last record are present\n",filename,
+                 (int)whole,record->num_packets);
+      record->num_packets = (uint32_t)whole;
+      posn = file_length;
+    }
+    ct->length += compact_TS_record_length(ct,record);
+    ct->num_records ++;
+  }
+  return 0;
+}
+
+/*
+ * Open a compact TS file for reading.
+ *
+ * - `filename` is the file to read
+ * - if `expand_nulls` is true, the data read will be the original TS data,
+ *   with each of its null packets reconstructed. Otherwise, the data read
+ *   will just be the (non-null) TS packets that were kept.
+ * - `ct` is the new reader context
+ *
+ * The whole file is indexed when it is opened, so that we can seek
+ * directly to any packet.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_compact_TS(char          *filename,
+                           int            expand_nulls,
+                           compact_TS_p  *ct)
+{
+  int   err;
+  int   length;
+  byte  header[COMPACT_TS_HEADER_LEN];
+  compact_TS_p  new;
+
+  new = malloc(SIZEOF_COMPACT_TS);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate compact TS datastructure\n");
+    return 1;
+  }
+  new->expand_nulls = expand_nulls;
+  new->records = NULL;
+  new->num_records = 0;
+  new->length = 0;
+  new->current = 0;
+  new->posn = 0;
+  new->file_posn = -1;
+
+  new->file = open_binary_file(filename,FALSE);
+  if (new->file == -1)
+  {
+    free(new);
+    return 1;
+  }
+
+  length = read_all_bytes(new->file,header,COMPACT_TS_HEADER_LEN);
+  if (length != COMPACT_TS_HEADER_LEN ||
+      memcmp(header,COMPACT_TS_MAGIC,COMPACT_TS_MAGIC_LEN))
+  {
+    if (length != -1)
+      fprint_err("### File %s is not a compact TS file\n",filename);
+    free_compact_TS(&new);
+    return 1;
+  }
+  if (header[COMPACT_TS_MAGIC_LEN] != COMPACT_TS_VERSION)
+  {
+    fprint_err("### Compact TS file %s is version %d, but only version %d"
+               " is understood\n",filename,header[COMPACT_TS_MAGIC_LEN],
+               COMPACT_TS_VERSION);
+    free_compact_TS(&new);
+    return 1;
+  }
+
+  err = index_compact_TS(new,filename);
+  if (err)
+  {
+    fprint_err("### Error indexing compact TS file %s\n",filename);
+    free_compact_TS(&new);
+    return 1;
+  }
+  *ct = new;
+  return 0;
+}
+
+/*
+ * Close a compact TS file that is being read, and free its context.
+ *
+ * Sets `ct` to NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (in which case
+ * the context will still have been freed).
+ */
+extern int close_compact_TS(compact_TS_p  *ct)
+{
+  int  err = 0;
+  if (*ct == NULL)
+    return 0;
+  if ((*ct)->file != -1)
+  {
+    err = close_file((*ct)->file);
+    (*ct)->file = -1;
+  }
+  free_compact_TS(ct);
+  return err;
+}
+
+/*
+ * Close a compact TS file given as a (reader's) handle.
+ *
+ * This is suitable for use as the `close_fn` of a TS reader.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int close_compact_TS_handle(void  *handle)
+{
+  compact_TS_p  ct = handle;
+  return close_compact_TS(&ct);
+}
+
+/*
+ * Reconstruct the `index`th null packet of a record
+ */
+static void build_null_packet(compact_TS_record_p  record,
+                              uint32_t             index,
+                              byte                 packet[TS_PACKET_SIZE])
+{
+  byte  cc = (byte)((record->null_header[2] +
+                     (index & 0x0F) * record->null_cc_step) & 0x0F);
+  packet[0] = 0x47;
+  packet[1] = record->null_header[0];
+  packet[2] = record->null_header[1];
+  packet[3] = (record->null_header[2] & 0xF0) | cc;
+  memset(packet+4,record->null_fill,TS_PACKET_SIZE-4);
+}
+
+/*
+ * Read bytes from a compact TS file, in the manner of read().
+ *
+ * This is suitable for use as the `read_fn` of a TS reader, with the
+ * compact TS context as the `handle`.
+ *
+ * At most `num_bytes` bytes are read into `data` - fewer may be read
+ * if the end of a record is reached.
+ *
+ * Returns the number of bytes read, 0 at the end of the file, or -1
+ * if something went wrong.
+ */
+extern int read_compact_TS(void    *handle,
+                           byte    *data,
+                           size_t   num_bytes)
+{
+  compact_TS_p         ct = handle;
+  compact_TS_record_p  record;
+  offset_t  offset;
+  offset_t  nulls_length;
+  offset_t  available;
+
+  if (ct->posn >= ct->length || num_bytes == 0)
+    return 0;
+
+  // Move on past any records we've finished with (or which are empty in
+  // this view)
+  record = &ct->records[ct->current];
+  while (ct->posn >= record->view_start + compact_TS_record_length(ct,record))
+  {
+    ct->current ++;
+    record = &ct->records[ct->current];
+  }
+
+  offset = ct->posn - record->view_start;
+  nulls_length = (ct->expand_nulls ?
+                  (offset_t)record->num_nulls * TS_PACKET_SIZE : 0);
+  if (offset < nulls_length)
+  {
+    // Reconstruct (some of) the null packets
+    size_t  done = 0;
+    available = nulls_length - offset;
+    if ((offset_t)num_bytes > available)
+      num_bytes = (size_t)available;
+    while (done < num_bytes)
+    {
+      offset_t  index = (offset + done) / TS_PACKET_SIZE;
+      int   start = (int)((offset + done) % TS_PACKET_SIZE);
+      size_t  count = TS_PACKET_SIZE - start;
+      byte  null_packet[TS_PACKET_SIZE];
+      if (count > num_bytes - done)
+        count = num_bytes - done;
+      build_null_packet(record,(uint32_t)index,null_packet);
+      memcpy(data+done,null_packet+start,count);
+      done += count;
+    }
+    ct->posn += num_bytes;
+    return (int)num_bytes;
+  }
+  else
+  {
+    int       length;
+    offset_t  file_posn = record->data_posn + (offset - nulls_length);
+    available = (offset_t)record->num_packets * TS_PACKET_SIZE -
+      (offset - nulls_length);
+    if ((offset_t)num_bytes > available)
+      num_bytes = (size_t)available;
+    if (file_posn != ct->file_posn)
+    {
+      if (seek_file(ct->file,file_posn))
+        return -1;
+      ct->file_posn = file_posn;
+    }
+    length = read_all_bytes(ct->file,data,num_bytes);
+    if (length == -1)
+      return -1;
+    else if (length == 0)
+    {
+      print_err("### Compact TS file is shorter than when it was opened\n");
+      return -1;
+    }
+    ct->file_posn += length;
+    ct->posn += length;
+    return length;
+  }
+}
+
+/*
+ * Seek to a position in a compact TS file.
+ *
+ * This is suitable for use as the `seek_fn` of a TS reader, with the
+ * compact TS context as the `handle`.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int seek_compact_TS(void      *handle,
+                           offset_t   posn)
+{
+  int  lo, hi;
+  compact_TS_p  ct = handle;
+
+  if (posn < 0 || posn > ct->length)
+  {
+    fprint_err("### Cannot seek to position " OFFSET_T_FORMAT
+               " in compact TS file of length " OFFSET_T_FORMAT "\n",
+               posn,ct->length);
+    return 1;
+  }
+
+  // Find the last record that starts at or before `posn`
+  lo = 0;
+  hi = ct->num_records - 1;
+  while (lo < hi)
+  {
+    int mid = (lo + hi + 1) / 2;
+    if (ct->records[mid].view_start <= posn)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  ct->current = (lo < 0 ? 0 : lo);
+  ct->posn = posn;
+  return 0;
+}
+
+/*
+ * Open a compact TS file, and build a TS reader for it.
+ *
+ * - `filename` is the file to read
+ * - if `expand_nulls` is true, the TS reader will read the original TS
+ *   data, including (reconstructed) null packets. This is what is wanted
+ *   when playing the data out, so that its timing is preserved. Otherwise,
+ *   it will read just the non-null packets, which is what is wanted for
+ *   analysis.
+ * - `tsreader` is the new TS reader. close_TS_reader() will close the
+ *   compact TS file as well.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_compact_TS_for_TS_read(char         *filename,
+                                       int           expand_nulls,
+                                       TS_reader_p  *tsreader)
+{
+  int  err;
+  compact_TS_p  ct;
+
+  err = open_compact_TS(filename,expand_nulls,&ct);
+  if (err) return 1;
+
+  err = build_TS_reader_with_fns(ct,read_compact_TS,seek_compact_TS,
+                                 tsreader);
+  if (err)
+  {
+    (void) close_compact_TS(&ct);
+    return 1;
+  }
+  (*tsreader)->close_fn = close_compact_TS_handle;
+  return 0;
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,142 @@
+/*
+ * Datastructures for reading and writing "compact" (null packet stripped)
+ * Transport Stream archives
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+
+#ifndef _tscompact_defns
+#define _tscompact_defns
+
+#include "compat.h"
+#include "ts_defns.h"
+
+// A compact TS file is a Transport Stream with its null packets (PID 0x1FFF)
+// removed, but with their positions remembered, so that the original
+// packet sequence (and thus its timing) can be reconstructed.
+//
+// The file starts with a header:
+//
+//   4 bytes  COMPACT_TS_MAGIC
+//   1 byte   COMPACT_TS_VERSION
+//   3 bytes  reserved (zero)
+//
+// and is followed by any number of records, each of which is:
+//
+//   4 bytes  the number of null packets that came next in the original
+//            (big-endian)
+//   4 bytes  the number, N, of (non-null) TS packets that followed them
+//            (big-endian)
+//   3 bytes  bytes 1 to 3 of the header of the first of those null packets
+//   1 byte   the value of every byte after the header in each null packet
+//   1 byte   how much the continuity counter goes up by (modulo 16) from
+//            one null packet to the next
+//   3 bytes  reserved (zero)
+//   N * 188  those TS packets
+//
+// Thus each null packet in a record can be reconstructed exactly - all
+// of them have the same header as the first, apart from their continuity
+// counter, and a payload of a single repeated byte. A null packet that
+// does not fit that pattern (because its payload is not all one value,
+// or it does not follow on from the previous null packet) starts a new
+// record, or, if its own payload is not all one value, is kept as an
+// ordinary packet.
+
+#define COMPACT_TS_MAGIC        "TSCA"
+#define COMPACT_TS_MAGIC_LEN    4
+#define COMPACT_TS_VERSION      1
+#define COMPACT_TS_HEADER_LEN   8
+#define COMPACT_TS_RECORD_LEN   16
+
+// The most TS packets the writer will put into a single record. This bounds
+// both the writer's buffer and how far the reader has to go to find a
+// particular packet.
+#define COMPACT_TS_MAX_RUN      1024
+
+// Writing a compact TS file
+struct compact_TS_writer
+{
+  int       file;
+  uint32_t  num_nulls;          // Null packets since the last record
+  uint32_t  num_packets;        // Packets buffered for the next record
+  byte      null_header[3];     // Bytes 1-3 of the first of those nulls
+  byte      null_fill;          // and the value of the rest of its bytes
+  byte      null_cc_step;       // How the continuity counter goes up
+  byte      packets[COMPACT_TS_MAX_RUN*TS_PACKET_SIZE];
+
+  // Statistics
+  uint32_t  total_nulls;        // How many null packets we have dropped
+  uint32_t  total_packets;      // How many packets we have kept
+  uint32_t  total_kept_nulls;   // How many of those were null packets
+  uint32_t  num_records;        // How many records we have written
+};
+typedef struct compact_TS_writer *compact_TS_writer_p;
+#define SIZEOF_COMPACT_TS_WRITER sizeof(struct compact_TS_writer)
+
+// Each record in a compact TS file, as remembered by the reader
+struct compact_TS_record
+{
+  offset_t  data_posn;          // The position of its TS packets in the file
+  offset_t  view_start;         // Where it starts in the view being read
+  uint32_t  num_nulls;
+  uint32_t  num_packets;
+  byte      null_header[3];     // As in the record header in the file
+  byte      null_fill;
+  byte      null_cc_step;
+};
+typedef struct compact_TS_record *compact_TS_record_p;
+#define SIZEOF_COMPACT_TS_RECORD sizeof(struct compact_TS_record)
+
+// Reading a compact TS file.
+//
+// The reader presents either the stripped data (just the non-null packets),
+// or, if `expand_nulls` is set, the original data (with null packets
+// reinstated). In either case, it can be read and seeked within as if it
+// were a simple file of TS packets.
+struct compact_TS
+{
+  int       file;
+  int       expand_nulls;
+
+  struct compact_TS_record *records;
+  int       num_records;
+  offset_t  length;             // The length of the view being read
+
+  int       current;            // The record we are reading from
+  offset_t  posn;               // Our position within the view
+  offset_t  file_posn;          // Our actual position in the file
+};
+typedef struct compact_TS *compact_TS_p;
+#define SIZEOF_COMPACT_TS sizeof(struct compact_TS)
+
+#endif // _tscompact_defns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
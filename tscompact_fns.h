@@ -0,0 +1,163 @@
+/*
+ * Prototypes for reading and writing "compact" (null packet stripped)
+ * Transport Stream archives
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef _tscompact_fns
+#define _tscompact_fns
+
+#include "tscompact_defns.h"
+#include "ts_defns.h"
+
+/*
+ * Is the named file a compact TS file (i.e., does it start with the
+ * compact TS header)?
+ *
+ * Returns TRUE if it is, FALSE if it is not, or if it cannot be read
+ * (including if `filename` is NULL).
+ */
+extern int is_compact_TS_file(char  *filename);
+/*
+ * Open a compact TS file for writing.
+ *
+ * - `filename` is the file to write to
+ * - `writer` is the new writer context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_compact_TS_writer(char                 *filename,
+                                  compact_TS_writer_p  *writer);
+/*
+ * Write a TS packet to a compact TS file.
+ *
+ * If the packet is a null packet (PID 0x1FFF), then only the fact that it
+ * occurred is remembered, along with enough of its content to rebuild it
+ * exactly. A null packet whose payload is not a single repeated byte is
+ * kept as an ordinary packet.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int write_compact_TS_packet(compact_TS_writer_p  writer,
+                                   byte                 packet[TS_PACKET_SIZE]);
+/*
+ * Close a compact TS file that is being written, and free the writer
+ * context.
+ *
+ * Any buffered packets (and any trailing null packets) are written out
+ * first.
+ *
+ * Sets `writer` to NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (in which case
+ * the context will still have been freed).
+ */
+extern int close_compact_TS_writer(compact_TS_writer_p  *writer);
+/*
+ * Open a compact TS file for reading.
+ *
+ * - `filename` is the file to read
+ * - if `expand_nulls` is true, the data read will be the original TS data,
+ *   with each of its null packets reconstructed. Otherwise, the data read
+ *   will just be the (non-null) TS packets that were kept.
+ * - `ct` is the new reader context
+ *
+ * The whole file is indexed when it is opened, so that we can seek
+ * directly to any packet.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_compact_TS(char          *filename,
+                           int            expand_nulls,
+                           compact_TS_p  *ct);
+/*
+ * Close a compact TS file that is being read, and free its context.
+ *
+ * Sets `ct` to NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (in which case
+ * the context will still have been freed).
+ */
+extern int close_compact_TS(compact_TS_p  *ct);
+/*
+ * Close a compact TS file given as a (reader's) handle.
+ *
+ * This is suitable for use as the `close_fn` of a TS reader.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int close_compact_TS_handle(void  *handle);
+/*
+ * Read bytes from a compact TS file, in the manner of read().
+ *
+ * This is suitable for use as the `read_fn` of a TS reader, with the
+ * compact TS context as the `handle`.
+ *
+ * At most `num_bytes` bytes are read into `data` - fewer may be read
+ * if the end of a record is reached.
+ *
+ * Returns the number of bytes read, 0 at the end of the file, or -1
+ * if something went wrong.
+ */
+extern int read_compact_TS(void    *handle,
+                           byte    *data,
+                           size_t   num_bytes);
+/*
+ * Seek to a position in a compact TS file.
+ *
+ * This is suitable for use as the `seek_fn` of a TS reader, with the
+ * compact TS context as the `handle`.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int seek_compact_TS(void      *handle,
+                           offset_t   posn);
+/*
+ * Open a compact TS file, and build a TS reader for it.
+ *
+ * - `filename` is the file to read
+ * - if `expand_nulls` is true, the TS reader will read the original TS
+ *   data, including (reconstructed) null packets. This is what is wanted
+ *   when playing the data out, so that its timing is preserved. Otherwise,
+ *   it will read just the non-null packets, which is what is wanted for
+ *   analysis.
+ * - `tsreader` is the new TS reader. close_TS_reader() will close the
+ *   compact TS file as well.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int open_compact_TS_for_TS_read(char         *filename,
+                                       int           expand_nulls,
+                                       TS_reader_p  *tsreader);
+
+#endif // _tscompact_fns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
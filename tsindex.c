@@ -0,0 +1,758 @@
+/*
+ * Index a Transport Stream as it is written, so that it can be searched by
+ * time or picture without a separate pass over the data.
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "compat.h"
+#include "misc_fns.h"
+#include "printing_fns.h"
+#include "ts_fns.h"
+#include "pidint_fns.h"
+#include "tsindex_fns.h"
+
+/*
+ * Create a TS index file, ready to index a recording.
+ *
+ * - `filename` is the index file to write
+ * - `indexer` is the new indexer context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_TS_indexer(char          *filename,
+                            TS_indexer_p  *indexer)
+{
+  TS_indexer_p  new = calloc(1,SIZEOF_TS_INDEXER);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate TS indexer datastructure\n");
+    return 1;
+  }
+
+  new->file = fopen(filename,"w");
+  if (new->file == NULL)
+  {
+    fprint_err("### Unable to open index file %s: %s\n",filename,
+               strerror(errno));
+    free(new);
+    return 1;
+  }
+  fprintf(new->file,"%s\n",TS_INDEX_HEADER);
+
+  *indexer = new;
+  return 0;
+}
+
+/*
+ * Note that the recording continues in a new file (chunk).
+ *
+ * - `indexer` is the indexer context
+ * - `chunk` is the number of the new chunk
+ * - `filename` is its name
+ */
+extern void TS_indexer_new_chunk(TS_indexer_p  indexer,
+                                 int           chunk,
+                                 char         *filename)
+{
+  indexer->chunk = chunk;
+  fprintf(indexer->file,"F %d %s\n",chunk,filename);
+}
+
+/*
+ * Does the start of this video PES packet look like a random access point?
+ *
+ * We believe the random_access_indicator if it is set, and otherwise look
+ * for something that starts a sequence, or an intra picture, in the data
+ * we have (which is only the rest of the first TS packet).
+ */
+static int is_random_access(byte  stream_type,
+                            byte  adapt[],
+                            int   adapt_len,
+                            byte  es[],
+                            int   es_len)
+{
+  int  ii;
+
+  if (adapt_len > 0 && (adapt[0] & 0x40))
+    return TRUE;
+
+  for (ii = 0; ii + 5 < es_len; ii++)
+  {
+    byte  code;
+    if (es[ii] != 0 || es[ii+1] != 0 || es[ii+2] != 1)
+      continue;
+    code = es[ii+3];
+    switch (stream_type)
+    {
+    case MPEG1_VIDEO_STREAM_TYPE:
+    case MPEG2_VIDEO_STREAM_TYPE:
+      // Sequence header, or picture header with picture_coding_type I
+      if (code == 0xB3 || (code == 0x00 && ((es[ii+5] >> 3) & 7) == 1))
+        return TRUE;
+      break;
+    case AVC_VIDEO_STREAM_TYPE:
+      // IDR, or a sequence parameter set
+      if ((code & 0x1F) == 5 || (code & 0x1F) == 7)
+        return TRUE;
+      break;
+    case H265_VIDEO_STREAM_TYPE:
+      // IRAP pictures, or a video/sequence parameter set
+      code = (code >> 1) & 0x3F;
+      if ((code >= 16 && code <= 21) || code == 32 || code == 33)
+        return TRUE;
+      break;
+    case AVS_VIDEO_STREAM_TYPE:
+      // Sequence header, or I picture
+      if (code == 0xB0 || code == 0xB3)
+        return TRUE;
+      break;
+    case MPEG4_PART2_VIDEO_STREAM_TYPE:
+      // Visual object sequence, or an I-VOP
+      if (code == 0xB0 || (code == 0xB6 && (es[ii+4] >> 6) == 0))
+        return TRUE;
+      break;
+    default:
+      return FALSE;
+    }
+  }
+  return FALSE;
+}
+
+/*
+ * Handle a TS packet on PID 0 (the PAT)
+ */
+static void index_PAT(TS_indexer_p  indexer,
+                      int           payload_unit_start_indicator,
+                      byte          payload[],
+                      int           payload_len)
+{
+  int  err, ii;
+  pidint_list_p  prog_list = NULL;
+
+  if (payload_unit_start_indicator && indexer->pat_data)
+  {
+    free(indexer->pat_data);
+    indexer->pat_data = NULL;
+    indexer->pat_data_len = indexer->pat_data_used = 0;
+  }
+  else if (!payload_unit_start_indicator && !indexer->pat_data)
+    return;
+
+  err = build_psi_data(FALSE,payload,payload_len,0,&indexer->pat_data,
+                       &indexer->pat_data_len,&indexer->pat_data_used);
+  if (err || indexer->pat_data_len > indexer->pat_data_used)
+    return;
+
+  err = extract_prog_list_from_pat(FALSE,indexer->pat_data,
+                                   indexer->pat_data_len,&prog_list);
+  free(indexer->pat_data);
+  indexer->pat_data = NULL;
+  indexer->pat_data_len = indexer->pat_data_used = 0;
+  if (err) return;
+
+  for (ii = 0; ii < prog_list->length; ii++)
+  {
+    // Program number 0 names the network PID, not a PMT
+    if (prog_list->number[ii] != 0)
+      indexer->pid_flags[prog_list->pid[ii] & 0x1FFF] |= TS_INDEX_PID_PMT;
+  }
+  free_pidint_list(&prog_list);
+}
+
+/*
+ * Handle a TS packet on a PMT PID
+ */
+static void index_PMT(TS_indexer_p  indexer,
+                      uint32_t      pid,
+                      int           payload_unit_start_indicator,
+                      byte          payload[],
+                      int           payload_len)
+{
+  int    err, ii;
+  pmt_p  pmt = NULL;
+
+  if (payload_unit_start_indicator && indexer->pmt_data)
+  {
+    free(indexer->pmt_data);
+    indexer->pmt_data = NULL;
+    indexer->pmt_data_len = indexer->pmt_data_used = 0;
+  }
+  else if (!payload_unit_start_indicator &&
+           (!indexer->pmt_data || indexer->pmt_pid != pid))
+    return;
+
+  indexer->pmt_pid = pid;
+  err = build_psi_data(FALSE,payload,payload_len,pid,&indexer->pmt_data,
+                       &indexer->pmt_data_len,&indexer->pmt_data_used);
+  if (err || indexer->pmt_data_len > indexer->pmt_data_used)
+    return;
+
+  err = extract_pmt(FALSE,indexer->pmt_data,indexer->pmt_data_len,pid,&pmt);
+  free(indexer->pmt_data);
+  indexer->pmt_data = NULL;
+  indexer->pmt_data_len = indexer->pmt_data_used = 0;
+  if (err) return;
+
+  for (ii = 0; ii < pmt->num_streams; ii++)
+  {
+    uint32_t  es_pid = pmt->streams[ii].elementary_PID & 0x1FFF;
+    byte      stream_type = pmt->streams[ii].stream_type;
+
+    if ((indexer->pid_flags[es_pid] & TS_INDEX_PID_TYPED) &&
+        indexer->stream_type[es_pid] == stream_type)
+      continue;
+
+    indexer->pid_flags[es_pid] |= TS_INDEX_PID_TYPED;
+    indexer->stream_type[es_pid] = stream_type;
+    fprintf(indexer->file,"S %u %u %u\n",es_pid,stream_type,
+            pmt->program_number);
+  }
+  free_pmt(&pmt);
+}
+
+/*
+ * Handle the start of a PES packet on a video PID
+ */
+static void index_picture(TS_indexer_p  indexer,
+                          uint32_t      pid,
+                          uint64_t      offset,
+                          byte          adapt[],
+                          int           adapt_len,
+                          byte          payload[],
+                          int           payload_len)
+{
+  int       got_pts = FALSE;
+  uint64_t  pts = 0;
+  int       random_access;
+  int       es_start;
+
+  if (payload_len < 9 || payload[0] != 0 || payload[1] != 0 || payload[2] != 1)
+    return;
+
+  if ((payload[7] & 0x80) && payload_len >= 14)
+  {
+    got_pts = TRUE;
+    pts = ((uint64_t)((payload[9] >> 1) & 7) << 30) |
+          ((uint64_t)payload[10] << 22) |
+          ((uint64_t)(payload[11] >> 1) << 15) |
+          ((uint64_t)payload[12] << 7) |
+          (payload[13] >> 1);
+  }
+
+  es_start = 9 + payload[8];
+  if (es_start > payload_len)
+    es_start = payload_len;
+  random_access = is_random_access(indexer->stream_type[pid],adapt,adapt_len,
+                                   payload + es_start,payload_len - es_start);
+
+  if (got_pts)
+    fprintf(indexer->file,"I %d " LLU_FORMAT " %u " LLU_FORMAT " %s\n",
+            indexer->chunk,offset,pid,pts,(random_access?"K":"-"));
+  else
+    fprintf(indexer->file,"I %d " LLU_FORMAT " %u - %s\n",
+            indexer->chunk,offset,pid,(random_access?"K":"-"));
+
+  indexer->num_pictures ++;
+  if (random_access)
+    indexer->num_random_access ++;
+}
+
+/*
+ * Index some TS packets, as they are written to the current chunk.
+ *
+ * The data should start at the start of a TS packet. If it does not, or
+ * if it contains part of a packet at the end, the offending data is not
+ * indexed (but is counted).
+ *
+ * - `indexer` is the indexer context
+ * - `data` is the TS packets
+ * - `data_len` is how many bytes there are
+ * - `offset` is where they are being written in the current chunk
+ * - `arrival` is when they arrived, in microseconds since the epoch, or 0
+ */
+extern void TS_indexer_add_packets(TS_indexer_p  indexer,
+                                   byte          data[],
+                                   int           data_len,
+                                   uint64_t      offset,
+                                   uint64_t      arrival)
+{
+  int  posn;
+
+  for (posn = 0; posn + TS_PACKET_SIZE <= data_len; posn += TS_PACKET_SIZE)
+  {
+    byte     *packet = data + posn;
+    uint32_t  pid;
+    int       pusi;
+    byte     *adapt, *payload;
+    int       adapt_len, payload_len;
+    uint64_t  here = offset + posn;
+
+    if (packet[0] != 0x47)
+    {
+      indexer->num_unaligned ++;
+      return;
+    }
+    if (split_TS_packet(packet,&pid,&pusi,&adapt,&adapt_len,
+                        &payload,&payload_len))
+      continue;
+
+    if (!(indexer->pid_flags[pid] & TS_INDEX_PID_SEEN))
+    {
+      indexer->pid_flags[pid] |= TS_INDEX_PID_SEEN;
+      fprintf(indexer->file,"N %d " LLU_FORMAT " %u\n",
+              indexer->chunk,here,pid);
+    }
+    indexer->pid_count[pid] ++;
+
+    if (adapt_len > 0)
+    {
+      int       got_pcr;
+      uint64_t  pcr;
+      get_PCR_from_adaptation_field(adapt,adapt_len,&got_pcr,&pcr);
+      if (got_pcr)
+      {
+        fprintf(indexer->file,"P %d " LLU_FORMAT " %u " LLU_FORMAT " "
+                LLU_FORMAT "\n",indexer->chunk,here,pid,pcr,arrival);
+        indexer->num_pcrs ++;
+      }
+    }
+
+    if (payload_len == 0)
+      continue;
+    else if (pid == 0)
+      index_PAT(indexer,pusi,payload,payload_len);
+    else if (indexer->pid_flags[pid] & TS_INDEX_PID_PMT)
+      index_PMT(indexer,pid,pusi,payload,payload_len);
+    else if (pusi && (indexer->pid_flags[pid] & TS_INDEX_PID_TYPED) &&
+             IS_VIDEO_STREAM_TYPE(indexer->stream_type[pid]))
+      index_picture(indexer,pid,here,adapt,adapt_len,payload,payload_len);
+  }
+  if (posn < data_len)
+    indexer->num_unaligned ++;
+}
+
+/*
+ * Note that some datagrams were lost before `offset`.
+ */
+extern void TS_indexer_note_loss(TS_indexer_p  indexer,
+                                 uint64_t      offset,
+                                 uint32_t      count)
+{
+  fprintf(indexer->file,"L %d " LLU_FORMAT " %u\n",indexer->chunk,offset,
+          count);
+  indexer->num_lost += count;
+}
+
+/*
+ * Make sure that everything indexed so far is in the index file.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int TS_indexer_flush(TS_indexer_p  indexer)
+{
+  if (fflush(indexer->file))
+  {
+    fprint_err("### Error writing index file: %s\n",strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Finish the index file (writing the per-PID packet counts), close it,
+ * and free the indexer context.
+ *
+ * `indexer` is returned as NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int close_TS_indexer(TS_indexer_p  *indexer)
+{
+  int       err = 0;
+  uint32_t  pid;
+
+  if (*indexer == NULL)
+    return 0;
+
+  for (pid = 0; pid < TS_INDEX_NUM_PIDS; pid++)
+  {
+    if ((*indexer)->pid_count[pid] != 0)
+      fprintf((*indexer)->file,"C %u " LLU_FORMAT "\n",pid,
+              (*indexer)->pid_count[pid]);
+  }
+
+  if (fclose((*indexer)->file))
+  {
+    fprint_err("### Error closing index file: %s\n",strerror(errno));
+    err = 1;
+  }
+  free((*indexer)->pat_data);
+  free((*indexer)->pmt_data);
+  free(*indexer);
+  *indexer = NULL;
+  return err;
+}
+
+/*
+ * Report on what an indexer has found
+ */
+extern void report_TS_indexer(TS_indexer_p  indexer)
+{
+  uint32_t  pid;
+  int       num_pids = 0;
+
+  for (pid = 0; pid < TS_INDEX_NUM_PIDS; pid++)
+  {
+    if (indexer->pid_count[pid] != 0)
+      num_pids ++;
+  }
+  fprint_msg("Indexed %d PID%s, %u PCR%s, %u picture%s (%u random access)\n",
+             num_pids,(num_pids==1?"":"s"),
+             indexer->num_pcrs,(indexer->num_pcrs==1?"":"s"),
+             indexer->num_pictures,(indexer->num_pictures==1?"":"s"),
+             indexer->num_random_access);
+  if (indexer->num_unaligned)
+    fprint_msg("!!! %u datagram%s did not hold whole TS packets, and were"
+               " not (fully) indexed\n",indexer->num_unaligned,
+               (indexer->num_unaligned==1?"":"s"));
+}
+
+// ============================================================
+// Reading an index
+// ============================================================
+
+/*
+ * Is the named file a TS index (i.e., does it start with the index header)?
+ *
+ * Returns TRUE if it is, FALSE if it is not, or if it cannot be read.
+ */
+extern int is_TS_index_file(char  *filename)
+{
+  char   line[TS_INDEX_MAX_LINE];
+  FILE  *file = fopen(filename,"r");
+  int    result;
+
+  if (file == NULL)
+    return FALSE;
+  result = (fgets(line,TS_INDEX_MAX_LINE,file) != NULL &&
+            !strncmp(line,TS_INDEX_HEADER,strlen(TS_INDEX_HEADER)));
+  (void) fclose(file);
+  return result;
+}
+
+/*
+ * Read the next (decimal) number from an index line, moving `text` past it
+ *
+ * Returns 0 if all goes well, 1 if there is no number there.
+ */
+static int read_index_number(char     **text,
+                             uint64_t  *value)
+{
+  char  *ptr = *text;
+  while (*ptr == ' ')
+    ptr ++;
+  if (*ptr < '0' || *ptr > '9')
+    return 1;
+  *value = 0;
+  while (*ptr >= '0' && *ptr <= '9')
+    *value = *value * 10 + (*ptr++ - '0');
+  *text = ptr;
+  return 0;
+}
+
+/*
+ * Add the (signed) difference between two timestamps that wrap at `wrap`
+ * to `elapsed`.
+ */
+static void add_index_time(int64_t   *elapsed,
+                           uint64_t   prev,
+                           uint64_t   this,
+                           uint64_t   wrap)
+{
+  uint64_t  delta = (this + wrap - prev) % wrap;
+  if (delta > wrap / 2)
+    *elapsed -= (int64_t)(wrap - delta);
+  else
+    *elapsed += (int64_t)delta;
+}
+
+/*
+ * Work out the name of a chunk named in an index.
+ *
+ * The names in the index are as the recording was given them, so if the
+ * index itself is named with a directory, we look for the chunk (by its
+ * own name) in that directory.
+ *
+ * Returns the new name, or NULL if it could not be allocated.
+ */
+static char *index_chunk_name(char  *index_name,
+                              char  *name)
+{
+  char  *index_slash = strrchr(index_name,'/');
+  char  *name_slash = strrchr(name,'/');
+  int    dir_len = (index_slash == NULL ? 0 :
+                    (int)(index_slash - index_name) + 1);
+  char  *result;
+
+  if (name_slash != NULL)
+    name = name_slash + 1;
+  result = malloc(dir_len + strlen(name) + 1);
+  if (result == NULL)
+    return NULL;
+  memcpy(result,index_name,dir_len);
+  strcpy(result+dir_len,name);
+  return result;
+}
+
+/*
+ * Use a TS index to find where to start reading a recording, in order to
+ * start `start_time` seconds in.
+ *
+ * Time is measured from the first picture in the index, and we look for
+ * the first random access point at or after `start_time`. If the index
+ * has no pictures with PTS, we use its PCRs instead, and find the first
+ * PCR at or after `start_time`.
+ *
+ * - `index_name` is the index file to read
+ * - `start_time` is how far in to start, in seconds
+ * - `num_chunks` and `chunk_names` are returned as the names of the file
+ *   (chunk of the recording) to start in and of each later chunk that the
+ *   index names, in order, to be read as if they were one file. They should
+ *   be freed with free_TS_index_chunk_names(). If the index does not name
+ *   the file to start in, `num_chunks` is 0 and `chunk_names` is NULL.
+ * - `offset` is returned as where to start in the first of those files
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (including if the
+ * recording is not as long as `start_time`).
+ */
+extern int find_TS_index_start(char      *index_name,
+                               double     start_time,
+                               int       *num_chunks,
+                               char    ***chunk_names,
+                               offset_t  *offset)
+{
+  FILE     *file;
+  char      line[TS_INDEX_MAX_LINE];
+  int       ii;
+
+  // The chunks named by the index, in order
+  char    **names = NULL;
+  int      *chunks = NULL;
+  int       num_names = 0;
+
+  // For pictures
+  int       had_picture = FALSE;
+  uint32_t  video_pid = 0;
+  uint64_t  prev_pts = 0;
+  int64_t   pts_elapsed = 0;
+  int64_t   pts_target = (int64_t)(start_time * 90000.0);
+
+  // For PCRs
+  int       had_pcr = FALSE;
+  uint32_t  pcr_pid = 0;
+  uint64_t  prev_pcr = 0;
+  int64_t   pcr_elapsed = 0;
+  int64_t   pcr_target = (int64_t)(start_time * 27000000.0);
+
+  int       found_pcr = FALSE;
+  int       found = FALSE;
+  int       found_chunk = 0;
+  uint64_t  found_offset = 0;
+  int       first_name = -1;
+
+  *num_chunks = 0;
+  *chunk_names = NULL;
+
+  file = fopen(index_name,"r");
+  if (file == NULL)
+  {
+    fprint_err("### Unable to open index file %s: %s\n",index_name,
+               strerror(errno));
+    return 1;
+  }
+  if (fgets(line,TS_INDEX_MAX_LINE,file) == NULL ||
+      strncmp(line,TS_INDEX_HEADER,strlen(TS_INDEX_HEADER)))
+  {
+    fprint_err("### File %s is not a TS index\n",index_name);
+    (void) fclose(file);
+    return 1;
+  }
+
+  // Once we have found where to start, we still need the rest of the
+  // index for the names of the chunks after it
+  while (fgets(line,TS_INDEX_MAX_LINE,file) != NULL)
+  {
+    char     *ptr = line + 1;
+    uint64_t  chunk, where, pid, value;
+    int       len = (int)strlen(line);
+
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+      line[--len] = '\0';
+
+    if (line[0] == 'F')
+    {
+      char  **more_names;
+      int    *more_chunks;
+      if (read_index_number(&ptr,&chunk) || *ptr != ' ')
+        continue;
+      more_names = realloc(names,(num_names+1)*sizeof(char *));
+      if (more_names != NULL)
+        names = more_names;
+      more_chunks = realloc(chunks,(num_names+1)*sizeof(int));
+      if (more_chunks != NULL)
+        chunks = more_chunks;
+      if (more_names == NULL || more_chunks == NULL ||
+          (names[num_names] = index_chunk_name(index_name,ptr+1)) == NULL)
+      {
+        print_err("### Unable to allocate memory for chunk filename\n");
+        (void) fclose(file);
+        free_TS_index_chunk_names(&num_names,&names);
+        free(chunks);
+        return 1;
+      }
+      chunks[num_names++] = (int)chunk;
+    }
+    else if (found)
+      continue;
+    else if (line[0] == 'I')
+    {
+      if (read_index_number(&ptr,&chunk) ||
+          read_index_number(&ptr,&where) ||
+          read_index_number(&ptr,&pid) ||
+          read_index_number(&ptr,&value))
+        continue;               // which includes pictures without a PTS
+      if (!had_picture)
+      {
+        had_picture = TRUE;
+        video_pid = (uint32_t)pid;
+      }
+      else if (pid != video_pid)
+        continue;
+      else
+        add_index_time(&pts_elapsed,prev_pts,value,(uint64_t)1 << 33);
+      prev_pts = value;
+      if (pts_elapsed >= pts_target && !strcmp(ptr," K"))
+      {
+        found = TRUE;
+        found_chunk = (int)chunk;
+        found_offset = where;
+      }
+    }
+    else if (line[0] == 'P' && !had_picture && !found_pcr)
+    {
+      if (read_index_number(&ptr,&chunk) ||
+          read_index_number(&ptr,&where) ||
+          read_index_number(&ptr,&pid) ||
+          read_index_number(&ptr,&value))
+        continue;
+      if (!had_pcr)
+      {
+        had_pcr = TRUE;
+        pcr_pid = (uint32_t)pid;
+      }
+      else if (pid != pcr_pid)
+        continue;
+      else
+        add_index_time(&pcr_elapsed,prev_pcr,value,(uint64_t)300 << 33);
+      prev_pcr = value;
+      if (pcr_elapsed >= pcr_target)
+      {
+        // Remember it, in case there turn out to be no pictures
+        found_pcr = TRUE;
+        found_chunk = (int)chunk;
+        found_offset = where;
+      }
+    }
+  }
+  (void) fclose(file);
+
+  if (!found && !(found_pcr && !had_picture))
+  {
+    if (!had_picture && !had_pcr)
+      fprint_err("### Index %s has no pictures or PCRs to find a time by\n",
+                 index_name);
+    else
+      fprint_err("### Index %s does not reach %.2f seconds\n",index_name,
+                 start_time);
+    free_TS_index_chunk_names(&num_names,&names);
+    free(chunks);
+    return 1;
+  }
+
+  // Keep the chunk we start in, and those after it
+  for (ii = 0; ii < num_names; ii++)
+  {
+    if (chunks[ii] == found_chunk)
+    {
+      first_name = ii;
+      break;
+    }
+  }
+  free(chunks);
+  if (first_name == -1)
+    free_TS_index_chunk_names(&num_names,&names);
+  else
+  {
+    for (ii = 0; ii < first_name; ii++)
+      free(names[ii]);
+    memmove(names,names+first_name,(num_names-first_name)*sizeof(char *));
+    *num_chunks = num_names - first_name;
+    *chunk_names = names;
+  }
+  *offset = (offset_t)found_offset;
+  return 0;
+}
+
+/*
+ * Free the chunk names returned by find_TS_index_start().
+ *
+ * Sets `chunk_names` to NULL and `num_chunks` to 0.
+ */
+extern void free_TS_index_chunk_names(int     *num_chunks,
+                                      char  ***chunk_names)
+{
+  int  ii;
+  if (*chunk_names != NULL)
+  {
+    for (ii = 0; ii < *num_chunks; ii++)
+      free((*chunk_names)[ii]);
+    free(*chunk_names);
+  }
+  *chunk_names = NULL;
+  *num_chunks = 0;
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
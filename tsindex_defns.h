@@ -0,0 +1,118 @@
+/*
+ * Datastructures for indexing a Transport Stream as it is written
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef _tsindex_defns
+#define _tsindex_defns
+
+#include <stdio.h>
+#include "compat.h"
+#include "ts_defns.h"
+
+// A TS index is a text file, written alongside a recording, which says
+// where things are in it - so that the recording can be searched by time
+// or picture without reading through all of it first.
+//
+// It starts with the line:
+//
+//   # TS index 1
+//
+// and each subsequent line is an entry, whose first character says what
+// it is. A recording may be split into several files ("chunks"), numbered
+// from 0, and offsets are always in bytes from the start of the chunk.
+//
+//   F <chunk> <filename>
+//       the recording continues in the named file
+//   N <chunk> <offset> <pid>
+//       the first packet with this PID
+//   S <pid> <stream type> <program>
+//       the PMT for <program> says <pid> has <stream type> (only given
+//       when it changes)
+//   P <chunk> <offset> <pid> <pcr> <arrival>
+//       a PCR (in 27MHz units), and when it arrived (in microseconds
+//       since the epoch, or 0 if not known)
+//   I <chunk> <offset> <pid> <pts> <K or ->
+//       the start of a video PES packet (normally, a picture), its PTS
+//       (in 90kHz units, or - if it has none), and K if it is a random
+//       access point (a sequence header, IDR, and so on)
+//   L <chunk> <offset> <count>
+//       <count> datagrams were lost just before <offset>
+//   C <pid> <packets>
+//       at the end, how many packets there were on each PID
+//
+// Numbers are decimal. Lines starting with # are comments.
+
+#define TS_INDEX_HEADER  "# TS index 1"
+
+#define TS_INDEX_NUM_PIDS  0x2000
+
+// The longest index line we expect to read (an F line, with a long
+// filename, is the only thing likely to get near this)
+#define TS_INDEX_MAX_LINE  1024
+
+// Per-PID flags
+#define TS_INDEX_PID_SEEN   0x01
+#define TS_INDEX_PID_PMT    0x02
+#define TS_INDEX_PID_TYPED  0x04  // we know its stream type
+
+struct TS_indexer
+{
+  FILE     *file;
+  int       chunk;        // the current chunk
+
+  byte      pid_flags[TS_INDEX_NUM_PIDS];
+  byte      stream_type[TS_INDEX_NUM_PIDS];
+  uint64_t  pid_count[TS_INDEX_NUM_PIDS];
+
+  // PSI that is still being assembled. We only keep one PMT at a time,
+  // which is enough since PMTs are rarely split over packets
+  byte     *pat_data;
+  int       pat_data_len;
+  int       pat_data_used;
+  byte     *pmt_data;
+  int       pmt_data_len;
+  int       pmt_data_used;
+  uint32_t  pmt_pid;
+
+  // Statistics
+  uint32_t  num_pcrs;
+  uint32_t  num_pictures;
+  uint32_t  num_random_access;
+  uint32_t  num_lost;
+  uint32_t  num_unaligned;  // data that didn't start with a TS packet
+};
+typedef struct TS_indexer *TS_indexer_p;
+#define SIZEOF_TS_INDEXER sizeof(struct TS_indexer)
+
+#endif // _tsindex_defns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -0,0 +1,144 @@
+/*
+ * Prototypes for indexing a Transport Stream as it is written
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifndef _tsindex_fns
+#define _tsindex_fns
+
+#include "tsindex_defns.h"
+
+/*
+ * Create a TS index file, ready to index a recording.
+ *
+ * - `filename` is the index file to write
+ * - `indexer` is the new indexer context
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int build_TS_indexer(char          *filename,
+                            TS_indexer_p  *indexer);
+/*
+ * Note that the recording continues in a new file (chunk).
+ *
+ * - `indexer` is the indexer context
+ * - `chunk` is the number of the new chunk
+ * - `filename` is its name
+ */
+extern void TS_indexer_new_chunk(TS_indexer_p  indexer,
+                                 int           chunk,
+                                 char         *filename);
+/*
+ * Index some TS packets, as they are written to the current chunk.
+ *
+ * The data should start at the start of a TS packet. If it does not, or
+ * if it contains part of a packet at the end, the offending data is not
+ * indexed (but is counted).
+ *
+ * - `indexer` is the indexer context
+ * - `data` is the TS packets
+ * - `data_len` is how many bytes there are
+ * - `offset` is where they are being written in the current chunk
+ * - `arrival` is when they arrived, in microseconds since the epoch, or 0
+ */
+extern void TS_indexer_add_packets(TS_indexer_p  indexer,
+                                   byte          data[],
+                                   int           data_len,
+                                   uint64_t      offset,
+                                   uint64_t      arrival);
+/*
+ * Note that some datagrams were lost before `offset`.
+ */
+extern void TS_indexer_note_loss(TS_indexer_p  indexer,
+                                 uint64_t      offset,
+                                 uint32_t      count);
+/*
+ * Make sure that everything indexed so far is in the index file.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int TS_indexer_flush(TS_indexer_p  indexer);
+/*
+ * Finish the index file (writing the per-PID packet counts), close it,
+ * and free the indexer context.
+ *
+ * `indexer` is returned as NULL.
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong.
+ */
+extern int close_TS_indexer(TS_indexer_p  *indexer);
+/*
+ * Report on what an indexer has found
+ */
+extern void report_TS_indexer(TS_indexer_p  indexer);
+/*
+ * Is the named file a TS index (i.e., does it start with the index header)?
+ *
+ * Returns TRUE if it is, FALSE if it is not, or if it cannot be read.
+ */
+extern int is_TS_index_file(char  *filename);
+/*
+ * Use a TS index to find where to start reading a recording, in order to
+ * start `start_time` seconds in.
+ *
+ * Time is measured from the first picture in the index, and we look for
+ * the first random access point at or after `start_time`. If the index
+ * has no pictures with PTS, we use its PCRs instead, and find the first
+ * PCR at or after `start_time`.
+ *
+ * - `index_name` is the index file to read
+ * - `start_time` is how far in to start, in seconds
+ * - `num_chunks` and `chunk_names` are returned as the names of the file
+ *   (chunk of the recording) to start in and of each later chunk that the
+ *   index names, in order, to be read as if they were one file. They should
+ *   be freed with free_TS_index_chunk_names(). If the index does not name
+ *   the file to start in, `num_chunks` is 0 and `chunk_names` is NULL.
+ * - `offset` is returned as where to start in the first of those files
+ *
+ * Returns 0 if all goes well, 1 if something goes wrong (including if the
+ * recording is not as long as `start_time`).
+ */
+extern int find_TS_index_start(char      *index_name,
+                               double     start_time,
+                               int       *num_chunks,
+                               char    ***chunk_names,
+                               offset_t  *offset);
+/*
+ * Free the chunk names returned by find_TS_index_start().
+ *
+ * Sets `chunk_names` to NULL and `num_chunks` to 0.
+ */
+extern void free_TS_index_chunk_names(int     *num_chunks,
+                                      char  ***chunk_names);
+
+#endif // _tsindex_fns
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
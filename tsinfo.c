@@ -44,18 +44,104 @@
 #include "misc_fns.h"
 #include "printing_fns.h"
 #include "pidint_fns.h"
+#include "probecache_fns.h"
 #include "version.h"
 
 
+/*
+ * Report on a (new) PAT, found in TS packet `packet`
+ */
+static void report_PAT(int            packet,
+                       pidint_list_p  prog_list,
+                       int            changed,
+                       int            verbose)
+{
+  if (changed)
+    fprint_msg("\nPacket %d is PAT - content changed\n",packet);
+  else if (!verbose)
+    fprint_msg("\nPacket %d is PAT\n",packet);
+
+  report_pidint_list(prog_list,"Program list","Program",FALSE);
+
+  if (prog_list->length == 0)
+    fprint_msg("No programs defined in PAT (packet %d)\n",packet);
+  else if (prog_list->length > 1)
+    fprint_msg("Multiple programs in PAT - using the first\n");
+}
+
+/*
+ * Report on a (new) PMT, found in TS packet `packet`
+ */
+static void report_PMT(int       packet,
+                       uint32_t  pid,
+                       pmt_p     pmt,
+                       int       changed,
+                       int       verbose)
+{
+  if (changed)
+    fprint_msg("\nPacket %d is PMT with PID %04x (%d)"
+               " - content changed\n",packet,pid,pid);
+  else if (!verbose)
+    fprint_msg("\nPacket %d is PMT with PID %04x (%d)\n",packet,pid,pid);
+
+  report_pmt(TRUE,"  ",pmt);
+}
+
+/*
+ * Report on what was found, after scanning `max` TS packets
+ */
+static void report_scan_totals(int  num_pats,
+                               int  num_pmts,
+                               int  max)
+{
+  fprint_msg("\nFound %d PAT packet%s and %d PMT packet%s in %d TS packets\n",
+             num_pats,(num_pats==1?"":"s"),
+             num_pmts,(num_pmts==1?"":"s"),max);
+}
+
+/*
+ * Report on the program streams, as remembered by a probe cache from an
+ * earlier scan, in the same way as report_streams() does.
+ */
+static void report_cached_streams(probe_cache_p  cache)
+{
+  int  ii;
+  int  had_pat = FALSE;
+  int  had_pmt = FALSE;
+
+  fprint_msg("Scanning %d TS packets\n",cache->scan_max);
+  for (ii = 0; ii < cache->num_events; ii++)
+  {
+    probe_cache_event_p  event = &cache->events[ii];
+    if (event->prog_list != NULL)
+    {
+      report_PAT(event->packet,event->prog_list,had_pat,FALSE);
+      had_pat = TRUE;
+    }
+    else
+    {
+      report_PMT(event->packet,event->pmt_pid,event->pmt,had_pmt,FALSE);
+      had_pmt = TRUE;
+    }
+  }
+  if (cache->eof_at)
+    print_msg("EOF\n");
+  report_scan_totals(cache->num_pats,cache->num_pmts,cache->scan_max);
+}
+
 /*
  * Report on the program streams, by looking at the PAT and PMT packets
  * in the first `max` TS packets of the given input stream
  *
+ * If `cache` is not NULL, what is found is also remembered therein (unless
+ * anything odd happens that a cached report would not reproduce).
+ *
  * Returns 0 if all went well, 1 if something went wrong.
  */
-static int report_streams(TS_reader_p tsreader,
-                          int         max,
-                          int         verbose)
+static int report_streams(TS_reader_p    tsreader,
+                          int            max,
+                          int            verbose,
+                          probe_cache_p  cache)
 {
   int     err;
   int     ii;
@@ -81,7 +167,12 @@ static int report_streams(TS_reader_p tsreader,
   int num_pats = 0;
   int num_pmts = 0;
 
+  int eof_at = 0;
+  int cacheable = (cache != NULL);
+
   fprint_msg("Scanning %d TS packets\n",max);
+  if (cache != NULL)
+    probe_cache_start_scan(cache,max);
 
   for (ii=0; ii<max; ii++)
   {
@@ -96,6 +187,7 @@ static int report_streams(TS_reader_p tsreader,
     if (err == EOF)
     {
       print_msg("EOF\n");
+      eof_at = ii+1;
       break;
     }
     else if (err)
@@ -116,6 +208,7 @@ static int report_streams(TS_reader_p tsreader,
       if (payload_len == 0)
       {
         fprint_msg("Packet %d is PAT, but has no payload\n",ii+1);
+        cacheable = FALSE;
         continue;
       }
 
@@ -124,6 +217,7 @@ static int report_streams(TS_reader_p tsreader,
         // This is the start of a new PAT packet, but we'd already
         // started one, so throw its data away
         print_err("!!! Discarding previous (uncompleted) PAT data\n");
+        cacheable = FALSE;
         free(pat_data);
         pat_data = NULL; pat_data_len = 0; pat_data_used = 0;
       }
@@ -132,6 +226,7 @@ static int report_streams(TS_reader_p tsreader,
         // This is the continuation of a PAT packet, but we hadn't
         // started one yet
         print_err("!!! Discarding PAT continuation, no PAT started\n");
+        cacheable = FALSE;
         continue;
       }
 
@@ -177,21 +272,11 @@ static int report_streams(TS_reader_p tsreader,
 
       if (!same_pidint_list(this_prog_list,last_prog_list))
       {
-        if (last_prog_list != NULL)
-          fprint_msg("\nPacket %d is PAT - content changed\n",ii+1);
-        else if (!verbose)
-          fprint_msg("\nPacket %d is PAT\n",ii+1);
-
-        report_pidint_list(this_prog_list,"Program list","Program",FALSE);
-
-        if (this_prog_list->length == 0)
-          fprint_msg("No programs defined in PAT (packet %d)\n",ii+1);
-        else
-        {
-          if (this_prog_list->length > 1)
-            fprint_msg("Multiple programs in PAT - using the first\n");
+        report_PAT(ii+1,this_prog_list,last_prog_list != NULL,verbose);
+        if (this_prog_list->length > 0)
           pmt_pid = this_prog_list->pid[0];
-        }
+        if (cacheable && probe_cache_add_PAT(cache,ii+1,this_prog_list))
+          cacheable = FALSE;
       }
       free_pidint_list(&last_prog_list);
       last_prog_list = this_prog_list;
@@ -204,6 +289,7 @@ static int report_streams(TS_reader_p tsreader,
       if (payload_len == 0)
       {
         fprint_msg("Packet %d is PMT, but has no payload\n",ii+1);
+        cacheable = FALSE;
         continue;
       }
 
@@ -212,6 +298,7 @@ static int report_streams(TS_reader_p tsreader,
         // This is the start of a new PMT packet, but we'd already
         // started one, so throw its data away
         print_err("!!! Discarding previous (uncompleted) PMT data\n");
+        cacheable = FALSE;
         free(pmt_data);
         pmt_data = NULL; pmt_data_len = 0; pmt_data_used = 0;
       }
@@ -220,6 +307,7 @@ static int report_streams(TS_reader_p tsreader,
         // This is the continuation of a PMT packet, but we hadn't
         // started one yet
         print_err("!!! Discarding PMT continuation, no PMT started\n");
+        cacheable = FALSE;
         continue;
       }
 
@@ -258,22 +346,18 @@ static int report_streams(TS_reader_p tsreader,
         continue;
       }
 
-      if (last_pmt != NULL)
-        fprint_msg("\nPacket %d is PMT with PID %04x (%d)"
-                   " - content changed\n",ii+1,pid,pid);
-      else if (!verbose)
-        fprint_msg("\nPacket %d is PMT with PID %04x (%d)\n",ii+1,pid,pid);
-
-      report_pmt(TRUE,"  ",this_pmt);
+      report_PMT(ii+1,pid,this_pmt,last_pmt != NULL,verbose);
+      if (cacheable && probe_cache_add_PMT(cache,ii+1,pid,this_pmt))
+        cacheable = FALSE;
 
       free_pmt(&last_pmt);
       last_pmt = this_pmt;
     }
   }
 
-  fprint_msg("\nFound %d PAT packet%s and %d PMT packet%s in %d TS packets\n",
-             num_pats,(num_pats==1?"":"s"),
-             num_pmts,(num_pmts==1?"":"s"),max);
+  report_scan_totals(num_pats,num_pmts,max);
+  if (cacheable)
+    probe_cache_end_scan(cache,num_pats,num_pmts,eof_at);
 
   free_pidint_list(&last_prog_list);
   free_pmt(&last_pmt);
@@ -302,6 +386,13 @@ static void print_usage()
     "  -verbose, -v       Output extra information about packets\n"
     "  -max <n>, -m <n>   Number of TS packets to scan. Defaults to 10000.\n"
     "  -repeat <n>        Look for <n> PMT packets, and report on each\n"
+    "  -cache             Remember what is found in a cache file alongside\n"
+    "                     <infile> (named <infile>" PROBE_CACHE_SUFFIX "), and use it\n"
+    "                     instead of reading <infile> if the same question is\n"
+    "                     asked again and <infile> has not changed since. The\n"
+    "                     cache is shared with stream_type. It is not used\n"
+    "                     with -verbose (but is still updated).\n"
+    "  -cachefile <file>  As -cache, but use the given cache file.\n"
     );
 }
 
@@ -314,8 +405,11 @@ int main(int argc, char **argv)
   int    verbose = FALSE; // True => output diagnostic/progress messages
   int    lookfor = 1;
   int    err = 0;
+  int    use_cache = FALSE;
+  char  *cache_name = NULL;
 
-  TS_reader_p  tsreader = NULL;
+  TS_reader_p    tsreader = NULL;
+  probe_cache_p  cache = NULL;
 
   int    ii = 1;
 
@@ -369,6 +463,17 @@ int main(int argc, char **argv)
         if (err) return 1;
         ii++;
       }
+      else if (!strcmp("-cache",argv[ii]))
+      {
+        use_cache = TRUE;
+      }
+      else if (!strcmp("-cachefile",argv[ii]))
+      {
+        CHECKARG("tsinfo",ii);
+        use_cache = TRUE;
+        cache_name = argv[ii+1];
+        ii++;
+      }
       else if (!strcmp("-stdin",argv[ii]))
       {
         use_stdin = TRUE;
@@ -403,23 +508,57 @@ int main(int argc, char **argv)
     return 1;
   }
 
+  if (use_cache)
+  {
+    if (use_stdin)
+    {
+      print_err("### tsinfo: Cannot use a probe cache with -stdin\n");
+      return 1;
+    }
+    err = build_probe_cache(input_name,cache_name,&cache);
+    if (err)
+    {
+      fprint_err("### tsinfo: Unable to use a probe cache for %s\n",
+                 input_name);
+      return 1;
+    }
+    if (!verbose && cache->have_scan && cache->scan_max == max)
+    {
+      fprint_msg("Reading from %s\n",input_name);
+      fprint_msg("Using cached results from %s\n",cache->filename);
+      report_cached_streams(cache);
+      free_probe_cache(&cache);
+      return 0;
+    }
+  }
+
   err = open_file_for_TS_read((use_stdin?NULL:input_name),&tsreader);
   if (err)
   {
     fprint_err("### tsinfo: Unable to open input file %s for reading TS\n",
                use_stdin?"<stdin>":input_name);
+    free_probe_cache(&cache);
     return 1;
   }
   fprint_msg("Reading from %s\n",(use_stdin?"<stdin>":input_name));
 
-  err = report_streams(tsreader,max,verbose);
+  err = report_streams(tsreader,max,verbose,cache);
   if (err)
   {
     print_err("### tsinfo: Error reporting on stream\n");
     (void) close_TS_reader(&tsreader);
+    free_probe_cache(&cache);
     return 1;
   }
 
+  if (cache != NULL)
+  {
+    // Failing to update the cache doesn't invalidate what we've reported
+    if (write_probe_cache(cache))
+      print_err("!!! tsinfo: Unable to update probe cache\n");
+    free_probe_cache(&cache);
+  }
+
   err = close_TS_reader(&tsreader);
   if (err) return 1;
 
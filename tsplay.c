@@ -52,6 +52,11 @@
 #include "ps_fns.h"
 #include "pes_fns.h"
 #include "pidint_fns.h"
+#include "ts_fns.h"
+#include "tscompact_fns.h"
+#include "tsindex_fns.h"
+#include "multifile_fns.h"
+#include "metrics_fns.h"
 
 static void print_usage(int summary)
 {
@@ -103,6 +108,15 @@ static void print_usage(int summary)
     "\n"
     "  -tcp              Output to the host is via TCP.\n"
     "  -udp              Output to the host is via UDP (the default).\n"
+    "\n"
+    "  -pcap <file>      Instead of sending the UDP datagrams to the host\n"
+    "                    (which defaults to 127.0.0.1 for this), record them\n"
+    "                    in pcap file <file>, with the headers they would\n"
+    "                    have had, each stamped with the time it was due to\n"
+    "                    be sent. Use pcapreport to analyse the timing.\n"
+    "  -pcapactual <file>\n"
+    "                    With -pcap, also record the datagrams to <file>,\n"
+    "                    stamped with the time they were actually written.\n"
     );
   if (summary)
     print_msg(
@@ -123,9 +137,21 @@ static void print_usage(int summary)
     "                    network interface to use. This may not be supported\n"
     "                    on some versions of Windows.\n"
     "\n"
+    "  -metrics <port>\n"
+    "  -metrics <host>:<port>\n"
+    "  -metrics <path>   Publish live metrics (circular buffer occupancy, data\n"
+    "                    sent, pacing error, etc.) in Prometheus text format,\n"
+    "                    over HTTP on the given TCP port (on 127.0.0.1 unless\n"
+    "                    a host is given), or Unix domain socket <path>.\n"
+    "                    Not supported on Windows.\n"
+    "\n"
     "General Switches:\n"
     "  -quiet, -q        Only output error messages\n"
     "  -verbose, -v      Output progress messages\n"
+    "  -diag-limit <n>   Only show the first <n> messages about each sort of\n"
+    "                    problem in the input (lost TS sync, broken PES\n"
+    "                    packets, and so on), then just count them. 0 shows\n"
+    "                    all of them. The default is 0.\n"
     "  -help <subject>   Show help on a particular subject\n"
     "  -help             Summarise the <subject>s that can be specified\n"
     "\n"
@@ -294,6 +320,23 @@ static void print_help_ps()
     "  -dolby dvb       Use stream type 0x06 (the default)\n"
     "  -dolby atsc      Use stream type 0x81\n"
     "\n"
+    "Part of the data may be played, by time (as given by the pack header\n"
+    "SCRs, in seconds from the first pack header). The packs are found\n"
+    "without reading the data before them, so this is quick even for large\n"
+    "files, but does need input from a named file:\n"
+    "\n"
+    "  -starttime <t>    Start at the first PS pack at or after <t> seconds.\n"
+    "  -endtime <t>      Stop at the first PS pack at or after <t> seconds.\n"
+    "                    With -loop, it is this part of the data that is\n"
+    "                    played repeatedly.\n"
+    "\n"
+    "-starttime may also be used with a TS recording that has an index (as\n"
+    "written by tsrecord to <infile>.idx). Playing then starts at the first\n"
+    "random access point at or after <t> seconds (or the first PCR, if the\n"
+    "index has no pictures), in whichever chunk of the recording that is in,\n"
+    "and continues through each later chunk the index names, to the end of\n"
+    "the recording. -endtime and -loop cannot be used in this case.\n"
+    "\n"
     "Finally, it is occasionally useful to tweak how often PAT/PMT are written,\n"
     "and how much padding the stream starts with:\n"
     "\n"
@@ -338,6 +381,7 @@ int main(int argc, char **argv)
   int    had_input_name = FALSE;
   int    had_output_name = FALSE;
   int    input   = -1;
+  TS_reader_p  tsreader = NULL;  // Only used for compact or indexed TS input
   int    max     = 0;     // The maximum number of TS packets to read (or 0)
   int    quiet   = FALSE;
   int    verbose = FALSE;
@@ -353,6 +397,10 @@ int main(int argc, char **argv)
   int                   port = 88;             // the port to connect to
   int    use_network = FALSE;
   char *multicast_if = NULL;                   // IP address of multicast i/f
+  char *metrics_where = NULL;                  // where to publish metrics
+  metrics_p metrics = NULL;
+  char *pcap_name = NULL;                      // record to pcap, not UDP
+  char *pcap_actual_name = NULL;               // and also with actual times
 
   tsplay_output_pace_mode pace_mode = TSPLAY_OUTPUT_PACE_PCR2_TS;
 
@@ -367,6 +415,14 @@ int main(int argc, char **argv)
   int     repeat_program_every = 100;
   int     pad_start = 8;
   int     input_is_dvd = TRUE;
+  double  start_time = 0.0;
+  double  end_time = 0.0;
+
+  // TS input with an index (as written by tsrecord) can also use -starttime
+  int       use_index = FALSE;
+  int       num_chunks = 0;      // the files the index says to play,
+  char    **chunk_names = NULL;  // starting with the one to start in
+  offset_t  index_offset = 0;    // and where in it
 
   int     video_stream = -1;
   int     audio_stream = -1;
@@ -470,6 +526,30 @@ int main(int argc, char **argv)
         multicast_if = argv[ii+1];
         ii++;
       }
+      else if (!strcmp("-metrics",argv[ii]))
+      {
+        CHECKARG("tsplay",ii);
+        metrics_where = argv[ii+1];
+        ii++;
+      }
+      else if (!strcmp("-pcap",argv[ii]))
+      {
+        CHECKARG("tsplay",ii);
+        if (how == TS_W_STDOUT || how == TS_W_FILE || how == TS_W_TCP)
+        {
+          print_err("### tsplay: -pcap only makes sense with UDP output\n");
+          return 1;
+        }
+        how = TS_W_PCAP;
+        pcap_name = argv[ii+1];
+        ii++;
+      }
+      else if (!strcmp("-pcapactual",argv[ii]))
+      {
+        CHECKARG("tsplay",ii);
+        pcap_actual_name = argv[ii+1];
+        ii++;
+      }
       else if (!strcmp("-stdout",argv[ii]))
       {
         had_output_name = TRUE;  // more or less
@@ -506,6 +586,11 @@ int main(int argc, char **argv)
           print_err("### tsplay: -tcp does not make sense with file output\n");
           return 1;
         }
+        if (how == TS_W_PCAP)
+        {
+          print_err("### tsplay: -tcp does not make sense with -pcap\n");
+          return 1;
+        }
         use_network = TRUE;
         how = TS_W_TCP;
       }
@@ -517,7 +602,8 @@ int main(int argc, char **argv)
           return 1;
         }
         use_network = TRUE;
-        how = TS_W_UDP;
+        if (how != TS_W_PCAP)   // which is recording UDP anyway
+          how = TS_W_UDP;
       }
       else if (!strcmp("-max",argv[ii]) || !strcmp("-m",argv[ii]))
       {
@@ -526,6 +612,15 @@ int main(int argc, char **argv)
         if (err) return 1;
         ii++;
       }
+      else if (!strcmp("-diag-limit",argv[ii]))
+      {
+        int  limit;
+        CHECKARG("tsplay",ii);
+        err = int_value("tsplay",argv[ii],argv[ii+1],TRUE,10,&limit);
+        if (err) return 1;
+        set_diagnostic_limit(limit);
+        ii++;
+      }
       else if (!strcmp("-oldpace",argv[ii]))
       {
         pace_mode = TSPLAY_OUTPUT_PACE_FIXED;
@@ -627,6 +722,20 @@ int main(int argc, char **argv)
         if (err) return 1;
         ii++;
       }
+      else if (!strcmp("-starttime",argv[ii]))
+      {
+        CHECKARG("tsplay",ii);
+        err = double_value("tsplay",argv[ii],argv[ii+1],TRUE,&start_time);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-endtime",argv[ii]))
+      {
+        CHECKARG("tsplay",ii);
+        err = double_value("tsplay",argv[ii],argv[ii+1],TRUE,&end_time);
+        if (err) return 1;
+        ii++;
+      }
       else if (!strcmp("-ignore",argv[ii]))
       {
         CHECKARG("tsplay",ii);
@@ -712,6 +821,18 @@ int main(int argc, char **argv)
     return 1;
   }
 
+  // When recording to pcap, we don't *need* a host to pretend to send to
+  if (how == TS_W_PCAP && !had_output_name)
+  {
+    output_name = "127.0.0.1";
+    had_output_name = TRUE;
+  }
+  if (pcap_actual_name != NULL && how != TS_W_PCAP)
+  {
+    print_err("### tsplay: -pcapactual requires -pcap\n");
+    return 1;
+  }
+
   // We *need* some output...
   if (!had_output_name)
   {
@@ -731,7 +852,8 @@ int main(int argc, char **argv)
   }
 
   // This is an important check
-  if (max > 0 && how == TS_W_UDP && (max / 7) < context.circ_buf_size)
+  if (max > 0 && (how == TS_W_UDP || how == TS_W_PCAP) &&
+      (max / 7) < context.circ_buf_size)
   {
     fprint_err("### tsplay: -max %d cannot work with -buffer %d"
                " - max must be at least %d",max,
@@ -749,7 +871,56 @@ int main(int argc, char **argv)
   else if (pace_mode == TSPLAY_OUTPUT_PACE_PCR1)
     context.pcr_mode = TSWRITE_PCR_MODE_PCR1;
 
-  if (input_name)
+  // A recording made by tsrecord has an index, which lets us start part
+  // way through it without reading up to there
+  if (input_name && start_time > 0.0)
+  {
+    char  *index_name = malloc(strlen(input_name) + 5);
+    if (index_name == NULL)
+    {
+      print_err("### tsplay: Unable to allocate memory\n");
+      return 1;
+    }
+    sprintf(index_name,"%s.idx",input_name);
+    if (is_TS_index_file(index_name))
+    {
+      if (end_time > 0.0 || loop)
+      {
+        fprint_err("### tsplay: -endtime and -loop cannot be used when"
+                   " starting from the index %s\n",index_name);
+        free(index_name);
+        return 1;
+      }
+      err = find_TS_index_start(index_name,start_time,&num_chunks,
+                                &chunk_names,&index_offset);
+      if (err)
+      {
+        fprint_err("### tsplay: Unable to use index %s to start %.2f"
+                   " seconds in\n",index_name,start_time);
+        free(index_name);
+        return 1;
+      }
+      use_index = TRUE;
+      if (num_chunks > 0)
+        input_name = chunk_names[0];
+    }
+    free(index_name);
+  }
+
+  if (input_name && is_compact_TS_file(input_name))
+  {
+    // Reinstate its null packets, so that it plays out with the
+    // original timing
+    err = open_compact_TS_for_TS_read(input_name,TRUE,&tsreader);
+    if (err)
+    {
+      fprint_err("### tsplay: Unable to open input file %s\n",input_name);
+      return 1;
+    }
+    input = -1;
+    is_TS = TRUE;
+  }
+  else if (input_name)
   {
     input = open_binary_file(input_name,FALSE);
     if (input == -1)
@@ -772,15 +943,94 @@ int main(int argc, char **argv)
     input = STDIN_FILENO;
     is_TS = TRUE;                       // an assertion
   }
+  if (use_index)
+  {
+    if (!is_TS || tsreader != NULL)
+    {
+      fprint_err("### tsplay: %s has an index, but is not a plain TS file\n",
+                 input_name);
+      (void) close_file(input);
+      (void) close_TS_reader(&tsreader);
+      free_TS_index_chunk_names(&num_chunks,&chunk_names);
+      return 1;
+    }
+    if (num_chunks > 0)
+    {
+      // Read the chunk we start in and all those after it, in turn
+      multifile_p  multifile;
+      (void) close_file(input);
+      input = -1;
+      err = build_multifile(num_chunks,chunk_names,&multifile);
+      if (err)
+      {
+        fprint_err("### tsplay: Unable to open the chunks of the recording,"
+                   " starting with %s\n",input_name);
+        free_TS_index_chunk_names(&num_chunks,&chunk_names);
+        return 1;
+      }
+      err = build_TS_reader_with_fns(multifile,read_multifile,seek_multifile,
+                                     &tsreader);
+      if (err)
+      {
+        print_err("### tsplay: Unable to build TS reader\n");
+        (void) close_multifile(&multifile);
+        free_TS_index_chunk_names(&num_chunks,&chunk_names);
+        return 1;
+      }
+      tsreader->close_fn = close_multifile_handle;
+    }
+    else
+    {
+      err = build_TS_reader(input,&tsreader);
+      if (err)
+      {
+        print_err("### tsplay: Unable to build TS reader\n");
+        (void) close_file(input);
+        return 1;
+      }
+      input = -1;  // it now belongs to `tsreader`
+    }
+    err = seek_using_TS_reader(tsreader,index_offset);
+    if (err)
+    {
+      fprint_err("### tsplay: Unable to seek to " OFFSET_T_FORMAT " in %s\n",
+                 index_offset,input_name);
+      (void) close_TS_reader(&tsreader);
+      free_TS_index_chunk_names(&num_chunks,&chunk_names);
+      return 1;
+    }
+    if (!quiet)
+      fprint_msg("Starting %.2f seconds in (according to the index),"
+                 " at offset " OFFSET_T_FORMAT "\n",start_time,index_offset);
+  }
+  else if (is_TS && (start_time > 0.0 || end_time > 0.0))
+  {
+    print_err("### tsplay: -starttime and -endtime are only supported"
+              " for PS input, or for TS input with an index\n");
+    (void) close_file(input);
+    (void) close_TS_reader(&tsreader);
+    return 1;
+  }
   if (!quiet)
-    fprint_msg("Reading from  %s%s\n",input_name,(loop?" (and looping)":""));
+  {
+    if (num_chunks > 1)
+      fprint_msg("Reading from  %s (and the %d chunk%s after it)\n",
+                 input_name,num_chunks-1,(num_chunks==2?"":"s"));
+    else
+      fprint_msg("Reading from  %s%s\n",input_name,(loop?" (and looping)":""));
+  }
 
-  err = tswrite_open(how,output_name,multicast_if,port,quiet,
-                     &tswriter);
+  if (how == TS_W_PCAP)
+    err = tswrite_open_pcap(pcap_name,pcap_actual_name,output_name,port,quiet,
+                            &tswriter);
+  else
+    err = tswrite_open(how,output_name,multicast_if,port,quiet,
+                       &tswriter);
   if (err)
   {
     fprint_err("### tsplay: Cannot open/connect to %s\n",output_name);
     (void) close_file(input);
+    (void) close_TS_reader(&tsreader);
     return 1;
   }
 
@@ -807,10 +1057,24 @@ int main(int argc, char **argv)
     if (max)
       fprint_msg("Stopping after at most %d packets\n",max);
 
-    if (how == TS_W_UDP)
+    if (how == TS_W_UDP || how == TS_W_PCAP)
       tswrite_report_args(&context);
   }
 
+  if (metrics_where != NULL)
+  {
+    err = start_metrics_server("tsplay",metrics_where,quiet,&metrics);
+    if (err)
+    {
+      print_err("### tsplay: Unable to publish metrics\n");
+      (void) close_file(input);
+      (void) close_TS_reader(&tsreader);
+      (void) tswrite_close(tswriter,TRUE);
+      return 1;
+    }
+    tswrite_set_metrics(tswriter,claim_metrics_session(metrics));
+  }
+
   if (drop_packets)
   {
     if (!quiet)
@@ -825,19 +1089,24 @@ int main(int argc, char **argv)
 
   // We can only use buffered output for TCP/IP and UDP
   // (it doesn't make much sense for output to a file)
-  if (how == TS_W_UDP)
+  if (how == TS_W_UDP || how == TS_W_PCAP)
   {
     err = tswrite_start_buffering_from_context(tswriter,&context);
     if (err)
     {
       print_err("### tsplay: Error setting up buffering\n");
       (void) close_file(input);
+      (void) close_TS_reader(&tsreader);
       (void) tswrite_close(tswriter,TRUE);
+      (void) stop_metrics_server(&metrics);
       return 1;
     }
   }
 
-  if (is_TS)
+  if (tsreader != NULL)
+    err = play_TS_stream_from_reader(tsreader,tswriter,pace_mode,pid_to_ignore,
+                                     override_pcr_pid,max,loop,quiet,verbose);
+  else if (is_TS)
   {
     err = play_TS_stream(input,tswriter,pace_mode,pid_to_ignore,
                          override_pcr_pid,max,loop,quiet,verbose);
@@ -848,13 +1117,16 @@ int main(int argc, char **argv)
                          want_h262,input_is_dvd,
                          video_stream,audio_stream,want_ac3_audio,
                          want_dolby_as_dvb,pmt_pid,pcr_pid,
-                         video_pid,TRUE,audio_pid,max,loop,
-                         verbose,quiet);
+                         video_pid,TRUE,audio_pid,max,start_time,end_time,
+                         loop,verbose,quiet);
+  report_diagnostics();
   if (err)
   {
     print_err("### tsplay: Error playing stream\n");
     (void) close_file(input);
+    (void) close_TS_reader(&tsreader);
     (void) tswrite_close(tswriter,TRUE);
+    (void) stop_metrics_server(&metrics);
     return 1;
   }
 
@@ -866,19 +1138,27 @@ int main(int argc, char **argv)
     fprint_msg("Elapsed time %.1fs\n",difftime(end,start));
   }
   
-  err = close_file(input);
+  if (tsreader != NULL)
+    err = close_TS_reader(&tsreader);
+  else
+    err = close_file(input);
   if (err)
   {
     fprint_err("### tsplay: Error closing input file %s\n",input_name);
     (void) tswrite_close(tswriter,TRUE);
+    (void) stop_metrics_server(&metrics);
     return 1;
   }
   err = tswrite_close(tswriter,quiet);
   if (err)
   {
     fprint_err("### tsplay: Error closing output to %s\n",output_name);
+    (void) stop_metrics_server(&metrics);
     return 1;
   }
+  err = stop_metrics_server(&metrics);
+  free_TS_index_chunk_names(&num_chunks,&chunk_names);
+  if (err) return 1;
   return 0;
 }
 
@@ -31,9 +31,43 @@
 #ifndef _tsplay_fns
 #define _tsplay_fns
 
+#include "ts_defns.h"
 #include "tswrite_defns.h"
 #include "tsplay_defns.h"
 
+/*
+ * Read TS packets and then output them.
+ *
+ * Assumes (strongly) that it is starting from the start of the file.
+ *
+ * - `tsreader` is the TS reader to read from. It is not freed.
+ * - `tswriter` is our (maybe buffered) writer
+ * - if `pid_to_ignore` is non-zero, then any TS packets with that PID
+ *   will not be written out (note: any PCR information in them may still
+ *   be used)
+ * - if `scan_for_PCRs`, use a read-ahead buffer to find the *next* PCR,
+ *   and thus allow exact timing of packets.
+ * - if we are using the PCR read-ahead buffer, and `override_pcr_pid` is
+ *   non-zero, then it is the PID to use for PCRs, ignoring any value found in
+ *   a PMT
+ * - if `max` is greater than zero, then at most `max` TS packets should
+ *   be read from the input
+ * - if `loop`, play the input file repeatedly (up to `max` TS packets
+ *   if applicable)
+ * - if `quiet` is true, then only error messages should be written out
+ * - if `verbose` is true, then give extra progress messages
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+extern int play_TS_stream_from_reader(TS_reader_p tsreader,
+                                      TS_writer_p tswriter,
+                                      const tsplay_output_pace_mode pace_mode,
+                                      uint32_t    pid_to_ignore,
+                                      uint32_t    override_pcr_pid,
+                                      int         max,
+                                      int         loop,
+                                      int         quiet,
+                                      int         verbose);
 /*
  * Read TS packets and then output them.
  *
@@ -101,6 +135,8 @@ extern int play_TS_stream(int         input,
  * - `audio_pid` is the PID for the audio we write
  * - if `max` is non-zero, then we want to stop reading after we've read
  *   `max` packets
+ * - if `start_time` or `end_time` is non-zero, then we want to play only
+ *   the data between those times, in seconds (see `set_PS_time_range`)
  * - if `loop`, play the input file repeatedly (up to `max` TS packets
  *   if applicable)
  * - if `verbose` then we want to output diagnostic information
@@ -127,6 +163,8 @@ extern int play_PS_stream(int          input,
                           int          keep_audio,
                           uint32_t     audio_pid,
                           int          max,
+                          double       start_time,
+                          double       end_time,
                           int          loop,
                           int          verbose,
                           int          quiet);
@@ -0,0 +1,995 @@
+/*
+ * Record one or more Transport Streams arriving over UDP (or RTP) to disk,
+ * indexing them as they are written.
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE      // for recvmmsg
+#endif // __linux__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#endif // _WIN32
+
+#include "compat.h"
+#include "ts_fns.h"
+#include "tsindex_fns.h"
+#include "misc_fns.h"
+#include "printing_fns.h"
+#include "version.h"
+
+#ifdef _WIN32
+
+int main(int argc, char **argv)
+{
+  print_err("### tsrecord: Not supported on Windows\n");
+  return 1;
+}
+
+#else // _WIN32
+
+// How many datagrams we ask for at once
+#define RECORD_BATCH  64
+
+// The biggest datagram we expect (allowing for jumbo frames)
+#define RECORD_MAX_DATAGRAM  9216
+
+// Output is written in blocks of this alignment
+#define RECORD_ALIGN  4096
+
+#define RECORD_DEFAULT_BUFFER  (1024*1024)     // bytes
+#define RECORD_DEFAULT_RCVBUF  (8*1024*1024)   // bytes
+
+// How often (in microseconds) we make sure the data and index on disk are
+// reasonably up-to-date
+#define RECORD_FLUSH_INTERVAL  1000000
+
+// A stream we are recording
+struct record_stream
+{
+  char       *source;        // as given by the user, for messages
+  int         socket;
+  char       *output_name;   // the output file name (pattern)
+  int         output;        // the current output file
+  char       *chunk_name;    // and its name
+  int         chunk;         // and its number
+  uint64_t    chunk_bytes;   // how much has been recorded to it
+  uint64_t    chunk_start;   // and when it started (microseconds)
+
+  // Data waiting to be written. `buffer_start` is the offset in the chunk
+  // of its first byte
+  byte       *buffer;
+  int         buffer_used;
+  uint64_t    buffer_start;
+
+  // Where recvmmsg puts the datagrams
+  byte       *datagrams;
+#ifdef __linux__
+  struct mmsghdr  msgs[RECORD_BATCH];
+#endif // __linux__
+  struct iovec    iovs[RECORD_BATCH];
+  int             lengths[RECORD_BATCH];    // what we actually received
+  int             truncated[RECORD_BATCH];  // TRUE if it didn't fit
+
+  TS_indexer_p  indexer;
+
+  int         is_rtp;        // -1 if we don't know yet
+  int         had_rtp_seq;
+  uint16_t    rtp_seq;       // the next RTP sequence number we expect
+
+  // Statistics
+  uint64_t    num_datagrams;
+  uint64_t    num_bytes;
+  uint64_t    num_batches;
+  uint32_t    num_lost;
+  uint32_t    num_truncated;
+  uint32_t    num_writes;
+};
+typedef struct record_stream *record_stream_p;
+
+// What the user asked for
+struct record_options
+{
+  int       buffer_size;     // output buffer size (bytes)
+  int       rcvbuf;          // socket receive buffer size (bytes)
+  uint64_t  chunk_size;      // bytes, 0 for no limit
+  uint64_t  chunk_time;      // microseconds, 0 for no limit
+  int       index;           // write an index?
+  char     *mcastif;         // interface to receive multicast on, or NULL
+  int       quiet;
+  int       verbose;
+};
+
+static volatile sig_atomic_t  stop_recording = FALSE;
+
+static void stop_handler(int sig)
+{
+  stop_recording = TRUE;
+}
+
+static uint64_t time_now(void)
+{
+  struct timeval  now;
+  gettimeofday(&now,NULL);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/*
+ * Open a socket to receive from `source` (<host>:<port>, where <host> may
+ * be a multicast group to join, a local address, or empty for any address).
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int open_record_socket(char                  *source,
+                              struct record_options *options,
+                              int                   *sock)
+{
+  int     err;
+  char   *copy = strdup(source);
+  char   *hostname;
+  int     port = 0;
+  int     one = 1;
+  int     rcvbuf = options->rcvbuf;
+  struct sockaddr_in  addr;
+  socklen_t  len = sizeof(rcvbuf);
+  int     fd;
+
+  if (copy == NULL)
+  {
+    print_err("### tsrecord: Unable to allocate memory\n");
+    return 1;
+  }
+  err = host_value("tsrecord",NULL,copy,&hostname,&port);
+  if (err || port == 0)
+  {
+    if (!err)
+      fprint_err("### tsrecord: No port given in '%s'\n",source);
+    free(copy);
+    return 1;
+  }
+
+  memset(&addr,0,sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (hostname[0] != '\0')
+  {
+    struct hostent *hp = gethostbyname(hostname);
+    if (hp == NULL)
+    {
+      fprint_err("### tsrecord: Unable to resolve host %s\n",hostname);
+      free(copy);
+      return 1;
+    }
+    memcpy(&addr.sin_addr.s_addr,hp->h_addr,hp->h_length);
+  }
+
+  fd = socket(AF_INET,SOCK_DGRAM,0);
+  if (fd == -1)
+  {
+    fprint_err("### tsrecord: Unable to create socket: %s\n",strerror(errno));
+    free(copy);
+    return 1;
+  }
+  // Several of us may want to listen to the same multicast group
+  (void) setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+
+  if (setsockopt(fd,SOL_SOCKET,SO_RCVBUF,&rcvbuf,sizeof(rcvbuf)) ||
+      getsockopt(fd,SOL_SOCKET,SO_RCVBUF,&rcvbuf,&len))
+    fprint_err("!!! tsrecord: Unable to set receive buffer size for %s: %s\n",
+               source,strerror(errno));
+  else if (rcvbuf < options->rcvbuf && !options->quiet)
+    fprint_msg("!!! tsrecord: Asked for a receive buffer of %d bytes for %s,"
+               " but got %d (see net.core.rmem_max)\n",options->rcvbuf,
+               source,rcvbuf);
+
+  if (bind(fd,(struct sockaddr *)&addr,sizeof(addr)))
+  {
+    fprint_err("### tsrecord: Unable to bind to %s: %s\n",source,
+               strerror(errno));
+    close(fd);
+    free(copy);
+    return 1;
+  }
+
+  if (IN_MULTICAST(ntohl(addr.sin_addr.s_addr)))
+  {
+    struct ip_mreq  mreq;
+    mreq.imr_multiaddr = addr.sin_addr;
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (options->mcastif != NULL)
+      mreq.imr_interface.s_addr = inet_addr(options->mcastif);
+    if (setsockopt(fd,IPPROTO_IP,IP_ADD_MEMBERSHIP,&mreq,sizeof(mreq)))
+    {
+      fprint_err("### tsrecord: Unable to join multicast group %s: %s\n",
+                 hostname,strerror(errno));
+      close(fd);
+      free(copy);
+      return 1;
+    }
+  }
+
+  free(copy);
+  *sock = fd;
+  return 0;
+}
+
+/*
+ * Work out the name of chunk `chunk` of the output `name`. If we are not
+ * splitting the output, it is just `name`, otherwise we add the chunk
+ * number before any extension, so "rec.ts" gives "rec-0000.ts", etc.
+ *
+ * Returns the (malloc'ed) name, or NULL if we run out of memory.
+ */
+static char *chunk_filename(char                  *name,
+                            int                    chunk,
+                            struct record_options *options)
+{
+  char  *result = malloc(strlen(name) + 12);
+  char  *dot = strrchr(name,'.');
+  char  *slash = strrchr(name,'/');
+
+  if (result == NULL)
+    return NULL;
+  if (options->chunk_size == 0 && options->chunk_time == 0)
+    strcpy(result,name);
+  else if (dot == NULL || (slash != NULL && dot < slash))
+    sprintf(result,"%s-%04d",name,chunk);
+  else
+    sprintf(result,"%.*s-%04d%s",(int)(dot - name),name,chunk,dot);
+  return result;
+}
+
+/*
+ * Write out the start of a stream's output buffer. If `all` is FALSE, we
+ * only write out whole blocks, so that our writes stay aligned.
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int write_record_buffer(record_stream_p  stream,
+                               int              all)
+{
+  int  length = stream->buffer_used;
+  int  done = 0;
+
+  if (!all)
+    length -= length % RECORD_ALIGN;
+  if (length == 0)
+    return 0;
+
+  while (done < length)
+  {
+    ssize_t  written = write(stream->output,stream->buffer + done,
+                             length - done);
+    if (written == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      fprint_err("### tsrecord: Error writing to %s: %s\n",
+                 stream->chunk_name,strerror(errno));
+      return 1;
+    }
+    done += written;
+  }
+  stream->num_writes ++;
+
+  if (length < stream->buffer_used)
+    memmove(stream->buffer,stream->buffer + length,
+            stream->buffer_used - length);
+  stream->buffer_used -= length;
+  stream->buffer_start += length;
+  return 0;
+}
+
+/*
+ * Start the next chunk of output for a stream (or the first)
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int start_record_chunk(record_stream_p        stream,
+                              struct record_options *options,
+                              uint64_t               now)
+{
+  if (stream->output != -1)
+  {
+    if (write_record_buffer(stream,TRUE))
+      return 1;
+    if (close(stream->output))
+    {
+      fprint_err("### tsrecord: Error closing %s: %s\n",stream->chunk_name,
+                 strerror(errno));
+      return 1;
+    }
+    stream->chunk ++;
+  }
+  free(stream->chunk_name);
+
+  stream->chunk_name = chunk_filename(stream->output_name,stream->chunk,
+                                      options);
+  if (stream->chunk_name == NULL)
+  {
+    print_err("### tsrecord: Unable to allocate memory\n");
+    return 1;
+  }
+  stream->output = open(stream->chunk_name,O_WRONLY|O_CREAT|O_TRUNC,0644);
+  if (stream->output == -1)
+  {
+    fprint_err("### tsrecord: Unable to open %s: %s\n",stream->chunk_name,
+               strerror(errno));
+    return 1;
+  }
+  stream->chunk_bytes = 0;
+  stream->chunk_start = now;
+  stream->buffer_start = 0;
+
+  if (stream->indexer != NULL)
+    TS_indexer_new_chunk(stream->indexer,stream->chunk,stream->chunk_name);
+  if (options->verbose)
+    fprint_msg("%s: recording to %s\n",stream->source,stream->chunk_name);
+  return 0;
+}
+
+/*
+ * Record (and index) some data from a stream
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int record_data(record_stream_p        stream,
+                       struct record_options *options,
+                       byte                   data[],
+                       int                    length,
+                       uint64_t               now)
+{
+  // Is it time for a new chunk?
+  if (stream->chunk_bytes > 0 &&
+      ((options->chunk_size != 0 &&
+        stream->chunk_bytes + length > options->chunk_size) ||
+       (options->chunk_time != 0 &&
+        now - stream->chunk_start >= options->chunk_time)))
+  {
+    if (start_record_chunk(stream,options,now))
+      return 1;
+  }
+
+  if (stream->indexer != NULL)
+    TS_indexer_add_packets(stream->indexer,data,length,stream->chunk_bytes,
+                           now);
+  stream->chunk_bytes += length;
+
+  while (length > 0)
+  {
+    int  space = options->buffer_size - stream->buffer_used;
+    int  count = (length < space ? length : space);
+
+    memcpy(stream->buffer + stream->buffer_used,data,count);
+    stream->buffer_used += count;
+    data += count;
+    length -= count;
+    if (stream->buffer_used == options->buffer_size)
+    {
+      if (write_record_buffer(stream,FALSE))
+        return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Handle a datagram received on a stream - work out whether it is RTP,
+ * and if so check its sequence number and remove its header, and then
+ * record its content.
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int record_datagram(record_stream_p        stream,
+                           struct record_options *options,
+                           byte                   data[],
+                           int                    length,
+                           int                    truncated,
+                           uint64_t               now)
+{
+  stream->num_datagrams ++;
+  stream->num_bytes += length;
+  if (truncated)
+    stream->num_truncated ++;
+
+  if (length == 0)
+    return 0;
+
+  // The first datagram tells us whether we have RTP or just TS
+  if (stream->is_rtp == -1)
+  {
+    stream->is_rtp = (data[0] != 0x47 && (data[0] & 0xC0) == 0x80);
+    if (!options->quiet)
+      fprint_msg("%s: receiving %s\n",stream->source,
+                 (stream->is_rtp?"RTP":"UDP"));
+  }
+
+  if (stream->is_rtp)
+  {
+    int       header = 12;
+    uint16_t  seq;
+
+    if (length < header || (data[0] & 0xC0) != 0x80)
+      return 0;
+    header += 4 * (data[0] & 0x0F);       // CSRC identifiers
+    if ((data[0] & 0x10) && length >= header + 4)  // header extension
+      header += 4 + 4 * ((data[header+2] << 8) | data[header+3]);
+    if ((data[0] & 0x20) && length > header)  // padding
+      length -= data[length-1];
+    if (length < header)
+      return 0;
+
+    // Only media (MP2T) packets - not FEC or anything else that might
+    // share the port
+    if ((data[1] & 0x7F) != 33)
+      return 0;
+
+    seq = (data[2] << 8) | data[3];
+    if (stream->had_rtp_seq && seq != stream->rtp_seq)
+    {
+      uint16_t  lost = seq - stream->rtp_seq;
+      // A small step backwards is reordering or duplication, which we
+      // can't do anything about
+      if (lost < 0x8000)
+      {
+        stream->num_lost += lost;
+        if (stream->indexer != NULL)
+          TS_indexer_note_loss(stream->indexer,stream->chunk_bytes,lost);
+      }
+    }
+    stream->had_rtp_seq = TRUE;
+    stream->rtp_seq = seq + 1;
+
+    data += header;
+    length -= header;
+  }
+
+  return record_data(stream,options,data,length,now);
+}
+
+/*
+ * Read everything that is waiting on a stream's socket, in batches
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int receive_stream(record_stream_p        stream,
+                          struct record_options *options)
+{
+  for (;;)
+  {
+    int       count, ii;
+    uint64_t  now;
+
+#ifdef __linux__
+    for (ii = 0; ii < RECORD_BATCH; ii++)
+    {
+      stream->iovs[ii].iov_base = stream->datagrams + ii*RECORD_MAX_DATAGRAM;
+      stream->iovs[ii].iov_len = RECORD_MAX_DATAGRAM;
+      memset(&stream->msgs[ii],0,sizeof(stream->msgs[ii]));
+      stream->msgs[ii].msg_hdr.msg_iov = &stream->iovs[ii];
+      stream->msgs[ii].msg_hdr.msg_iovlen = 1;
+    }
+    count = recvmmsg(stream->socket,stream->msgs,RECORD_BATCH,MSG_DONTWAIT,
+                     NULL);
+    for (ii = 0; ii < count; ii++)
+    {
+      stream->lengths[ii] = stream->msgs[ii].msg_len;
+      stream->truncated[ii] = (stream->msgs[ii].msg_hdr.msg_flags & MSG_TRUNC);
+    }
+#else  // __linux__
+    // Without recvmmsg, we just read one datagram at a time
+    {
+      struct msghdr  msg;
+      ssize_t        length;
+      memset(&msg,0,sizeof(msg));
+      stream->iovs[0].iov_base = stream->datagrams;
+      stream->iovs[0].iov_len = RECORD_MAX_DATAGRAM;
+      msg.msg_iov = &stream->iovs[0];
+      msg.msg_iovlen = 1;
+      length = recvmsg(stream->socket,&msg,MSG_DONTWAIT);
+      count = (length == -1 ? -1 : 1);
+      if (count == 1)
+      {
+        stream->lengths[0] = length;
+        stream->truncated[0] = (msg.msg_flags & MSG_TRUNC);
+      }
+    }
+#endif // __linux__
+    if (count == -1)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return 0;
+      fprint_err("### tsrecord: Error receiving from %s: %s\n",
+                 stream->source,strerror(errno));
+      return 1;
+    }
+    if (count == 0)
+      return 0;
+
+    now = time_now();
+    stream->num_batches ++;
+    for (ii = 0; ii < count; ii++)
+    {
+      int  err = record_datagram(stream,options,
+                                 stream->datagrams + ii*RECORD_MAX_DATAGRAM,
+                                 stream->lengths[ii],stream->truncated[ii],
+                                 now);
+      if (err) return 1;
+    }
+
+    // If we didn't fill the batch, there's (probably) nothing left
+    if (count < RECORD_BATCH)
+      return 0;
+  }
+}
+
+/*
+ * Set up a stream to record `source` to `output_name`
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int start_record_stream(char                  *source,
+                               char                  *output_name,
+                               struct record_options *options,
+                               record_stream_p        stream)
+{
+  void  *buffer;
+
+  memset(stream,0,sizeof(*stream));
+  stream->source = source;
+  stream->output_name = output_name;
+  stream->output = -1;
+  stream->socket = -1;
+  stream->is_rtp = -1;
+
+  if (posix_memalign(&buffer,RECORD_ALIGN,options->buffer_size))
+  {
+    print_err("### tsrecord: Unable to allocate output buffer\n");
+    return 1;
+  }
+  stream->buffer = buffer;
+  stream->datagrams = malloc(RECORD_BATCH * RECORD_MAX_DATAGRAM);
+  if (stream->datagrams == NULL)
+  {
+    print_err("### tsrecord: Unable to allocate receive buffers\n");
+    return 1;
+  }
+
+  if (options->index)
+  {
+    int    err;
+    char  *index_name = malloc(strlen(output_name) + 5);
+    if (index_name == NULL)
+    {
+      print_err("### tsrecord: Unable to allocate memory\n");
+      return 1;
+    }
+    sprintf(index_name,"%s.idx",output_name);
+    err = build_TS_indexer(index_name,&stream->indexer);
+    free(index_name);
+    if (err) return 1;
+  }
+
+  if (open_record_socket(source,options,&stream->socket))
+    return 1;
+  return start_record_chunk(stream,options,time_now());
+}
+
+/*
+ * Finish recording a stream, and free its resources
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int stop_record_stream(record_stream_p        stream,
+                              struct record_options *options)
+{
+  int  err = 0;
+
+  if (stream->output != -1)
+  {
+    if (write_record_buffer(stream,TRUE))
+      err = 1;
+    if (close(stream->output))
+    {
+      fprint_err("### tsrecord: Error closing %s: %s\n",stream->chunk_name,
+                 strerror(errno));
+      err = 1;
+    }
+  }
+  if (stream->socket != -1)
+    close(stream->socket);
+
+  if (!options->quiet)
+  {
+    fprint_msg("%s: " LLU_FORMAT " datagram%s, " LLU_FORMAT " bytes, in "
+               LLU_FORMAT " batch%s (%.1f datagrams/batch), %u write%s"
+               " to %d file%s\n",stream->source,stream->num_datagrams,
+               (stream->num_datagrams==1?"":"s"),stream->num_bytes,
+               stream->num_batches,(stream->num_batches==1?"":"es"),
+               (stream->num_batches?(double)stream->num_datagrams/
+                stream->num_batches:0.0),
+               stream->num_writes,(stream->num_writes==1?"":"s"),
+               stream->chunk+1,(stream->chunk==0?"":"s"));
+    if (stream->num_lost)
+      fprint_msg("%s: !!! %u datagram%s lost (RTP sequence gaps)\n",
+                 stream->source,stream->num_lost,
+                 (stream->num_lost==1?"":"s"));
+    if (stream->num_truncated)
+      fprint_msg("%s: !!! %u datagram%s truncated (longer than %d bytes)\n",
+                 stream->source,stream->num_truncated,
+                 (stream->num_truncated==1?"":"s"),RECORD_MAX_DATAGRAM);
+    if (stream->indexer != NULL)
+    {
+      fprint_msg("%s: ",stream->source);
+      report_TS_indexer(stream->indexer);
+    }
+  }
+
+  if (close_TS_indexer(&stream->indexer))
+    err = 1;
+  free(stream->chunk_name);
+  free(stream->buffer);
+  free(stream->datagrams);
+  return err;
+}
+
+/*
+ * Record all our streams, until we are told to stop, or run out of time
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int record_streams(record_stream_p        streams,
+                          int                    num_streams,
+                          struct record_options *options,
+                          uint64_t               duration)
+{
+  int       ii;
+  uint64_t  start = time_now();
+  uint64_t  last_flush = start;
+  struct pollfd  *fds = calloc(num_streams,sizeof(struct pollfd));
+
+  if (fds == NULL)
+  {
+    print_err("### tsrecord: Unable to allocate memory\n");
+    return 1;
+  }
+  for (ii = 0; ii < num_streams; ii++)
+  {
+    fds[ii].fd = streams[ii].socket;
+    fds[ii].events = POLLIN;
+  }
+
+  while (!stop_recording)
+  {
+    uint64_t  now;
+    int       count = poll(fds,num_streams,100);
+
+    if (count == -1 && errno != EINTR)
+    {
+      fprint_err("### tsrecord: Error waiting for data: %s\n",
+                 strerror(errno));
+      free(fds);
+      return 1;
+    }
+    for (ii = 0; count > 0 && ii < num_streams; ii++)
+    {
+      if (fds[ii].revents & POLLIN)
+      {
+        if (receive_stream(&streams[ii],options))
+        {
+          free(fds);
+          return 1;
+        }
+      }
+    }
+
+    // Keep what is on disk reasonably up-to-date, without giving up our
+    // aligned writes (so a little data may still be waiting)
+    now = time_now();
+    if (now - last_flush >= RECORD_FLUSH_INTERVAL)
+    {
+      for (ii = 0; ii < num_streams; ii++)
+      {
+        if (write_record_buffer(&streams[ii],FALSE))
+        {
+          free(fds);
+          return 1;
+        }
+        if (streams[ii].indexer != NULL &&
+            TS_indexer_flush(streams[ii].indexer))
+        {
+          free(fds);
+          return 1;
+        }
+      }
+      last_flush = now;
+    }
+
+    if (duration != 0 && now - start >= duration)
+      break;
+  }
+  free(fds);
+  return 0;
+}
+
+static void print_usage()
+{
+  print_msg(
+    "Usage: tsrecord [switches] <source> <outfile> [<source> <outfile> ...]\n"
+    "\n"
+    );
+  REPORT_VERSION("tsrecord");
+  fprint_msg(
+    "\n"
+    "  Record Transport Streams arriving over UDP, or RTP, to disk, writing\n"
+    "  an index for each as it goes, so that the recordings can be searched\n"
+    "  by time or picture straight away.\n"
+    "\n"
+    "  Recording continues until interrupted (or see -time).\n"
+    "\n"
+    "Files:\n"
+    "  <source>   is <host>:<port>, where <host> may be a multicast group to\n"
+    "             join, or a local address, or may be omitted (as in ':1234')\n"
+    "             to receive on any address.\n"
+    "  <outfile>  is the file to record the stream to. If the recording is\n"
+    "             split (see -chunksize and -chunktime), a chunk number is\n"
+    "             added before the extension (e.g., rec-0000.ts, rec-0001.ts).\n"
+    "             The index is written to <outfile>.idx\n"
+    "\n"
+    "RTP is recognised automatically, and its header removed. Gaps in the RTP\n"
+    "sequence numbers are reported, and noted in the index.\n"
+    "\n"
+    "Switches:\n"
+    "  -err stdout        Write error messages to standard output (the default)\n"
+    "  -err stderr        Write error messages to standard error (Unix traditional)\n"
+    "  -verbose, -v       Output additional messages\n"
+    "  -quiet, -q         Only output error messages\n"
+    "  -time <secs>       Stop recording after <secs> seconds\n"
+    "  -chunksize <MB>    Start a new output file every <MB> megabytes\n"
+    "  -chunktime <secs>  Start a new output file every <secs> seconds\n"
+    "  -noindex           Don't write an index\n"
+    "  -buffer <KB>       Write the output in blocks of <KB> kilobytes.\n"
+    "                     The default is %d.\n"
+    "  -rcvbuf <KB>       Ask for a socket receive buffer of <KB> kilobytes.\n"
+    "                     The default is %d.\n"
+    "  -mcastif <ipaddr>  Join multicast groups on the network interface with\n"
+    "                     this address, instead of the default.\n"
+    "\n"
+    "The index is a text file. Each line after the first (a header) is an\n"
+    "entry: F (a new output file), N (first packet on a PID), S (a stream\n"
+    "type from the PMT), P (a PCR, and when it arrived), I (the start of a\n"
+    "picture, with its PTS, and K if it is a random access point), L (lost\n"
+    "datagrams) and finally C (packets per PID). Offsets are in bytes from\n"
+    "the start of the output file. See tsindex_defns.h for details.\n",
+    RECORD_DEFAULT_BUFFER/1024,RECORD_DEFAULT_RCVBUF/1024);
+}
+
+int main(int argc, char **argv)
+{
+  struct record_options  options;
+  record_stream_p  streams = NULL;
+  int     num_streams = 0;
+  int     num_started = 0;
+  char   *pending_source = NULL;
+  int     duration = 0;
+  int     err = 0;
+  int     ii = 1;
+
+  options.buffer_size = RECORD_DEFAULT_BUFFER;
+  options.rcvbuf = RECORD_DEFAULT_RCVBUF;
+  options.chunk_size = 0;
+  options.chunk_time = 0;
+  options.index = TRUE;
+  options.mcastif = NULL;
+  options.quiet = FALSE;
+  options.verbose = FALSE;
+
+  if (argc < 2)
+  {
+    print_usage();
+    return 0;
+  }
+
+  // Each source/output pair needs a stream, and there can't be more of
+  // them than there are arguments
+  streams = calloc(argc,sizeof(struct record_stream));
+  if (streams == NULL)
+  {
+    print_err("### tsrecord: Unable to allocate memory\n");
+    return 1;
+  }
+
+  while (ii < argc)
+  {
+    if (argv[ii][0] == '-')
+    {
+      if (!strcmp("--help",argv[ii]) || !strcmp("-h",argv[ii]) ||
+          !strcmp("-help",argv[ii]))
+      {
+        print_usage();
+        return 0;
+      }
+      else if (!strcmp("-verbose",argv[ii]) || !strcmp("-v",argv[ii]))
+      {
+        options.verbose = TRUE;
+        options.quiet = FALSE;
+      }
+      else if (!strcmp("-quiet",argv[ii]) || !strcmp("-q",argv[ii]))
+      {
+        options.verbose = FALSE;
+        options.quiet = TRUE;
+      }
+      else if (!strcmp("-time",argv[ii]))
+      {
+        CHECKARG("tsrecord",ii);
+        err = int_value("tsrecord",argv[ii],argv[ii+1],TRUE,10,&duration);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-chunksize",argv[ii]))
+      {
+        int  temp;
+        CHECKARG("tsrecord",ii);
+        err = int_value("tsrecord",argv[ii],argv[ii+1],TRUE,10,&temp);
+        if (err) return 1;
+        options.chunk_size = (uint64_t)temp * 1024 * 1024;
+        ii++;
+      }
+      else if (!strcmp("-chunktime",argv[ii]))
+      {
+        int  temp;
+        CHECKARG("tsrecord",ii);
+        err = int_value("tsrecord",argv[ii],argv[ii+1],TRUE,10,&temp);
+        if (err) return 1;
+        options.chunk_time = (uint64_t)temp * 1000000;
+        ii++;
+      }
+      else if (!strcmp("-noindex",argv[ii]))
+        options.index = FALSE;
+      else if (!strcmp("-buffer",argv[ii]))
+      {
+        int  temp;
+        CHECKARG("tsrecord",ii);
+        err = int_value_in_range("tsrecord",argv[ii],argv[ii+1],4,256*1024,10,
+                                 &temp);
+        if (err) return 1;
+        // Keep it a whole number of blocks
+        options.buffer_size = (temp * 1024) / RECORD_ALIGN * RECORD_ALIGN;
+        ii++;
+      }
+      else if (!strcmp("-rcvbuf",argv[ii]))
+      {
+        int  temp;
+        CHECKARG("tsrecord",ii);
+        err = int_value_in_range("tsrecord",argv[ii],argv[ii+1],1,1024*1024,10,
+                                 &temp);
+        if (err) return 1;
+        options.rcvbuf = temp * 1024;
+        ii++;
+      }
+      else if (!strcmp("-mcastif",argv[ii]))
+      {
+        CHECKARG("tsrecord",ii);
+        options.mcastif = argv[ii+1];
+        ii++;
+      }
+      else if (!strcmp("-err",argv[ii]))
+      {
+        CHECKARG("tsrecord",ii);
+        if (!strcmp(argv[ii+1],"stderr"))
+          redirect_output_stderr();
+        else if (!strcmp(argv[ii+1],"stdout"))
+          redirect_output_stdout();
+        else
+        {
+          fprint_err("### tsrecord: "
+                     "Unrecognised option '%s' to -err (not 'stdout' or"
+                     " 'stderr')\n",argv[ii+1]);
+          return 1;
+        }
+        ii++;
+      }
+      else
+      {
+        fprint_err("### tsrecord: "
+                   "Unrecognised command line switch '%s'\n",argv[ii]);
+        return 1;
+      }
+    }
+    else if (pending_source == NULL)
+      pending_source = argv[ii];
+    else
+    {
+      streams[num_streams].source = pending_source;
+      streams[num_streams].output_name = argv[ii];
+      num_streams ++;
+      pending_source = NULL;
+    }
+    ii++;
+  }
+
+  if (pending_source != NULL)
+  {
+    fprint_err("### tsrecord: No output file given for %s\n",pending_source);
+    return 1;
+  }
+  if (num_streams == 0)
+  {
+    print_err("### tsrecord: No streams to record\n");
+    return 1;
+  }
+
+  for (ii = 0; ii < num_streams; ii++)
+  {
+    err = start_record_stream(streams[ii].source,streams[ii].output_name,
+                              &options,&streams[ii]);
+    num_started ++;
+    if (err) break;
+    if (!options.quiet)
+      fprint_msg("Recording %s to %s\n",streams[ii].source,
+                 streams[ii].output_name);
+  }
+
+  if (!err)
+  {
+    signal(SIGINT,stop_handler);
+    signal(SIGTERM,stop_handler);
+    err = record_streams(streams,num_streams,&options,
+                         (uint64_t)duration * 1000000);
+  }
+
+  for (ii = 0; ii < num_started; ii++)
+  {
+    if (stop_record_stream(&streams[ii],&options))
+      err = 1;
+  }
+  free(streams);
+  return err;
+}
+
+#endif // _WIN32
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
@@ -45,6 +45,7 @@
 #include "misc_fns.h"
 #include "printing_fns.h"
 #include "pidint_fns.h"
+#include "stats_fns.h"
 #include "fmtx.h"
 #include "version.h"
 
@@ -53,6 +54,9 @@
 // Used to mean "PID unset" for continuity_counter monitoring
 #define INVALID_PID     0x2000
 
+// Smoothing factor for the PCR jitter figure - roughly the last 16 PCRs
+#define PCR_ERROR_EWMA_ALPHA (1.0 / 16)
+
 static int tfmt_diff = FMTX_TS_DISPLAY_90kHz_RAW;
 static int tfmt_abs = FMTX_TS_DISPLAY_90kHz_RAW;
 
@@ -77,21 +81,6 @@ struct diff_from_pcr
   unsigned int  num;          // the number of TS records compared
 };
 
-typedef struct avg_rate_elss
-{
-  uint64_t time;
-  uint64_t bytes;
-} avg_rate_el_t;
-
-typedef struct avg_ratess
-{
-  unsigned int max_els;
-  unsigned int in_el;
-  unsigned int out_el;
-  avg_rate_el_t * els;
-  uint64_t max_rate;
-} avg_rate_t;
-
 struct stream_data {
   uint32_t       pid;
   int           stream_type;
@@ -131,7 +120,7 @@ struct stream_data {
   int           pcr_seen;
   uint64_t      first_pcr;
   uint64_t      ts_bytes;
-  avg_rate_t    rate;
+  stats_rate_p  rate;           // bit rate over the last half second
 
   uint8_t       last_pkt[188];
 };
@@ -147,51 +136,14 @@ static int pid_index(struct stream_data *data,
   return -1;
 }
 
-unsigned int
-avg_rate_inc(avg_rate_t * ar, unsigned int n)
+static void free_stream_rates(struct stream_data *data,
+                              int                 num_streams)
 {
-  return n + 1 >= ar->max_els ? 0 : n + 1;
-}
-
-static void
-avg_rate_add(avg_rate_t * ar, uint64_t time, uint64_t bytes)
-{
-  uint64_t gap = 27000000 / 2;  // 0.5 sec
-  uint64_t delta_b;
-  uint64_t delta_t;
-  uint64_t rate;
-
-  if (ar->els == NULL)
-  {
-    ar->max_els = 1024;
-    ar->els = calloc(ar->max_els, sizeof(ar->els[0]));
-  }
-
-  while (ar->in_el != ar->out_el && pcr_unsigned_diff(time, ar->els[ar->out_el].time) > gap)
-  {
-    ar->out_el = avg_rate_inc(ar, ar->out_el);
-  }
-
-  ar->els[ar->in_el].time = time;
-  ar->els[ar->in_el].bytes = bytes;
-
-  delta_b = bytes - ar->els[ar->out_el].bytes;
-  delta_t = pcr_unsigned_diff(time, ar->els[ar->out_el].time);
-
-  if (delta_t != 0)
-  {
-    rate = (delta_b * 8LL * 27000000LL) / delta_t;
-    if (rate > ar->max_rate)
-    {
-      ar->max_rate = rate;
-    }
-  }
-
-  ar->in_el = avg_rate_inc(ar, ar->in_el);
+  int ii;
+  for (ii=0; ii<num_streams; ii++)
+    free_stats_rate(&data[ii].rate);
 }
 
-
-
 /*
  * Report on the given file
  *
@@ -233,6 +185,8 @@ static int report_buffering_stats(TS_reader_p  tsreader,
     int           know_pcr_rate;
     int64_t       min_pcr_error;  // 27MHz
     int64_t       max_pcr_error;  // 27MHz
+    struct stats_ewma error_ewma; // smoothed |error|, 27MHz
+    double        max_smoothed_error;
   };
   struct linear_prediction_data predict = {0};
 
@@ -268,6 +222,7 @@ static int report_buffering_stats(TS_reader_p  tsreader,
   }
   predict.min_pcr_error = LONG_MAX;
   predict.max_pcr_error = LONG_MIN;
+  init_stats_ewma(&predict.error_ewma, PCR_ERROR_EWMA_ALPHA);
 
   if (output_name)
   {
@@ -364,6 +319,7 @@ static int report_buffering_stats(TS_reader_p  tsreader,
     {
       fprint_err("### Error reading TS packet %d at " OFFSET_T_FORMAT
                  "\n",count,posn);
+      free_stream_rates(stats,num_streams);
       return 1;
     }
 
@@ -374,6 +330,7 @@ static int report_buffering_stats(TS_reader_p  tsreader,
     {
       fprint_err("### Error splitting TS packet %d at " OFFSET_T_FORMAT
                  "\n",count,posn);
+      free_stream_rates(stats,num_streams);
       return 1;
     }
 
@@ -400,6 +357,12 @@ static int report_buffering_stats(TS_reader_p  tsreader,
             predict.min_pcr_error = delta;
           if (delta > predict.max_pcr_error)
             predict.max_pcr_error = delta;
+          {
+            double smoothed = stats_ewma_add(&predict.error_ewma,
+                                             (double)(delta < 0 ? -delta : delta));
+            if (smoothed > predict.max_smoothed_error)
+              predict.max_smoothed_error = smoothed;
+          }
         }
 
         if (verbose)
@@ -591,7 +554,22 @@ static int report_buffering_stats(TS_reader_p  tsreader,
       if (stats[index].pcr_seen)
       {
         stats[index].pcr_seen = FALSE;
-        avg_rate_add(&stats[index].rate, acc_pcr, stats[index].ts_bytes);
+        if (stats[index].rate == NULL)
+        {
+          err = build_stats_rate(27000000 / 2,PCR_UNSIGNED_WRAP,27000000,
+                                 &stats[index].rate);
+          if (err)
+          {
+            free_stream_rates(stats,num_streams);
+            return 1;
+          }
+        }
+        err = stats_rate_add(stats[index].rate, acc_pcr, stats[index].ts_bytes);
+        if (err)
+        {
+          free_stream_rates(stats,num_streams);
+          return 1;
+        }
       }
       if (stats[index].first_pcr == ~(uint64_t)0)
         stats[index].first_pcr = acc_pcr;
@@ -620,6 +598,7 @@ static int report_buffering_stats(TS_reader_p  tsreader,
       {
         fprint_err("### Got DTS but not PTS, in TS packet at "
                    OFFSET_T_FORMAT "\n",posn);
+        free_stream_rates(stats,num_streams);
         return 1;
       }
 
@@ -804,6 +783,10 @@ static int report_buffering_stats(TS_reader_p  tsreader,
   fprint_msg("Linear PCR prediction errors: min=%s, max=%s\n",
              fmtx_timestamp(predict.min_pcr_error, tfmt_diff | FMTX_TS_N_27MHz),
              fmtx_timestamp(predict.max_pcr_error, tfmt_diff | FMTX_TS_N_27MHz));
+  if (predict.error_ewma.primed)
+    fprint_msg("Smoothed PCR jitter (|error| averaged over ~16 PCRs): max=%s\n",
+               fmtx_timestamp((int64_t)(predict.max_smoothed_error + 0.5),
+                              tfmt_diff | FMTX_TS_N_27MHz));
 
   for (ii = 0; ii < num_streams; ii++)
   {
@@ -868,7 +851,8 @@ static int report_buffering_stats(TS_reader_p  tsreader,
       // Calculate rate over the range of PCRs seen in this stream
       uint64_t avg = ss->pcr == ss->first_pcr ? 0LL :
          ((ss->ts_bytes - 188LL) * 8LL * 27000000LL) / pcr_unsigned_diff(ss->pcr, ss->first_pcr);
-      fprint_msg("  Stream: %llu bytes; rate: avg %llu bits/s, max %llu bits/s\n", ss->ts_bytes, avg, ss->rate.max_rate);
+      fprint_msg("  Stream: %llu bytes; rate: avg %llu bits/s, max %llu bits/s\n", ss->ts_bytes, avg,
+                 ss->rate == NULL ? 0ULL : ss->rate->max_rate);
     }
     if (ss->discontinuity_flag_count != 0)
       fprint_msg("  Discontinuity flags: *%d", ss->discontinuity_flag_count);
@@ -887,6 +871,7 @@ static int report_buffering_stats(TS_reader_p  tsreader,
     if (ss->err_dts_lt_pcr != 0)
       fprint_msg("  ### DTS < PCR * %d\n", ss->err_dts_lt_pcr);
   }
+  free_stream_rates(stats,num_streams);
   return 0;
 }
 
@@ -1255,6 +1240,10 @@ static void print_usage()
     "  -verbose, -v      Also output (fairly detailed) information on each TS packet.\n"
     "  -quiet, -q        Only output summary information (this is the default)\n"
     "  -max <n>, -m <n>  Maximum number of TS packets to read\n"
+    "  -diag-limit <n>   Only show the first <n> messages about each sort of\n"
+    "                    problem in the data (lost TS sync, broken PES\n"
+    "                    packets, and so on), then just count them. 0 shows\n"
+    "                    all of them. The default is 0.\n"
     "\n"
     "Buffering information:\n"
     "  -buffering, -b    Report on the differences between PCR and PTS, and\n"
@@ -1437,6 +1426,15 @@ int main(int argc, char **argv)
         if (err) return 1;
         ii++;
       }
+      else if (!strcmp("-diag-limit",argv[ii]))
+      {
+        int  limit;
+        CHECKARG("tsreport",ii);
+        err = int_value("tsreport",argv[ii],argv[ii+1],TRUE,10,&limit);
+        if (err) return 1;
+        set_diagnostic_limit(limit);
+        ii++;
+      }
       else if (!strcmp("-stdin",argv[ii]))
       {
         use_stdin = TRUE;
@@ -1497,6 +1495,7 @@ int main(int argc, char **argv)
                                  output_name,continuity_cnt_pid,report_mask);
   else
     err = report_ts(tsreader,max,verbose,show_data,report_timing);
+  report_diagnostics();
   if (err)
   {
     print_err("### tsreport: Error reporting on input stream\n");
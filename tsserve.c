@@ -59,6 +59,7 @@
 #include "misc_fns.h"
 #include "printing_fns.h"
 #include "tswrite_fns.h"
+#include "metrics_fns.h"
 #include "es_fns.h"
 #include "h262_fns.h"
 #include "filter_fns.h"
@@ -108,6 +109,10 @@ struct tsserve_context
   
   int      ffrequency;   // Fast forward frequency when filtering
   int      rfrequency;   // Base reverse frequency
+  uint32_t trick_bitrate;// Target bitrate for fast forward/reverse, or 0
+  int      trick_fps;    // and the picture rate it is displayed at
+  uint32_t picture_cache;// Bytes of recently output pictures to keep for
+                         // changing direction, or 0
   int      with_seq_hdrs;// For H.262, output sequence headers when not
                          // doing normal play?
 
@@ -127,6 +132,8 @@ struct tsserve_context
 
   // Transport Stream specific options
   int      tsdirect;
+
+  metrics_p metrics;      // Live metrics, or NULL if not publishing them
 };
 typedef struct tsserve_context *tsserve_context_p;
 
@@ -292,6 +299,22 @@ static void free_filter_context(filter_context  fcontext)
   else
     free_h264_filter_context(&(fcontext.u.h264));
 }
+
+/*
+ * Tell fast forward (filtering) and reverse what bitrate to aim for
+ * (0 means just use the frequency)
+ */
+static void set_trick_bitrate(filter_context  fcontext,
+                              reverse_data_p  reverse_data,
+                              uint32_t        bitrate,
+                              int             picture_rate)
+{
+  if (fcontext.is_h262)
+    set_h262_filter_bitrate(fcontext.u.h262,bitrate,picture_rate);
+  else
+    set_h264_filter_bitrate(fcontext.u.h264,bitrate,picture_rate);
+  set_reverse_bitrate(reverse_data,bitrate,picture_rate);
+}
 
 /*
  * "Reset" a stream, such that the picture reading contexts do not contain
@@ -2102,6 +2125,7 @@ static int play_pes_packets(PES_reader_p       reader[MAX_INPUT_FILES],
     // Tell it what PID and stream id to use when outputting reversed data
     set_reverse_pid(reverse_data[ii],reader[ii]->output_video_pid,
                     DEFAULT_VIDEO_STREAM_ID);
+    set_reverse_cache_size(reverse_data[ii],context->picture_cache);
 
     if (!context->with_seq_hdrs)
       reverse_data[ii]->output_sequence_headers = FALSE;
@@ -2113,6 +2137,8 @@ static int play_pes_packets(PES_reader_p       reader[MAX_INPUT_FILES],
       fprint_err("### Unable to build filter context for stream %d\n",ii);
       goto tidy_up;
     }
+    set_trick_bitrate(fcontext[ii],reverse_data[ii],
+                      context->trick_bitrate,context->trick_fps);
 
 
     err = build_filter_context(stream[ii],TRUE,0,&scontext[ii]);
@@ -2131,6 +2157,8 @@ static int play_pes_packets(PES_reader_p       reader[MAX_INPUT_FILES],
 tidy_up:
   for (ii = 0; ii < MAX_INPUT_FILES; ii++)
   {
+      if (!quiet && reverse_data[ii] != NULL)
+        report_reverse_cache(reverse_data[ii]);
       close_elementary_stream(&es[ii]);
       free_reverse_data(&reverse_data[ii]);
       close_stream(stream[ii]);
@@ -2567,6 +2595,7 @@ static int test_play_pes_packets(PES_reader_p       reader,
     close_elementary_stream(&es);
     return 1;
   }
+  set_reverse_cache_size(reverse_data,context->picture_cache);
 
   stream.is_h262 = fcontext.is_h262 = scontext.is_h262 = !(reader->is_h264);
 
@@ -2610,6 +2639,8 @@ static int test_play_pes_packets(PES_reader_p       reader,
     stream.u.h264 = acontext;
     fcontext.u.h264 = fcontext4;
     scontext.u.h264 = scontext4;
+    set_trick_bitrate(fcontext,reverse_data,
+                      context->trick_bitrate,context->trick_fps);
 
     if (skiptest)
       err = test_skip(reader,stream,fcontext,scontext,reverse_data,tswriter,
@@ -2667,6 +2698,8 @@ static int test_play_pes_packets(PES_reader_p       reader,
     stream.u.h262 = h262;
     fcontext.u.h262 = fcontext2;
     scontext.u.h262 = scontext2;
+    set_trick_bitrate(fcontext,reverse_data,
+                      context->trick_bitrate,context->trick_fps);
 
     if (skiptest)
       err = test_skip(reader,stream,fcontext,scontext,reverse_data,tswriter,
@@ -2682,6 +2715,8 @@ static int test_play_pes_packets(PES_reader_p       reader,
     free_h262_filter_context(&scontext2);
   }
 
+  if (!quiet)
+    report_reverse_cache(reverse_data);
   close_elementary_stream(&es);
   free_reverse_data(&reverse_data);
 
@@ -2948,7 +2983,12 @@ static int start_child(tsserve_context_p  context,
   else if (pid == 0)
   {
     // Aha - we're the child
-    _exit(tsserve_child_process(&args));
+    metrics_session_p session = claim_metrics_session(context->metrics);
+    int result;
+    tswrite_set_metrics(tswriter,session);
+    result = tsserve_child_process(&args);
+    release_metrics_session(session);
+    _exit(result);
   }
   tswriter->child = pid;
   return 0;
@@ -3470,6 +3510,19 @@ static void print_detailed_usage()
     "  -ffreq <n>        Frequency for faster forward ('F'). Default is 8.\n"
     "  -rfreq <n>        Frequency for reverse (fast reverse is twice\n"
     "                    the speed). Default is 8.\n"
+    "  -tprate <n>       Keep fast forward and reverse within <n> kbit/s,\n"
+    "                    choosing pictures by their size as well as by\n"
+    "                    frequency (so large pictures may be dropped, and\n"
+    "                    the last picture repeated instead, and for H.262\n"
+    "                    P pictures may be kept if there is room). The\n"
+    "                    default is 0, meaning choose by frequency alone.\n"
+    "  -tpfps <n>        The picture rate at which fast forward and reverse\n"
+    "                    are displayed, for -tprate. Default is 25.\n"
+    "  -picturecache <n> Keep up to <n> KB of the I pictures most recently\n"
+    "                    output or played past, so that reversing, and\n"
+    "                    skipping back, can start from memory rather than\n"
+    "                    by re-reading them. Default is 4096, and 0 turns\n"
+    "                    this off.\n"
     "\n"
     "  -pes_padding <n>  When outputting in 'normal play' mode, input PES packets\n" 
     "                    are copied to the output. If '-pes_padding' is used, then <n>\n"
@@ -3482,6 +3535,14 @@ static void print_detailed_usage()
     "                    Applies to all TS packets output, regardless of selected file.\n"
     "                    This can be useful when testing other applications.\n"
     "\n"
+    "  -metrics <port>\n"
+    "  -metrics <host>:<port>\n"
+    "  -metrics <path>   Publish live metrics for each client session (data\n"
+    "                    sent, current command, etc.) in Prometheus text\n"
+    "                    format, over HTTP on the given TCP port (on 127.0.0.1\n"
+    "                    unless a host is given), or Unix domain socket <path>.\n"
+    "                    Only used in server mode. Not supported on Windows.\n"
+    "\n"
     "Alternate modes\n"
     "---------------\n"
     "  Command input and testing modes connect directly to a host, and thus\n"
@@ -3565,6 +3626,8 @@ int main(int argc, char **argv)
   int  output_to_file = FALSE;
   int  skiptest = FALSE;
 
+  char *metrics_where = NULL;
+
   struct tsserve_context context;
 
   for (ii = 0; ii < MAX_INPUT_FILES; ii++)
@@ -3574,6 +3637,9 @@ int main(int argc, char **argv)
   context.pad_start = 8;
   context.ffrequency = DEFAULT_FORWARD_FREQUENCY;
   context.rfrequency = DEFAULT_REVERSE_FREQUENCY;
+  context.trick_bitrate = 0;
+  context.trick_fps = DEFAULT_TRICK_PICTURE_RATE;
+  context.picture_cache = DEFAULT_REVERSE_CACHE_KB * 1024;
   context.with_seq_hdrs = TRUE;
   context.pes_padding = 0;
   context.drop_packets = 0;
@@ -3589,6 +3655,8 @@ int main(int argc, char **argv)
   // Transport Stream specific options
   context.tsdirect = FALSE;     // Write to server as a side effect of PES reading
 
+  context.metrics = NULL;
+
   context.force_stream_type = FALSE;
   context.want_h262 = TRUE; // shouldn't matter
   context.dolby_is_dvb = TRUE;
@@ -3696,6 +3764,43 @@ int main(int argc, char **argv)
         if (err) return 1;
         argno++;
       }
+      else if (!strcmp("-tprate",argv[argno]))
+      {
+        int  kbps;
+        CHECKARG("tsserve",argno);
+        err = int_value("tsserve",argv[argno],argv[argno+1],TRUE,10,&kbps);
+        if (err) return 1;
+        context.trick_bitrate = (uint32_t)kbps * 1000;
+        argno++;
+      }
+      else if (!strcmp("-picturecache",argv[argno]))
+      {
+        int  kbytes;
+        CHECKARG("tsserve",argno);
+        err = int_value("tsserve",argv[argno],argv[argno+1],TRUE,10,&kbytes);
+        if (err) return 1;
+        if (kbytes > 1024*1024)
+        {
+          print_err("### tsserve: -picturecache may not be more than"
+                    " 1048576 (1GB)\n");
+          return 1;
+        }
+        context.picture_cache = (uint32_t)kbytes * 1024;
+        argno++;
+      }
+      else if (!strcmp("-tpfps",argv[argno]))
+      {
+        CHECKARG("tsserve",argno);
+        err = int_value("tsserve",argv[argno],argv[argno+1],TRUE,10,
+                        &context.trick_fps);
+        if (err) return 1;
+        if (context.trick_fps == 0)
+        {
+          print_err("### tsserve: -tpfps must be greater than 0\n");
+          return 1;
+        }
+        argno++;
+      }
       else if (!strcmp("-pes_padding",argv[argno]))
       {
         CHECKARG("tsserve",argno);
@@ -3719,6 +3824,12 @@ int main(int argc, char **argv)
         if (err) return 1;
         argno += 2;
       }
+      else if (!strcmp("-metrics",argv[argno]))
+      {
+        CHECKARG("tsserve",argno);
+        metrics_where = argv[argno+1];
+        argno++;
+      }
       else if (!strcmp("-quiet",argv[argno]) || !strcmp("-q",argv[argno]))
       {
         quiet = TRUE;
@@ -3953,12 +4064,20 @@ int main(int argc, char **argv)
   switch (action)
   {
   case ACTION_SERVER:
+    if (metrics_where != NULL)
+    {
+      err = start_metrics_server("tsserve",metrics_where,quiet,&context.metrics);
+      if (err) return 1;
+    }
     err = run_server(&context,listen_port,verbose,quiet);
     if (err)
     {
       print_err("### tsserve: Error in server\n");
+      (void) stop_metrics_server(&context.metrics);
       return 1;
     }
+    err = stop_metrics_server(&context.metrics);
+    if (err) return 1;
     break;
 
   case ACTION_TEST:
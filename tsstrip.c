@@ -0,0 +1,449 @@
+/*
+ * Convert a Transport Stream to or from a compact (null packet stripped)
+ * archive.
+ *
+ * ***** BEGIN LICENSE BLOCK *****
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is the MPEG TS, PS and ES tools.
+ *
+ * The Initial Developer of the Original Code is Amino Communications Ltd.
+ * Portions created by the Initial Developer are Copyright (C) 2008
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *   Amino Communications Ltd, Swavesey, Cambridge UK
+ *
+ * ***** END LICENSE BLOCK *****
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#ifdef _WIN32
+#include <stddef.h>
+#else // _WIN32
+#include <unistd.h>
+#endif // _WIN32
+
+#include "compat.h"
+#include "ts_fns.h"
+#include "tscompact_fns.h"
+#include "misc_fns.h"
+#include "printing_fns.h"
+#include "version.h"
+
+
+/*
+ * Write a Transport Stream out as a compact TS file
+ *
+ * - `tsreader` is the TS to read
+ * - `output_name` is the compact TS file to write
+ * - if `max` is greater than zero, then at most `max` TS packets should
+ *   be read from the input
+ * - if `verbose` is true, then extra information should be written out
+ * - if `quiet` is true, then only error messages should be written out
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int compact_TS(TS_reader_p  tsreader,
+                      char        *output_name,
+                      int          max,
+                      int          verbose,
+                      int          quiet)
+{
+  int  err;
+  int  count = 0;
+  compact_TS_writer_p  writer;
+
+  err = open_compact_TS_writer(output_name,&writer);
+  if (err)
+  {
+    fprint_err("### tsstrip: Unable to open output file %s\n",output_name);
+    return 1;
+  }
+
+  for (;;)
+  {
+    byte  *packet;
+
+    if (max > 0 && count >= max)
+    {
+      if (!quiet)
+        fprint_msg("Stopping after %d TS packets\n",max);
+      break;
+    }
+
+    err = read_next_TS_packet(tsreader,&packet);
+    if (err == EOF)
+      break;
+    else if (err)
+    {
+      fprint_err("### tsstrip: Error reading TS packet %d\n",count);
+      (void) close_compact_TS_writer(&writer);
+      return 1;
+    }
+    count ++;
+
+    err = write_compact_TS_packet(writer,packet);
+    if (err)
+    {
+      fprint_err("### tsstrip: Error writing TS packet %d\n",count);
+      (void) close_compact_TS_writer(&writer);
+      return 1;
+    }
+  }
+
+  if (!quiet)
+  {
+    fprint_msg("Read %d TS packet%s\n",count,(count==1?"":"s"));
+    fprint_msg("Kept %u packet%s, dropped %u null packet%s (%.1f%%),"
+               " in %u record%s\n",
+               writer->total_packets,(writer->total_packets==1?"":"s"),
+               writer->total_nulls,(writer->total_nulls==1?"":"s"),
+               (count == 0 ? 0.0 : 100.0 * writer->total_nulls / count),
+               writer->num_records,(writer->num_records==1?"":"s"));
+    if (verbose)
+      fprint_msg("Kept %u null packet%s whose payload was not a single"
+                 " repeated byte\n",writer->total_kept_nulls,
+                 (writer->total_kept_nulls==1?"":"s"));
+  }
+
+  err = close_compact_TS_writer(&writer);
+  if (err)
+  {
+    fprint_err("### tsstrip: Error closing output file %s\n",output_name);
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Expand a compact TS file back to a Transport Stream
+ *
+ * - `input_name` is the compact TS file to read
+ * - `output` is the TS file to write
+ * - if `max` is greater than zero, then at most `max` TS packets should
+ *   be written
+ * - if `quiet` is true, then only error messages should be written out
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int expand_TS(char  *input_name,
+                     FILE  *output,
+                     int    max,
+                     int    quiet)
+{
+  int  err;
+  int  count = 0;
+  TS_reader_p  tsreader;
+
+  err = open_compact_TS_for_TS_read(input_name,TRUE,&tsreader);
+  if (err)
+  {
+    fprint_err("### tsstrip: Unable to open input file %s\n",input_name);
+    return 1;
+  }
+
+  for (;;)
+  {
+    byte   *packet;
+    size_t  written;
+
+    if (max > 0 && count >= max)
+    {
+      if (!quiet)
+        fprint_msg("Stopping after %d TS packets\n",max);
+      break;
+    }
+
+    err = read_next_TS_packet(tsreader,&packet);
+    if (err == EOF)
+      break;
+    else if (err)
+    {
+      fprint_err("### tsstrip: Error reading TS packet %d\n",count);
+      (void) close_TS_reader(&tsreader);
+      return 1;
+    }
+
+    written = fwrite(packet,TS_PACKET_SIZE,1,output);
+    if (written != 1)
+    {
+      fprint_err("### tsstrip: Error writing TS packet %d: %s\n",
+                 count,strerror(errno));
+      (void) close_TS_reader(&tsreader);
+      return 1;
+    }
+    count ++;
+  }
+
+  if (!quiet)
+    fprint_msg("Wrote %d TS packet%s\n",count,(count==1?"":"s"));
+
+  err = close_TS_reader(&tsreader);
+  if (err)
+  {
+    fprint_err("### tsstrip: Error closing input file %s\n",input_name);
+    return 1;
+  }
+  return 0;
+}
+
+static void print_usage()
+{
+  print_msg(
+    "Usage: tsstrip [switches] [<infile>] <outfile>\n"
+    "\n"
+    );
+  REPORT_VERSION("tsstrip");
+  print_msg(
+    "\n"
+    "  Convert a Transport Stream to a compact archive, or a compact archive\n"
+    "  back to a Transport Stream.\n"
+    "\n"
+    "  A compact archive omits the null packets (PID 0x1FFF) from the\n"
+    "  Transport Stream, but remembers where they were. The other tools\n"
+    "  can read a compact archive directly, and will just see its non-null\n"
+    "  packets, except for tsplay, which reinstates the null packets so\n"
+    "  that the data is played out with its original timing.\n"
+    "\n"
+    "  Each run of null packets is remembered with its first header, how its\n"
+    "  continuity counter goes up, and its payload byte, so that expanding a\n"
+    "  compact archive reproduces the original Transport Stream exactly.\n"
+    "  (A null packet whose payload is not a single repeated byte is just\n"
+    "  kept as it is.)\n"
+    "\n"
+    "Files:\n"
+    "  <infile>  is an H.222 Transport Stream file (but see -stdin), or a\n"
+    "            compact archive, which will be expanded\n"
+    "  <outfile> is the compact archive or Transport Stream to write\n"
+    "            (but see -stdout)\n"
+    "\n"
+    "Switches:\n"
+    "  -err stdout        Write error messages to standard output (the default)\n"
+    "  -err stderr        Write error messages to standard error (Unix traditional)\n"
+    "  -stdin             Input (Transport Stream) from standard input,\n"
+    "                     instead of a file\n"
+    "  -stdout            Output (expanded Transport Stream) to standard\n"
+    "                     output, instead of a file. Forces -quiet and\n"
+    "                     -err stderr.\n"
+    "  -verbose, -v       Output informational/diagnostic messages\n"
+    "  -quiet, -q         Only output error messages\n"
+    "  -max <n>, -m <n>   Maximum number of TS packets to read (or, when\n"
+    "                     expanding, to write)\n"
+    );
+}
+
+int main(int argc, char **argv)
+{
+  int    use_stdout = FALSE;
+  int    use_stdin = FALSE;
+  char  *input_name = NULL;
+  char  *output_name = NULL;
+  int    had_input_name = FALSE;
+  int    had_output_name = FALSE;
+  int    expand = FALSE;
+
+  int    max     = 0;     // The maximum number of TS packets to read (or 0)
+  int    quiet   = FALSE; // True => be as quiet as possible
+  int    verbose = FALSE; // True => output diagnostic/progress messages
+
+  int    err = 0;
+  int    ii = 1;
+
+  if (argc < 2)
+  {
+    print_usage();
+    return 0;
+  }
+
+  while (ii < argc)
+  {
+    if (argv[ii][0] == '-')
+    {
+      if (!strcmp("--help",argv[ii]) || !strcmp("-h",argv[ii]) ||
+          !strcmp("-help",argv[ii]))
+      {
+        print_usage();
+        return 0;
+      }
+      else if (!strcmp("-verbose",argv[ii]) || !strcmp("-v",argv[ii]))
+      {
+        verbose = TRUE;
+        quiet = FALSE;
+      }
+      else if (!strcmp("-quiet",argv[ii]) || !strcmp("-q",argv[ii]))
+      {
+        verbose = FALSE;
+        quiet = TRUE;
+      }
+      else if (!strcmp("-max",argv[ii]) || !strcmp("-m",argv[ii]))
+      {
+        CHECKARG("tsstrip",ii);
+        err = int_value("tsstrip",argv[ii],argv[ii+1],TRUE,10,&max);
+        if (err) return 1;
+        ii++;
+      }
+      else if (!strcmp("-stdin",argv[ii]))
+      {
+        use_stdin = TRUE;
+        had_input_name = TRUE;  // so to speak
+      }
+      else if (!strcmp("-stdout",argv[ii]))
+      {
+        use_stdout = TRUE;
+        had_output_name = TRUE;  // so to speak
+        redirect_output_stderr();
+      }
+      else if (!strcmp("-err",argv[ii]))
+      {
+        CHECKARG("tsstrip",ii);
+        if (!strcmp(argv[ii+1],"stderr"))
+          redirect_output_stderr();
+        else if (!strcmp(argv[ii+1],"stdout"))
+          redirect_output_stdout();
+        else
+        {
+          fprint_err("### tsstrip: "
+                     "Unrecognised option '%s' to -err (not 'stdout' or"
+                     " 'stderr')\n",argv[ii+1]);
+          return 1;
+        }
+        ii++;
+      }
+      else
+      {
+        fprint_err("### tsstrip: "
+                   "Unrecognised command line switch '%s'\n",argv[ii]);
+        return 1;
+      }
+    }
+    else
+    {
+      if (had_input_name && had_output_name)
+      {
+        fprint_err("### tsstrip: Unexpected '%s'\n",argv[ii]);
+        return 1;
+      }
+      else if (had_input_name)  // shouldn't do this if had -stdout
+      {
+        output_name = argv[ii];
+        had_output_name = TRUE;
+      }
+      else
+      {
+        input_name = argv[ii];
+        had_input_name = TRUE;
+      }
+    }
+    ii++;
+  }
+
+  if (!had_input_name)
+  {
+    print_err("### tsstrip: No input file specified\n");
+    return 1;
+  }
+  if (!had_output_name)
+  {
+    print_err("### tsstrip: No output file specified\n");
+    return 1;
+  }
+
+  expand = is_compact_TS_file(input_name);
+  if (use_stdout && !expand)
+  {
+    print_err("### tsstrip: -stdout can only be used when expanding"
+              " a compact archive\n");
+    return 1;
+  }
+
+  // Try to stop extraneous data ending up in our output stream
+  if (use_stdout)
+  {
+    verbose = FALSE;
+    quiet = TRUE;
+  }
+
+  if (!quiet)
+  {
+    fprint_msg("Reading from %s\n",(use_stdin?"<stdin>":input_name));
+    fprint_msg("Writing to   %s\n",(use_stdout?"<stdout>":output_name));
+    if (expand)
+      print_msg("Expanding compact archive to Transport Stream\n");
+    else
+      print_msg("Writing Transport Stream as compact archive\n");
+  }
+
+  if (expand)
+  {
+    FILE  *output;
+    if (use_stdout)
+      output = stdout;
+    else
+    {
+      output = fopen(output_name,"wb");
+      if (output == NULL)
+      {
+        fprint_err("### tsstrip: "
+                   "Unable to open output file %s: %s\n",output_name,
+                   strerror(errno));
+        return 1;
+      }
+    }
+    err = expand_TS(input_name,output,max,quiet);
+    if (!use_stdout)
+    {
+      errno = 0;
+      if (fclose(output))
+      {
+        fprint_err("### tsstrip: Error closing output file %s: %s\n",
+                   output_name,strerror(errno));
+        err = 1;
+      }
+    }
+  }
+  else
+  {
+    TS_reader_p  tsreader;
+    err = open_file_for_TS_read((use_stdin?NULL:input_name),&tsreader);
+    if (err)
+    {
+      fprint_err("### tsstrip: Unable to open input file %s\n",
+                 (use_stdin?"<stdin>":input_name));
+      return 1;
+    }
+    err = compact_TS(tsreader,output_name,max,verbose,quiet);
+    if (close_TS_reader(&tsreader))
+    {
+      fprint_err("### tsstrip: Error closing input file %s\n",
+                 (use_stdin?"<stdin>":input_name));
+      err = 1;
+    }
+  }
+  if (err)
+  {
+    print_err("### tsstrip: Error converting data\n");
+    return 1;
+  }
+  return 0;
+}
+
+// Local Variables:
+// tab-width: 8
+// indent-tabs-mode: nil
+// c-basic-offset: 2
+// End:
+// vim: set tabstop=8 shiftwidth=2 expandtab:
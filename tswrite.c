@@ -30,6 +30,10 @@
  * ***** END LICENSE BLOCK *****
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE      // for sched_setaffinity
+#endif // __linux__
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -51,6 +55,14 @@
 #include <sys/mman.h>    // memory mapping
 #include <sys/wait.h>
 #include <sys/socket.h>  // send
+#include <netinet/in.h>  // sockaddr_in
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <arpa/inet.h>   // inet_addr
+#include <netdb.h>       // gethostbyname
+#ifdef __linux__
+#include <linux/net_tstamp.h>  // struct sock_txtime
+#include <sched.h>             // sched_setaffinity, sched_setscheduler
+#endif // __linux__
 #endif // _WIN32
 
 #include "compat.h"
@@ -58,6 +70,27 @@
 #include "printing_fns.h"
 #include "tswrite_fns.h"
 #include "ts_fns.h"
+#include "fec_fns.h"
+#include "metrics_fns.h"
+#include "pcap.h"
+
+// Can the kernel pace our UDP output for us?
+#if defined(__linux__) && defined(SO_TXTIME) && defined(SCM_TXTIME)
+#define HAVE_SO_TXTIME 1
+#endif
+#if defined(__linux__) && defined(SO_MAX_PACING_RATE)
+#define HAVE_SO_MAX_PACING_RATE 1
+#endif
+
+// When the kernel is pacing our output, we hand it each item up to this
+// many microseconds before it is due, rather than waking up for each one
+#define PACING_LEAD_US  2000
+
+// When limiting the socket's rate, we allow this percentage of the rate
+// we measure from the item times, so that the kernel never makes us late,
+// and we remeasure the rate over (about) this many microseconds
+#define PACING_RATE_HEADROOM  105
+#define PACING_RATE_PERIOD    1000000
 
 // ------------------------------------------------------------
 // Global flags affecting debugging
@@ -88,6 +121,35 @@ static int global_child_debug = FALSE;
 static unsigned global_perturb_seed;
 static unsigned global_perturb_range = 0;
 static int      global_perturb_verbose = FALSE;
+
+// Should the child process run on a simulated clock, rather than the real
+// one? If so, then waiting for the time to write a packet just moves the
+// simulated clock on, without sleeping, so that the whole pacing schedule
+// can be worked out (and recorded to pcap) as fast as the data can be read.
+// The simulated clock starts at the real time when the child first asks.
+static int      global_virtual_clock = FALSE;
+static struct timeval global_virtual_now = {0};
+
+// Should the child process be given the best chance we can manage of
+// sending each packet on time (a "real-time profile")? If so, then its
+// memory is locked (and the circular buffer prefaulted, in huge pages if we
+// can get them), and it reports how late it woke up from each wait. It is
+// also pinned to CPU `global_rt_cpu` if that is not -1, and runs with
+// SCHED_FIFO at `global_rt_priority` if that is not 0.
+static int      global_realtime = FALSE;
+static int      global_rt_cpu = -1;
+static int      global_rt_priority = 0;
+
+// How late the child woke up from its waits, in microseconds
+// (only measured with the real-time profile)
+static uint32_t global_wake_count = 0;
+static uint32_t global_wake_late_max = 0;
+static uint32_t global_wake_late_1ms = 0;  // how many times by > 1ms
+static uint64_t global_wake_late_total = 0;
+
+// When asking for huge pages for the circular buffer, we round its size up
+// to (what is almost always) the size of a huge page
+#define HUGE_PAGE_SIZE  (2*1024*1024)
 // ------------------------------------------------------------
 
 // The default number of set-of-N-packets to allow for in priming the
@@ -219,6 +281,13 @@ struct circular_buffer
   // The location of the packet data for the circular buffer items
   byte     *item_data;
 
+  // How much memory we actually allocated for the buffer (which may have
+  // been rounded up, if we got huge pages)
+  size_t    mapped_size;
+
+  // Where to record how we are doing, or NULL if no-one is interested
+  metrics_session_p  metrics;
+
   // The "header" data for each circular buffer item
   struct circular_buffer_item item[];
 };
@@ -316,7 +385,50 @@ struct buffered_TS_output
   int                prime_speedup;
 
   pcr_pace_env       pcr_pace;
+
+  // If we are sending SMPTE 2022-1 FEC alongside RTP output, the child
+  // generates it as it sends each item, and sends column FEC to the
+  // media port + 2 and row FEC (if wanted) to the media port + 4
+  FEC_encoder_p      fec;
+  SOCKET             fec_column_socket;
+  SOCKET             fec_row_socket;
+
+  // If we are recording to a pcap file instead of sending, our pcap output
+  TS_pcap_output_p   pcap;
+
+  // How the child paces its output. For TSWRITE_PACING_RATE, `pacing_rate`
+  // is the rate (bytes/second) the socket is currently limited to, and we
+  // count the bytes sent since `pacing_start` (an item time) to remeasure it
+  tswrite_pacing_mode  pacing;
+  uint32_t           pacing_rate;
+  uint32_t           pacing_start;
+  uint64_t           pacing_bytes;
+  int                pacing_restart;  // TRUE if we need a new `pacing_start`
+};
+
+// ------------------------------------------------------------
+// When recording to pcap, each datagram is given the Ethernet, IPv4 and UDP
+// headers it would have had on the wire
+#define PCAP_ETHERNET_HDR_SIZE  14
+#define PCAP_IPV4_HDR_SIZE      20
+#define PCAP_UDP_HDR_SIZE        8
+#define PCAP_HEADERS_SIZE  (PCAP_ETHERNET_HDR_SIZE + PCAP_IPV4_HDR_SIZE + \
+                            PCAP_UDP_HDR_SIZE)
+
+// The (documentation, RFC 5737) address we pretend to be sending from
+#define PCAP_SOURCE_ADDR  0xC0000201  // 192.0.2.1
+
+struct TS_pcap_output
+{
+  PCAP_writer_p  scheduled; // stamped with the time each datagram was due
+  PCAP_writer_p  actual;    // stamped with when it was written, or NULL
+  uint32_t       dest_addr; // where we are pretending to send to
+  int            dest_port;
+  uint16_t       ident;     // IPv4 identification for the next datagram
+  byte           header[PCAP_HEADERS_SIZE];  // headers for the next datagram
+  uint32_t       datagrams; // how many we have recorded
 };
+#define SIZEOF_TS_PCAP_OUTPUT sizeof(struct TS_pcap_output)
 
 #ifdef _WIN32
 // ============================================================
@@ -383,6 +495,7 @@ static int map_circular_buffer(circular_buffer_p  *circular,
                   (circ_buf_size * SIZEOF_CIRCULAR_BUFFER_ITEM);
   int data_size = circ_buf_size * (TS_in_packet * TS_PACKET_SIZE + hdr_size);
   int total_size = base_size + data_size;
+  size_t mapped_size = total_size;
   circular_buffer_p cb;
 
   *circular = NULL;
@@ -398,8 +511,22 @@ static int map_circular_buffer(circular_buffer_p  *circular,
     return 1;
   }
 #else // _WIN32
-  cb = mmap(NULL,total_size,
-                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+  cb = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  // With the real-time profile, huge pages (if the system has any to
+  // spare) save the child from TLB misses as it works through the buffer
+  if (global_realtime)
+  {
+    mapped_size = (total_size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    cb = mmap(NULL,mapped_size,PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_ANON | MAP_HUGETLB, -1, 0);
+    if (cb == MAP_FAILED)
+      mapped_size = total_size;
+  }
+#endif // MAP_HUGETLB
+  if (cb == MAP_FAILED)
+    cb = mmap(NULL,total_size,
+              PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
 
   if (cb == MAP_FAILED)
   {
@@ -409,6 +536,11 @@ static int map_circular_buffer(circular_buffer_p  *circular,
   }
 #endif // _WIN32
 
+  // With the real-time profile, touch every page now, so that neither
+  // process takes a page fault on the buffer once we are under way
+  if (global_realtime)
+    memset(cb,0,mapped_size);
+
   cb->start = 1;
   cb->end = 0;
   cb->pending = 0;
@@ -429,6 +561,8 @@ static int map_circular_buffer(circular_buffer_p  *circular,
   cb->maxnowait = maxnowait;
   cb->waitfor = waitfor;
   cb->item_data = (byte *) cb + base_size + hdr_size;
+  cb->mapped_size = mapped_size;
+  cb->metrics = NULL;
   *circular = cb;
   return 0;
 }
@@ -442,16 +576,12 @@ static int map_circular_buffer(circular_buffer_p  *circular,
  */
 static int unmap_circular_buffer(circular_buffer_p  circular)
 {
-  int base_size = SIZEOF_CIRCULAR_BUFFER +
-                  (circular->size * SIZEOF_CIRCULAR_BUFFER_ITEM);
-  int data_size = circular->size * circular->item_size;
-  int total_size = base_size + data_size;
 #ifdef _WIN32
   // Under Windows, we're using threading to manage our parent/child
   // processes, so we malloced our circular buffer
   free(circular);
 #else // _WIN32
-  int err = munmap(circular,total_size);
+  int err = munmap(circular,circular->mapped_size);
   if (err)
   {
     fprint_err("### Error unmapping circular buffer from shared memory: %s\n",
@@ -469,6 +599,17 @@ static inline int circular_buffer_empty(circular_buffer_p  circular)
 {
   return (circular->start == (circular->end + 1) % circular->size);
 }
+
+/*
+ * Record how many items are in the circular buffer (both ready to send,
+ * and waiting for their time to be decided), if anyone is interested
+ */
+static inline void note_buffer_items(circular_buffer_p  circular)
+{
+  METRIC_SET(circular->metrics,buffer_items,
+             (circular->pending + 1 - circular->start + circular->size) %
+             circular->size);
+}
 
 /*
  * Is the buffer full?
@@ -505,6 +646,7 @@ static inline int wait_if_buffer_empty(circular_buffer_p  circular)
 #endif
     if (global_parent_debug) print_msg("<-- wait\n");
     count ++;
+    METRIC_ADD(circular->metrics,buffer_empty_waits,1);
 
 #ifdef _WIN32
     Sleep(global_child_wait);
@@ -592,6 +734,7 @@ static inline int wait_if_buffer_full(circular_buffer_p  circular)
 #endif
     if (global_parent_debug) print_msg("--> wait\n");
     count ++;
+    METRIC_ADD(circular->metrics,buffer_full_waits,1);
 
 #ifdef _WIN32
     Sleep(global_parent_wait);
@@ -726,6 +869,14 @@ static int build_buffered_TS_output(buffered_TS_output_p  *writer,
 
   new->pcr_scale = pcr_scale;
 
+  new->fec = NULL;
+  new->fec_column_socket = -1;
+  new->pcap = NULL;
+  new->fec_row_socket = -1;
+
+  new->pacing = TSWRITE_PACING_USER;
+  new->pacing_restart = TRUE;
+
   new->pcr_pace.prime_speed = prime_speedup;
   new->pcr_pace.prime_req = (prime_speedup != PRIME_SPEED_NORMAL);
   fprint_msg("prime speed set to %d\n", prime_speedup);
@@ -760,6 +911,12 @@ static int free_buffered_TS_output(buffered_TS_output_p  *writer)
   }
   (*writer)->buffer  = NULL;
   (*writer)->started = FALSE;
+
+  if ((*writer)->fec_column_socket != -1)
+    (void) disconnect_socket((*writer)->fec_column_socket);
+  if ((*writer)->fec_row_socket != -1)
+    (void) disconnect_socket((*writer)->fec_row_socket);
+  free_FEC_encoder(&(*writer)->fec);
   
   free(*writer);
   *writer = NULL;
@@ -779,6 +936,21 @@ static inline uint64_t pcr_delta_u(const uint64_t a, const uint64_t b)
 // ============================================================
 // Timing
 // ============================================================
+// Fill in the RTP header for circular buffer item `i`, with the given
+// (90KHz) timestamp
+static void
+set_rtp_header(const circular_buffer_p circ, const int i,
+    const uint32_t timestamp)
+{
+  uint8_t * rtp_buf = circ->item_data + i * circ->item_size - 12;
+
+  rtp_buf[0] = 0x80;
+  rtp_buf[1] = 33; // TS
+  set_16_be(rtp_buf + 2, ++circ->hdr.rtp.seq);
+  set_32_be(rtp_buf + 4, timestamp);
+  set_32_be(rtp_buf + 8, circ->hdr.rtp.ssrc);
+}
+
 /*
  * Set the time indicator for the next circular buffer item, using PCRs
  *
@@ -800,6 +972,10 @@ static int set_buffer_item_time_pcr1(buffered_TS_output_p writer)
   static uint32_t last_timestamp_near_PCR = 0;
 
   static uint32_t last_timestamp = 0;
+  // The circular buffer times wrap every 71.6 minutes or so, but the RTP
+  // timestamp (at 90KHz) must only wrap when its 32 bits do, so we keep
+  // our own 64 bit running time (in microseconds) for it
+  static uint64_t rtp_time = 0;
 
   static int had_first_pcr  = FALSE;  // Did we *have* a previous PCR?
   static int had_second_pcr = FALSE;  // And the second PCR is special, too
@@ -958,27 +1134,13 @@ static int set_buffer_item_time_pcr1(buffered_TS_output_p writer)
     last_pcr_index = writer->packet[ii].index;
   }
 
+  rtp_time += (uint32_t)(timestamp - last_timestamp);
   last_timestamp = circular->item[writer->which].time = timestamp;
+  if (circular->hdr_type == PKT_HDR_TYPE_RTP)
+    set_rtp_header(circular, writer->which, (uint32_t)(rtp_time * 90 / 1000));
   return writer->which;
 }
 
-static inline void
-set_32_be(uint8_t * const p, const uint32_t x)
-{
-  p[0] = x >> 24;
-  p[1] = (x >> 16) & 0xff;
-  p[2] = (x >> 8) & 0xff;
-  p[3] = x & 0xff;
-}
-
-static inline void
-set_16_be(uint8_t * const p, const unsigned int x)
-{
-  p[0] = (x >> 8) & 0xff;
-  p[1] = x & 0xff;
-}
-
-
 // Set times on all packets between where we were and where we are now
 // Sets the time on both the first & last packets
 // Returns the index of the last circ buffer entry modified
@@ -1003,16 +1165,7 @@ set_circ_times(const circular_buffer_p circ,
       prime_last_pcr - ((prime_last_pcr - pcr) * (int64_t)100) / (int64_t)prime_speed;
 
     if (circ->hdr_type == PKT_HDR_TYPE_RTP)
-    {
-      uint32_t timestamp = (uint32_t)(pcr / (uint64_t)300);
-      uint8_t * rtp_buf = circ->item_data + i * circ->item_size - 12;
-
-      rtp_buf[0] = 0x80;
-      rtp_buf[1] = 33; // TS
-      set_16_be(rtp_buf + 2, ++circ->hdr.rtp.seq);
-      set_32_be(rtp_buf + 4, timestamp);
-      set_32_be(rtp_buf + 8, circ->hdr.rtp.ssrc);
-    }
+      set_rtp_header(circ, i, (uint32_t)(pcr / (uint64_t)300));
 
     item->time = (uint32_t)(adj_pcr / 27);  // "time" in us
     offset += item->length;
@@ -1167,11 +1320,15 @@ retry:
 static int set_buffer_item_time_plain(buffered_TS_output_p writer)
 {
   static uint32_t last_time = 0;      // The last circular buffer time stamp
+  static uint64_t rtp_time = 0;       // The same, but without wrapping
   circular_buffer_p  circular = writer->buffer;
   int num_bytes = writer->num_packets * TS_PACKET_SIZE;// Bytes since last time
   uint32_t elapsed_time = (uint32_t) (num_bytes * 1000000.0 / writer->rate);
   last_time += elapsed_time;
+  rtp_time += elapsed_time;
   circular->item[writer->which].time = last_time;
+  if (circular->hdr_type == PKT_HDR_TYPE_RTP)
+    set_rtp_header(circular, writer->which, (uint32_t)(rtp_time * 90 / 1000));
   return writer->which;
 }
 
@@ -1276,6 +1433,7 @@ static void internal_flush_buffered_TS_output(const buffered_TS_output_p  writer
 
   // Make this item available for reading
   circular->pending = writer->which;
+  note_buffer_items(circular);
 
   // And then prepare for the next index
   writer->which   = (circular->pending + 1) % circular->size;
@@ -1418,12 +1576,33 @@ static int write_to_buffered_TS_output(buffered_TS_output_p  writer,
 // ============================================================
 // Child process - writing out data from the circular buffer
 // ============================================================
+/*
+ * Find out what time the child process thinks it is.
+ *
+ * Normally this is just the time of day, but if we are running on a
+ * simulated clock, it is wherever that clock has got to.
+ */
+static void get_child_time(struct timeval *now)
+{
+  if (global_virtual_clock)
+  {
+    if (global_virtual_now.tv_sec == 0 && global_virtual_now.tv_usec == 0)
+      gettimeofday(&global_virtual_now,NULL);
+    *now = global_virtual_now;
+  }
+  else
+    gettimeofday(now,NULL);
+}
+
 /*
  * Wait for a given number of microseconds (or longer). Must be < 1s.
  *
  * Note that on a "normal" Linux or BSD machine, the shortest wait possible
  * may be as long as 10ms (10000 microseconds)
  *
+ * If we are running on a simulated clock, then this just moves that clock
+ * on by `microseconds`, and returns at once.
+ *
  * On Windows, this will actually wait for a number of milliseconds,
  * using 0 milliseconds if the number of microseconds is too small.
  *
@@ -1431,6 +1610,13 @@ static int write_to_buffered_TS_output(buffered_TS_output_p  writer,
  */
 static void wait_microseconds(int  microseconds)
 {
+  if (global_virtual_clock)
+  {
+    global_virtual_now.tv_usec += microseconds;
+    global_virtual_now.tv_sec  += global_virtual_now.tv_usec / 1000000;
+    global_virtual_now.tv_usec %= 1000000;
+    return;
+  }
 #ifdef _WIN32
   // Best we can (easily) do is to wait for the nearest (rounded down!)
   // number of milliseconds - hopefully this will do
@@ -1438,12 +1624,16 @@ static void wait_microseconds(int  microseconds)
 #else // _WIN32
   struct  timespec   time = {0};
   struct  timespec   remaining;
+  struct  timespec   before, after;
   uint32_t nanoseconds = microseconds * 1000;
   int     err = 0;
 
   time.tv_sec = 0;
   time.tv_nsec = nanoseconds;
 
+  if (global_realtime)
+    clock_gettime(CLOCK_MONOTONIC,&before);
+
   errno = 0;
   err = nanosleep(&time,&remaining);
   while (err == -1 && errno == EINTR)  // cope with being woken too early
@@ -1452,6 +1642,24 @@ static void wait_microseconds(int  microseconds)
     time = remaining;
     err = nanosleep(&time,&remaining);
   }
+
+  if (global_realtime)
+  {
+    // So how much later than we asked did we actually wake up?
+    int64_t  slept;
+    uint32_t late = 0;
+    clock_gettime(CLOCK_MONOTONIC,&after);
+    slept = (int64_t)(after.tv_sec - before.tv_sec) * 1000000 +
+            (after.tv_nsec - before.tv_nsec) / 1000;
+    if (slept > microseconds)
+      late = (uint32_t)(slept - microseconds);
+    global_wake_count ++;
+    global_wake_late_total += late;
+    if (late > global_wake_late_max)
+      global_wake_late_max = late;
+    if (late > 1000)
+      global_wake_late_1ms ++;
+  }
 #endif // _WIN32
   return;
 }
@@ -1550,6 +1758,188 @@ static int write_socket_data(SOCKET output,
   return 0;
 }
 
+/*
+ * Write a datagram out to a socket, asking the kernel to transmit it at a
+ * particular time (see SO_TXTIME)
+ *
+ * - `output` is a socket for our output, which must have had SO_TXTIME set
+ * - `data` is the data to write out
+ * - `data_len` is how much of it there is
+ * - `txtime` is when to transmit it, in nanoseconds on CLOCK_MONOTONIC
+ * - `unsupported` is set TRUE if the kernel refused the transmit time, in
+ *   which case the caller should stop asking for one
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int write_timed_socket_data(SOCKET    output,
+                                   byte      data[],
+                                   int       data_len,
+                                   uint64_t  txtime,
+                                   int      *unsupported)
+{
+#ifdef HAVE_SO_TXTIME
+  struct iovec    iov;
+  struct msghdr   msg = {0};
+  struct cmsghdr *cmsg;
+  union {
+    char            buf[CMSG_SPACE(sizeof(uint64_t))];
+    struct cmsghdr  align;
+  } control;
+
+  iov.iov_base = data;
+  iov.iov_len = data_len;
+  memset(&control,0,sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_TXTIME;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+  memcpy(CMSG_DATA(cmsg),&txtime,sizeof(uint64_t));
+
+  *unsupported = FALSE;
+  for (;;)
+  {
+    errno = 0;
+    if (sendmsg(output,&msg,0) != -1)
+      return 0;
+    else if (errno == ENOBUFS)
+      print_err("!!! Warning: 'no buffer space available' writing out"
+                " TS packet data - retrying\n");
+    else if (errno == EINVAL || errno == EOPNOTSUPP || errno == ENOPROTOOPT)
+    {
+      *unsupported = TRUE;
+      return 1;
+    }
+    else
+    {
+      fprint_err("### Error writing out TS packet data: %s\n",
+                 strerror(errno));
+      return 1;
+    }
+  }
+#else  // HAVE_SO_TXTIME
+  *unsupported = TRUE;
+  return 1;
+#endif // HAVE_SO_TXTIME
+}
+
+/*
+ * Ask the kernel to pace our UDP output, as requested by `pacing`.
+ *
+ * - `tswriter` is the TS output context, with its buffered output already
+ *   built
+ * - `pacing` is how we would like output paced
+ * - `byterate` is the rate (bytes/second) to start with, if we are
+ *   limiting the socket's rate
+ *
+ * If the kernel can't do what we ask, we fall back to pacing in user space,
+ * with a warning - so there is no error return.
+ */
+static void start_kernel_pacing(TS_writer_p          tswriter,
+                                tswrite_pacing_mode  pacing,
+                                int                  byterate)
+{
+  buffered_TS_output_p  writer = tswriter->writer;
+  const char *name = (pacing == TSWRITE_PACING_TXTIME?"SO_TXTIME":
+                      "SO_MAX_PACING_RATE");
+
+  writer->pacing = TSWRITE_PACING_USER;
+  if (pacing == TSWRITE_PACING_USER)
+    return;
+
+  // There is nothing to pace if we are recording to pcap (which is the
+  // only thing we allow on a virtual clock)
+  if (tswriter->how != TS_W_UDP)
+    return;
+
+  errno = 0;
+#ifdef HAVE_SO_TXTIME
+  if (pacing == TSWRITE_PACING_TXTIME)
+  {
+    struct sock_txtime  config = {0};
+    config.clockid = CLOCK_MONOTONIC;
+    config.flags = 0;
+    if (setsockopt(tswriter->where.socket,SOL_SOCKET,SO_TXTIME,
+                   &config,sizeof(config)) == 0)
+      writer->pacing = TSWRITE_PACING_TXTIME;
+  }
+#endif // HAVE_SO_TXTIME
+#ifdef HAVE_SO_MAX_PACING_RATE
+  if (pacing == TSWRITE_PACING_RATE)
+  {
+    uint32_t  rate = (uint32_t)((uint64_t)byterate * PACING_RATE_HEADROOM / 100);
+    if (setsockopt(tswriter->where.socket,SOL_SOCKET,SO_MAX_PACING_RATE,
+                   &rate,sizeof(rate)) == 0)
+    {
+      writer->pacing = TSWRITE_PACING_RATE;
+      writer->pacing_rate = rate;
+    }
+  }
+#endif // HAVE_SO_MAX_PACING_RATE
+
+  if (writer->pacing == TSWRITE_PACING_USER)
+    fprint_err("!!! Kernel pacing with %s is not available (%s) -"
+               " pacing in user space instead\n",name,
+               (errno?strerror(errno):"not supported on this system"));
+}
+
+/*
+ * Keep the socket's rate limit (SO_MAX_PACING_RATE) in line with the rate
+ * implied by the times on the items we are sending.
+ *
+ * - `output` is the socket for our output
+ * - `writer` is our buffered output context
+ * - `item_time` is the time of the item about to be sent
+ * - `length` is how many bytes it is
+ * - `restart` is TRUE if the timeline has just been reset
+ */
+static void update_pacing_rate(SOCKET                output,
+                               buffered_TS_output_p  writer,
+                               uint32_t              item_time,
+                               int                   length,
+                               int                   restart)
+{
+  uint32_t  elapsed;
+
+  if (restart || writer->pacing_restart)
+  {
+    writer->pacing_start = item_time;
+    writer->pacing_bytes = 0;
+    writer->pacing_restart = FALSE;
+  }
+
+  elapsed = item_time - writer->pacing_start;
+  if (elapsed >= PACING_RATE_PERIOD && writer->pacing_bytes != 0)
+  {
+    uint64_t  rate = writer->pacing_bytes * 1000000 / elapsed *
+                     PACING_RATE_HEADROOM / 100;
+    uint64_t  diff = (rate > writer->pacing_rate ?
+                      rate - writer->pacing_rate :
+                      writer->pacing_rate - rate);
+
+    // Only bother the kernel if the rate has changed by more than 1%
+    if (rate <= UINT32_MAX && diff * 100 > writer->pacing_rate)
+    {
+#ifdef HAVE_SO_MAX_PACING_RATE
+      uint32_t  new_rate = (uint32_t)rate;
+      if (setsockopt(output,SOL_SOCKET,SO_MAX_PACING_RATE,
+                     &new_rate,sizeof(new_rate)) == 0)
+        writer->pacing_rate = new_rate;
+      else
+        fprint_err("!!! Unable to change SO_MAX_PACING_RATE to %u: %s\n",
+                   new_rate,strerror(errno));
+#endif // HAVE_SO_MAX_PACING_RATE
+    }
+    writer->pacing_start = item_time;
+    writer->pacing_bytes = 0;
+  }
+  writer->pacing_bytes += length;
+}
+
 /*
  * Read a command character from the command input socket
  *
@@ -1796,6 +2186,18 @@ static int read_command(SOCKET    command_socket,
   return 0;
 }
 
+/*
+ * Record a newly received command, if anyone is interested
+ */
+static inline void note_command(TS_writer_p  tswriter)
+{
+  if (tswriter->metrics != NULL && tswriter->command_changed)
+  {
+    METRIC_ADD(tswriter->metrics,commands,1);
+    METRIC_SET(tswriter->metrics,command,tswriter->command);
+  }
+}
+
 /*
  * Write data out to a socket using TCP/IP (and maybe reading commands as well)
  *
@@ -1867,6 +2269,7 @@ static int write_tcp_data(TS_writer_p  tswriter,
         err = read_command(tswriter->command_socket,
                            &tswriter->command,&tswriter->command_changed);
         if (err) return 1;
+        note_command(tswriter);
       }
 
       // Note that, unless we've quit, we always write out the outstanding
@@ -1943,24 +2346,138 @@ extern int wait_for_command(TS_writer_p  tswriter)
         err = read_command(tswriter->command_socket,
                            &tswriter->command,&tswriter->command_changed);
         if (err) return 1;
+        note_command(tswriter);
       }
     }
     return 0;
   }
 }
 
+/*
+ * Close pcap output (as opened by `open_pcap_output`), and free it.
+ *
+ * Returns 0 if all goes well, 1 if something went wrong.
+ */
+static int close_pcap_output(TS_pcap_output_p  *pcap)
+{
+  int  err = 0;
+  if (*pcap == NULL)
+    return 0;
+  if (pcap_write_close(&(*pcap)->scheduled))
+    err = 1;
+  if (pcap_write_close(&(*pcap)->actual))
+    err = 1;
+  if (err)
+    fprint_err("### Error closing pcap output: %s\n",strerror(errno));
+  free(*pcap);
+  *pcap = NULL;
+  return err;
+}
+
+/*
+ * Record a datagram to our pcap output, as if it had been sent to our
+ * destination port + `port_offset`, at time `due`.
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int write_pcap_datagram(TS_pcap_output_p  pcap,
+                               int               port_offset,
+                               struct timeval   *due,
+                               byte             *data,
+                               int               length)
+{
+  int       err;
+  byte     *ip  = pcap->header + PCAP_ETHERNET_HDR_SIZE;
+  byte     *udp = ip + PCAP_IPV4_HDR_SIZE;
+  uint32_t  sum = 0;
+  int       ii;
+
+  set_16_be(ip+2,PCAP_IPV4_HDR_SIZE + PCAP_UDP_HDR_SIZE + length);
+  set_16_be(ip+4,pcap->ident++);
+  set_16_be(ip+10,0);
+  for (ii = 0; ii < PCAP_IPV4_HDR_SIZE; ii += 2)
+    sum += (ip[ii] << 8) | ip[ii+1];
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  set_16_be(ip+10,~sum & 0xFFFF);
+
+  set_16_be(udp+2,pcap->dest_port + port_offset);
+  set_16_be(udp+4,PCAP_UDP_HDR_SIZE + length);
+
+  err = pcap_write_next(pcap->scheduled,due->tv_sec,due->tv_usec,
+                        pcap->header,PCAP_HEADERS_SIZE,data,length);
+  if (err == 0 && pcap->actual != NULL)
+  {
+    struct timeval now;
+    get_child_time(&now);
+    err = pcap_write_next(pcap->actual,now.tv_sec,now.tv_usec,
+                          pcap->header,PCAP_HEADERS_SIZE,data,length);
+  }
+  if (err)
+  {
+    fprint_err("### Error writing datagram to pcap file: %s\n",
+               strerror(errno));
+    return 1;
+  }
+  pcap->datagrams ++;
+  return 0;
+}
+
+/*
+ * Generate any FEC that results from sending the given RTP packet, and
+ * send it (or, if recording to pcap, record it, stamped with `due`).
+ *
+ * Errors are reported, but otherwise ignored, in the same spirit as errors
+ * writing the media packets themselves.
+ */
+static void write_FEC_data(buffered_TS_output_p  writer,
+                           struct timeval       *due,
+                           byte                 *packet,
+                           int                   length)
+{
+  int   err;
+  byte *column_fec, *row_fec;
+  int   column_length, row_length;
+
+  err = add_packet_to_FEC(writer->fec,packet,length,
+                          &column_fec,&column_length,&row_fec,&row_length);
+  if (err) return;
+
+  if (writer->pcap != NULL)
+  {
+    if (column_fec != NULL)
+      (void) write_pcap_datagram(writer->pcap,2,due,column_fec,column_length);
+    if (row_fec != NULL)
+      (void) write_pcap_datagram(writer->pcap,4,due,row_fec,row_length);
+    return;
+  }
+  if (column_fec != NULL)
+    (void) write_socket_data(writer->fec_column_socket,column_fec,
+                             column_length);
+  if (row_fec != NULL)
+    (void) write_socket_data(writer->fec_row_socket,row_fec,row_length);
+}
+
 /*
  * Write the next data item in our buffer
  *
  * - `output` is a socket for our output
- * - `circular` is our circular buffer of "packets"
+ * - `writer` is our buffered output context, containing our circular
+ *   buffer of "packets"
+ * - `due` is when the item should be sent (used to stamp it if we are
+ *   recording to a pcap file instead)
+ * - `txtime` is when the kernel should send it (nanoseconds, on
+ *   CLOCK_MONOTONIC), if we are pacing with SO_TXTIME
  *
  * Returns 0 if all went well, 1 if something went wrong.
  */
 static int write_circular_data(const SOCKET             output,
-                               const circular_buffer_p  circular)
+                               buffered_TS_output_p     writer,
+                               struct timeval          *due,
+                               uint64_t                 txtime)
 {
   int     err;
+  circular_buffer_p  circular = writer->buffer;
   byte   *buffer  = circular->item_data + circular->start*circular->item_size - circular->hdr_size;
   int     length  = circular->item[circular->start].length + circular->hdr_size;
 #if DISPLAY_BUFFER
@@ -1969,7 +2486,29 @@ static int write_circular_data(const SOCKET             output,
   int  newend,newstart;
 #endif
 
-  err = write_socket_data(output,buffer,length);
+  if (writer->pcap != NULL)
+    err = write_pcap_datagram(writer->pcap,0,due,buffer,length);
+  else if (writer->pacing == TSWRITE_PACING_TXTIME)
+  {
+    int  unsupported;
+    err = write_timed_socket_data(output,buffer,length,txtime,&unsupported);
+    if (err && unsupported)
+    {
+      fprint_err("!!! Kernel refused a transmit time (%s) -"
+                 " pacing in user space instead\n",strerror(errno));
+      writer->pacing = TSWRITE_PACING_USER;
+      err = write_socket_data(output,buffer,length);
+    }
+  }
+  else
+    err = write_socket_data(output,buffer,length);
+  if (err)
+    METRIC_ADD(circular->metrics,send_errors,1);
+  else
+  {
+    METRIC_ADD(circular->metrics,datagrams_sent,1);
+    METRIC_ADD(circular->metrics,bytes_sent,length);
+  }
 
   if (err)
   {
@@ -1982,6 +2521,9 @@ static int write_circular_data(const SOCKET             output,
     // of error or warning message).
   }
 
+  if (writer->fec != NULL)
+    write_FEC_data(writer,due,buffer,length);
+
 #if DISPLAY_BUFFER
   if (global_show_circular)
   {
@@ -2006,6 +2548,7 @@ static int write_circular_data(const SOCKET             output,
   // the circular buffer
   buffer[0] = 0; // just for debug output's sake
   circular->start = (circular->start + 1) % circular->size;
+  note_buffer_items(circular);
 
 #if DISPLAY_BUFFER
   if (global_show_circular)
@@ -2086,7 +2629,8 @@ static int32_t perturb_time_by(void)
  * Write the next data item in our buffer
  *
  * - `output` is a socket for our output
- * - `circular` is our circular buffer of "packets"
+ * - `writer` is our buffered output context, containing our circular
+ *   buffer of "packets"
  * - if `quiet` then don't output extra messages (about filling up
  *   circular buffer)
  * - `had_eof` is set TRUE if we read a packet flagged to indicate
@@ -2094,12 +2638,13 @@ static int32_t perturb_time_by(void)
  *
  * Returns 0 if all went well, 1 if something went wrong.
  */
-static int write_from_circular(SOCKET             output,
-                               circular_buffer_p  circular,
-                               int                quiet,
-                               int               *had_eof)
+static int write_from_circular(SOCKET                output,
+                               buffered_TS_output_p  writer,
+                               int                   quiet,
+                               int                  *had_eof)
 {
   int  err;
+  circular_buffer_p  circular = writer->buffer;
 
   // Are we starting up for the first time?
   static int starting = TRUE;
@@ -2127,6 +2672,9 @@ static int write_from_circular(SOCKET             output,
   static int32_t  delta_start;  // difference between our time and the parent's
   uint32_t adjusted_now;   // our time, adjusted by delta_start
   int32_t  waitfor; // how long we think we need to wait to adjust
+  struct timeval due;      // when, on our time line, it should be written
+  uint64_t txtime = 0;     // and when the kernel should send it, if it paces
+  int      timeline_reset = FALSE;
 
   // How many items have we sent without *any* delay?
   // (not used if maxnowait is off)
@@ -2180,7 +2728,17 @@ static int write_from_circular(SOCKET             output,
   packet_time_gap  = this_packet_time - last_packet_time;
 
   // Work out the actual position on our own timeline
-  gettimeofday(&now, NULL);
+  get_child_time(&now);
+#ifdef HAVE_SO_TXTIME
+  if (writer->pacing == TSWRITE_PACING_TXTIME)
+  {
+    // The kernel wants transmit times on CLOCK_MONOTONIC, so note where
+    // that clock is now, and we can add our wait to it
+    struct timespec  mono;
+    clock_gettime(CLOCK_MONOTONIC,&mono);
+    txtime = (uint64_t)mono.tv_sec * 1000000000 + mono.tv_nsec;
+  }
+#endif // HAVE_SO_TXTIME
   // We're *actually* at this distance along our time line
   our_time_now = (now.tv_sec - start.tv_sec) * 1000000 +
     (now.tv_usec - start.tv_usec);
@@ -2209,6 +2767,7 @@ static int write_from_circular(SOCKET             output,
       fprint_msg("<-- packet %6u, gap %6u; STARTING delta %6d ",
                  this_packet_time,packet_time_gap,delta_start);
     reset = FALSE;
+    timeline_reset = TRUE;
   }
   else
   {
@@ -2224,6 +2783,21 @@ static int write_from_circular(SOCKET             output,
                  waitfor);
   }
 
+  METRIC_SET(circular->metrics,pacing_error,waitfor);
+
+  // Which is to say, at this time
+  {
+    int64_t  due_usec = (int64_t)start.tv_usec +
+                        (int32_t)(this_packet_time - delta_start);
+    due.tv_sec  = start.tv_sec + (long)(due_usec / 1000000);
+    due.tv_usec = (long)(due_usec % 1000000);
+    if (due.tv_usec < 0)
+    {
+      due.tv_sec --;
+      due.tv_usec += 1000000;
+    }
+  }
+
   // So how long *should* we wait for the correct time to write?
   if (waitfor > 0)
   {
@@ -2231,6 +2805,7 @@ static int write_from_circular(SOCKET             output,
     {
       fprint_msg("###[%d] (%d) >0.2s, RESET\n", circular->start, waitfor);
       reset = TRUE;
+      METRIC_ADD(circular->metrics,timing_resets,1);
       waitfor = 200000;
     }
     if (global_child_debug) print_msg("(waiting");
@@ -2264,6 +2839,7 @@ static int write_from_circular(SOCKET             output,
       // Ask for a reset, and output the packet right away
       reset = TRUE;
       waitfor = 0;
+      METRIC_ADD(circular->metrics,timing_resets,1);
     }
   }
 
@@ -2287,14 +2863,33 @@ static int write_from_circular(SOCKET             output,
     if (global_child_debug) print_msg(")\n");
 
   // So, finally, do we need to wait before writing?
-  if (waitfor > 0)
+  if (writer->pacing == TSWRITE_PACING_USER)
   {
-    wait_microseconds(waitfor);
-    sent_without_delay = 0;
+    if (waitfor > 0)
+    {
+      wait_microseconds(waitfor);
+      sent_without_delay = 0;
+    }
+  }
+  else
+  {
+    // The kernel does the fine timing, so we only need to wake up in time
+    // to hand it each item a little before it is due
+    if (waitfor > PACING_LEAD_US)
+      wait_microseconds(waitfor - PACING_LEAD_US);
+    if (waitfor > 0)
+    {
+      txtime += (uint64_t)waitfor * 1000;
+      sent_without_delay = 0;
+    }
+    if (writer->pacing == TSWRITE_PACING_RATE)
+      update_pacing_rate(output,writer,this_packet_time,
+                         circular->item[circular->start].length +
+                         circular->hdr_size,timeline_reset);
   }
 
   // Write it...
-  err = write_circular_data(output,circular);
+  err = write_circular_data(output,writer,&due,txtime);
   if (err) return 1;
 
   // Don't forget to update our memory before we finish
@@ -2302,6 +2897,74 @@ static int write_from_circular(SOCKET             output,
   return 0;
 }
 
+/*
+ * Apply the real-time profile to the child process (or thread, on Windows),
+ * as far as we are able.
+ *
+ * None of this is essential, so if any of it fails (typically because we
+ * are not allowed to do it), we warn and carry on without it.
+ */
+static void start_realtime_child(int  quiet)
+{
+#ifdef _WIN32
+  if (global_rt_cpu != -1 &&
+      SetThreadAffinityMask(GetCurrentThread(),
+                            (DWORD_PTR)1 << global_rt_cpu) == 0)
+    fprint_err("!!! Unable to pin output thread to CPU %d\n",global_rt_cpu);
+  if (global_rt_priority != 0 &&
+      !SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_TIME_CRITICAL))
+    print_err("!!! Unable to raise output thread priority\n");
+#else  // _WIN32
+#ifdef __linux__
+  if (global_rt_cpu != -1)
+  {
+    cpu_set_t  cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(global_rt_cpu,&cpus);
+    if (sched_setaffinity(0,sizeof(cpus),&cpus))
+      fprint_err("!!! Unable to pin output process to CPU %d: %s\n",
+                 global_rt_cpu,strerror(errno));
+  }
+  if (global_rt_priority != 0)
+  {
+    struct sched_param  param = {0};
+    param.sched_priority = global_rt_priority;
+    if (sched_setscheduler(0,SCHED_FIFO,&param))
+      fprint_err("!!! Unable to use SCHED_FIFO priority %d for output"
+                 " process: %s\n",global_rt_priority,strerror(errno));
+  }
+#else  // __linux__
+  if (global_rt_cpu != -1 || global_rt_priority != 0)
+    print_err("!!! CPU pinning and SCHED_FIFO are not supported on this"
+              " system\n");
+#endif // __linux__
+  // Locking our memory also faults in anything not yet mapped, including
+  // our view of the (already prefaulted) circular buffer
+  if (mlockall(MCL_CURRENT | MCL_FUTURE))
+    fprint_err("!!! Unable to lock output process memory: %s\n",
+               strerror(errno));
+#endif // _WIN32
+  if (!quiet)
+  {
+    print_msg("Output using real-time profile\n");
+    flush_msg();
+  }
+}
+
+/*
+ * Report on how late the child woke up, with the real-time profile
+ */
+static void report_wake_latency(void)
+{
+  if (global_wake_count == 0)
+    return;
+  fprint_msg("Woke %u times, late by %u microseconds on average"
+             " (at most %u), %u times by more than 1ms\n",
+             global_wake_count,
+             (uint32_t)(global_wake_late_total / global_wake_count),
+             global_wake_late_max,global_wake_late_1ms);
+}
+
 /*
  * The child process just writes the contents of the circular buffer out,
  * as it receives it.
@@ -2327,15 +2990,43 @@ static int write_from_circular(SOCKET             output,
 static int tswrite_child_process(TS_writer_p  tswriter)
 {
   int had_eof = FALSE;
+  if (global_realtime)
+    start_realtime_child(tswriter->quiet);
   for (;;)
   {
     int err = write_from_circular(tswriter->where.socket,
-                                  tswriter->writer->buffer,
+                                  tswriter->writer,
                                   tswriter->quiet,
                                   &had_eof);
     if (err) return 1;
     if (had_eof) break;
   }
+  if (tswriter->writer->pcap != NULL)
+  {
+    TS_pcap_output_p  pcap = tswriter->writer->pcap;
+    // Our records are still (at least partly) in our output buffers
+    if (pcap_flush(pcap->scheduled) || pcap_flush(pcap->actual))
+      print_err("### Error writing out pcap file\n");
+    if (!tswriter->quiet)
+    {
+      fprint_msg("Recorded %u datagrams to pcap\n",pcap->datagrams);
+      flush_msg();  // since the child will exit with _exit()
+    }
+  }
+  if (tswriter->writer->fec != NULL && !tswriter->quiet)
+  {
+    FEC_encoder_p  fec = tswriter->writer->fec;
+    fprint_msg("Sent %u column ",fec->num_column);
+    if (fec->want_rows)
+      fprint_msg("and %u row ",fec->num_row);
+    fprint_msg("FEC packets for %u RTP packets\n",fec->num_media);
+    flush_msg();  // since the child will exit with _exit()
+  }
+  if (global_realtime && !tswriter->quiet)
+  {
+    report_wake_latency();
+    flush_msg();  // since the child will exit with _exit()
+  }
   return 0;
 }
 #ifdef _WIN32
@@ -2356,9 +3047,14 @@ static void child_thread_fn(void_p arg)
     // On Windows, only the "child" knows when it has finished using its
     // resources (i.e., the circular buffer and output socket), so only the
     // "child" can sensibly release them...
-    err = disconnect_socket(tswriter->where.socket);
-    if (err == EOF)
-      fprint_err("### Error closing output: %s\n",strerror(errno));
+    if (tswriter->how == TS_W_PCAP)
+      err = close_pcap_output(&tswriter->where.pcap);
+    else
+    {
+      err = disconnect_socket(tswriter->where.socket);
+      if (err == EOF)
+        fprint_err("### Error closing output: %s\n",strerror(errno));
+    }
 
     // And free the buffering stuff
     err = free_buffered_TS_output(&(tswriter->writer));
@@ -2470,6 +3166,7 @@ static int tswrite_build(TS_WRITER_TYPE  how,
   new->command_changed = FALSE;   // no new command
   new->atomic_command = FALSE;    // but any command is interruptable
   new->drop_packets = 0;
+  new->metrics = NULL;
   *tswriter = new;
   return 0;
 }
@@ -2568,6 +3265,10 @@ extern int tswrite_open(TS_WRITER_TYPE  how,
     }
     if (!quiet) fprint_msg("Writing    to %s via UDP\n",name);
     break;
+  case TS_W_PCAP:
+    print_err("### Use tswrite_open_pcap() to record to a pcap file\n");
+    free(new);
+    return 1;
   default:
     fprint_err("### Unexpected writer type %d to tswrite_open()\n",how);
     free(new);
@@ -2627,6 +3328,157 @@ extern int tswrite_open_file(char           *name,
   return tswrite_open((name==NULL?TS_W_STDOUT:TS_W_FILE),name,NULL,0,quiet,
                       tswriter);
 }
+
+/*
+ * Open pcap file(s) to record the datagrams we would send to `host`:`port`.
+ *
+ * - `filename` is the file to record them to, stamped with when each
+ *   datagram was due to be sent
+ * - `actual_filename` is NULL, or a second file to record them to,
+ *   stamped with when each was actually written
+ * - `host` and `port` are where we are pretending to send to
+ * - `pcap` is the new pcap output
+ *
+ * Returns 0 if all goes well, 1 if something went wrong.
+ */
+static int open_pcap_output(char              *filename,
+                            char              *actual_filename,
+                            char              *host,
+                            int                port,
+                            TS_pcap_output_p  *pcap)
+{
+  TS_pcap_output_p  new;
+  uint32_t  addr = inet_addr(host);
+  byte     *ethernet, *ip, *udp;
+  int       err;
+
+  if (addr == INADDR_NONE)
+  {
+    struct hostent *hp = gethostbyname(host);
+    if (hp == NULL)
+    {
+      fprint_err("### Unable to resolve host %s\n",host);
+      return 1;
+    }
+    memcpy(&addr,hp->h_addr,4);
+  }
+  addr = ntohl(addr);
+
+  new = malloc(SIZEOF_TS_PCAP_OUTPUT);
+  if (new == NULL)
+  {
+    print_err("### Unable to allocate pcap output datastructure\n");
+    return 1;
+  }
+  memset(new,0,SIZEOF_TS_PCAP_OUTPUT);
+  new->dest_addr = addr;
+  new->dest_port = port;
+
+  err = pcap_create(&new->scheduled,filename,PCAP_NETWORK_TYPE_ETHERNET);
+  if (err)
+  {
+    fprint_err("### Unable to create pcap file %s: %s\n",
+               filename,strerror(errno));
+    free(new);
+    return 1;
+  }
+  if (actual_filename != NULL)
+  {
+    err = pcap_create(&new->actual,actual_filename,PCAP_NETWORK_TYPE_ETHERNET);
+    if (err)
+    {
+      fprint_err("### Unable to create pcap file %s: %s\n",
+                 actual_filename,strerror(errno));
+      (void) close_pcap_output(&new);
+      return 1;
+    }
+  }
+
+  // Fill in everything in the headers that does not change from
+  // datagram to datagram
+  ethernet = new->header;
+  if (IN_CLASSD(addr))
+  {
+    // The multicast MAC address for the group
+    ethernet[0] = 0x01; ethernet[1] = 0x00; ethernet[2] = 0x5E;
+    ethernet[3] = (addr >> 16) & 0x7F;
+    ethernet[4] = (addr >> 8) & 0xFF;
+    ethernet[5] = addr & 0xFF;
+  }
+  else
+  {
+    // A locally administered unicast address
+    ethernet[0] = 0x02; ethernet[5] = 0x02;
+  }
+  ethernet[6] = 0x02; ethernet[11] = 0x01;
+  set_16_be(ethernet+12,0x0800);      // IPv4
+
+  ip = ethernet + PCAP_ETHERNET_HDR_SIZE;
+  ip[0] = 0x45;                       // version 4, 5 words of header
+  set_16_be(ip+6,0x4000);             // don't fragment
+  ip[8] = (IN_CLASSD(addr) ? 1 : 64); // TTL
+  ip[9] = 17;                         // UDP
+  set_32_be(ip+12,PCAP_SOURCE_ADDR);
+  set_32_be(ip+16,addr);
+
+  udp = ip + PCAP_IPV4_HDR_SIZE;
+  set_16_be(udp,port);                // send from the same port number
+  // and we leave the (optional, for IPv4) UDP checksum as 0
+
+  *pcap = new;
+  return 0;
+}
+
+/*
+ * Open a pcap file for TS output.
+ *
+ * Instead of sending UDP datagrams to `host`:`port`, each datagram is
+ * recorded (with the Ethernet, IPv4 and UDP headers it would have had) in
+ * pcap file `filename`, stamped with the time at which it was due to be
+ * sent. This allows the output timing to be examined (for instance, with
+ * pcapreport) without needing a network.
+ *
+ * - `filename` is the pcap file to write
+ * - `actual_filename` is NULL, or the name of a second pcap file, to which
+ *   the same datagrams are written, stamped with the time they were
+ *   actually written
+ * - `host` and `port` are where the datagrams are notionally sent to
+ * - `quiet` is true if only error messages should be printed
+ * - `tswriter` is the new context to use for writing TS output,
+ *   which should be closed using `tswrite_close`.
+ *
+ * As for TS_W_UDP, the ``tswrite_start_buffering`` function must be called
+ * before any output is written via the `tswriter`.
+ *
+ * Returns 0 if all goes well, 1 if something went wrong.
+ */
+extern int tswrite_open_pcap(char           *filename,
+                             char           *actual_filename,
+                             char           *host,
+                             int             port,
+                             int             quiet,
+                             TS_writer_p    *tswriter)
+{
+  int err = tswrite_build(TS_W_PCAP,quiet,tswriter);
+  if (err) return 1;
+
+  err = open_pcap_output(filename,actual_filename,host,port,
+                         &(*tswriter)->where.pcap);
+  if (err)
+  {
+    free(*tswriter);
+    *tswriter = NULL;
+    return 1;
+  }
+  if (!quiet)
+  {
+    fprint_msg("Recording  to %s, as UDP to %s port %d\n",filename,host,port);
+    if (actual_filename != NULL)
+      fprint_msg("(and to %s, stamped with the actual time written)\n",
+                 actual_filename);
+  }
+  return 0;
+}
 
 /*
  * Wait for a client to connect and then both write TS data to it and
@@ -2682,6 +3534,123 @@ extern int tswrite_wait_for_client(int           server_socket,
   return 0;
 }
 
+/*
+ * Open a UDP socket for FEC output, sending to the same host as our
+ * media output socket, but on port `port_offset` higher.
+ *
+ * If the media output is multicast, then its TTL and interface are copied.
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int open_FEC_socket(SOCKET   media,
+                           int      port_offset,
+                           SOCKET  *fec)
+{
+  struct sockaddr_in  addr;
+#ifdef _WIN32
+  int        addr_len = sizeof(addr);
+#else
+  socklen_t  addr_len = sizeof(addr);
+#endif
+  SOCKET     output;
+  int        result;
+
+  result = getpeername(media,(struct sockaddr *)&addr,&addr_len);
+  if (result != 0)
+  {
+    fprint_err("### Unable to find where output is going, for FEC: %s\n",
+               strerror(errno));
+    return 1;
+  }
+  addr.sin_port = htons(ntohs(addr.sin_port) + port_offset);
+
+  output = socket(AF_INET,SOCK_DGRAM,0);
+  if (output == -1)
+  {
+    fprint_err("### Unable to create FEC socket: %s\n",strerror(errno));
+    return 1;
+  }
+
+  if (IN_CLASSD(ntohl(addr.sin_addr.s_addr)))
+  {
+    byte            ttl;
+    struct in_addr  iface;
+#ifdef _WIN32
+    int        len;
+#else
+    socklen_t  len;
+#endif
+    len = sizeof(ttl);
+    if (getsockopt(media,IPPROTO_IP,IP_MULTICAST_TTL,(char *)&ttl,&len) == 0)
+      (void) setsockopt(output,IPPROTO_IP,IP_MULTICAST_TTL,(char *)&ttl,len);
+    len = sizeof(iface);
+    if (getsockopt(media,IPPROTO_IP,IP_MULTICAST_IF,(char *)&iface,&len) == 0)
+      (void) setsockopt(output,IPPROTO_IP,IP_MULTICAST_IF,(char *)&iface,len);
+  }
+
+  result = connect(output,(struct sockaddr *)&addr,addr_len);
+  if (result != 0)
+  {
+    fprint_err("### Unable to connect FEC socket to port %d: %s\n",
+               ntohs(addr.sin_port),strerror(errno));
+    (void) disconnect_socket(output);
+    return 1;
+  }
+  *fec = output;
+  return 0;
+}
+
+/*
+ * Set up SMPTE 2022-1 FEC generation for our (RTP) buffered output.
+ *
+ * This must be done before the child process is started, since it is the
+ * child that generates and sends the FEC.
+ *
+ * Returns 0 if all went well, 1 if something went wrong.
+ */
+static int start_FEC_output(TS_writer_p  tswriter,
+                            int          columns,
+                            int          rows,
+                            int          row_fec)
+{
+  int  err;
+  buffered_TS_output_p  writer = tswriter->writer;
+  circular_buffer_p     circular = writer->buffer;
+
+  if (circular->hdr_type != PKT_HDR_TYPE_RTP)
+  {
+    print_err("### FEC can only be sent with RTP output\n");
+    return 1;
+  }
+
+  err = build_FEC_encoder(columns,rows,row_fec,
+                          circular->item_size - circular->hdr_size,
+                          &writer->fec);
+  if (err) return 1;
+
+  // When recording to pcap, the FEC is recorded alongside the media
+  if (writer->pcap == NULL)
+  {
+    err = open_FEC_socket(tswriter->where.socket,2,&writer->fec_column_socket);
+    if (err) return 1;
+    if (row_fec)
+    {
+      err = open_FEC_socket(tswriter->where.socket,4,&writer->fec_row_socket);
+      if (err) return 1;
+    }
+  }
+
+  if (!tswriter->quiet)
+  {
+    fprint_msg("Sending SMPTE 2022-1 FEC for a %dx%d matrix: column FEC on"
+               " port +2",columns,rows);
+    if (row_fec)
+      print_msg(", row FEC on port +4");
+    print_msg("\n");
+  }
+  return 0;
+}
+
 /*
  * Set up internal buffering for TS output. This is necessary for UDP
  * output, and not allowed for other forms of output.
@@ -2713,6 +3682,13 @@ extern int tswrite_wait_for_client(int           server_socket,
  *   rate. This should normally be set to 100 (i.e., no effect).
  * - `pcr_scale` determines how much to "accelerate" each PCR - see the
  *   notes elsewhere on how this works.
+ * - `hdr_type` says what header (if any) to put before each network packet
+ * - if `fec_columns` is non-zero, then SMPTE 2022-1 FEC is sent alongside
+ *   the (RTP) output, using a matrix of `fec_columns` by `fec_rows`. Column
+ *   FEC is sent to the output port + 2, and, if `fec_row_fec` is TRUE, row
+ *   FEC to the output port + 4.
+ * - `pacing` says how UDP output should be paced. If the kernel cannot
+ *   do the pacing asked for, we fall back to pacing in user space.
  *
  * Returns 0 if all went well, 1 if something went wrong.
  */
@@ -2726,11 +3702,15 @@ extern int tswrite_start_buffering(TS_writer_p  tswriter,
                                    int          prime_size,
                                    int          prime_speedup,
                                    double       pcr_scale,
-                                   const tswrite_pkt_hdr_type_t hdr_type)
+                                   const tswrite_pkt_hdr_type_t hdr_type,
+                                   int          fec_columns,
+                                   int          fec_rows,
+                                   int          fec_row_fec,
+                                   tswrite_pacing_mode pacing)
 {
   int   err;
 
-  if (tswriter->how != TS_W_UDP)
+  if (tswriter->how != TS_W_UDP && tswriter->how != TS_W_PCAP)
   {
     fprint_err("### Buffered output not supported for %s output\n",
                (tswriter->how == TS_W_TCP?"TCP/IP":
@@ -2738,6 +3718,12 @@ extern int tswrite_start_buffering(TS_writer_p  tswriter,
                 tswriter->how == TS_W_STDOUT?"<standard output>":"???"));
     return 1;
   }
+  if (global_virtual_clock && tswriter->how != TS_W_PCAP)
+  {
+    print_err("### A virtual clock only makes sense when recording"
+              " to a pcap file\n");
+    return 1;
+  }
   
   err = build_buffered_TS_output(&(tswriter->writer),
                                  circ_buf_size,TS_in_packet,
@@ -2746,6 +3732,27 @@ extern int tswrite_start_buffering(TS_writer_p  tswriter,
 	                             hdr_type);
   if (err) return 1;
 
+  if (tswriter->how == TS_W_PCAP)
+    tswriter->writer->pcap = tswriter->where.pcap;
+
+  if (tswriter->metrics != NULL)
+  {
+    tswriter->writer->buffer->metrics = tswriter->metrics;
+    METRIC_SET(tswriter->metrics,buffer_size,tswriter->writer->buffer->size);
+  }
+
+  start_kernel_pacing(tswriter,pacing,byterate);
+
+  if (fec_columns)
+  {
+    err = start_FEC_output(tswriter,fec_columns,fec_rows,fec_row_fec);
+    if (err)
+    {
+      (void) free_buffered_TS_output(&tswriter->writer);
+      return 1;
+    }
+  }
+
   err = start_child(tswriter);
   if (err) 
   {
@@ -2780,9 +3787,36 @@ extern int tswrite_start_buffering_from_context(TS_writer_p  tswriter,
                                  context->prime_size,
                                  context->prime_speedup,
                                  context->pcr_scale,
-                                 context->pkt_hdr_type);
+                                 context->pkt_hdr_type,
+                                 context->fec_columns,
+                                 context->fec_rows,
+                                 context->fec_row_fec,
+                                 context->pacing);
 }
 
+/*
+ * Ask a TS output context to record how it is doing in the given metrics
+ * session (see metrics_fns.h).
+ *
+ * If buffered output is used, this should be called before
+ * ``tswrite_start_buffering``, so that the child process also records
+ * what it does.
+ *
+ * - `tswriter` is the TS output context returned by `tswrite_open`
+ * - `session` is the metrics session, or NULL to stop recording metrics
+ */
+extern void tswrite_set_metrics(TS_writer_p        tswriter,
+                                metrics_session_p  session)
+{
+  tswriter->metrics = session;
+  METRIC_SET(session,state,METRICS_SESSION_PLAYING);
+  if (tswriter->writer != NULL)
+  {
+    tswriter->writer->buffer->metrics = session;
+    METRIC_SET(session,buffer_size,tswriter->writer->buffer->size);
+  }
+}
+
 /*
  * Indicate to a TS output context that `input` is to be used as
  * command input.
@@ -2990,6 +4024,10 @@ static int tswrite_close_file(TS_writer_p  tswriter)
       return 1;
     }
     break;
+  case TS_W_PCAP:
+    err = close_pcap_output(&tswriter->where.pcap);
+    if (err) return 1;
+    break;
   default:
     fprint_err("### Unexpected writer type %d to tswrite_close()\n",
                tswriter->how);
@@ -3068,6 +4106,94 @@ extern int tswrite_close(TS_writer_p  tswriter,
   return 0;
 }
 
+/*
+ * Ask for output to be passed on with as little delay as possible, for
+ * live use.
+ *
+ * For TCP/IP output, this turns off Nagle's algorithm (TCP_NODELAY), so
+ * that data is not held back waiting for an acknowledgement. On Linux, the
+ * socket is also "corked", so that full size segments are still sent while
+ * a picture is being written, and `tswrite_flush` then sends what is left.
+ *
+ * For file and standard output, `tswrite_flush` pushes out what has been
+ * written so far.
+ *
+ * - `tswriter` is the TS output context returned by `tswrite_open`
+ *
+ * Returns 0 if all goes well, 1 if something went wrong.
+ */
+extern int tswrite_set_low_latency(TS_writer_p  tswriter)
+{
+  int  on = 1;
+
+  if (tswriter->how != TS_W_TCP)
+    return 0;
+
+  if (setsockopt(tswriter->where.socket,IPPROTO_TCP,TCP_NODELAY,
+                 (char *)&on,sizeof(on)))
+  {
+    fprint_err("### Error turning off Nagle's algorithm for TCP/IP"
+               " output: %s\n",strerror(errno));
+    return 1;
+  }
+#ifdef TCP_CORK
+  if (setsockopt(tswriter->where.socket,IPPROTO_TCP,TCP_CORK,
+                 &on,sizeof(on)))
+  {
+    fprint_err("### Error corking TCP/IP output: %s\n",strerror(errno));
+    return 1;
+  }
+#endif // TCP_CORK
+  return 0;
+}
+
+/*
+ * Push out any TS data that has been written but is still being held in
+ * a buffer. Typically used after each picture, with
+ * `tswrite_set_low_latency`.
+ *
+ * This has no effect for buffered (UDP) output, where the child process
+ * decides when to send each packet.
+ *
+ * - `tswriter` is the TS output context returned by `tswrite_open`
+ *
+ * Returns 0 if all goes well, 1 if something went wrong.
+ */
+extern int tswrite_flush(TS_writer_p  tswriter)
+{
+  switch (tswriter->how)
+  {
+  case TS_W_STDOUT:
+  case TS_W_FILE:
+    if (fflush(tswriter->where.file))
+    {
+      fprint_err("### Error flushing output: %s\n",strerror(errno));
+      return 1;
+    }
+    break;
+#ifdef TCP_CORK
+  case TS_W_TCP:
+    {
+      // Taking the cork out sends anything that is waiting, and we then
+      // put it back for next time
+      int  off = 0, on = 1;
+      if (setsockopt(tswriter->where.socket,IPPROTO_TCP,TCP_CORK,
+                     &off,sizeof(off)) ||
+          setsockopt(tswriter->where.socket,IPPROTO_TCP,TCP_CORK,
+                     &on,sizeof(on)))
+      {
+        fprint_err("### Error flushing TCP/IP output: %s\n",strerror(errno));
+        return 1;
+      }
+    }
+    break;
+#endif // TCP_CORK
+  default:
+    break;
+  }
+  return 0;
+}
+
 /*
  * Write a Transport Stream packet out via the TS writer.
  *
@@ -3137,10 +4263,14 @@ extern int tswrite_write(TS_writer_p  tswriter,
     case TS_W_TCP:
       err = write_tcp_data(tswriter,packet,TS_PACKET_SIZE);
       if (err) return err;  // important, because it might be 0, 1 or EOF
+      METRIC_ADD(tswriter->metrics,datagrams_sent,1);
+      METRIC_ADD(tswriter->metrics,bytes_sent,TS_PACKET_SIZE);
       break;
     case TS_W_UDP:
       err = write_socket_data(tswriter->where.socket,packet,TS_PACKET_SIZE);
       if (err) return 1;
+      METRIC_ADD(tswriter->metrics,datagrams_sent,1);
+      METRIC_ADD(tswriter->metrics,bytes_sent,TS_PACKET_SIZE);
       break;
     default:
       fprint_err("### Unexpected writer type %d to tswrite_write()\n",
@@ -3157,6 +4287,7 @@ extern int tswrite_write(TS_writer_p  tswriter,
                                       pid,got_pcr,pcr);
     if (err) return 1;
   }
+  METRIC_ADD(tswriter->metrics,ts_packets,1);
   return 0;
 }
 
@@ -3222,6 +4353,23 @@ extern void tswrite_help_tuning(void)
     "                    give fragmented packets on 'traditional' networks. Specifying\n"
     "                    less will cause more packets than necessary.\n"
     "\n"
+    "  -rtp              Put an RTP header on each network packet.\n"
+    "  -fec <L>,<D>      Also send SMPTE 2022-1 (Pro-MPEG) FEC for a matrix of\n"
+    "                    <L> columns by <D> rows of RTP packets: column FEC to\n"
+    "                    the output port + 2, and row FEC to the port + 4.\n"
+    "                    <L> may be 1..20 and <D> 4..20, with <L>*<D> at most\n"
+    "                    100. Implies -rtp.\n"
+    "  -fec1d <L>,<D>    The same, but only send column FEC.\n"
+    "\n"
+    "  -pacing <how>     How to pace UDP output. 'user' (the default) sleeps\n"
+    "                    until each packet is due. 'txtime' gives each packet\n"
+    "                    its transmit time (SO_TXTIME), and 'rate' limits the\n"
+    "                    socket to the data rate (SO_MAX_PACING_RATE), letting\n"
+    "                    the kernel do the fine timing while packets are\n"
+    "                    handed over up to %dms early. These need Linux and a\n"
+    "                    suitable queuing discipline (e.g., fq), and fall\n"
+    "                    back to 'user' if they are not available.\n"
+    "\n"
     "When the child process starts up, it waits for the circular buffer to fill\n"
     "up before it starts sending any data.\n"
     "\n"
@@ -3268,10 +4416,25 @@ extern void tswrite_help_tuning(void)
     "(the exact values may change in future releases of this software).\n"
     "It may also sometimes help to specify '-nopcr' as well (i.e., ignore\n"
     "the timing information in the video stream itself).\n"
+    "\n"
+    "On a busy machine, the child process can be given a better chance of\n"
+    "sending each packet on time:\n"
+    "\n"
+    "  -realtime         Lock the child's memory, prefault the circular\n"
+    "                    buffer (in huge pages, if there are any free), and\n"
+    "                    report how late the child woke up from its waits.\n"
+    "  -rtcpu <n>        As -realtime, and pin the child to CPU <n>.\n"
+    "  -rtfifo <p>       As -realtime, and run the child with SCHED_FIFO\n"
+    "                    priority <p> (1..99).\n"
+    "\n"
+    "Pinning and SCHED_FIFO need Linux, and (like locking memory) usually\n"
+    "need suitable privileges. Anything that cannot be done is reported,\n"
+    "and the output carries on without it.\n"
     "",
     DEFAULT_BYTE_RATE,
     DEFAULT_BYTE_RATE*8,
     DEFAULT_CIRCULAR_BUFFER_SIZE,
+    PACING_LEAD_US/1000,
     DEFAULT_PRIME_SIZE);
 }
 
@@ -3295,6 +4458,15 @@ extern void tswrite_help_testing(void)
     "if it is 1 then each perturbation time will be reported.\n"
     "It is probably worth selecting a large value for -maxnowait when\n"
     "using -perturb.\n"
+    "\n"
+    "When recording to a pcap file, the child process can be run on a\n"
+    "simulated clock, so that pacing can be checked faster than real time:\n"
+    "\n"
+    "  -virtualclock     Instead of sleeping until each packet is due,\n"
+    "                    just move the child's clock on to that time.\n"
+    "                    The pcap file then records the schedule that\n"
+    "                    would have been used, but is written as fast as\n"
+    "                    the input can be read. Only allowed with -pcap.\n"
     );
 }
 
@@ -3367,6 +4539,18 @@ extern void tswrite_report_args(TS_context_p  context)
   if (context->pcr_scale)
     fprint_msg("Multiply PCRs by %g\n",context->pcr_scale);
 
+  if (context->pkt_hdr_type == PKT_HDR_TYPE_RTP)
+    print_msg("Sending each network packet with an RTP header\n");
+  if (context->fec_columns)
+    fprint_msg("Sending SMPTE 2022-1 %s FEC for a %dx%d matrix\n",
+               (context->fec_row_fec?"column and row":"column"),
+               context->fec_columns,context->fec_rows);
+
+  if (context->pacing == TSWRITE_PACING_TXTIME)
+    print_msg("Asking the kernel to pace output with SO_TXTIME\n");
+  else if (context->pacing == TSWRITE_PACING_RATE)
+    print_msg("Asking the kernel to pace output with SO_MAX_PACING_RATE\n");
+
   if (global_parent_wait != DEFAULT_PARENT_WAIT)
     fprint_msg("Parent will wait %dms for buffer to unfill\n",
                global_parent_wait);
@@ -3380,6 +4564,17 @@ extern void tswrite_report_args(TS_context_p  context)
                " with seed %u\n",global_perturb_range,global_perturb_range,
                global_perturb_seed);
   }
+  if (global_virtual_clock)
+    print_msg("Child will run on a virtual clock\n");
+  if (global_realtime)
+  {
+    print_msg("Child will use a real-time profile");
+    if (global_rt_cpu != -1)
+      fprint_msg(", pinned to CPU %d",global_rt_cpu);
+    if (global_rt_priority != 0)
+      fprint_msg(", SCHED_FIFO priority %d",global_rt_priority);
+    print_msg("\n");
+  }
 }
 
 /*
@@ -3425,6 +4620,10 @@ extern int tswrite_process_args(char           *prefix,
   context->prime_speedup = 100;
   context->pcr_scale     = 1.0;
   context->pkt_hdr_type  = PKT_HDR_TYPE_NONE;
+  context->fec_columns   = 0;
+  context->fec_rows      = 0;
+  context->fec_row_fec   = FALSE;
+  context->pacing        = TSWRITE_PACING_USER;
 
   while (ii < argc)
   {
@@ -3554,6 +4753,36 @@ extern int tswrite_process_args(char           *prefix,
       context->pkt_hdr_type = PKT_HDR_TYPE_RTP;
       argv[ii] = TSWRITE_PROCESSED;
     }
+    else if (!strcmp("-fec",argv[ii]) || !strcmp("-fec1d",argv[ii]))
+    {
+      CHECKARG(prefix,ii);
+      err = parse_FEC_size(argv[ii+1],&context->fec_columns,
+                           &context->fec_rows);
+      if (err) return 1;
+      context->fec_row_fec = !strcmp("-fec",argv[ii]);
+      // FEC only makes sense for RTP
+      context->pkt_hdr_type = PKT_HDR_TYPE_RTP;
+      argv[ii] = argv[ii+1] = TSWRITE_PROCESSED;
+      ii++;
+    }
+    else if (!strcmp("-pacing",argv[ii]))
+    {
+      CHECKARG(prefix,ii);
+      if (!strcmp("user",argv[ii+1]))
+        context->pacing = TSWRITE_PACING_USER;
+      else if (!strcmp("txtime",argv[ii+1]))
+        context->pacing = TSWRITE_PACING_TXTIME;
+      else if (!strcmp("rate",argv[ii+1]))
+        context->pacing = TSWRITE_PACING_RATE;
+      else
+      {
+        fprint_err("### %s: Unrecognised argument to -pacing '%s'"
+                   " (expecting user, txtime or rate)\n",prefix,argv[ii+1]);
+        return 1;
+      }
+      argv[ii] = argv[ii+1] = TSWRITE_PROCESSED;
+      ii++;
+    }
     else if (!strcmp("-hd", argv[ii]))
     {
       context->maxnowait = 40;
@@ -3663,6 +4892,47 @@ extern int tswrite_process_args(char           *prefix,
       argv[ii] = argv[ii+1] = argv[ii+2] = argv[ii+3] = TSWRITE_PROCESSED;
       ii+=3;
     }
+    else if (!strcmp("-realtime",argv[ii]))
+    {
+      global_realtime = TRUE;
+      argv[ii] = TSWRITE_PROCESSED;
+    }
+    else if (!strcmp("-rtcpu",argv[ii]))
+    {
+      CHECKARG(prefix,ii);
+      err = int_value(prefix,argv[ii],argv[ii+1],TRUE,10,&global_rt_cpu);
+      if (err) return 1;
+      if (global_rt_cpu > 63)
+      {
+        fprint_err("### %s: -rtcpu %d is not supported (maximum is 63)\n",
+                   prefix,global_rt_cpu);
+        return 1;
+      }
+      global_realtime = TRUE;
+      argv[ii] = argv[ii+1] = TSWRITE_PROCESSED;
+      ii++;
+    }
+    else if (!strcmp("-rtfifo",argv[ii]))
+    {
+      CHECKARG(prefix,ii);
+      err = int_value(prefix,argv[ii],argv[ii+1],TRUE,10,
+                      &global_rt_priority);
+      if (err) return 1;
+      if (global_rt_priority < 1 || global_rt_priority > 99)
+      {
+        fprint_err("### %s: -rtfifo priority must be 1..99, not %d\n",
+                   prefix,global_rt_priority);
+        return 1;
+      }
+      global_realtime = TRUE;
+      argv[ii] = argv[ii+1] = TSWRITE_PROCESSED;
+      ii++;
+    }
+    else if (!strcmp("-virtualclock",argv[ii]))
+    {
+      global_virtual_clock = TRUE;
+      argv[ii] = TSWRITE_PROCESSED;
+    }
 #if DISPLAY_BUFFER
     else if (!strcmp("-visual",argv[ii]))
     {
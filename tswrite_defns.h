@@ -36,6 +36,7 @@
 #include "compat.h"
 #include "ts_defns.h"
 #include "h222_defns.h"
+#include "metrics_defns.h"
 
 #ifdef _WIN32
 #include <winsock2.h>  // for definition of SOCKET
@@ -48,6 +49,9 @@ typedef int SOCKET;    // for compatibility with Windows
 struct buffered_TS_output;
 typedef struct buffered_TS_output *buffered_TS_output_p;
 #define SIZEOF_BUFFERED_TS_OUTPUT sizeof(struct buffered_TS_output)
+
+struct TS_pcap_output;
+typedef struct TS_pcap_output *TS_pcap_output_p;
 
 // ============================================================
 // EXTERNAL DATASTRUCTURES - these are *intended* for external use
@@ -63,6 +67,7 @@ enum TS_writer_type
   TS_W_FILE,    // a file
   TS_W_TCP,     // a socket, over TCP/IP
   TS_W_UDP,     // a socket, over UDP
+  TS_W_PCAP,    // a pcap file, recording what would be sent over UDP
 };
 typedef enum TS_writer_type TS_WRITER_TYPE;
 
@@ -72,6 +77,7 @@ union TS_writer_output
 {
   FILE   *file;
   SOCKET  socket;
+  TS_pcap_output_p  pcap;
 };
 
 // ------------------------------------------------------------
@@ -88,6 +94,11 @@ union TS_writer_output
 // set to a buffered output context. Since the circular buffer is being
 // used, there will also be a child process.
 //
+// When writing to a pcap file, "how" will be TS_W_PCAP, and "where" will be
+// the pcap output. Everything is as for UDP (including the circular buffer
+// and child process), except that each datagram is recorded in the pcap
+// file, stamped with the time it was due to be sent, instead of being sent.
+//
 // When writing over TCP/IP, "how" will be TS_W_TCP, and "where" will be the
 // socket that is being written to. Timing is not an issue, so "writer" will
 // not be needed, and nor will there be a child process.  However, it is
@@ -137,6 +148,9 @@ struct TS_writer
   // useful for debugging other applications
   int    drop_packets;  // 0 to keep all packets, otherwise keep <n> packets
   int    drop_number;   // and then drop this many
+
+  // Where to record how we are doing (see metrics_defns.h), or NULL
+  metrics_session_p  metrics;
 };
 typedef struct TS_writer *TS_writer_p;
 #define SIZEOF_TS_WRITER sizeof(struct TS_writer)
@@ -178,6 +192,18 @@ typedef enum tswrite_pcr_mode_e {
   TSWRITE_PCR_MODE_PCR2
 } tswrite_pcr_mode;
 
+// How the child paces UDP output: in user space, by sleeping until each
+// item is due (the original method), or by handing (most of) that job to
+// the kernel, either by giving each datagram its transmit time (SO_TXTIME)
+// or by limiting the socket's rate (SO_MAX_PACING_RATE). The kernel methods
+// fall back to user space pacing if they are not available.
+typedef enum tswrite_pacing_mode_e
+{
+  TSWRITE_PACING_USER = 0,
+  TSWRITE_PACING_TXTIME,
+  TSWRITE_PACING_RATE
+} tswrite_pacing_mode;
+
 typedef enum tswrite_pkt_hdr_type_e
 {
   PKT_HDR_TYPE_NONE = 0,
@@ -201,6 +227,10 @@ struct TS_context
   int prime_speedup; // percentage of normal speed to prime with
   tswrite_pkt_hdr_type_t pkt_hdr_type;
   double pcr_scale;       // multiplier for PCRs -- see buffered_TS_output
+  int fec_columns;   // SMPTE 2022-1 FEC matrix columns (L), 0 for no FEC
+  int fec_rows;      // and rows (D)
+  int fec_row_fec;   // send row FEC as well as column FEC?
+  tswrite_pacing_mode pacing;  // how to pace UDP output
 };  
 typedef struct TS_context *TS_context_p;
 
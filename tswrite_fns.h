@@ -119,6 +119,35 @@ extern int tswrite_open_connection(int             use_tcp,
 extern int tswrite_open_file(char           *name,
                              int             quiet,
                              TS_writer_p    *tswriter);
+/*
+ * Open a pcap file for TS output.
+ *
+ * Instead of sending UDP datagrams to `host`:`port`, each datagram is
+ * recorded (with the Ethernet, IPv4 and UDP headers it would have had) in
+ * pcap file `filename`, stamped with the time at which it was due to be
+ * sent. This allows the output timing to be examined (for instance, with
+ * pcapreport) without needing a network.
+ *
+ * - `filename` is the pcap file to write
+ * - `actual_filename` is NULL, or the name of a second pcap file, to which
+ *   the same datagrams are written, stamped with the time they were
+ *   actually written
+ * - `host` and `port` are where the datagrams are notionally sent to
+ * - `quiet` is true if only error messages should be printed
+ * - `tswriter` is the new context to use for writing TS output,
+ *   which should be closed using `tswrite_close`.
+ *
+ * As for TS_W_UDP, the ``tswrite_start_buffering`` function must be called
+ * before any output is written via the `tswriter`.
+ *
+ * Returns 0 if all goes well, 1 if something went wrong.
+ */
+extern int tswrite_open_pcap(char           *filename,
+                             char           *actual_filename,
+                             char           *host,
+                             int             port,
+                             int             quiet,
+                             TS_writer_p    *tswriter);
 /*
  * Wait for a client to connect and then both write TS data to it and
  * listen for command from it. Uses TCP/IP.
@@ -164,6 +193,13 @@ extern int tswrite_wait_for_client(int           server_socket,
  *   rate. This should normally be set to 100 (i.e., no effect).
  * - `pcr_scale` determines how much to "accelerate" each PCR - see the
  *   notes elsewhere on how this works.
+ * - `hdr_type` says what header (if any) to put before each network packet
+ * - if `fec_columns` is non-zero, then SMPTE 2022-1 FEC is sent alongside
+ *   the (RTP) output, using a matrix of `fec_columns` by `fec_rows`. Column
+ *   FEC is sent to the output port + 2, and, if `fec_row_fec` is TRUE, row
+ *   FEC to the output port + 4.
+ * - `pacing` says how UDP output should be paced. If the kernel cannot
+ *   do the pacing asked for, we fall back to pacing in user space.
  *
  * Returns 0 if all went well, 1 if something went wrong.
  */
@@ -178,7 +214,11 @@ extern int tswrite_start_buffering(TS_writer_p  tswriter,
                                    int          prime_size,
                                    int          prime_speedup,
                                    double       pcr_scale,
-                                   const tswrite_pkt_hdr_type_t hdr_type);
+                                   const tswrite_pkt_hdr_type_t hdr_type,
+                                   int          fec_columns,
+                                   int          fec_rows,
+                                   int          fec_row_fec,
+                                   tswrite_pacing_mode pacing);
 
 /*
  * Set up internal buffering for TS output. This is necessary for UDP output,
@@ -194,6 +234,19 @@ extern int tswrite_start_buffering(TS_writer_p  tswriter,
  */
 extern int tswrite_start_buffering_from_context(TS_writer_p  tswriter,
                                                 TS_context_p context);
+/*
+ * Ask a TS output context to record how it is doing in the given metrics
+ * session (see metrics_fns.h).
+ *
+ * If buffered output is used, this should be called before
+ * ``tswrite_start_buffering``, so that the child process also records
+ * what it does.
+ *
+ * - `tswriter` is the TS output context returned by `tswrite_open`
+ * - `session` is the metrics session, or NULL to stop recording metrics
+ */
+extern void tswrite_set_metrics(TS_writer_p        tswriter,
+                                metrics_session_p  session);
 /*
  * Indicate to a TS output context that `input` is to be used as
  * command input.
@@ -246,6 +299,36 @@ extern void tswrite_set_command_atomic(TS_writer_p  tswriter,
  * character has changed.
  */
 extern int tswrite_command_changed(TS_writer_p  tswriter);
+/*
+ * Ask for output to be passed on with as little delay as possible, for
+ * live use.
+ *
+ * For TCP/IP output, this turns off Nagle's algorithm (TCP_NODELAY), so
+ * that data is not held back waiting for an acknowledgement. On Linux, the
+ * socket is also "corked", so that full size segments are still sent while
+ * a picture is being written, and `tswrite_flush` then sends what is left.
+ *
+ * For file and standard output, `tswrite_flush` pushes out what has been
+ * written so far.
+ *
+ * - `tswriter` is the TS output context returned by `tswrite_open`
+ *
+ * Returns 0 if all goes well, 1 if something went wrong.
+ */
+extern int tswrite_set_low_latency(TS_writer_p  tswriter);
+/*
+ * Push out any TS data that has been written but is still being held in
+ * a buffer. Typically used after each picture, with
+ * `tswrite_set_low_latency`.
+ *
+ * This has no effect for buffered (UDP) output, where the child process
+ * decides when to send each packet.
+ *
+ * - `tswriter` is the TS output context returned by `tswrite_open`
+ *
+ * Returns 0 if all goes well, 1 if something went wrong.
+ */
+extern int tswrite_flush(TS_writer_p  tswriter);
 /*
  * Close a file or socket opened using `tswrite_open`, and if necessary,
  * send the child process used for output buffering an end-of-file